@@ -0,0 +1,152 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// ReliabilityLayer collects the numbers of the datagrams it receives in a RangeList and sends them back
+// as ACK frames, one MTU at a time. The sender reads each frame back into a RangeList and walks every
+// acknowledged number. This sample replays that for a steady stream of datagrams with random loss, once
+// with the range frames older peers understand and once with the bitmap frames, without sockets.
+
+#include "DS_RangeList.h"
+#include "BitStream.h"
+#include "GetTime.h"
+#include "RakNetTypes.h"
+#include "MTUSize.h"
+#include "CCRakNetCongestionControl.h"
+#include <cstdio>
+#include <stdlib.h>
+#include <vector>
+
+using namespace RakNet;
+
+typedef DataStructures::RangeList<DatagramSequenceNumberType> AckList;
+
+struct Result
+{
+    TimeUS encodeTime;
+    TimeUS decodeTime;
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t acked;
+};
+
+// One ack interval: which datagrams arrived, out of those sent since the last ACK
+static void FillAckList(AckList &list, const std::vector<bool> &received, uint32_t firstNumber)
+{
+    list.Clear();
+    for (size_t i = 0; i < received.size(); i++)
+    {
+        if (received[i])
+            list.Insert(DatagramSequenceNumberType(firstNumber + (uint32_t) i));
+    }
+}
+
+static void RunInterval(AckList &list, bool bitmap, BitSize_t maxBits, BitStream &frame, AckList &incoming, Result &result)
+{
+    while (list.Size() > 0)
+    {
+        frame.Reset();
+        TimeUS startTime = GetTimeUS();
+        if (bitmap)
+            list.SerializeBitmap(&frame, maxBits, true);
+        else
+            list.Serialize(&frame, maxBits, true);
+        TimeUS encodedTime = GetTimeUS();
+
+        incoming.Clear();
+        bool ok = bitmap ? incoming.DeserializeBitmap(&frame) : incoming.Deserialize(&frame);
+        uint64_t acked = 0;
+        for (unsigned i = 0; ok && i < incoming.ranges.Size(); i++)
+        {
+            for (DatagramSequenceNumberType datagramNumber = incoming.ranges[i].minIndex;; datagramNumber++)
+            {
+                acked++;
+                if (datagramNumber == incoming.ranges[i].maxIndex)
+                    break;
+            }
+        }
+        TimeUS decodedTime = GetTimeUS();
+
+        if (!ok)
+            printf("Deserialize failed\n");
+        result.encodeTime += encodedTime - startTime;
+        result.decodeTime += decodedTime - encodedTime;
+        result.bytes += frame.GetNumberOfBytesUsed();
+        result.frames++;
+        result.acked += acked;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int datagramsPerSecond = 100000;
+    int seconds = 10;
+    int ackIntervalMs = 10;
+    if (argc > 1)
+        datagramsPerSecond = atoi(argv[1]);
+    if (argc > 2)
+        seconds = atoi(argv[2]);
+    if (argc > 3)
+        ackIntervalMs = atoi(argv[3]);
+    if (datagramsPerSecond < 1)
+        datagramsPerSecond = 1;
+    if (seconds < 1)
+        seconds = 1;
+    if (ackIntervalMs < 1)
+        ackIntervalMs = 1;
+
+    const int datagramsPerInterval = datagramsPerSecond * ackIntervalMs / 1000 > 0 ? datagramsPerSecond * ackIntervalMs / 1000 : 1;
+    const int intervals = seconds * 1000 / ackIntervalMs;
+    // Room left in a datagram after the UDP and ACK headers, as ReliabilityLayer::SendACKs() has it
+    const BitSize_t maxBits = BYTES_TO_BITS(MAXIMUM_MTU_SIZE - UDP_HEADER_SIZE - 1 - 4);
+    static const double lossRates[] = {0.0, 0.001, 0.01, 0.05, 0.2};
+
+    printf("ACK frame benchmark\n");
+    printf("%i datagrams/sec, %i sec, one ACK every %i ms (%i datagrams)\n", datagramsPerSecond, seconds, ackIntervalMs, datagramsPerInterval);
+    printf("CPU time is per second of traffic, encode and decode together\n\n");
+    printf("%6s  %-7s %10s %10s %12s %10s\n", "loss", "format", "CPU us/s", "ns/ack", "wire KB/s", "frames/s");
+
+    AckList list, incoming;
+    BitStream frame(MAXIMUM_MTU_SIZE);
+    std::vector<bool> received(datagramsPerInterval);
+    for (size_t lossIndex = 0; lossIndex < sizeof(lossRates) / sizeof(lossRates[0]); lossIndex++)
+    {
+        Result results[2] = {};
+        srand(1);
+        uint32_t firstNumber = 0;
+        for (int interval = 0; interval < intervals; interval++)
+        {
+            for (int i = 0; i < datagramsPerInterval; i++)
+                received[i] = (double) rand() / RAND_MAX >= lossRates[lossIndex];
+
+            // Both formats get the same list. Building it is the same work either way, so it is not timed
+            for (int format = 0; format < 2; format++)
+            {
+                FillAckList(list, received, firstNumber);
+                RunInterval(list, format == 1, maxBits, frame, incoming, results[format]);
+            }
+            firstNumber = (firstNumber + datagramsPerInterval) & 0xFFFFFF;
+        }
+
+        for (int format = 0; format < 2; format++)
+        {
+            const Result &r = results[format];
+            TimeUS cpu = r.encodeTime + r.decodeTime;
+            printf("%5.1f%%  %-7s %10.1f %10.2f %12.1f %10.1f\n", lossRates[lossIndex] * 100.0,
+                format == 1 ? "bitmap" : "ranges",
+                (double) cpu / seconds,
+                r.acked ? (double) cpu * 1000.0 / (double) r.acked : 0.0,
+                (double) r.bytes / 1024.0 / seconds,
+                (double) r.frames / seconds);
+        }
+    }
+
+    return 0;
+}
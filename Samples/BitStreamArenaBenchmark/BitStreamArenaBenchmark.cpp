@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Plugins such as ReplicaManager3 build a temporary BitStream for each object they serialize, then copy it into a
+// message stream. Any stream past BITSTREAM_STACK_ALLOCATION_SIZE bytes goes to the heap, and reallocates as it grows.
+// This sample builds such ticks with the streams on the heap and in a BitStreamArena reset once a tick, and counts
+// the heap allocations each makes.
+
+#include "BitStream.h"
+#include "BitStreamArena.h"
+#include "GetTime.h"
+#include <cstdio>
+#include <stdlib.h>
+#include <vector>
+
+using namespace RakNet;
+
+// Largest object state, in bytes
+static const unsigned int MAXIMUM_OBJECT_SIZE = 2048;
+
+// Writes one object's state. Most are small, some are large enough to leave the stack buffer
+static void SerializeObject(BitStream *bitStream, unsigned int size, const unsigned char *bytes)
+{
+    bitStream->WriteAlignedBytes(bytes, size);
+}
+
+// Returns the size of the messages built, so the work can't be optimized away
+static BitSize_t BuildTick(BitStreamArena *arena, const std::vector<unsigned int> &objectSizes,
+    unsigned int objectsPerMessage, const unsigned char *bytes)
+{
+    BitSize_t bitsBuilt = 0;
+    for (size_t first = 0; first < objectSizes.size(); first += objectsPerMessage)
+    {
+        BitStream message(arena);
+        message.Write((unsigned char) 0);
+        for (size_t i = first; i < first + objectsPerMessage && i < objectSizes.size(); i++)
+        {
+            BitStream object(arena);
+            SerializeObject(&object, objectSizes[i], bytes);
+            // Aligned, so the copy is a memcpy and the time is mostly allocation
+            message.Write(object.GetNumberOfBitsUsed());
+            message.AlignWriteToByteBoundary();
+            message.Write(&object);
+        }
+        bitsBuilt += message.GetNumberOfBitsUsed();
+    }
+    return bitsBuilt;
+}
+
+static void RunBenchmark(bool useArena, const std::vector<unsigned int> &objectSizes, unsigned int objectsPerMessage,
+    int ticks, const unsigned char *bytes)
+{
+    BitStreamArena arena;
+    BitStreamArena *tickArena = useArena ? &arena : 0;
+    BitSize_t bitsBuilt = 0;
+
+    // One tick to warm up, as a game running for a while would be
+    bitsBuilt += BuildTick(tickArena, objectSizes, objectsPerMessage, bytes);
+    arena.Reset();
+
+    const uint64_t heapAllocationsBefore = BitStream::GetHeapAllocationCount() + arena.GetHeapAllocationCount();
+    TimeUS startTime = GetTimeUS();
+    for (int i = 0; i < ticks; i++)
+    {
+        bitsBuilt += BuildTick(tickArena, objectSizes, objectsPerMessage, bytes);
+        arena.Reset();
+    }
+    TimeUS elapsed = GetTimeUS() - startTime;
+    const uint64_t heapAllocations = BitStream::GetHeapAllocationCount() + arena.GetHeapAllocationCount() -
+        heapAllocationsBefore;
+
+    if (elapsed == 0)
+        elapsed = 1;
+    printf("%-6s %8.1f us/tick  %8.2f heap allocations/tick  (%llu bits built)\n",
+        useArena ? "arena" : "heap", (double) elapsed / ticks, (double) heapAllocations / ticks,
+        (unsigned long long) bitsBuilt);
+}
+
+int main(int argc, char **argv)
+{
+    int objectsPerTick = 2000;
+    int ticks = 500;
+    if (argc > 1)
+        objectsPerTick = atoi(argv[1]);
+    if (argc > 2)
+        ticks = atoi(argv[2]);
+    if (objectsPerTick < 1)
+        objectsPerTick = 1;
+    if (ticks < 1)
+        ticks = 1;
+
+    std::vector<unsigned int> objectSizes;
+    srand(1);
+    for (int i = 0; i < objectsPerTick; i++)
+        objectSizes.push_back(rand() % 8 == 0 ? 256 + (unsigned int) (rand() % (MAXIMUM_OBJECT_SIZE - 256)) :
+            16 + (unsigned int) (rand() % 112));
+    unsigned char bytes[MAXIMUM_OBJECT_SIZE];
+    for (unsigned int i = 0; i < sizeof(bytes); i++)
+        bytes[i] = (unsigned char) rand();
+
+    printf("BitStream arena benchmark\n");
+    printf("%i objects per tick in messages of 8, %i ticks\n\n", objectsPerTick, ticks);
+
+    RunBenchmark(false, objectSizes, 8, ticks, bytes);
+    RunBenchmark(true, objectSizes, 8, ticks, bytes);
+
+    return 0;
+}
@@ -0,0 +1,478 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Serialization writes most values with BitStream::WriteBits() and reads them with ReadBits(), and unless a value
+// starts on a byte boundary and is whole bytes long, both go through their bit packing loops. This sample fills
+// streams with bools, small integers, floats, byte runs and WriteCompressed() integers, each off a byte boundary,
+// then reads them back. It compares the byte at a time loops BitStream had before with the ones it has now. Both
+// must write the same bits.
+
+#include "BitStream.h"
+#include "GetTime.h"
+#include <cstdio>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace RakNet;
+
+// The old loops were compiled in BitStream.cpp, so keep them from being inlined here either
+#if defined(__GNUC__)
+#define LEGACY_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define LEGACY_NOINLINE __declspec(noinline)
+#else
+#define LEGACY_NOINLINE
+#endif
+
+// The bit packing BitStream had before, moving one byte at a time
+class LegacyBitStream
+{
+public:
+    LegacyBitStream() : numberOfBitsUsed(0), readOffset(0), numberOfBitsAllocated(BITS_TO_BYTES_ALLOCATED * 8)
+    {
+        data = (unsigned char *) malloc(BITS_TO_BYTES_ALLOCATED);
+    }
+    ~LegacyBitStream() {free(data);}
+    const char *GetName(void) const {return "byte at a time";}
+    void Reset(void) {numberOfBitsUsed = 0; readOffset = 0;}
+    void ResetReadPointer(void) {readOffset = 0;}
+    const unsigned char *GetData(void) const {return data;}
+    BitSize_t GetNumberOfBitsUsed(void) const {return numberOfBitsUsed;}
+    void Write(bool value) {if (value) Write1(); else Write0();}
+    bool Read(bool &value) {if (readOffset + 1 > numberOfBitsUsed) return false; value = ReadBit(); return true;}
+
+    LEGACY_NOINLINE void Write0()
+    {
+        AddBitsAndReallocate(1);
+        if ((numberOfBitsUsed & 7) == 0)
+            data[numberOfBitsUsed >> 3] = 0;
+        numberOfBitsUsed++;
+    }
+
+    LEGACY_NOINLINE void Write1()
+    {
+        AddBitsAndReallocate(1);
+        BitSize_t numberOfBitsMod8 = numberOfBitsUsed & 7;
+        if (numberOfBitsMod8 == 0)
+            data[numberOfBitsUsed >> 3] = 0x80;
+        else
+            data[numberOfBitsUsed >> 3] |= 0x80 >> (numberOfBitsMod8);
+        numberOfBitsUsed++;
+    }
+
+    LEGACY_NOINLINE bool ReadBit()
+    {
+        bool result = (data[readOffset >> 3] & (0x80 >> (readOffset & 7))) != 0;
+        readOffset++;
+        return result;
+    }
+
+    LEGACY_NOINLINE void WriteBits(const unsigned char *inByteArray, BitSize_t numberOfBitsToWrite, bool rightAlignedBits = true)
+    {
+        AddBitsAndReallocate(numberOfBitsToWrite);
+        const BitSize_t numberOfBitsUsedMod8 = numberOfBitsUsed & 7;
+        if (numberOfBitsUsedMod8 == 0 && (numberOfBitsToWrite & 7) == 0)
+        {
+            memcpy(data + (numberOfBitsUsed >> 3), inByteArray, numberOfBitsToWrite >> 3);
+            numberOfBitsUsed += numberOfBitsToWrite;
+            return;
+        }
+
+        const unsigned char *inputPtr = inByteArray;
+        while (numberOfBitsToWrite > 0)
+        {
+            unsigned char dataByte = *(inputPtr++);
+            if (numberOfBitsToWrite < 8 && rightAlignedBits)
+                dataByte <<= 8 - numberOfBitsToWrite;
+            if (numberOfBitsUsedMod8 == 0)
+                *(data + (numberOfBitsUsed >> 3)) = dataByte;
+            else
+            {
+                *(data + (numberOfBitsUsed >> 3)) |= dataByte >> (numberOfBitsUsedMod8);
+                if (8 - (numberOfBitsUsedMod8) < 8 && 8 - (numberOfBitsUsedMod8) < numberOfBitsToWrite)
+                    *(data + (numberOfBitsUsed >> 3) + 1) = dataByte << (8 - (numberOfBitsUsedMod8));
+            }
+            if (numberOfBitsToWrite >= 8)
+            {
+                numberOfBitsUsed += 8;
+                numberOfBitsToWrite -= 8;
+            }
+            else
+            {
+                numberOfBitsUsed += numberOfBitsToWrite;
+                numberOfBitsToWrite = 0;
+            }
+        }
+    }
+
+    // WriteCompressed() and ReadCompressed() of an integer, one bit per matching byte
+    template <class templateType>
+    void WriteCompressed(const templateType &inTemplateVar)
+    {
+        unsigned char output[sizeof(templateType)];
+        if (BitStream::DoEndianSwap())
+            BitStream::ReverseBytes((unsigned char *) &inTemplateVar, output, sizeof(templateType));
+        else
+            memcpy(output, &inTemplateVar, sizeof(templateType));
+        WriteCompressed(output, sizeof(templateType) * 8, true);
+    }
+
+    template <class templateType>
+    bool ReadCompressed(templateType &outTemplateVar)
+    {
+        unsigned char output[sizeof(templateType)];
+        if (!ReadCompressed(output, sizeof(templateType) * 8, true))
+            return false;
+        if (BitStream::DoEndianSwap())
+            BitStream::ReverseBytes(output, (unsigned char *) &outTemplateVar, sizeof(templateType));
+        else
+            memcpy(&outTemplateVar, output, sizeof(templateType));
+        return true;
+    }
+
+    LEGACY_NOINLINE void WriteCompressed(const unsigned char *inByteArray, unsigned int size, bool unsignedData)
+    {
+        BitSize_t currentByte = (size >> 3) - 1;
+        unsigned char byteMatch = unsignedData ? 0 : 0xFF;
+        while (currentByte > 0)
+        {
+            if (inByteArray[currentByte] == byteMatch)
+                Write(true);
+            else
+            {
+                Write(false);
+                WriteBits(inByteArray, (currentByte + 1) << 3, true);
+                return;
+            }
+            currentByte--;
+        }
+        if ((unsignedData && (inByteArray[currentByte] & 0xF0) == 0x00) ||
+            (!unsignedData && (inByteArray[currentByte] & 0xF0) == 0xF0))
+        {
+            Write(true);
+            WriteBits(inByteArray + currentByte, 4, true);
+        }
+        else
+        {
+            Write(false);
+            WriteBits(inByteArray + currentByte, 8, true);
+        }
+    }
+
+    LEGACY_NOINLINE bool ReadCompressed(unsigned char *inOutByteArray, unsigned int size, bool unsignedData)
+    {
+        unsigned char byteMatch = unsignedData ? 0 : 0xFF;
+        unsigned char halfByteMatch = unsignedData ? 0 : 0xF0;
+        unsigned int currentByte = (size >> 3) - 1;
+        while (currentByte > 0)
+        {
+            bool b;
+            if (!Read(b))
+                return false;
+            if (b)
+            {
+                inOutByteArray[currentByte] = byteMatch;
+                currentByte--;
+            }
+            else
+                return ReadBits(inOutByteArray, (currentByte + 1) << 3);
+        }
+        bool b = false;
+        if (!Read(b))
+            return false;
+        if (b)
+        {
+            if (!ReadBits(inOutByteArray + currentByte, 4))
+                return false;
+            inOutByteArray[currentByte] |= halfByteMatch;
+        }
+        else if (!ReadBits(inOutByteArray + currentByte, 8))
+            return false;
+        return true;
+    }
+
+    LEGACY_NOINLINE bool ReadBits(unsigned char *inOutByteArray, BitSize_t numberOfBitsToRead, bool alignBitsToRight = true)
+    {
+        if (numberOfBitsToRead <= 0)
+            return false;
+        if (readOffset + numberOfBitsToRead > numberOfBitsUsed)
+            return false;
+        const BitSize_t readOffsetMod8 = readOffset & 7;
+        if (readOffsetMod8 == 0 && (numberOfBitsToRead & 7) == 0)
+        {
+            memcpy(inOutByteArray, data + (readOffset >> 3), numberOfBitsToRead >> 3);
+            readOffset += numberOfBitsToRead;
+            return true;
+        }
+
+        BitSize_t offset = 0;
+        memset(inOutByteArray, 0, (size_t) BITS_TO_BYTES(numberOfBitsToRead));
+        while (numberOfBitsToRead > 0)
+        {
+            *(inOutByteArray + offset) |= *(data + (readOffset >> 3)) << (readOffsetMod8);
+            if (readOffsetMod8 > 0 && numberOfBitsToRead > 8 - (readOffsetMod8))
+                *(inOutByteArray + offset) |= *(data + (readOffset >> 3) + 1) >> (8 - (readOffsetMod8));
+            if (numberOfBitsToRead >= 8)
+            {
+                numberOfBitsToRead -= 8;
+                readOffset += 8;
+                offset++;
+            }
+            else
+            {
+                int neg = (int) numberOfBitsToRead - 8;
+                if (neg < 0)
+                {
+                    if (alignBitsToRight)
+                        *(inOutByteArray + offset) >>= -neg;
+                    readOffset += 8 + neg;
+                }
+                else
+                    readOffset += 8;
+                offset++;
+                numberOfBitsToRead = 0;
+            }
+        }
+        return true;
+    }
+
+protected:
+    // Large enough for every workload, so only the check for more room is left, as with a warmed up BitStream
+    static const unsigned int BITS_TO_BYTES_ALLOCATED = 1 << 20;
+
+    LEGACY_NOINLINE void AddBitsAndReallocate(BitSize_t numberOfBitsToWrite)
+    {
+        BitSize_t newNumberOfBitsAllocated = numberOfBitsToWrite + numberOfBitsUsed;
+        if (numberOfBitsToWrite + numberOfBitsUsed > 0 &&
+            ((numberOfBitsAllocated - 1) >> 3) < ((newNumberOfBitsAllocated - 1) >> 3))
+        {
+            newNumberOfBitsAllocated = (numberOfBitsToWrite + numberOfBitsUsed) * 2;
+            data = (unsigned char *) realloc(data, (size_t) BITS_TO_BYTES(newNumberOfBitsAllocated));
+        }
+        if (newNumberOfBitsAllocated > numberOfBitsAllocated)
+            numberOfBitsAllocated = newNumberOfBitsAllocated;
+    }
+
+    unsigned char *data;
+    BitSize_t numberOfBitsUsed;
+    BitSize_t readOffset;
+    BitSize_t numberOfBitsAllocated;
+};
+
+// BitStream as it is now
+class CurrentBitStream : public BitStream
+{
+public:
+    const char *GetName(void) const {return "64 bit words";}
+};
+
+enum Workload
+{
+    WORKLOAD_BOOLS,
+    WORKLOAD_SMALL_INTEGERS,
+    WORKLOAD_FLOATS,
+    WORKLOAD_BYTE_RUNS,
+    WORKLOAD_COMPRESSED,
+    WORKLOAD_COUNT
+};
+
+static const char *workloadNames[WORKLOAD_COUNT] = {"bools", "small integers", "floats", "byte runs", "compressed"};
+
+// Bytes in each byte run
+static const unsigned int BYTE_RUN_LENGTH = 100;
+
+struct Values
+{
+    std::vector<unsigned char> bools;
+    std::vector<unsigned short> integers;
+    std::vector<float> floats;
+    std::vector<unsigned char> bytes;
+    std::vector<uint64_t> compressed;
+};
+
+// Writes the values once. Every workload but bools starts one bit off a byte boundary
+template <class stream_type>
+void WriteValues(stream_type &stream, Workload workload, const Values &values, int valuesPerStream)
+{
+    if (workload == WORKLOAD_BOOLS)
+    {
+        for (int i = 0; i < valuesPerStream; i++)
+            stream.Write(values.bools[i] != 0);
+        return;
+    }
+
+    stream.Write(true);
+    for (int i = 0; i < valuesPerStream; i++)
+    {
+        if (workload == WORKLOAD_SMALL_INTEGERS)
+        {
+            // 5 and 12 bits, such as an enum and a clamped health value
+            stream.WriteBits((const unsigned char *) &values.integers[i], (i & 1) ? 12 : 5, true);
+        }
+        else if (workload == WORKLOAD_FLOATS)
+            stream.WriteBits((const unsigned char *) &values.floats[i], sizeof(float) * 8, true);
+        else if (workload == WORKLOAD_COMPRESSED)
+        {
+            // Ids, counters and timestamps
+            if (i % 3 == 0)
+                stream.WriteCompressed((uint16_t) values.compressed[i]);
+            else if (i % 3 == 1)
+                stream.WriteCompressed((uint32_t) values.compressed[i]);
+            else
+                stream.WriteCompressed(values.compressed[i]);
+        }
+        else
+            stream.WriteBits(&values.bytes[(i % 16) * BYTE_RUN_LENGTH], BYTE_RUN_LENGTH * 8, true);
+    }
+}
+
+// Reads the values back, returning false if any differ
+template <class stream_type>
+bool ReadValues(stream_type &stream, Workload workload, const Values &values, int valuesPerStream)
+{
+    bool matches = true;
+    if (workload == WORKLOAD_BOOLS)
+    {
+        for (int i = 0; i < valuesPerStream; i++)
+        {
+            bool value = false;
+            matches &= stream.Read(value) && value == (values.bools[i] != 0);
+        }
+        return matches;
+    }
+
+    bool first = false;
+    matches &= stream.Read(first) && first;
+    for (int i = 0; i < valuesPerStream; i++)
+    {
+        if (workload == WORKLOAD_SMALL_INTEGERS)
+        {
+            unsigned short value = 0;
+            matches &= stream.ReadBits((unsigned char *) &value, (i & 1) ? 12 : 5, true) && value == values.integers[i];
+        }
+        else if (workload == WORKLOAD_FLOATS)
+        {
+            float value;
+            matches &= stream.ReadBits((unsigned char *) &value, sizeof(float) * 8, true) &&
+                memcmp(&value, &values.floats[i], sizeof(float)) == 0;
+        }
+        else if (workload == WORKLOAD_COMPRESSED)
+        {
+            if (i % 3 == 0)
+            {
+                uint16_t value = 0;
+                matches &= stream.ReadCompressed(value) && value == (uint16_t) values.compressed[i];
+            }
+            else if (i % 3 == 1)
+            {
+                uint32_t value = 0;
+                matches &= stream.ReadCompressed(value) && value == (uint32_t) values.compressed[i];
+            }
+            else
+            {
+                uint64_t value = 0;
+                matches &= stream.ReadCompressed(value) && value == values.compressed[i];
+            }
+        }
+        else
+        {
+            unsigned char run[BYTE_RUN_LENGTH];
+            matches &= stream.ReadBits(run, BYTE_RUN_LENGTH * 8, true) &&
+                memcmp(run, &values.bytes[(i % 16) * BYTE_RUN_LENGTH], BYTE_RUN_LENGTH) == 0;
+        }
+    }
+    return matches;
+}
+
+template <class stream_type>
+void RunBenchmark(Workload workload, const Values &values, int valuesPerStream, int iterations,
+    std::vector<unsigned char> &written)
+{
+    stream_type stream;
+    bool matches = true;
+
+    TimeUS startTime = GetTimeUS();
+    for (int i = 0; i < iterations; i++)
+    {
+        stream.Reset();
+        WriteValues(stream, workload, values, valuesPerStream);
+    }
+    TimeUS writeTime = GetTimeUS() - startTime;
+
+    startTime = GetTimeUS();
+    for (int i = 0; i < iterations; i++)
+    {
+        stream.ResetReadPointer();
+        matches &= ReadValues(stream, workload, values, valuesPerStream);
+    }
+    TimeUS readTime = GetTimeUS() - startTime;
+
+    // The first run keeps its bits for the second to compare against
+    const unsigned char *data = stream.GetData();
+    std::vector<unsigned char> bits(data, data + BITS_TO_BYTES(stream.GetNumberOfBitsUsed()));
+    const char *sameBits = "";
+    if (written.empty())
+        written = bits;
+    else
+        sameBits = written == bits ? "  same bits" : "  DIFFERENT BITS";
+
+    if (writeTime == 0)
+        writeTime = 1;
+    if (readTime == 0)
+        readTime = 1;
+    double megabits = (double) stream.GetNumberOfBitsUsed() * iterations / 1000000.0;
+    printf("%-15s %-15s write %8.1f Mbit/sec  read %8.1f Mbit/sec  %s%s\n",
+        workloadNames[workload], stream.GetName(),
+        megabits * 1000000.0 / (double) writeTime,
+        megabits * 1000000.0 / (double) readTime,
+        matches ? "read back" : "READ BACK WRONG", sameBits);
+}
+
+int main(int argc, char **argv)
+{
+    int valuesPerStream = 1000;
+    int iterations = 2000;
+    if (argc > 1)
+        valuesPerStream = atoi(argv[1]);
+    if (argc > 2)
+        iterations = atoi(argv[2]);
+    if (valuesPerStream < 1)
+        valuesPerStream = 1;
+    if (iterations < 1)
+        iterations = 1;
+
+    Values values;
+    srand(1);
+    for (int i = 0; i < valuesPerStream; i++)
+    {
+        values.bools.push_back((unsigned char) (rand() & 1));
+        values.integers.push_back((unsigned short) (rand() & ((i & 1) ? 0xFFF : 0x1F)));
+        values.floats.push_back((float) rand() / (float) RAND_MAX * 1000.0f);
+        // From a few bits to all of them
+        uint64_t value = (uint64_t) rand() << 42 ^ (uint64_t) rand() << 21 ^ (uint64_t) rand();
+        values.compressed.push_back(value >> (rand() % 64));
+    }
+    for (unsigned int i = 0; i < 16 * BYTE_RUN_LENGTH; i++)
+        values.bytes.push_back((unsigned char) rand());
+
+    printf("BitStream benchmark\n");
+    printf("%i values per stream, %i iterations\n\n", valuesPerStream, iterations);
+
+    for (int workload = 0; workload < WORKLOAD_COUNT; workload++)
+    {
+        std::vector<unsigned char> written;
+        RunBenchmark<LegacyBitStream>((Workload) workload, values, valuesPerStream, iterations, written);
+        RunBenchmark<CurrentBitStream>((Workload) workload, values, valuesPerStream, iterations, written);
+    }
+
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Messages are usually written one field at a time, each call checking the stream's room and the byte order on its
+// own. BitStreamSchema packs the fields of a struct at offsets known at compile time and hands them to the stream in
+// one call. This sample writes and reads entity states both ways, and checks both write the same bits.
+
+#include "BitStreamSchema.h"
+#include "GetTime.h"
+#include <cstdio>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace RakNet;
+
+enum EntityAnimation
+{
+    ANIMATION_IDLE,
+    ANIMATION_WALK,
+    ANIMATION_RUN,
+    ANIMATION_JUMP
+};
+
+struct EntityState
+{
+    unsigned int networkId;
+    float x, y, z;
+    float yaw;
+    int health;
+    unsigned short ammo;
+    unsigned char animation;
+    bool crouching;
+    bool firing;
+};
+
+typedef BitStreamSchema<EntityState,
+    RAKNET_SCHEMA_VALUE(EntityState, networkId),
+    RAKNET_SCHEMA_FLOAT16(EntityState, x, -8192, 8192),
+    RAKNET_SCHEMA_FLOAT16(EntityState, y, -8192, 8192),
+    RAKNET_SCHEMA_FLOAT16(EntityState, z, -1024, 1024),
+    RAKNET_SCHEMA_FLOAT16(EntityState, yaw, -4, 4),
+    RAKNET_SCHEMA_INTEGER_RANGE(EntityState, health, 0, 100),
+    RAKNET_SCHEMA_INTEGER_RANGE(EntityState, ammo, 0, 999),
+    RAKNET_SCHEMA_INTEGER_RANGE(EntityState, animation, ANIMATION_IDLE, ANIMATION_JUMP),
+    RAKNET_SCHEMA_VALUE(EntityState, crouching),
+    RAKNET_SCHEMA_VALUE(EntityState, firing)> EntityStateSchema;
+
+// The same fields, one call at a time
+static void WriteByHand(const EntityState &state, BitStream *bitStream)
+{
+    bitStream->Write(state.networkId);
+    bitStream->WriteFloat16(state.x, -8192.0f, 8192.0f);
+    bitStream->WriteFloat16(state.y, -8192.0f, 8192.0f);
+    bitStream->WriteFloat16(state.z, -1024.0f, 1024.0f);
+    bitStream->WriteFloat16(state.yaw, -4.0f, 4.0f);
+    bitStream->WriteBitsFromIntegerRange(state.health, 0, 100);
+    bitStream->WriteBitsFromIntegerRange(state.ammo, (unsigned short) 0, (unsigned short) 999);
+    bitStream->WriteBitsFromIntegerRange(state.animation, (unsigned char) ANIMATION_IDLE, (unsigned char) ANIMATION_JUMP);
+    bitStream->Write(state.crouching);
+    bitStream->Write(state.firing);
+}
+
+static bool ReadByHand(EntityState &state, BitStream *bitStream)
+{
+    return bitStream->Read(state.networkId) &&
+        bitStream->ReadFloat16(state.x, -8192.0f, 8192.0f) &&
+        bitStream->ReadFloat16(state.y, -8192.0f, 8192.0f) &&
+        bitStream->ReadFloat16(state.z, -1024.0f, 1024.0f) &&
+        bitStream->ReadFloat16(state.yaw, -4.0f, 4.0f) &&
+        bitStream->ReadBitsFromIntegerRange(state.health, 0, 100) &&
+        bitStream->ReadBitsFromIntegerRange(state.ammo, (unsigned short) 0, (unsigned short) 999) &&
+        bitStream->ReadBitsFromIntegerRange(state.animation, (unsigned char) ANIMATION_IDLE, (unsigned char) ANIMATION_JUMP) &&
+        bitStream->Read(state.crouching) &&
+        bitStream->Read(state.firing);
+}
+
+static bool SameState(const EntityState &a, const EntityState &b)
+{
+    return a.networkId == b.networkId && a.x == b.x && a.y == b.y && a.z == b.z && a.yaw == b.yaw &&
+        a.health == b.health && a.ammo == b.ammo && a.animation == b.animation && a.crouching == b.crouching &&
+        a.firing == b.firing;
+}
+
+template <bool useSchema>
+void RunBenchmark(const std::vector<EntityState> &states, int iterations, std::vector<unsigned char> &written,
+    std::vector<EntityState> &read)
+{
+    BitStream bitStream;
+    const int structsPerStream = (int) states.size();
+    std::vector<EntityState> readStates(states.size());
+    bool readAll = true;
+
+    TimeUS startTime = GetTimeUS();
+    for (int i = 0; i < iterations; i++)
+    {
+        bitStream.Reset();
+        // A message id, so the structs start off a byte boundary as they would after one
+        bitStream.WriteBits((const unsigned char *) "\x05", 3, true);
+        for (int j = 0; j < structsPerStream; j++)
+        {
+            if (useSchema)
+                EntityStateSchema::Write(states[j], &bitStream);
+            else
+                WriteByHand(states[j], &bitStream);
+        }
+    }
+    TimeUS writeTime = GetTimeUS() - startTime;
+
+    startTime = GetTimeUS();
+    for (int i = 0; i < iterations; i++)
+    {
+        bitStream.SetReadOffset(3);
+        for (int j = 0; j < structsPerStream; j++)
+        {
+            if (useSchema)
+                readAll &= EntityStateSchema::Read(readStates[j], &bitStream);
+            else
+                readAll &= ReadByHand(readStates[j], &bitStream);
+        }
+    }
+    TimeUS readTime = GetTimeUS() - startTime;
+
+    // The first run keeps what it wrote and read for the second to compare against
+    const unsigned char *data = bitStream.GetData();
+    std::vector<unsigned char> bits(data, data + bitStream.GetNumberOfBytesUsed());
+    const char *sameBits = "";
+    if (written.empty())
+    {
+        written = bits;
+        read = readStates;
+    }
+    else
+    {
+        bool sameRead = true;
+        for (int j = 0; j < structsPerStream; j++)
+            sameRead &= SameState(read[j], readStates[j]);
+        sameBits = written == bits && sameRead ? "  same bits" : "  DIFFERENT BITS";
+    }
+
+    if (writeTime == 0)
+        writeTime = 1;
+    if (readTime == 0)
+        readTime = 1;
+    double structs = (double) structsPerStream * iterations;
+    printf("%-10s write %7.1f ns/struct  read %7.1f ns/struct  %s%s\n",
+        useSchema ? "schema" : "by hand",
+        (double) writeTime * 1000.0 / structs,
+        (double) readTime * 1000.0 / structs,
+        readAll ? "read back" : "READ BACK FAILED", sameBits);
+}
+
+int main(int argc, char **argv)
+{
+    int structsPerStream = 100;
+    int iterations = 20000;
+    if (argc > 1)
+        structsPerStream = atoi(argv[1]);
+    if (argc > 2)
+        iterations = atoi(argv[2]);
+    if (structsPerStream < 1)
+        structsPerStream = 1;
+    if (iterations < 1)
+        iterations = 1;
+
+    std::vector<EntityState> states;
+    srand(1);
+    for (int i = 0; i < structsPerStream; i++)
+    {
+        EntityState state;
+        state.networkId = (unsigned int) rand();
+        state.x = (float) (rand() % 16000 - 8000) + 0.5f;
+        state.y = (float) (rand() % 16000 - 8000) + 0.25f;
+        state.z = (float) (rand() % 2000 - 1000) * 0.5f;
+        state.yaw = (float) (rand() % 628 - 314) / 100.0f;
+        state.health = rand() % 101;
+        state.ammo = (unsigned short) (rand() % 1000);
+        state.animation = (unsigned char) (rand() % 4);
+        state.crouching = (rand() & 1) != 0;
+        state.firing = (rand() & 1) != 0;
+        states.push_back(state);
+    }
+
+    printf("BitStream schema benchmark\n");
+    printf("%i bits per struct, %i structs per stream, %i iterations\n\n", (int) EntityStateSchema::BITS,
+        structsPerStream, iterations);
+
+    std::vector<unsigned char> written;
+    std::vector<EntityState> read;
+    RunBenchmark<false>(states, iterations, written, read);
+    RunBenchmark<true>(states, iterations, written, read);
+
+    return 0;
+}
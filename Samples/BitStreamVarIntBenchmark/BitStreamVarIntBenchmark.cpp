@@ -0,0 +1,166 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// WriteCompressed() only drops whole matching bytes, so 300 in a 32 bit integer still costs 19 bits, or all 33 unless
+// __BITSTREAM_NATIVE_END is defined, and a small negative delta costs all of them. WriteVarInt() writes seven bits a
+// byte and zigzag encodes signed types. This sample writes ids and counters with both, and entity positions that move
+// a little each update with WriteCompressedDelta() as it was and with DELTA_VARINT, then reads them back and compares
+// the sizes and times.
+
+#include "BitStream.h"
+#include "GetTime.h"
+#include <cstdio>
+#include <stdlib.h>
+#include <vector>
+
+using namespace RakNet;
+
+enum Workload
+{
+    WORKLOAD_COUNTERS,
+    WORKLOAD_COUNTERS_UNALIGNED,
+    WORKLOAD_POSITION_DELTAS,
+    WORKLOAD_COUNT
+};
+
+static const char *workloadNames[WORKLOAD_COUNT] = {"counters", "counters, unaligned", "position deltas"};
+
+struct Values
+{
+    std::vector<uint32_t> counters;
+    std::vector<int32_t> lastPositions;
+    std::vector<int32_t> positions;
+};
+
+template <bool useVarInt>
+void WriteValues(BitStream &bitStream, Workload workload, const Values &values)
+{
+    const int count = (int) values.counters.size();
+    if (workload == WORKLOAD_COUNTERS_UNALIGNED)
+        bitStream.WriteBits((const unsigned char *) "\x05", 3, true);
+    for (int i = 0; i < count; i++)
+    {
+        if (workload == WORKLOAD_POSITION_DELTAS)
+        {
+            if (useVarInt)
+                bitStream.WriteCompressedDelta(values.positions[i], values.lastPositions[i], BitStream::DELTA_VARINT);
+            else
+                bitStream.WriteCompressedDelta(values.positions[i], values.lastPositions[i]);
+        }
+        else if (useVarInt)
+            bitStream.WriteVarInt(values.counters[i]);
+        else
+            bitStream.WriteCompressed(values.counters[i]);
+    }
+}
+
+// Returns false if any value read differs
+template <bool useVarInt>
+bool ReadValues(BitStream &bitStream, Workload workload, const Values &values)
+{
+    const int count = (int) values.counters.size();
+    bool matches = true;
+    for (int i = 0; i < count; i++)
+    {
+        if (workload == WORKLOAD_POSITION_DELTAS)
+        {
+            int32_t position = values.lastPositions[i];
+            if (useVarInt)
+                matches &= bitStream.ReadCompressedDelta(position, BitStream::DELTA_VARINT);
+            else
+                matches &= bitStream.ReadCompressedDelta(position);
+            matches &= position == values.positions[i];
+        }
+        else
+        {
+            uint32_t counter = 0;
+            if (useVarInt)
+                matches &= bitStream.ReadVarInt(counter);
+            else
+                matches &= bitStream.ReadCompressed(counter);
+            matches &= counter == values.counters[i];
+        }
+    }
+    return matches;
+}
+
+template <bool useVarInt>
+void RunBenchmark(Workload workload, const Values &values, int iterations)
+{
+    BitStream bitStream;
+    bool matches = true;
+
+    TimeUS startTime = GetTimeUS();
+    for (int i = 0; i < iterations; i++)
+    {
+        bitStream.Reset();
+        WriteValues<useVarInt>(bitStream, workload, values);
+    }
+    TimeUS writeTime = GetTimeUS() - startTime;
+
+    startTime = GetTimeUS();
+    for (int i = 0; i < iterations; i++)
+    {
+        bitStream.SetReadOffset(workload == WORKLOAD_COUNTERS_UNALIGNED ? 3 : 0);
+        matches &= ReadValues<useVarInt>(bitStream, workload, values);
+    }
+    TimeUS readTime = GetTimeUS() - startTime;
+
+    if (writeTime == 0)
+        writeTime = 1;
+    if (readTime == 0)
+        readTime = 1;
+    const double count = (double) values.counters.size();
+    const BitSize_t valueBits = bitStream.GetNumberOfBitsUsed() - (workload == WORKLOAD_COUNTERS_UNALIGNED ? 3 : 0);
+    printf("%-20s %-11s %5.1f bits/value  write %6.2f ns/value  read %6.2f ns/value  %s\n",
+        workloadNames[workload], useVarInt ? "varint" : "compressed",
+        (double) valueBits / count,
+        (double) writeTime * 1000.0 / (count * iterations),
+        (double) readTime * 1000.0 / (count * iterations),
+        matches ? "read back" : "READ BACK WRONG");
+}
+
+int main(int argc, char **argv)
+{
+    int valuesPerStream = 1000;
+    int iterations = 20000;
+    if (argc > 1)
+        valuesPerStream = atoi(argv[1]);
+    if (argc > 2)
+        iterations = atoi(argv[2]);
+    if (valuesPerStream < 1)
+        valuesPerStream = 1;
+    if (iterations < 1)
+        iterations = 1;
+
+    Values values;
+    srand(1);
+    for (int i = 0; i < valuesPerStream; i++)
+    {
+        // Mostly under a thousand, now and then up to a hundred thousand
+        values.counters.push_back((uint32_t) (rand() % 8 == 0 ? rand() % 100000 : rand() % 1000));
+        // Centimetres across a 160 metre map. A fifth of the entities stand still, the rest move up to half a metre
+        const int32_t lastPosition = rand() % 16000 - 8000;
+        values.lastPositions.push_back(lastPosition);
+        values.positions.push_back(rand() % 5 == 0 ? lastPosition : lastPosition + rand() % 101 - 50);
+    }
+
+    printf("BitStream varint benchmark\n");
+    printf("%i values per stream, %i iterations\n\n", valuesPerStream, iterations);
+
+    for (int workload = 0; workload < WORKLOAD_COUNT; workload++)
+    {
+        RunBenchmark<false>((Workload) workload, values, iterations);
+        RunBenchmark<true>((Workload) workload, values, iterations);
+    }
+
+    return 0;
+}
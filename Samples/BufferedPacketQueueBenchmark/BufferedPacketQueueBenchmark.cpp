@@ -0,0 +1,205 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Receive threads in RakPeer take an RNS2RecvStruct from a free pool, fill it and push it onto
+// bufferedPacketsQueue. The update thread pops it and returns it to the pool. This sample runs the
+// same traffic pattern without sockets so only the cost of the hand-off is measured.
+
+#include "RakNetSocket2.h"
+#include "DS_Queue.h"
+#include "DS_LockFreeRing.h"
+#include "SimpleMutex.h"
+#include "GetTime.h"
+#include "RakNetDefines.h"
+#include <cstdio>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace RakNet;
+
+// The queue and free pool as RakPeer had them before: each guarded by its own mutex
+class MutexQueues
+{
+public:
+    ~MutexQueues()
+    {
+        while (freePool.Size())
+            delete freePool.Pop();
+    }
+    const char *GetName(void) const {return "SimpleMutex + DataStructures::Queue";}
+    RNS2RecvStruct *Alloc(void)
+    {
+        RNS2RecvStruct *s = 0;
+        freePoolMutex.Lock();
+        if (freePool.Size())
+            s = freePool.Pop();
+        freePoolMutex.Unlock();
+        return s ? s : new RNS2RecvStruct;
+    }
+    void Dealloc(RNS2RecvStruct *s)
+    {
+        freePoolMutex.Lock();
+        freePool.Push(s);
+        freePoolMutex.Unlock();
+    }
+    bool Push(RNS2RecvStruct *s)
+    {
+        queueMutex.Lock();
+        queue.Push(s);
+        queueMutex.Unlock();
+        return true;
+    }
+    RNS2RecvStruct *Pop(void)
+    {
+        RNS2RecvStruct *s = 0;
+        queueMutex.Lock();
+        if (queue.Size())
+            s = queue.Pop();
+        queueMutex.Unlock();
+        return s;
+    }
+    uint64_t GetContentionCount(void) const {return 0;}
+
+protected:
+    DataStructures::Queue<RNS2RecvStruct*> freePool, queue;
+    SimpleMutex freePoolMutex, queueMutex;
+};
+
+// The queue and free pool as RakPeer has them now
+class RingQueues
+{
+public:
+    RingQueues()
+    {
+        freePool.Init(CRABNET_BUFFERED_PACKETS_QUEUE_SIZE);
+        queue.Init(CRABNET_BUFFERED_PACKETS_QUEUE_SIZE);
+    }
+    ~RingQueues()
+    {
+        RNS2RecvStruct *s;
+        while (freePool.Pop(s))
+            delete s;
+    }
+    const char *GetName(void) const {return "DataStructures::LockFreeRing";}
+    RNS2RecvStruct *Alloc(void)
+    {
+        RNS2RecvStruct *s;
+        if (freePool.Pop(s))
+            return s;
+        return new RNS2RecvStruct;
+    }
+    void Dealloc(RNS2RecvStruct *s)
+    {
+        if (freePool.Push(s) == false)
+            delete s;
+    }
+    bool Push(RNS2RecvStruct *s) {return queue.Push(s);}
+    RNS2RecvStruct *Pop(void)
+    {
+        RNS2RecvStruct *s;
+        if (queue.Pop(s))
+            return s;
+        return 0;
+    }
+    uint64_t GetContentionCount(void) const {return freePool.GetContentionCount() + queue.GetContentionCount();}
+
+protected:
+    DataStructures::LockFreeRing<RNS2RecvStruct*> freePool, queue;
+};
+
+template <class queues_type>
+void RunBenchmark(int producerCount, int datagramsPerThread)
+{
+    queues_type queues;
+    std::atomic<int> producersDone(0);
+    std::atomic<uint64_t> queueFull(0);
+    std::vector<std::thread> producers;
+
+    TimeUS startTime = GetTimeUS();
+    for (int i = 0; i < producerCount; i++)
+    {
+        producers.push_back(std::thread([&queues, &producersDone, &queueFull, datagramsPerThread]()
+        {
+            for (int j = 0; j < datagramsPerThread; j++)
+            {
+                RNS2RecvStruct *s = queues.Alloc();
+                s->bytesRead = j;
+                // RakPeer drops the datagram when the queue is full. Here the producer waits instead,
+                // so both implementations move the same number of datagrams
+                while (queues.Push(s) == false)
+                {
+                    queueFull++;
+                    std::this_thread::yield();
+                }
+            }
+            producersDone++;
+        }));
+    }
+
+    // The update thread
+    uint64_t received = 0;
+    for (;;)
+    {
+        RNS2RecvStruct *s = queues.Pop();
+        if (s)
+        {
+            received++;
+            queues.Dealloc(s);
+        }
+        else if (producersDone == producerCount)
+        {
+            // Producers finished; drain whatever they pushed last
+            while ((s = queues.Pop()) != 0)
+            {
+                received++;
+                queues.Dealloc(s);
+            }
+            break;
+        }
+        else
+            std::this_thread::yield();
+    }
+    TimeUS elapsed = GetTimeUS() - startTime;
+
+    for (size_t i = 0; i < producers.size(); i++)
+        producers[i].join();
+
+    if (elapsed == 0)
+        elapsed = 1;
+    printf("%-38s %10.0f datagrams/sec  received %llu  queue full %llu  contention %llu\n",
+        queues.GetName(), (double) received * 1000000.0 / (double) elapsed,
+        (unsigned long long) received, (unsigned long long) queueFull.load(),
+        (unsigned long long) queues.GetContentionCount());
+}
+
+int main(int argc, char **argv)
+{
+    int producerCount = 4;
+    int datagramsPerThread = 1000000;
+    if (argc > 1)
+        producerCount = atoi(argv[1]);
+    if (argc > 2)
+        datagramsPerThread = atoi(argv[2]);
+    if (producerCount < 1)
+        producerCount = 1;
+    if (datagramsPerThread < 1)
+        datagramsPerThread = 1;
+
+    printf("Buffered packet queue benchmark\n");
+    printf("%i producer threads, %i datagrams each, one consumer thread\n\n", producerCount, datagramsPerThread);
+
+    RunBenchmark<MutexQueues>(producerCount, datagramsPerThread);
+    RunBenchmark<RingQueues>(producerCount, datagramsPerThread);
+
+    return 0;
+}
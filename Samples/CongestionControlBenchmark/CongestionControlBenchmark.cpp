@@ -0,0 +1,224 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// A sender offers a fixed load of RELIABLE_ORDERED messages to a receiver on loopback, through the
+// network simulator. Each message carries the time it was passed to Send(). The receiver subtracts
+// that and the simulated one way latency, which leaves the time the message spent queued because
+// congestion control held it back. A controller that keeps up with the offered load keeps that
+// delay low; one that backs off on random loss lets the send queue, and the delay, grow.
+
+#include "RakPeerInterface.h"
+#include "MessageIdentifiers.h"
+#include "BitStream.h"
+#include "RakNetStatistics.h"
+#include "RakSleep.h"
+#include "GetTime.h"
+#include <cstdio>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+using namespace RakNet;
+
+static const unsigned short RECEIVER_PORT = 60200;
+
+struct Result
+{
+    unsigned int sent;
+    unsigned int received;
+    double goodputKBPerSecond;
+    double averageQueueingDelayMS;
+    double p99QueueingDelayMS;
+    uint64_t bytesResent;
+    uint64_t pacingDelays;
+    TimeUS pacingDelayTotal;
+};
+
+static const char *GetAlgorithmName(CongestionControlAlgorithm algorithm)
+{
+    switch (algorithm)
+    {
+        case CC_SLIDING_WINDOW:
+            return "Sliding window";
+        case CC_UDT:
+            return "UDT";
+        case CC_BBR:
+            return "BBR";
+        default:
+            return "?";
+    }
+}
+
+static void DrainReceiver(RakPeerInterface *receiver, unsigned short oneWayLatencyMS, unsigned int *received,
+                          uint64_t *bytesReceived, std::vector<double> *queueingDelaysMS)
+{
+    Packet *packets[64];
+    unsigned int count;
+    while ((count = receiver->ReceiveBatch(packets, 64)) != 0)
+    {
+        TimeUS now = GetTimeUS();
+        for (unsigned int i = 0; i < count; i++)
+        {
+            if (packets[i]->data[0] != ID_USER_PACKET_ENUM)
+                continue;
+            BitStream bs(packets[i]->data, packets[i]->length, false);
+            bs.IgnoreBytes(sizeof(MessageID));
+            TimeUS sendTime;
+            bs.Read(sendTime);
+            double delayMS = (double) (now - sendTime) / 1000.0 - oneWayLatencyMS;
+            queueingDelaysMS->push_back(delayMS > 0.0 ? delayMS : 0.0);
+            *bytesReceived += packets[i]->length;
+            (*received)++;
+        }
+        receiver->DeallocatePacketBatch(packets, count);
+    }
+}
+
+static bool Run(CongestionControlAlgorithm algorithm, float loss, unsigned short pingMS, unsigned int offeredKBPerSecond,
+                unsigned int seconds, unsigned int messageSize, bool pacing, Result *result)
+{
+    RakPeerInterface *receiver = RakPeerInterface::GetInstance();
+    RakPeerInterface *sender = RakPeerInterface::GetInstance();
+    receiver->SetCongestionControl(algorithm, UNASSIGNED_SYSTEM_ADDRESS);
+    sender->SetCongestionControl(algorithm, UNASSIGNED_SYSTEM_ADDRESS);
+    sender->SetPacing(pacing, UNASSIGNED_SYSTEM_ADDRESS);
+
+    SocketDescriptor receiverSocket(RECEIVER_PORT, 0), senderSocket;
+    if (receiver->Startup(1, &receiverSocket, 1) != CRABNET_STARTED || sender->Startup(1, &senderSocket, 1) != CRABNET_STARTED)
+    {
+        printf("Startup failed\n");
+        RakPeerInterface::DestroyInstance(sender);
+        RakPeerInterface::DestroyInstance(receiver);
+        return false;
+    }
+    receiver->SetMaximumIncomingConnections(1);
+
+    // Half the ping each way, so data and acks are both delayed. Applied before connecting so no controller sees
+    // a round trip time the benchmark does not simulate
+    unsigned short oneWayLatencyMS = pingMS / 2;
+    sender->ApplyNetworkSimulator(loss, oneWayLatencyMS, 0);
+    receiver->ApplyNetworkSimulator(loss, oneWayLatencyMS, 0);
+    sender->Connect("127.0.0.1", RECEIVER_PORT, 0, 0);
+
+    SystemAddress receiverAddress = UNASSIGNED_SYSTEM_ADDRESS;
+    Time connectStart = GetTime();
+    while (receiverAddress == UNASSIGNED_SYSTEM_ADDRESS && GetTime() - connectStart < 10000)
+    {
+        for (Packet *p = sender->Receive(); p; sender->DeallocatePacket(p), p = sender->Receive())
+        {
+            if (p->data[0] == ID_CONNECTION_REQUEST_ACCEPTED)
+                receiverAddress = p->systemAddress;
+        }
+        for (Packet *p = receiver->Receive(); p; receiver->DeallocatePacket(p), p = receiver->Receive())
+            ;
+        RakSleep(1);
+    }
+    if (receiverAddress == UNASSIGNED_SYSTEM_ADDRESS)
+    {
+        printf("Connection failed\n");
+        sender->Shutdown(0);
+        receiver->Shutdown(0);
+        RakPeerInterface::DestroyInstance(sender);
+        RakPeerInterface::DestroyInstance(receiver);
+        return false;
+    }
+
+    std::vector<char> payload(messageSize > sizeof(MessageID) + sizeof(TimeUS) ? messageSize - sizeof(MessageID) - sizeof(TimeUS) : 0);
+    std::vector<double> queueingDelaysMS;
+    uint64_t bytesReceived = 0;
+    result->sent = 0;
+    result->received = 0;
+
+    TimeUS start = GetTimeUS();
+    TimeUS end = start + (TimeUS) seconds * 1000000;
+    TimeUS now;
+    while ((now = GetTimeUS()) < end)
+    {
+        uint64_t due = (uint64_t) offeredKBPerSecond * 1000 * (now - start) / 1000000 / messageSize;
+        for (; result->sent < due; result->sent++)
+        {
+            BitStream bs;
+            bs.Write((MessageID) ID_USER_PACKET_ENUM);
+            bs.Write(GetTimeUS());
+            if (!payload.empty())
+                bs.Write(&payload[0], (unsigned int) payload.size());
+            sender->Send(&bs, HIGH_PRIORITY, RELIABLE_ORDERED, 0, receiverAddress, false);
+        }
+
+        DrainReceiver(receiver, oneWayLatencyMS, &result->received, &bytesReceived, &queueingDelaysMS);
+        for (Packet *p = sender->Receive(); p; sender->DeallocatePacket(p), p = sender->Receive())
+            ;
+        RakSleep(1);
+    }
+
+    RakNetStatistics rns;
+    sender->GetStatistics(receiverAddress, &rns);
+    result->bytesResent = rns.runningTotal[USER_MESSAGE_BYTES_RESENT];
+    result->pacingDelays = rns.pacingDelays;
+    result->pacingDelayTotal = rns.pacingDelayTotal;
+    result->goodputKBPerSecond = (double) bytesReceived / 1000.0 / seconds;
+    result->averageQueueingDelayMS = 0.0;
+    result->p99QueueingDelayMS = 0.0;
+    if (!queueingDelaysMS.empty())
+    {
+        double total = 0.0;
+        for (size_t i = 0; i < queueingDelaysMS.size(); i++)
+            total += queueingDelaysMS[i];
+        result->averageQueueingDelayMS = total / queueingDelaysMS.size();
+        std::sort(queueingDelaysMS.begin(), queueingDelaysMS.end());
+        result->p99QueueingDelayMS = queueingDelaysMS[queueingDelaysMS.size() * 99 / 100];
+    }
+
+    sender->Shutdown(0);
+    receiver->Shutdown(0);
+    RakPeerInterface::DestroyInstance(sender);
+    RakPeerInterface::DestroyInstance(receiver);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    float loss = argc > 1 ? (float) atof(argv[1]) / 100.0f : 0.02f;
+    unsigned short pingMS = argc > 2 ? (unsigned short) atoi(argv[2]) : 100;
+    unsigned int offeredKBPerSecond = argc > 3 ? (unsigned int) atoi(argv[3]) : 2000;
+    unsigned int seconds = argc > 4 ? (unsigned int) atoi(argv[4]) : 10;
+    unsigned int messageSize = argc > 5 ? (unsigned int) atoi(argv[5]) : 1000;
+    bool pacing = argc > 6 && atoi(argv[6]) != 0;
+    if (seconds == 0)
+        seconds = 1;
+    if (messageSize < sizeof(MessageID) + sizeof(TimeUS))
+        messageSize = sizeof(MessageID) + sizeof(TimeUS);
+
+    printf("%.1f%% loss, %u ms ping, %u KB/s offered in %u byte messages, %u seconds per controller, pacing %s\n",
+           loss * 100.0f, pingMS, offeredKBPerSecond, messageSize, seconds, pacing ? "on" : "off");
+
+    RakPeerInterface *probe = RakPeerInterface::GetInstance();
+    probe->ApplyNetworkSimulator(loss, pingMS / 2, 0);
+    if ((loss > 0.0f || pingMS > 1) && !probe->IsNetworkSimulatorActive())
+        printf("Warning: the network simulator is only compiled into _DEBUG builds. Loss and ping are not applied\n");
+    RakPeerInterface::DestroyInstance(probe);
+
+    printf("%-16s %10s %10s %14s %16s %16s %14s %14s\n", "Controller", "Sent", "Received", "Goodput KB/s",
+           "Avg queue ms", "99% queue ms", "Resent KB", "Avg pacing us");
+    for (int i = 0; i < CC_ALGORITHM_COUNT; i++)
+    {
+        CongestionControlAlgorithm algorithm = (CongestionControlAlgorithm) i;
+        Result result;
+        if (!Run(algorithm, loss, pingMS, offeredKBPerSecond, seconds, messageSize, pacing, &result))
+            return 1;
+        printf("%-16s %10u %10u %14.1f %16.1f %16.1f %14.1f %14.1f\n", GetAlgorithmName(algorithm), result.sent, result.received,
+               result.goodputKBPerSecond, result.averageQueueingDelayMS, result.p99QueueingDelayMS,
+               (double) result.bytesResent / 1000.0,
+               result.pacingDelays ? (double) result.pacingDelayTotal / result.pacingDelays : 0.0);
+    }
+
+    return 0;
+}
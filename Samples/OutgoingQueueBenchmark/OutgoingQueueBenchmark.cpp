@@ -0,0 +1,149 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// ReliabilityLayer::Send() pushes each message onto outgoingPacketBuffer, and Update() pops them
+// while it fills datagrams. This sample keeps a backlog of queued messages and pushes and pops through
+// it, without sockets, so only the cost of the send queue is measured. It also counts the priorities of
+// the first messages sent from a backlog of all priorities, which shows how the bandwidth is shared.
+// Both must agree.
+
+#include "OutgoingQueue.h"
+#include "DS_Heap.h"
+#include "GetTime.h"
+#include <cstdio>
+#include <stdlib.h>
+#include <vector>
+
+using namespace RakNet;
+
+// outgoingPacketBuffer as ReliabilityLayer had it before: one heap keyed by a weight from GetNextWeight()
+class HeapQueue
+{
+public:
+    HeapQueue() {InitHeapWeights();}
+    const char *GetName(void) const {return "DataStructures::Heap";}
+    void Push(InternalPacket *internalPacket) {heap.Push(GetNextWeight(internalPacket->priority), internalPacket);}
+    InternalPacket *Pop(void) {return heap.Pop(0);}
+    unsigned int Size(void) const {return heap.Size();}
+
+protected:
+    void InitHeapWeights(void)
+    {
+        for (int priorityLevel = 0; priorityLevel < NUMBER_OF_PRIORITIES; priorityLevel++)
+            nextWeights[priorityLevel] = (1 << priorityLevel) * priorityLevel + priorityLevel;
+    }
+    uint64_t GetNextWeight(int priorityLevel)
+    {
+        uint64_t next = nextWeights[priorityLevel];
+        if (heap.Size() > 0)
+        {
+            int peekPL = heap.Peek()->priority;
+            uint64_t weight = heap.PeekWeight();
+            uint64_t min = weight - (1 << peekPL) * peekPL + peekPL;
+            if (next < min)
+                next = min + ((uint64_t) 1 << priorityLevel) * priorityLevel + priorityLevel;
+            nextWeights[priorityLevel] = next + ((uint64_t) 1 << priorityLevel) * (priorityLevel + 1) + priorityLevel;
+        }
+        else
+            InitHeapWeights();
+        return next;
+    }
+
+    DataStructures::Heap<uint64_t, InternalPacket*, false> heap;
+    uint64_t nextWeights[NUMBER_OF_PRIORITIES];
+};
+
+// outgoingPacketBuffer as ReliabilityLayer has it now
+class RingQueue
+{
+public:
+    const char *GetName(void) const {return "OutgoingQueue";}
+    void Push(InternalPacket *internalPacket) {queue.Push(internalPacket);}
+    InternalPacket *Pop(void) {return queue.Pop();}
+    unsigned int Size(void) const {return queue.Size();}
+
+protected:
+    OutgoingQueue queue;
+};
+
+template <class queue_type>
+void RunBenchmark(std::vector<InternalPacket> &messages, int backlog, int operations)
+{
+    queue_type queue;
+    unsigned int sent[NUMBER_OF_PRIORITIES] = {};
+    size_t nextMessage = 0;
+
+    TimeUS startTime = GetTimeUS();
+    for (int i = 0; i < backlog; i++)
+        queue.Push(&messages[nextMessage++ % messages.size()]);
+    TimeUS fillTime = GetTimeUS() - startTime;
+
+    startTime = GetTimeUS();
+    for (int i = 0; queue.Size(); i++)
+    {
+        InternalPacket *internalPacket = queue.Pop();
+        if (i < backlog / 10)
+            sent[internalPacket->priority]++;
+    }
+    TimeUS drainTime = GetTimeUS() - startTime;
+
+    // Steady state: Send() adds one message for each one Update() sends
+    for (int i = 0; i < backlog; i++)
+        queue.Push(&messages[nextMessage++ % messages.size()]);
+    startTime = GetTimeUS();
+    for (int i = 0; i < operations; i++)
+    {
+        queue.Push(&messages[nextMessage++ % messages.size()]);
+        queue.Pop();
+    }
+    TimeUS steadyTime = GetTimeUS() - startTime;
+
+    if (fillTime == 0)
+        fillTime = 1;
+    if (steadyTime == 0)
+        steadyTime = 1;
+    if (drainTime == 0)
+        drainTime = 1;
+    printf("%-22s push %6.1f M/sec  push+pop %6.1f M/sec  pop %6.1f M/sec  first tenth by priority %u %u %u %u\n",
+        queue.GetName(),
+        (double) backlog / (double) fillTime,
+        (double) operations / (double) steadyTime,
+        (double) backlog / (double) drainTime,
+        sent[IMMEDIATE_PRIORITY], sent[HIGH_PRIORITY], sent[MEDIUM_PRIORITY], sent[LOW_PRIORITY]);
+}
+
+int main(int argc, char **argv)
+{
+    int backlog = 100000;
+    int operations = 10000000;
+    if (argc > 1)
+        backlog = atoi(argv[1]);
+    if (argc > 2)
+        operations = atoi(argv[2]);
+    if (backlog < 1)
+        backlog = 1;
+    if (operations < 1)
+        operations = 1;
+
+    // Enough messages that the queue never holds one twice, with every priority equally common
+    std::vector<InternalPacket> messages(backlog * 2);
+    srand(1);
+    for (size_t i = 0; i < messages.size(); i++)
+        messages[i].priority = (PacketPriority) (rand() % NUMBER_OF_PRIORITIES);
+
+    printf("Outgoing queue benchmark\n");
+    printf("%i messages queued, %i push+pop operations\n\n", backlog, operations);
+
+    RunBenchmark<HeapQueue>(messages, backlog, operations);
+    RunBenchmark<RingQueue>(messages, backlog, operations);
+
+    return 0;
+}
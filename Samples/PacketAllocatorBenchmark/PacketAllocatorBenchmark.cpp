@@ -0,0 +1,136 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// The network thread in RakPeer allocates a Packet for every message it delivers, and the application
+// frees it with DeallocatePacket() from its own thread. This sample runs the same pattern without
+// sockets, so only the cost of allocating and freeing packets is measured.
+
+#include "PacketAllocator.h"
+#include "RakNetTypes.h"
+#include "DS_LockFreeRing.h"
+#include "GetTime.h"
+#include "RakNetDefines.h"
+#include <cstdio>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+
+using namespace RakNet;
+
+// Packets as RakPeer allocated them before: the Packet and its data each from malloc
+class MallocPackets
+{
+public:
+    const char *GetName(void) const {return "malloc";}
+    Packet *Alloc(unsigned int dataSize)
+    {
+        Packet *p = (Packet *) malloc(sizeof(Packet));
+        p->data = (unsigned char *) malloc(dataSize);
+        p->length = dataSize;
+        return p;
+    }
+    void Dealloc(Packet *p)
+    {
+        free(p->data);
+        free(p);
+    }
+};
+
+// Packets as RakPeer allocates them now
+class PacketAllocatorPackets
+{
+public:
+    const char *GetName(void) const {return "PacketAllocator";}
+    Packet *Alloc(unsigned int dataSize)
+    {
+        Packet *p = PacketAllocator::Allocate();
+#if CRABNET_PACKET_INLINE_DATA_SIZE > 0
+        if (dataSize <= CRABNET_PACKET_INLINE_DATA_SIZE)
+            p->data = PacketAllocator::GetInlineData(p);
+        else
+#endif
+            p->data = (unsigned char *) malloc(dataSize);
+        p->length = dataSize;
+        return p;
+    }
+    void Dealloc(Packet *p)
+    {
+        if (p->data != PacketAllocator::GetInlineData(p))
+            free(p->data);
+        PacketAllocator::Release(p);
+    }
+};
+
+template <class allocator_type>
+void RunBenchmark(int packetCount, unsigned int smallSize, unsigned int largeSize, int largeEvery)
+{
+    allocator_type allocator;
+    DataStructures::LockFreeRing<Packet*> queue;
+    queue.Init(CRABNET_BUFFERED_PACKETS_QUEUE_SIZE);
+
+    TimeUS startTime = GetTimeUS();
+    // The network thread
+    std::thread producer([&allocator, &queue, packetCount, smallSize, largeSize, largeEvery]()
+    {
+        for (int i = 0; i < packetCount; i++)
+        {
+            Packet *p = allocator.Alloc(largeEvery > 0 && i % largeEvery == 0 ? largeSize : smallSize);
+            p->data[0] = (unsigned char) i;
+            while (queue.Push(p) == false)
+                std::this_thread::yield();
+        }
+    });
+
+    // The application thread
+    int received = 0;
+    while (received < packetCount)
+    {
+        Packet *p;
+        if (queue.Pop(p))
+        {
+            allocator.Dealloc(p);
+            received++;
+        }
+        else
+            std::this_thread::yield();
+    }
+    TimeUS elapsed = GetTimeUS() - startTime;
+    producer.join();
+
+    if (elapsed == 0)
+        elapsed = 1;
+    printf("%-16s %10.0f packets/sec\n", allocator.GetName(), (double) received * 1000000.0 / (double) elapsed);
+}
+
+int main(int argc, char **argv)
+{
+    int packetCount = 2000000;
+    // One in largeEvery packets is too big for the inline data. 0 for none
+    int largeEvery = 2;
+    if (argc > 1)
+        packetCount = atoi(argv[1]);
+    if (argc > 2)
+        largeEvery = atoi(argv[2]);
+    if (packetCount < 1)
+        packetCount = 1;
+
+    unsigned int smallSize = 16, largeSize = 1000;
+    printf("Packet allocator benchmark\n");
+    printf("%i packets of %u bytes, one in %i of %u bytes instead. One thread allocates, another frees\n",
+        packetCount, smallSize, largeEvery, largeSize);
+    printf("%i bytes of data are stored inline\n\n", CRABNET_PACKET_INLINE_DATA_SIZE);
+
+    RunBenchmark<MallocPackets>(packetCount, smallSize, largeSize, largeEvery);
+    RunBenchmark<PacketAllocatorPackets>(packetCount, smallSize, largeSize, largeEvery);
+    printf("Depot exchanges %llu\n", (unsigned long long) PacketAllocator::GetDepotExchangeCount());
+
+    return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// RakPeer keeps the time each connection next needs an update in a DataStructures::TimerWheel, and
+// sleeps until the earliest one. Before, RunUpdateCycle visited every connection on every cycle.
+// This sample schedules connections the same way without sockets, checks the wheel expires the same
+// connections as scanning a plain array, then times both.
+
+#include "DS_TimerWheel.h"
+#include "DS_List.h"
+#include "GetTime.h"
+#include <cstdio>
+#include <stdlib.h>
+#include <vector>
+
+using namespace RakNet;
+
+// Each connection updated at each tick picks its next update time from this, so both schedulers see
+// the same times no matter in which order they return the connections
+static uint64_t Hash(uint64_t a, uint64_t b)
+{
+    uint64_t h = a * 0x9E3779B97F4A7C15ULL ^ (b + 0x632BE59BD9B4E019ULL);
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+static const uint64_t NOT_SCHEDULED = (uint64_t) -1;
+
+// Connections as RakPeer scheduled them before: every cycle looks at all of them
+class ScanScheduler
+{
+public:
+    const char *GetName(void) const {return "Scan every connection";}
+    void Init(unsigned int numElements, uint64_t curTime)
+    {
+        (void) curTime;
+        expireTimes.assign(numElements, NOT_SCHEDULED);
+    }
+    void Schedule(unsigned int element, uint64_t expireTime) {expireTimes[element] = expireTime;}
+    void Cancel(unsigned int element) {expireTimes[element] = NOT_SCHEDULED;}
+    void Advance(uint64_t curTime, DataStructures::List<unsigned int> &output)
+    {
+        for (unsigned int i = 0; i < expireTimes.size(); i++)
+        {
+            if (expireTimes[i] <= curTime)
+            {
+                expireTimes[i] = NOT_SCHEDULED;
+                output.Push(i);
+            }
+        }
+    }
+    uint64_t GetTimeToNextExpiry(uint64_t curTime, uint64_t maxWait) const
+    {
+        uint64_t wait = maxWait;
+        for (unsigned int i = 0; i < expireTimes.size(); i++)
+        {
+            if (expireTimes[i] <= curTime)
+                return 0;
+            if (expireTimes[i] - curTime < wait)
+                wait = expireTimes[i] - curTime;
+        }
+        return wait;
+    }
+
+protected:
+    std::vector<uint64_t> expireTimes;
+};
+
+// Connections as RakPeer schedules them now
+class WheelScheduler
+{
+public:
+    const char *GetName(void) const {return "DataStructures::TimerWheel";}
+    void Init(unsigned int numElements, uint64_t curTime) {wheel.Init(numElements, curTime);}
+    void Schedule(unsigned int element, uint64_t expireTime) {wheel.Schedule(element, expireTime);}
+    void Cancel(unsigned int element) {wheel.Cancel(element);}
+    void Advance(uint64_t curTime, DataStructures::List<unsigned int> &output) {wheel.Advance(curTime, output);}
+    uint64_t GetTimeToNextExpiry(uint64_t curTime, uint64_t maxWait) const {return wheel.GetTimeToNextExpiry(curTime, maxWait);}
+
+protected:
+    DataStructures::TimerWheel wheel;
+};
+
+// What the connections due at \a curTime and one random connection do, shared by both schedulers
+template <class scheduler_type>
+void UpdateConnections(scheduler_type &scheduler, const DataStructures::List<unsigned int> &due, unsigned int connections,
+                       uint64_t curTime, uint64_t maxDelay)
+{
+    for (unsigned int i = 0; i < due.Size(); i++)
+    {
+        // Most connections want an update again soon. One in 64 is idle for longer than the inner level of the wheel covers
+        uint64_t h = Hash(due[i], curTime);
+        uint64_t delay = 1 + (h % 64 == 0 ? h % (maxDelay * 64) : h % maxDelay);
+        scheduler.Schedule(due[i], curTime + delay);
+    }
+
+    // Data arriving for a connection reschedules it to now, as ScheduleRemoteSystemUpdate() does. A closed connection is cancelled
+    uint64_t h = Hash(curTime, connections);
+    if (h % 8 == 0)
+        scheduler.Cancel((unsigned int) (h % connections));
+    else
+        scheduler.Schedule((unsigned int) (h % connections), curTime);
+}
+
+template <class scheduler_type>
+void StartConnections(scheduler_type &scheduler, unsigned int connections, uint64_t curTime, uint64_t maxDelay)
+{
+    scheduler.Init(connections, curTime);
+    for (unsigned int i = 0; i < connections; i++)
+        scheduler.Schedule(i, curTime + Hash(i, 0) % maxDelay);
+}
+
+static bool SameConnections(DataStructures::List<unsigned int> &a, DataStructures::List<unsigned int> &b, std::vector<uint64_t> &marks, uint64_t mark)
+{
+    if (a.Size() != b.Size())
+        return false;
+    for (unsigned int i = 0; i < a.Size(); i++)
+        marks[a[i]] = mark;
+    for (unsigned int i = 0; i < b.Size(); i++)
+    {
+        if (marks[b[i]] != mark)
+            return false;
+    }
+    return true;
+}
+
+// Runs both schedulers side by side. Every cycle they must expire the same connections, and the wheel must never
+// sleep past the next expiry. It may wake up early
+bool Verify(unsigned int connections, uint64_t duration, uint64_t maxDelay)
+{
+    const uint64_t maxWait = 100;
+    ScanScheduler scan;
+    WheelScheduler wheel;
+    DataStructures::List<unsigned int> scanDue, wheelDue;
+    std::vector<uint64_t> marks(connections, 0);
+    uint64_t cycles = 0, earlyWakeups = 0;
+
+    uint64_t curTime = 1000;
+    StartConnections(scan, connections, curTime, maxDelay);
+    StartConnections(wheel, connections, curTime, maxDelay);
+    while (curTime < duration)
+    {
+        scanDue.Clear(true);
+        wheelDue.Clear(true);
+        scan.Advance(curTime, scanDue);
+        wheel.Advance(curTime, wheelDue);
+        cycles++;
+        if (!SameConnections(scanDue, wheelDue, marks, cycles))
+        {
+            printf("FAILED: at tick %llu the scan expired %u connections and the wheel %u\n",
+                (unsigned long long) curTime, scanDue.Size(), wheelDue.Size());
+            return false;
+        }
+        UpdateConnections(scan, scanDue, connections, curTime, maxDelay);
+        UpdateConnections(wheel, wheelDue, connections, curTime, maxDelay);
+
+        uint64_t scanWait = scan.GetTimeToNextExpiry(curTime, maxWait);
+        uint64_t wheelWait = wheel.GetTimeToNextExpiry(curTime, maxWait);
+        if (wheelWait > scanWait)
+        {
+            printf("FAILED: at tick %llu the wheel would sleep %llu ticks, but a connection is due in %llu\n",
+                (unsigned long long) curTime, (unsigned long long) wheelWait, (unsigned long long) scanWait);
+            return false;
+        }
+        if (wheelWait < scanWait)
+            earlyWakeups++;
+        curTime += wheelWait > 0 ? wheelWait : 1;
+    }
+
+    printf("Both expired the same connections over %llu cycles. The wheel woke up early %llu times\n\n",
+        (unsigned long long) cycles, (unsigned long long) earlyWakeups);
+    return true;
+}
+
+template <class scheduler_type>
+void RunBenchmark(unsigned int connections, uint64_t duration, uint64_t maxDelay)
+{
+    const uint64_t maxWait = 100;
+    scheduler_type scheduler;
+    DataStructures::List<unsigned int> due;
+    uint64_t cycles = 0, updates = 0;
+
+    uint64_t curTime = 1000;
+    StartConnections(scheduler, connections, curTime, maxDelay);
+    TimeUS startTime = GetTimeUS();
+    while (curTime < duration)
+    {
+        due.Clear(true);
+        scheduler.Advance(curTime, due);
+        UpdateConnections(scheduler, due, connections, curTime, maxDelay);
+        updates += due.Size();
+        cycles++;
+
+        // The update thread sleeps until the next connection is due
+        uint64_t wait = scheduler.GetTimeToNextExpiry(curTime, maxWait);
+        curTime += wait > 0 ? wait : 1;
+    }
+    TimeUS elapsed = GetTimeUS() - startTime;
+
+    if (elapsed == 0)
+        elapsed = 1;
+    printf("%-28s %10.0f cycles/sec  %10.0f updates/sec  cycles %llu  updates %llu\n",
+        scheduler.GetName(),
+        (double) cycles * 1000000.0 / (double) elapsed,
+        (double) updates * 1000000.0 / (double) elapsed,
+        (unsigned long long) cycles, (unsigned long long) updates);
+}
+
+int main(int argc, char **argv)
+{
+    int connections = 10000;
+    int duration = 200000;
+    int maxDelay = 1000;
+    if (argc > 1)
+        connections = atoi(argv[1]);
+    if (argc > 2)
+        duration = atoi(argv[2]);
+    if (argc > 3)
+        maxDelay = atoi(argv[3]);
+    if (connections < 1)
+        connections = 1;
+    if (duration < 1)
+        duration = 1;
+    if (maxDelay < 1)
+        maxDelay = 1;
+
+    printf("Timer wheel benchmark\n");
+    printf("%i connections, %i ticks, updates every 1 to %i ticks\n\n", connections, duration, maxDelay);
+
+    if (!Verify(connections, duration, maxDelay))
+        return 1;
+
+    RunBenchmark<ScanScheduler>(connections, duration, maxDelay);
+    RunBenchmark<WheelScheduler>(connections, duration, maxDelay);
+
+    return 0;
+}
@@ -13,6 +13,7 @@
 ///
 
 #include "BitStream.h"
+#include "BitStreamArena.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -32,6 +33,11 @@
 #include <memory.h>
 #include <cfloat>
 #include <algorithm>
+#include <atomic>
+
+#if defined(_MSC_VER) && defined(_WIN64)
+#include <intrin.h>
+#endif
 
 // MSWin uses _copysign, others use copysign...
 #ifndef _WIN32
@@ -46,6 +52,139 @@ using namespace RakNet;
 
 STATIC_FACTORY_DEFINITIONS(BitStream, BitStream)
 
+// WriteBits() and ReadBits() move up to this many bits at a time through a 64 bit word. With the up to 7 bits the
+// stream is off a byte boundary, they still fit one word
+static const BitSize_t BITS_PER_WORD_STEP = 56;
+
+// The stream is most significant bit first, so its bytes are read as a big endian word. Compilers turn these into
+// a single load or store and a byte swap
+static inline uint64_t LoadBigEndian64(const unsigned char *in)
+{
+    return (uint64_t) in[0] << 56 | (uint64_t) in[1] << 48 | (uint64_t) in[2] << 40 | (uint64_t) in[3] << 32 |
+           (uint64_t) in[4] << 24 | (uint64_t) in[5] << 16 | (uint64_t) in[6] << 8 | (uint64_t) in[7];
+}
+
+static inline void StoreBigEndian64(unsigned char *out, uint64_t word)
+{
+    out[0] = (unsigned char) (word >> 56);
+    out[1] = (unsigned char) (word >> 48);
+    out[2] = (unsigned char) (word >> 40);
+    out[3] = (unsigned char) (word >> 32);
+    out[4] = (unsigned char) (word >> 24);
+    out[5] = (unsigned char) (word >> 16);
+    out[6] = (unsigned char) (word >> 8);
+    out[7] = (unsigned char) word;
+}
+
+// Loads the first byteCount bytes of a big endian word, the rest being 0
+static inline uint64_t LoadBigEndianPartial(const unsigned char *in, unsigned int byteCount)
+{
+    uint64_t word = 0;
+    for (unsigned int i = 0; i < byteCount; i++)
+        word |= (uint64_t) in[i] << (56 - 8 * i);
+    return word;
+}
+
+static inline void StoreBigEndianPartial(unsigned char *out, uint64_t word, unsigned int byteCount)
+{
+    for (unsigned int i = 0; i < byteCount; i++)
+        out[i] = (unsigned char) (word >> (56 - 8 * i));
+}
+
+// Writes the top bitCount bits of input, at most BITS_PER_WORD_STEP, at bitOffset. Off a byte boundary the first byte
+// is ORed into, the other bytes covered are overwritten, and bytes after the last are untouched, as writing byte by
+// byte did
+static inline void MergeBits(unsigned char *data, BitSize_t allocatedBytes, BitSize_t bitOffset, uint64_t input,
+                             BitSize_t bitCount)
+{
+    unsigned char *out = data + (bitOffset >> 3);
+    const unsigned int offset = (unsigned int) (bitOffset & 7);
+    const unsigned int outBytes = (unsigned int) ((offset + bitCount + 7) >> 3);
+    const uint64_t keep = (offset != 0 ? (uint64_t) 0xFF << 56 : 0) | (outBytes < 8 ? ~(uint64_t) 0 >> (8 * outBytes) : 0);
+    if ((BitSize_t) (out - data) + 8 <= allocatedBytes)
+        StoreBigEndian64(out, (LoadBigEndian64(out) & keep) | input >> offset);
+    else
+        StoreBigEndianPartial(out, (LoadBigEndianPartial(out, outBytes) & keep) | input >> offset, outBytes);
+}
+
+// MergeBits() for the few bits of a single value. Only the first byte is read, so it doesn't wait on the wider store
+// that wrote the value before
+static inline void MergeValueBits(unsigned char *data, BitSize_t bitOffset, uint64_t input, BitSize_t bitCount)
+{
+    unsigned char *out = data + (bitOffset >> 3);
+    const unsigned int offset = (unsigned int) (bitOffset & 7);
+    const uint64_t word = (uint64_t) (offset != 0 ? out[0] : 0) << 56 | input >> offset;
+    StoreBigEndianPartial(out, word, (unsigned int) ((offset + bitCount + 7) >> 3));
+}
+
+// LoadBits() returns at least this many valid bits, fewer only where the stream ends
+static const BitSize_t BITS_PER_LOAD = 57;
+
+// The bits from bitOffset on, starting at the most significant bit. Past the end of the stream they are garbage, and
+// the caller checks for that
+static inline uint64_t LoadBits(const unsigned char *data, BitSize_t usedBytes, BitSize_t bitOffset)
+{
+    const unsigned char *in = data + (bitOffset >> 3);
+    uint64_t word;
+    if ((BitSize_t) (in - data) + 8 <= usedBytes)
+        word = LoadBigEndian64(in);
+    else
+        word = LoadBigEndianPartial(in, (unsigned int) (usedBytes - (in - data)));
+    return word << (bitOffset & 7);
+}
+
+// Heap allocations and reallocations of data, by every BitStream
+static std::atomic<uint64_t> heapAllocationCount(0);
+
+// Bytes of a varint holding 64 bits, seven bits a byte
+static const unsigned int MAXIMUM_VARINT_BYTES = 10;
+
+// The top bitCount bits set, for bitCount from 0 to 64
+static inline uint64_t TopBits(BitSize_t bitCount)
+{
+    return bitCount >= 64 ? ~(uint64_t) 0 : ~(~(uint64_t) 0 >> bitCount);
+}
+
+// Index of the lowest set bit. word may not be 0
+static inline unsigned int LowestSetBit(uint64_t word)
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (unsigned int) index;
+#elif defined(__GNUC__)
+    return (unsigned int) __builtin_ctzll(word);
+#else
+    unsigned int index = 0;
+    while ((word & 1) == 0)
+    {
+        word >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+// Index counted from the most significant bit of the highest set bit. word may not be 0
+static inline unsigned int LeadingZeroBits(uint64_t word)
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanReverse64(&index, word);
+    return 63 - (unsigned int) index;
+#elif defined(__GNUC__)
+    return (unsigned int) __builtin_clzll(word);
+#else
+    unsigned int count = 0;
+    while ((word & ((uint64_t) 1 << 63)) == 0)
+    {
+        word <<= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
 BitStream::BitStream()
 {
     numberOfBitsUsed = 0;
@@ -57,6 +196,7 @@ BitStream::BitStream()
 
     //memset(data, 0, 32);
     copyData = true;
+    arena = nullptr;
 }
 
 BitStream::BitStream(unsigned int initialBytesToAllocate)
@@ -72,11 +212,23 @@ BitStream::BitStream(unsigned int initialBytesToAllocate)
     {
         data = (unsigned char *) malloc((size_t) initialBytesToAllocate);
         numberOfBitsAllocated = initialBytesToAllocate << 3;
+        heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
     }
 
     RakAssert(data);
     // memset(data, 0, initialBytesToAllocate);
     copyData = true;
+    arena = nullptr;
+}
+
+BitStream::BitStream(BitStreamArena *_arena)
+{
+    numberOfBitsUsed = 0;
+    numberOfBitsAllocated = BITSTREAM_STACK_ALLOCATION_SIZE * 8;
+    readOffset = 0;
+    data = (unsigned char *) stackData;
+    copyData = true;
+    arena = _arena;
 }
 
 BitStream::BitStream(unsigned char *_data, unsigned int lengthInBytes, bool _copyData)
@@ -85,6 +237,7 @@ BitStream::BitStream(unsigned char *_data, unsigned int lengthInBytes, bool _cop
     readOffset = 0;
     copyData = _copyData;
     numberOfBitsAllocated = lengthInBytes << 3;
+    arena = nullptr;
 
     if (copyData)
     {
@@ -96,7 +249,10 @@ BitStream::BitStream(unsigned char *_data, unsigned int lengthInBytes, bool _cop
                 numberOfBitsAllocated = BITSTREAM_STACK_ALLOCATION_SIZE << 3;
             }
             else
+            {
                 data = (unsigned char *) malloc((size_t) lengthInBytes);
+                heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+            }
 
             RakAssert(data);
             memcpy(data, _data, (size_t) lengthInBytes);
@@ -118,7 +274,23 @@ void BitStream::SetNumberOfBitsAllocated(BitSize_t lengthInBits)
 BitStream::~BitStream()
 {
     if (copyData && numberOfBitsAllocated > (BITSTREAM_STACK_ALLOCATION_SIZE << 3))
-        free(data);  // Use realloc and free so we are more efficient than delete and new for resizing
+    {
+        if (arena)
+            arena->Release(data, (size_t) BITS_TO_BYTES(numberOfBitsAllocated));
+        else
+            free(data);  // Use realloc and free so we are more efficient than delete and new for resizing
+    }
+}
+
+void BitStream::SetArena(BitStreamArena *_arena)
+{
+    RakAssert(data == (unsigned char *) stackData && "SetArena() after the stream left its stack buffer");
+    arena = _arena;
+}
+
+uint64_t BitStream::GetHeapAllocationCount(void)
+{
+    return heapAllocationCount.load(std::memory_order_relaxed);
 }
 
 void BitStream::Reset()
@@ -277,7 +449,8 @@ void BitStream::ResetWritePointer()
 // Write a 0
 void BitStream::Write0()
 {
-    AddBitsAndReallocate(1);
+    if (numberOfBitsUsed >= numberOfBitsAllocated)
+        AddBitsAndReallocate(1);
 
     // New bytes need to be zeroed
     if ((numberOfBitsUsed & 7) == 0)
@@ -289,7 +462,8 @@ void BitStream::Write0()
 // Write a 1
 void BitStream::Write1()
 {
-    AddBitsAndReallocate(1);
+    if (numberOfBitsUsed >= numberOfBitsAllocated)
+        AddBitsAndReallocate(1);
 
     BitSize_t numberOfBitsMod8 = numberOfBitsUsed & 7;
 
@@ -390,55 +564,86 @@ void BitStream::WriteBits(const unsigned char *inByteArray, BitSize_t numberOfBi
 {
 //    if (numberOfBitsToWrite<=0)
 //        return;
-    AddBitsAndReallocate(numberOfBitsToWrite);
-
-    const BitSize_t numberOfBitsUsedMod8 = numberOfBitsUsed & 7;
+    if (numberOfBitsUsed + numberOfBitsToWrite > numberOfBitsAllocated)
+        AddBitsAndReallocate(numberOfBitsToWrite);
 
     // If currently aligned and numberOfBits is a multiple of 8, just memcpy for speed
-    if (numberOfBitsUsedMod8 == 0 && (numberOfBitsToWrite & 7) == 0)
+    if ((numberOfBitsUsed & 7) == 0 && (numberOfBitsToWrite & 7) == 0)
     {
         memcpy(data + (numberOfBitsUsed >> 3), inByteArray, numberOfBitsToWrite >> 3);
         numberOfBitsUsed += numberOfBitsToWrite;
         return;
     }
 
-    const unsigned char *inputPtr = inByteArray;
-
-    // Faster to put the while at the top surprisingly enough
-    while (numberOfBitsToWrite > 0)
+    if (numberOfBitsToWrite <= 16)
     {
-        unsigned char dataByte = *(inputPtr++);
+        // Small values such as bools and enums. At most two bytes of input, so at most three of output
+        const unsigned int partialBits = (unsigned int) (numberOfBitsToWrite & 7);
+        uint32_t input = (uint32_t) inByteArray[0] << 24;
+        if (numberOfBitsToWrite > 8)
+            input |= (uint32_t) inByteArray[1] << 16;
+        if (partialBits != 0)
+        {
+            // rightAlignedBits means in the case of a partial byte, the bits are aligned from the right (bit 0) rather than
+            // the left (as in the normal internal representation)
+            const unsigned int lastByteShift = numberOfBitsToWrite > 8 ? 16 : 24;
+            uint32_t lastByte = (input >> lastByteShift) & 0xFF;
+            if (rightAlignedBits)
+                lastByte = (lastByte << (8 - partialBits)) & 0xFF;
+            else
+                lastByte &= 0xFF << (8 - partialBits);
+            input = (input & ~((uint32_t) 0xFF << lastByteShift)) | lastByte << lastByteShift;
+        }
 
-        // rightAlignedBits means in the case of a partial byte, the bits are aligned from the right (bit 0) rather than
-        // the left (as in the normal internal representation)
-        if (numberOfBitsToWrite < 8 && rightAlignedBits)
-            dataByte <<= 8 - numberOfBitsToWrite;  // shift left to get the bits on the left, as in our internal representation
+        unsigned char *out = data + (numberOfBitsUsed >> 3);
+        const unsigned int offset = (unsigned int) (numberOfBitsUsed & 7);
+        // Off a byte boundary the first byte is ORed into, as writing byte by byte did
+        const uint32_t word = (uint32_t) (offset != 0 ? out[0] : 0) << 24 | input >> offset;
+        out[0] = (unsigned char) (word >> 24);
+        if (offset + numberOfBitsToWrite > 8)
+            out[1] = (unsigned char) (word >> 16);
+        if (offset + numberOfBitsToWrite > 16)
+            out[2] = (unsigned char) (word >> 8);
+        numberOfBitsUsed += numberOfBitsToWrite;
+        return;
+    }
 
-        // Writing to a new byte each time
-        if (numberOfBitsUsedMod8 == 0) *(data + (numberOfBitsUsed >> 3)) = dataByte;
+    const BitSize_t allocatedBytes = BITS_TO_BYTES(numberOfBitsAllocated);
+    while (numberOfBitsToWrite > 0)
+    {
+        // Next whole bytes of input, most significant bit first
+        BitSize_t stepBits;
+        uint64_t input;
+        if (numberOfBitsToWrite >= 64)
+        {
+            stepBits = BITS_PER_WORD_STEP;
+            input = LoadBigEndian64(inByteArray) & ~(uint64_t) 0xFF;
+        }
         else
         {
-            // Copy over the new data.
-            *(data + (numberOfBitsUsed >> 3)) |= dataByte >> (numberOfBitsUsedMod8); // First half
+            stepBits = numberOfBitsToWrite < BITS_PER_WORD_STEP ? numberOfBitsToWrite : BITS_PER_WORD_STEP;
+            unsigned int stepBytes = (unsigned int) BITS_TO_BYTES(stepBits);
+            input = LoadBigEndianPartial(inByteArray, stepBytes);
 
-            // If we didn't write it all out in the first half (8 - (numberOfBitsUsed%8) is the number we wrote in the first half)
-            if (8 - (numberOfBitsUsedMod8) < 8 && 8 - (numberOfBitsUsedMod8) < numberOfBitsToWrite)
+            unsigned int partialBits = (unsigned int) (stepBits & 7);
+            if (partialBits != 0)
             {
-                // Second half (overlaps byte boundary)
-                *(data + (numberOfBitsUsed >> 3) + 1) = dataByte << (8 - (numberOfBitsUsedMod8));
+                // rightAlignedBits means in the case of a partial byte, the bits are aligned from the right (bit 0) rather than
+                // the left (as in the normal internal representation)
+                unsigned char lastByte = inByteArray[stepBytes - 1];
+                if (rightAlignedBits)
+                    lastByte = (unsigned char) (lastByte << (8 - partialBits));
+                else
+                    lastByte &= (unsigned char) (0xFF << (8 - partialBits));
+                input = (input & ~((uint64_t) 0xFF << (64 - 8 * stepBytes))) | (uint64_t) lastByte << (64 - 8 * stepBytes);
             }
         }
 
-        if (numberOfBitsToWrite >= 8)
-        {
-            numberOfBitsUsed += 8;
-            numberOfBitsToWrite -= 8;
-        }
-        else
-        {
-            numberOfBitsUsed += numberOfBitsToWrite;
-            numberOfBitsToWrite = 0;
-        }
+        MergeBits(data, allocatedBytes, numberOfBitsUsed, input, stepBits);
+
+        inByteArray += stepBits >> 3;
+        numberOfBitsUsed += stepBits;
+        numberOfBitsToWrite -= stepBits;
     }
 }
 
@@ -452,6 +657,12 @@ void BitStream::SetData(unsigned char *inByteArray)
 // Assume the input source points to a native type, compress and write it
 void BitStream::WriteCompressed(const unsigned char *inByteArray, unsigned int size, bool unsignedData)
 {
+    if (size <= 64 && (size & 7) == 0 && size != 0)
+    {
+        WriteCompressedWord(LoadBigEndianPartial(inByteArray, size >> 3), size >> 3, unsignedData);
+        return;
+    }
+
     BitSize_t currentByte = (size >> 3) - 1; // PCs
 
     unsigned char byteMatch;
@@ -506,53 +717,39 @@ bool BitStream::ReadBits(unsigned char *inOutByteArray, BitSize_t numberOfBitsTo
     if (readOffset + numberOfBitsToRead > numberOfBitsUsed)
         return false;
 
-    const BitSize_t readOffsetMod8 = readOffset & 7;
-
     // If currently aligned and numberOfBits is a multiple of 8, just memcpy for speed
-    if (readOffsetMod8 == 0 && (numberOfBitsToRead & 7) == 0)
+    if ((readOffset & 7) == 0 && (numberOfBitsToRead & 7) == 0)
     {
         memcpy(inOutByteArray, data + (readOffset >> 3), numberOfBitsToRead >> 3);
         readOffset += numberOfBitsToRead;
         return true;
     }
 
-    BitSize_t offset = 0;
-
-    memset(inOutByteArray, 0, (size_t) BITS_TO_BYTES(numberOfBitsToRead));
-
+    const BitSize_t usedBytes = BITS_TO_BYTES(numberOfBitsUsed);
     while (numberOfBitsToRead > 0)
     {
-        *(inOutByteArray + offset) |= *(data + (readOffset >> 3)) << (readOffsetMod8); // First half
+        const BitSize_t stepBits = numberOfBitsToRead < BITS_PER_WORD_STEP ? numberOfBitsToRead : BITS_PER_WORD_STEP;
+        const unsigned int stepBytes = (unsigned int) BITS_TO_BYTES(stepBits);
 
-        // If we have a second half, we didn't read enough bytes in the first half
-        if (readOffsetMod8 > 0 && numberOfBitsToRead > 8 - (readOffsetMod8))
-            *(inOutByteArray + offset) |= *(data + (readOffset >> 3) + 1) >> (8 - (readOffsetMod8)); // Second half (overlaps byte boundary)
+        const uint64_t word = LoadBits(data, usedBytes, readOffset) & TopBits(stepBits);
 
-        if (numberOfBitsToRead >= 8)
+        if (numberOfBitsToRead > stepBits)
         {
-            numberOfBitsToRead -= 8;
-            readOffset += 8;
-            offset++;
+            // The byte after the step is written too, and overwritten by the next one
+            StoreBigEndian64(inOutByteArray, word);
         }
         else
         {
-            int neg = (int) numberOfBitsToRead - 8;
-
-            if (neg < 0)   // Reading a partial byte for the last byte, shift right so the data is aligned on the right
-            {
-
-                if (alignBitsToRight)
-                    *(inOutByteArray + offset) >>= -neg;
-
-                readOffset += 8 + neg;
-            }
-            else
-                readOffset += 8;
+            StoreBigEndianPartial(inOutByteArray, word, stepBytes);
 
-            offset++;
-
-            numberOfBitsToRead = 0;
+            // Reading a partial byte for the last byte, shift right so the data is aligned on the right
+            if ((stepBits & 7) != 0 && alignBitsToRight)
+                inOutByteArray[stepBytes - 1] >>= 8 - (stepBits & 7);
         }
+
+        inOutByteArray += stepBits >> 3;
+        readOffset += stepBits;
+        numberOfBitsToRead -= stepBits;
     }
 
     return true;
@@ -561,6 +758,15 @@ bool BitStream::ReadBits(unsigned char *inOutByteArray, BitSize_t numberOfBitsTo
 // Assume the input source points to a compressed native type. Decompress and read it
 bool BitStream::ReadCompressed(unsigned char *inOutByteArray, unsigned int size, bool unsignedData)
 {
+    if (size <= 64 && (size & 7) == 0 && size != 0)
+    {
+        uint64_t word;
+        if (!ReadCompressedWord(word, size >> 3, unsignedData))
+            return false;
+        StoreBigEndianPartial(inOutByteArray, word, size >> 3);
+        return true;
+    }
+
     unsigned char byteMatch, halfByteMatch;
 
     if (unsignedData)
@@ -623,6 +829,170 @@ bool BitStream::ReadCompressed(unsigned char *inOutByteArray, unsigned int size,
     return true;
 }
 
+// WriteCompressed() for up to 8 bytes. Writes the same bits, with the matching bytes counted at once and the prefix
+// and the remaining bytes merged in one or two words
+void BitStream::WriteCompressedWord(uint64_t word, unsigned int byteCount, bool unsignedData)
+{
+    // The first byte is the top of the word, so the bytes WriteCompressed() checks from the high end are the low bytes
+    // of the word
+    const uint64_t valueBits = ~(uint64_t) 0 << (64 - 8 * byteCount);
+    const uint64_t differing = (unsignedData ? word : ~word & valueBits) >> (64 - 8 * byteCount);
+    unsigned int matchingBytes = differing == 0 ? byteCount - 1 : LowestSetBit(differing) >> 3;
+    if (matchingBytes > byteCount - 1)
+        matchingBytes = byteCount - 1;
+
+    // A 1 for each matching byte, then a 0 and the remaining bytes. If all but the first byte match, a 1 instead and
+    // only its low 4 bits if its high 4 bits match too
+    uint64_t payload;
+    BitSize_t payloadBits;
+    bool flag = false;
+    if (matchingBytes < byteCount - 1)
+    {
+        payloadBits = 8 * (byteCount - matchingBytes);
+        payload = word & TopBits(payloadBits);
+    }
+    else
+    {
+        const unsigned char firstByte = (unsigned char) (word >> 56);
+        flag = (firstByte & 0xF0) == (unsignedData ? 0x00 : 0xF0);
+        payloadBits = flag ? 4 : 8;
+        payload = flag ? (uint64_t) (firstByte & 0x0F) << 60 : (uint64_t) firstByte << 56;
+    }
+
+    const BitSize_t prefixBits = matchingBytes + 1;
+    const uint64_t prefix = TopBits(matchingBytes) |
+                            (flag ? (uint64_t) 1 << (63 - matchingBytes) : 0);
+    const BitSize_t totalBits = prefixBits + payloadBits;
+    if (numberOfBitsUsed + totalBits > numberOfBitsAllocated)
+        AddBitsAndReallocate(totalBits);
+
+    const uint64_t head = prefix | payload >> prefixBits;
+    if (totalBits <= BITS_PER_WORD_STEP)
+        MergeValueBits(data, numberOfBitsUsed, head, totalBits);
+    else
+    {
+        MergeValueBits(data, numberOfBitsUsed, head & TopBits(BITS_PER_WORD_STEP), BITS_PER_WORD_STEP);
+        MergeValueBits(data, numberOfBitsUsed + BITS_PER_WORD_STEP, payload << (BITS_PER_WORD_STEP - prefixBits),
+                       totalBits - BITS_PER_WORD_STEP);
+    }
+    numberOfBitsUsed += totalBits;
+}
+
+// ReadCompressed() for up to 8 bytes
+bool BitStream::ReadCompressedWord(uint64_t &word, unsigned int byteCount, bool unsignedData)
+{
+    if (readOffset >= numberOfBitsUsed)
+        return false;
+    const BitSize_t unreadBits = numberOfBitsUsed - readOffset;
+    const BitSize_t usedBytes = BITS_TO_BYTES(numberOfBitsUsed);
+    const uint64_t head = LoadBits(data, usedBytes, readOffset);
+
+    // The 1s for matching bytes, and the bit after them
+    unsigned int matchingBytes = ~head == 0 ? 64 : LeadingZeroBits(~head);
+    if (matchingBytes > byteCount - 1)
+        matchingBytes = byteCount - 1;
+    const BitSize_t prefixBits = matchingBytes + 1;
+    if (prefixBits > unreadBits)
+        return false;
+
+    const uint64_t valueBits = ~(uint64_t) 0 << (64 - 8 * byteCount);
+    const uint64_t matchWord = unsignedData ? 0 : valueBits;
+    BitSize_t payloadBits;
+    if (matchingBytes < byteCount - 1)
+    {
+        payloadBits = 8 * (byteCount - matchingBytes);
+        if (prefixBits + payloadBits > unreadBits)
+            return false;
+        const uint64_t payloadMask = TopBits(payloadBits);
+        uint64_t payload;
+        if (prefixBits + payloadBits <= BITS_PER_LOAD)
+            payload = head << prefixBits;
+        else
+        {
+            payload = LoadBits(data, usedBytes, readOffset + prefixBits);
+            if (payloadBits > BITS_PER_LOAD)
+                payload = (payload & TopBits(BITS_PER_WORD_STEP)) |
+                          LoadBits(data, usedBytes, readOffset + prefixBits + BITS_PER_WORD_STEP) >> BITS_PER_WORD_STEP;
+        }
+        word = (payload & payloadMask) | (matchWord & ~payloadMask);
+    }
+    else
+    {
+        const bool flag = (head >> (63 - matchingBytes) & 1) != 0;
+        payloadBits = flag ? 4 : 8;
+        if (prefixBits + payloadBits > unreadBits)
+            return false;
+        unsigned char firstByte = (unsigned char) (head << prefixBits >> (64 - payloadBits));
+        if (flag)
+            firstByte |= unsignedData ? 0x00 : 0xF0;
+        word = (uint64_t) firstByte << 56 | (matchWord & ~((uint64_t) 0xFF << 56));
+    }
+
+    readOffset += prefixBits + payloadBits;
+    return true;
+}
+
+// LEB128. Seven bits a byte, the low bits first, with the high bit set on every byte but the last
+void BitStream::WriteVarIntWord(uint64_t word)
+{
+    const unsigned int byteCount = word == 0 ? 1 : (64 - LeadingZeroBits(word) + 6) / 7;
+    const BitSize_t bitCount = BYTES_TO_BITS(byteCount);
+    if (numberOfBitsUsed + bitCount > numberOfBitsAllocated)
+        AddBitsAndReallocate(bitCount);
+
+    if ((numberOfBitsUsed & 7) == 0)
+    {
+        // Aligned, so the bytes go straight into the stream
+        unsigned char *out = data + (numberOfBitsUsed >> 3);
+        for (unsigned int i = 0; i < byteCount - 1; i++, word >>= 7)
+            out[i] = (unsigned char) (word | 0x80);
+        out[byteCount - 1] = (unsigned char) word;
+        numberOfBitsUsed += bitCount;
+        return;
+    }
+
+    // Off a byte boundary, up to seven bytes are put together in a word and merged in at once
+    unsigned int i = 0;
+    while (i < byteCount)
+    {
+        const unsigned int wordBytes = byteCount - i < 7 ? byteCount - i : 7;
+        uint64_t bytes = 0;
+        for (unsigned int j = 0; j < wordBytes; j++, i++, word >>= 7)
+            bytes |= (uint64_t) ((word & 0x7F) | (i < byteCount - 1 ? 0x80 : 0)) << (56 - 8 * j);
+        MergeValueBits(data, numberOfBitsUsed, bytes, BYTES_TO_BITS(wordBytes));
+        numberOfBitsUsed += BYTES_TO_BITS(wordBytes);
+    }
+}
+
+bool BitStream::ReadVarIntWord(uint64_t &word)
+{
+    if (readOffset >= numberOfBitsUsed)
+        return false;
+    BitSize_t unreadBytes = (numberOfBitsUsed - readOffset) >> 3;
+    if (unreadBytes > MAXIMUM_VARINT_BYTES)
+        unreadBytes = MAXIMUM_VARINT_BYTES;
+    const unsigned char *in = data + (readOffset >> 3);
+    const unsigned int offset = (unsigned int) (readOffset & 7);
+
+    uint64_t result = 0;
+    for (unsigned int i = 0; i < unreadBytes; i++)
+    {
+        // Off a byte boundary each byte straddles two. The second is in the stream, as a whole byte is unread
+        const unsigned char byte = offset == 0 ? in[i] : (unsigned char) (in[i] << offset | in[i + 1] >> (8 - offset));
+        result |= (uint64_t) (byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0)
+        {
+            // The last of ten bytes only has the top bit of the word
+            if (i == MAXIMUM_VARINT_BYTES - 1 && byte > 1)
+                return false;
+            word = result;
+            readOffset += BYTES_TO_BITS(i + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
 // Reallocates (if necessary) in preparation of writing numberOfBitsToWrite
 void BitStream::AddBitsAndReallocate(BitSize_t numberOfBitsToWrite)
 {
@@ -651,7 +1021,13 @@ void BitStream::AddBitsAndReallocate(BitSize_t numberOfBitsToWrite)
         {
             if (amountToAllocate > BITSTREAM_STACK_ALLOCATION_SIZE)
             {
-                data = (unsigned char *) malloc((size_t) amountToAllocate);
+                if (arena)
+                    data = (unsigned char *) arena->Allocate((size_t) amountToAllocate);
+                else
+                {
+                    data = (unsigned char *) malloc((size_t) amountToAllocate);
+                    heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+                }
                 RakAssert(data);  // TODO: introduce optional exceptions instead RakAssert
 
                 // need to copy the stack data over to our new memory area too
@@ -659,6 +1035,9 @@ void BitStream::AddBitsAndReallocate(BitSize_t numberOfBitsToWrite)
 
             }
         }
+        else if (arena)
+            data = (unsigned char *) arena->Reallocate(data, (size_t) BITS_TO_BYTES(numberOfBitsAllocated),
+                                                       (size_t) amountToAllocate);
         else
         {
             auto tmp = (unsigned char *) realloc(data, (size_t) amountToAllocate);
@@ -667,6 +1046,7 @@ void BitStream::AddBitsAndReallocate(BitSize_t numberOfBitsToWrite)
             {
                 data = tmp;
             }
+            heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
         }
 
         //  memset(data+newByteOffset, 0,  ((newNumberOfBitsAllocated-1)>>3) - ((numberOfBitsAllocated-1)>>3)); // Set the new data block to 0
@@ -864,6 +1244,7 @@ void BitStream::AssertCopyData()
         if (numberOfBitsAllocated > 0)
         {
             auto newdata = (unsigned char *) malloc((size_t) BITS_TO_BYTES(numberOfBitsAllocated));
+            heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
 
             RakAssert(newdata); // TODO: introduce optional exceptions instead RakAssert
 
@@ -0,0 +1,155 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "BitStreamArena.h"
+#include "RakAssert.h"
+#include <stdlib.h>
+#include <string.h>
+
+using namespace RakNet;
+
+// Allocations are rounded up to this, so every one starts aligned as the block does
+static const size_t ALLOCATION_ALIGNMENT = 8;
+
+static inline size_t RoundUp(size_t size)
+{
+    return (size + ALLOCATION_ALIGNMENT - 1) & ~(ALLOCATION_ALIGNMENT - 1);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+BitStreamArena::BitStreamArena(unsigned int _blockSize)
+{
+    blockSize = RoundUp(_blockSize > 0 ? _blockSize : 1);
+    blocks = 0;
+    top = 0;
+    end = 0;
+    fullBlockBytes = 0;
+    peakBytesUsed = 0;
+    allocationCount = 0;
+    heapAllocationCount = 0;
+    liveAllocationCount = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+BitStreamArena::~BitStreamArena()
+{
+    RakAssert(liveAllocationCount == 0 && "A BitStream using this arena outlived it");
+    while (blocks)
+    {
+        Block *next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void *BitStreamArena::Allocate(size_t size)
+{
+    size = RoundUp(size > 0 ? size : 1);
+    if ((size_t) (end - top) < size)
+    {
+        // The rest of the current block is left unused
+        if (blocks)
+            fullBlockBytes += (size_t) (top - GetBlockData(blocks));
+        AddBlock(size > blockSize ? size : blockSize);
+    }
+
+    unsigned char *data = top;
+    top += size;
+    UpdatePeakBytesUsed();
+    allocationCount++;
+    liveAllocationCount++;
+    return data;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void *BitStreamArena::Reallocate(void *data, size_t size, size_t newSize)
+{
+    // At the end of what was handed out, it can grow in place until the block is full
+    unsigned char *bytes = (unsigned char *) data;
+    const size_t roundedNewSize = RoundUp(newSize > 0 ? newSize : 1);
+    if (bytes + RoundUp(size > 0 ? size : 1) == top && (size_t) (end - bytes) >= roundedNewSize)
+    {
+        top = bytes + roundedNewSize;
+        UpdatePeakBytesUsed();
+        return data;
+    }
+
+    void *newData = Allocate(newSize);
+    memcpy(newData, data, size < newSize ? size : newSize);
+    Release(data, size);
+    return newData;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void BitStreamArena::Release(void *data, size_t size)
+{
+    RakAssert(liveAllocationCount > 0);
+    liveAllocationCount--;
+    // Only the current block ends at top, so data from a full block never matches
+    unsigned char *bytes = (unsigned char *) data;
+    if (bytes + RoundUp(size > 0 ? size : 1) == top)
+        top = bytes;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void BitStreamArena::Reset(void)
+{
+    RakAssert(liveAllocationCount == 0 && "Reset while a BitStream still uses this arena");
+    if (blocks == 0)
+        return;
+
+    // Size the arena for a frame like this one, so the next takes nothing from the heap
+    if (blocks->next)
+    {
+        while (blocks)
+        {
+            Block *next = blocks->next;
+            free(blocks);
+            blocks = next;
+        }
+        AddBlock(peakBytesUsed > blockSize ? peakBytesUsed : blockSize);
+    }
+    else
+        top = GetBlockData(blocks);
+
+    fullBlockBytes = 0;
+    peakBytesUsed = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+size_t BitStreamArena::GetBytesUsed(void) const
+{
+    if (blocks == 0)
+        return 0;
+    return fullBlockBytes + (size_t) (top - GetBlockData(blocks));
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void BitStreamArena::UpdatePeakBytesUsed(void)
+{
+    const size_t bytesUsed = GetBytesUsed();
+    if (bytesUsed > peakBytesUsed)
+        peakBytesUsed = bytesUsed;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void BitStreamArena::AddBlock(size_t size)
+{
+    Block *block = (Block *) malloc(sizeof(Block) + size);
+    RakAssert(block);  // TODO: introduce optional exceptions instead RakAssert
+    block->next = blocks;
+    block->size = size;
+    blocks = block;
+    top = GetBlockData(block);
+    end = top + size;
+    heapAllocationCount++;
+}
@@ -0,0 +1,619 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "CCRakNetBBR.h"
+#include "MTUSize.h"
+#include "Rand.h"
+#include "RakAssert.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace RakNet;
+
+static const double UNSET_TIME_US = -1;
+
+#if CC_TIME_TYPE_BYTES == 4
+static const CCTimeType SYN = 10;
+static const CCTimeType MIN_RTT_WINDOW = 10000;
+static const CCTimeType PROBE_RTT_DURATION = 200;
+static const CCTimeType MAX_PACING_BURST_TIME = 2;
+#else
+static const CCTimeType SYN = 10000;
+static const CCTimeType MIN_RTT_WINDOW = 10000000;
+static const CCTimeType PROBE_RTT_DURATION = 200000;
+static const CCTimeType MAX_PACING_BURST_TIME = 2000;
+#endif
+
+// 2/ln(2), the smallest gain that still doubles the delivery rate every round trip
+static const double HIGH_GAIN = 2.885;
+static const double DRAIN_GAIN = 1.0 / 2.885;
+static const double CWND_GAIN = 2.0;
+static const double PACING_GAIN_CYCLE[] = {1.25, 0.75, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0};
+static const unsigned int PACING_GAIN_CYCLE_LENGTH = sizeof(PACING_GAIN_CYCLE) / sizeof(PACING_GAIN_CYCLE[0]);
+static const double FULL_BANDWIDTH_GROWTH = 1.25;
+static const uint32_t FULL_BANDWIDTH_ROUNDS = 3;
+static const uint32_t INITIAL_WINDOW_DATAGRAMS = 10;
+static const uint32_t MIN_PIPE_DATAGRAMS = 4;
+
+// ----------------------------------------------------------------------------------------------------------------------------
+CCRakNetBBR::CCRakNetBBR()
+{
+    Init(0, MAXIMUM_MTU_SIZE - UDP_HEADER_SIZE);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::Init(CCTimeType curTime, uint32_t maxDatagramPayload)
+{
+    RakAssert(maxDatagramPayload <= MAXIMUM_MTU_SIZE);
+    MAXIMUM_MTU_INCLUDING_UDP_HEADER = maxDatagramPayload;
+    nextDatagramSequenceNumber = 0;
+    expectedNextSequenceNumber = 0;
+
+    cwnd = priorCwnd = (double) INITIAL_WINDOW_DATAGRAMS * MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+    pacingBudget = cwnd;
+    lastPacingRefill = curTime;
+
+    delivered = 0;
+    deliveredTime = curTime;
+    roundCount = 0;
+    nextRoundDelivered = 0;
+    roundStart = false;
+
+    for (unsigned int i = 0; i < CC_BBR_BANDWIDTH_FILTER_ROUNDS; i++)
+        bandwidthSamples[i] = 0;
+    btlBw = 0;
+    fullBw = 0;
+    fullBwCount = 0;
+    fullBwReached = false;
+
+    minRtt = 0;
+    minRttStamp = curTime;
+    minRttSet = false;
+    minRttExpired = false;
+    probeRttDoneStamp = 0;
+    probeRttRoundDone = false;
+
+    cycleIndex = 0;
+    cycleStamp = curTime;
+
+    lastUnacknowledgedBytes = 0;
+    lastIsContinuousSend = false;
+
+    for (unsigned int i = 0; i < CC_BBR_SEND_HISTORY_LENGTH; i++)
+        sendHistory[i].isValid = false;
+
+    lastRtt = estimatedRTT = deviationRtt = UNSET_TIME_US;
+    oldestUnsentAck = 0;
+
+    EnterStartup();
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::Update(CCTimeType curTime, bool hasDataToSendOrResend)
+{
+    (void) curTime;
+    (void) hasDataToSendOrResend;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+int CCRakNetBBR::GetRetransmissionBandwidth(CCTimeType curTime, CCTimeType timeSinceLastTick,
+                                            uint32_t unacknowledgedBytes, bool isContinuousSend)
+{
+    (void) timeSinceLastTick;
+    (void) isContinuousSend;
+
+    lastUnacknowledgedBytes = unacknowledgedBytes;
+    RefillPacing(curTime);
+
+    // Resends are not limited by the window, they are already counted in it
+    if (GetPacingRate() == 0)
+        return unacknowledgedBytes;
+    if (pacingBudget <= 0)
+        return 0;
+    if (pacingBudget < (double) unacknowledgedBytes)
+        return (int) pacingBudget;
+    return unacknowledgedBytes;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+int CCRakNetBBR::GetTransmissionBandwidth(CCTimeType curTime, CCTimeType timeSinceLastTick,
+                                          uint32_t unacknowledgedBytes, bool isContinuousSend)
+{
+    (void) timeSinceLastTick;
+
+    lastUnacknowledgedBytes = unacknowledgedBytes;
+    lastIsContinuousSend = isContinuousSend;
+    RefillPacing(curTime);
+
+    if ((double) unacknowledgedBytes >= cwnd)
+        return 0;
+
+    double allowed = cwnd - (double) unacknowledgedBytes;
+    if (GetPacingRate() > 0 && pacingBudget < allowed)
+        allowed = pacingBudget;
+    if (allowed <= 0)
+        return 0;
+    return (int) allowed;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+bool CCRakNetBBR::ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToNextTick)
+{
+    (void) estimatedTimeToNextTick;
+
+    if (lastRtt == UNSET_TIME_US)
+        return true;
+    return curTime >= oldestUnsentAck + SYN;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+CCTimeType CCRakNetBBR::GetNextACKTime(CCTimeType curTime) const
+{
+    if (lastRtt == UNSET_TIME_US)
+        return curTime;
+    return oldestUnsentAck + SYN;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnSendBytes(CCTimeType curTime, uint32_t numBytes)
+{
+    (void) curTime;
+
+    if (GetPacingRate() > 0)
+        pacingBudget -= (double) numBytes;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnSendDatagram(CCTimeType curTime, DatagramSequenceNumberType datagramSequenceNumber, uint32_t sizeInBytes)
+{
+    // Nothing was in flight, so the delivery rate is measured from now rather than from the last ack
+    if (lastUnacknowledgedBytes == 0)
+        deliveredTime = curTime;
+
+    SendRecord &record = sendHistory[datagramSequenceNumber.val % CC_BBR_SEND_HISTORY_LENGTH];
+    record.datagramNumber = datagramSequenceNumber;
+    record.isValid = true;
+    record.isAppLimited = !lastIsContinuousSend;
+    record.sizeInBytes = sizeInBytes;
+    record.delivered = delivered;
+    record.deliveredTime = deliveredTime;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+bool CCRakNetBBR::GetNextSendTime(CCTimeType curTime, CCTimeType *sendTime) const
+{
+    BytesPerMicrosecond pacingRate = GetPacingRate();
+    if (pacingRate <= 0)
+        return false;
+
+    // Only an ack can open a full window
+    if ((double) lastUnacknowledgedBytes + MAXIMUM_MTU_INCLUDING_UDP_HEADER > cwnd)
+        return false;
+
+    double budget = pacingBudget;
+    if (curTime > lastPacingRefill)
+        budget += pacingRate * (double) (curTime - lastPacingRefill);
+    if (budget >= MAXIMUM_MTU_INCLUDING_UDP_HEADER)
+        *sendTime = curTime;
+    else
+        *sendTime = curTime + (CCTimeType) ((MAXIMUM_MTU_INCLUDING_UDP_HEADER - budget) / pacingRate) + 1;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnGotPacketPair(DatagramSequenceNumberType datagramSequenceNumber, uint32_t sizeInBytes,
+                                  CCTimeType curTime)
+{
+    (void) datagramSequenceNumber;
+    (void) sizeInBytes;
+    (void) curTime;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+bool CCRakNetBBR::OnGotPacket(DatagramSequenceNumberType datagramSequenceNumber, bool isContinuousSend,
+                              CCTimeType curTime, uint32_t sizeInBytes, uint32_t *skippedMessageCount)
+{
+    (void) isContinuousSend;
+    (void) sizeInBytes;
+
+    if (oldestUnsentAck == 0)
+        oldestUnsentAck = curTime;
+
+    if (datagramSequenceNumber == expectedNextSequenceNumber)
+    {
+        *skippedMessageCount = 0;
+        expectedNextSequenceNumber = datagramSequenceNumber + (DatagramSequenceNumberType) 1;
+    }
+    else if (GreaterThan(datagramSequenceNumber, expectedNextSequenceNumber))
+    {
+        *skippedMessageCount = datagramSequenceNumber - expectedNextSequenceNumber;
+        // Sanity check, just use timeout resend if this was really valid
+        if (*skippedMessageCount > 1000)
+        {
+            // During testing, the nat punchthrough server got 51200 on the first packet. I have no idea where this comes from, but has happened twice
+            if (*skippedMessageCount > (uint32_t) 50000)
+                return false;
+            *skippedMessageCount = 1000;
+        }
+        expectedNextSequenceNumber = datagramSequenceNumber + (DatagramSequenceNumberType) 1;
+    }
+    else
+        *skippedMessageCount = 0;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnResend(CCTimeType curTime, RakNet::TimeUS nextActionTime)
+{
+    (void) curTime;
+    (void) nextActionTime;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnNAK(CCTimeType curTime, DatagramSequenceNumberType nakSequenceNumber)
+{
+    (void) curTime;
+    (void) nakSequenceNumber;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnAck(CCTimeType curTime, CCTimeType rtt, bool hasBAndAS, BytesPerMicrosecond _B,
+                        BytesPerMicrosecond _AS, double totalUserDataBytesAcked, bool isContinuousSend,
+                        DatagramSequenceNumberType sequenceNumber)
+{
+    (void) hasBAndAS;
+    (void) _B;
+    (void) _AS;
+    (void) totalUserDataBytesAcked;
+    (void) isContinuousSend;
+
+    lastRtt = (double) rtt;
+    if (estimatedRTT == UNSET_TIME_US)
+    {
+        estimatedRTT = (double) rtt;
+        deviationRtt = (double) rtt;
+    }
+    else
+    {
+        double d = .05;
+        double difference = rtt - estimatedRTT;
+        estimatedRTT = estimatedRTT + d * difference;
+        deviationRtt = deviationRtt + d * (std::abs(difference) - deviationRtt);
+    }
+
+    UpdateMinRTT(curTime, rtt);
+
+    uint32_t bytesAcked = 0;
+    roundStart = false;
+    SendRecord &record = sendHistory[sequenceNumber.val % CC_BBR_SEND_HISTORY_LENGTH];
+    if (record.isValid && record.datagramNumber == sequenceNumber)
+    {
+        record.isValid = false;
+        bytesAcked = record.sizeInBytes;
+        delivered += bytesAcked;
+        deliveredTime = curTime;
+
+        if (record.delivered >= nextRoundDelivered)
+        {
+            nextRoundDelivered = delivered;
+            roundCount++;
+            roundStart = true;
+            // The oldest round leaves the filter
+            bandwidthSamples[roundCount % CC_BBR_BANDWIDTH_FILTER_ROUNDS] = 0;
+        }
+
+        BytesPerMicrosecond deliveryRate = 0;
+        if (curTime > record.deliveredTime)
+            deliveryRate = (double) (delivered - record.delivered) / (double) (curTime - record.deliveredTime);
+        UpdateBandwidthFilter(deliveryRate, record.isAppLimited);
+        CheckFullBandwidthReached(record.isAppLimited);
+    }
+
+    UpdateMode(curTime);
+    UpdateCongestionWindow(bytesAcked);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnDuplicateAck(CCTimeType curTime, DatagramSequenceNumberType sequenceNumber)
+{
+    (void) curTime;
+    (void) sequenceNumber;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnSendAckGetBAndAS(CCTimeType curTime, bool *hasBAndAS, BytesPerMicrosecond *_B,
+                                     BytesPerMicrosecond *_AS)
+{
+    (void) curTime;
+    (void) _B;
+    (void) _AS;
+
+    *hasBAndAS = false;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnSendAck(CCTimeType curTime, uint32_t numBytes)
+{
+    (void) curTime;
+    (void) numBytes;
+
+    oldestUnsentAck = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnSendNACK(CCTimeType curTime, uint32_t numBytes)
+{
+    (void) curTime;
+    (void) numBytes;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+CCTimeType CCRakNetBBR::GetRTOForRetransmission(unsigned char timesSent) const
+{
+    (void) timesSent;
+
+#if CC_TIME_TYPE_BYTES == 4
+    const CCTimeType maxThreshold = 2000;
+    const CCTimeType additionalVariance = 30;
+#else
+    const CCTimeType maxThreshold = 2000000;
+    const CCTimeType additionalVariance = 30000;
+#endif
+
+    if (estimatedRTT == UNSET_TIME_US)
+        return maxThreshold;
+
+    CCTimeType threshhold = (CCTimeType) (2.0 * estimatedRTT + 4.0 * deviationRtt) + additionalVariance;
+    if (threshhold > maxThreshold)
+        return maxThreshold;
+    return threshhold;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::SetMTU(uint32_t bytes)
+{
+    RakAssert(bytes < MAXIMUM_MTU_SIZE);
+    MAXIMUM_MTU_INCLUDING_UDP_HEADER = bytes;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+uint32_t CCRakNetBBR::GetMTU(void) const
+{
+    return MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+BytesPerMicrosecond CCRakNetBBR::GetLocalReceiveRate(CCTimeType currentTime) const
+{
+    (void) currentTime;
+
+    return 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+double CCRakNetBBR::GetRTT(void) const
+{
+    if (lastRtt == UNSET_TIME_US)
+        return 0.0;
+    return lastRtt;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+uint64_t CCRakNetBBR::GetBytesPerSecondLimitByCongestionControl(void) const
+{
+    return (uint64_t) (GetPacingRate() * 1000000.0);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::EnterStartup(void)
+{
+    mode = STARTUP;
+    pacingGain = HIGH_GAIN;
+    cwndGain = HIGH_GAIN;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::EnterProbeBW(CCTimeType curTime)
+{
+    mode = PROBE_BW;
+    cwndGain = CWND_GAIN;
+
+    // Start anywhere but the 0.75 phase, so connections that started together do not probe in lockstep
+    cycleIndex = randomMT() % (PACING_GAIN_CYCLE_LENGTH - 1);
+    if (cycleIndex >= 1)
+        cycleIndex++;
+    pacingGain = PACING_GAIN_CYCLE[cycleIndex];
+    cycleStamp = curTime;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::UpdateBandwidthFilter(BytesPerMicrosecond deliveryRate, bool isAppLimited)
+{
+    // When the application did not keep the connection busy, the rate only says the bottleneck is at least this fast
+    if (isAppLimited == false || deliveryRate > btlBw)
+    {
+        BytesPerMicrosecond &sample = bandwidthSamples[roundCount % CC_BBR_BANDWIDTH_FILTER_ROUNDS];
+        if (deliveryRate > sample)
+            sample = deliveryRate;
+    }
+
+    btlBw = 0;
+    for (unsigned int i = 0; i < CC_BBR_BANDWIDTH_FILTER_ROUNDS; i++)
+    {
+        if (bandwidthSamples[i] > btlBw)
+            btlBw = bandwidthSamples[i];
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::CheckFullBandwidthReached(bool isAppLimited)
+{
+    if (fullBwReached || roundStart == false || isAppLimited)
+        return;
+
+    if (btlBw >= fullBw * FULL_BANDWIDTH_GROWTH)
+    {
+        fullBw = btlBw;
+        fullBwCount = 0;
+        return;
+    }
+
+    if (++fullBwCount >= FULL_BANDWIDTH_ROUNDS)
+        fullBwReached = true;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::UpdateMode(CCTimeType curTime)
+{
+    if (mode == STARTUP && fullBwReached)
+    {
+        mode = DRAIN;
+        pacingGain = DRAIN_GAIN;
+        cwndGain = HIGH_GAIN;
+    }
+
+    // A few datagrams are always in flight while the application keeps sending, so a tiny BDP must not hold DRAIN forever
+    if (mode == DRAIN && (double) lastUnacknowledgedBytes <= std::max(GetBDP(), (double) MIN_PIPE_DATAGRAMS * MAXIMUM_MTU_INCLUDING_UDP_HEADER))
+        EnterProbeBW(curTime);
+
+    if (mode == PROBE_BW && curTime - cycleStamp > minRtt)
+    {
+        cycleIndex = (cycleIndex + 1) % PACING_GAIN_CYCLE_LENGTH;
+        pacingGain = PACING_GAIN_CYCLE[cycleIndex];
+        cycleStamp = curTime;
+    }
+
+    if (mode != PROBE_RTT && minRttExpired)
+    {
+        mode = PROBE_RTT;
+        pacingGain = 1.0;
+        cwndGain = 1.0;
+        priorCwnd = cwnd;
+        probeRttDoneStamp = 0;
+    }
+
+    if (mode == PROBE_RTT)
+    {
+        const double minPipe = (double) MIN_PIPE_DATAGRAMS * MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+        if (probeRttDoneStamp == 0)
+        {
+            // Hold the low window for PROBE_RTT_DURATION and one round trip once the queue has drained
+            if ((double) lastUnacknowledgedBytes <= minPipe)
+            {
+                probeRttDoneStamp = curTime + PROBE_RTT_DURATION;
+                probeRttRoundDone = false;
+                nextRoundDelivered = delivered;
+            }
+        }
+        else
+        {
+            if (roundStart)
+                probeRttRoundDone = true;
+            if (probeRttRoundDone && curTime >= probeRttDoneStamp)
+            {
+                minRttStamp = curTime;
+                minRttExpired = false;
+                if (cwnd < priorCwnd)
+                    cwnd = priorCwnd;
+                if (fullBwReached)
+                    EnterProbeBW(curTime);
+                else
+                    EnterStartup();
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::UpdateMinRTT(CCTimeType curTime, CCTimeType rtt)
+{
+    // Loopback can ack in under a microsecond
+    if (rtt == 0)
+        rtt = 1;
+
+    minRttExpired = minRttSet && curTime - minRttStamp > MIN_RTT_WINDOW;
+    if (minRttSet == false || rtt <= minRtt || minRttExpired)
+    {
+        minRtt = rtt;
+        minRttStamp = curTime;
+        minRttSet = true;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::UpdateCongestionWindow(uint32_t bytesAcked)
+{
+    const double minPipe = (double) MIN_PIPE_DATAGRAMS * MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+
+    if (btlBw > 0 && minRttSet)
+    {
+        double target = cwndGain * GetBDP();
+        if (fullBwReached)
+        {
+            cwnd += bytesAcked;
+            if (cwnd > target)
+                cwnd = target;
+        }
+        else if (cwnd < target)
+            cwnd += bytesAcked;
+    }
+    else
+        cwnd += bytesAcked;
+
+    if (cwnd < minPipe)
+        cwnd = minPipe;
+    if (mode == PROBE_RTT && cwnd > minPipe)
+        cwnd = minPipe;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+double CCRakNetBBR::GetBDP(void) const
+{
+    if (btlBw == 0 || minRttSet == false)
+        return (double) INITIAL_WINDOW_DATAGRAMS * MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+    return btlBw * (double) minRtt;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+BytesPerMicrosecond CCRakNetBBR::GetPacingRate(void) const
+{
+    if (btlBw > 0)
+        return pacingGain * btlBw;
+    // Before the first delivery rate sample, spread the initial window over one round trip
+    if (minRttSet)
+        return pacingGain * cwnd / (double) minRtt;
+    // Not even one round trip yet: only the window limits sends
+    return 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::RefillPacing(CCTimeType curTime)
+{
+    BytesPerMicrosecond pacingRate = GetPacingRate();
+    if (pacingRate <= 0)
+    {
+        pacingBudget = cwnd;
+        lastPacingRefill = curTime;
+        return;
+    }
+
+    if (curTime > lastPacingRefill)
+        pacingBudget += pacingRate * (double) (curTime - lastPacingRefill);
+    lastPacingRefill = curTime;
+
+    // Do not save up more than a short burst while idle or while the update thread slept late
+    double maxBudget = pacingRate * (double) MAX_PACING_BURST_TIME;
+    if (maxBudget < 2.0 * MAXIMUM_MTU_INCLUDING_UDP_HEADER)
+        maxBudget = 2.0 * MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+    if (pacingBudget > maxBudget)
+        pacingBudget = maxBudget;
+}
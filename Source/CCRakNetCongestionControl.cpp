@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "CCRakNetCongestionControl.h"
+#include "CCRakNetSlidingWindow.h"
+#include "CCRakNetUDT.h"
+#include "CCRakNetBBR.h"
+#include "RakAssert.h"
+
+using namespace RakNet;
+
+// ----------------------------------------------------------------------------------------------------------------------------
+CCRakNetCongestionControl *CCRakNetCongestionControl::GetInstance(CongestionControlAlgorithm algorithm)
+{
+    switch (algorithm)
+    {
+        case CC_UDT:
+            return new CCRakNetUDT;
+        case CC_BBR:
+            return new CCRakNetBBR;
+        default:
+            RakAssert(algorithm == CC_SLIDING_WINDOW);
+            return new CCRakNetSlidingWindow;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetCongestionControl::DestroyInstance(CCRakNetCongestionControl *instance)
+{
+    delete instance;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+DatagramSequenceNumberType CCRakNetCongestionControl::GetNextDatagramSequenceNumber(void)
+{
+    return nextDatagramSequenceNumber;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+DatagramSequenceNumberType CCRakNetCongestionControl::GetAndIncrementNextDatagramSequenceNumber(void)
+{
+    DatagramSequenceNumberType dsnt = nextDatagramSequenceNumber;
+    nextDatagramSequenceNumber++;
+    return dsnt;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetCongestionControl::ContinueSequenceNumbers(const CCRakNetCongestionControl &previous)
+{
+    nextDatagramSequenceNumber = previous.nextDatagramSequenceNumber;
+    expectedNextSequenceNumber = previous.expectedNextSequenceNumber;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+bool CCRakNetCongestionControl::GreaterThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b)
+{
+    // a > b?
+    const DatagramSequenceNumberType halfSpan = (DatagramSequenceNumberType) (
+            ((DatagramSequenceNumberType) (uint32_t) -1) / (DatagramSequenceNumberType) 2);
+    return b != a && b - a > halfSpan;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+bool CCRakNetCongestionControl::LessThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b)
+{
+    // a < b?
+    const DatagramSequenceNumberType halfSpan =
+            ((DatagramSequenceNumberType) (uint32_t) -1) / (DatagramSequenceNumberType) 2;
+    return b != a && b - a < halfSpan;
+}
@@ -11,8 +11,6 @@
 
 #include "CCRakNetSlidingWindow.h"
 
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL == 1
-
 static const double UNSET_TIME_US = -1;
 
 #if CC_TIME_TYPE_BYTES == 4
@@ -98,17 +96,12 @@ bool CCRakNetSlidingWindow::ShouldSendACKs(CCTimeType curTime, CCTimeType estima
 }
 
 // ----------------------------------------------------------------------------------------------------------------------------
-DatagramSequenceNumberType CCRakNetSlidingWindow::GetNextDatagramSequenceNumber(void)
+CCTimeType CCRakNetSlidingWindow::GetNextACKTime(CCTimeType curTime) const
 {
-    return nextDatagramSequenceNumber;
-}
+    if (GetSenderRTOForACK() == (CCTimeType) UNSET_TIME_US)
+        return curTime;
 
-// ----------------------------------------------------------------------------------------------------------------------------
-DatagramSequenceNumberType CCRakNetSlidingWindow::GetAndIncrementNextDatagramSequenceNumber(void)
-{
-    DatagramSequenceNumberType dsnt = nextDatagramSequenceNumber;
-    nextDatagramSequenceNumber++;
-    return dsnt;
+    return oldestUnsentAck + SYN;
 }
 
 // ----------------------------------------------------------------------------------------------------------------------------
@@ -355,28 +348,18 @@ double CCRakNetSlidingWindow::GetRTT() const
     return lastRtt;
 }
 
-// ----------------------------------------------------------------------------------------------------------------------------
-bool CCRakNetSlidingWindow::GreaterThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b)
-{
-    // a > b?
-    const DatagramSequenceNumberType halfSpan = (DatagramSequenceNumberType) (
-            ((DatagramSequenceNumberType) (const uint32_t) -1) / (DatagramSequenceNumberType) 2);
-    return b != a && b - a > halfSpan;
-}
-
-// ----------------------------------------------------------------------------------------------------------------------------
-bool CCRakNetSlidingWindow::LessThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b)
-{
-    // a < b?
-    const DatagramSequenceNumberType halfSpan =
-            ((DatagramSequenceNumberType) (const uint32_t) -1) / (DatagramSequenceNumberType) 2;
-    return b != a && b - a < halfSpan;
-}
-
 // ----------------------------------------------------------------------------------------------------------------------------
 uint64_t CCRakNetSlidingWindow::GetBytesPerSecondLimitByCongestionControl() const
 {
-    return 0; // TODO
+    // A little more than one window per round trip, so the pacer is never what keeps the window from filling
+    if (estimatedRTT == UNSET_TIME_US || estimatedRTT <= 0)
+        return 0;
+    double gain = IsInSlowStart() ? CRABNET_PACING_SLOW_START_GAIN : CRABNET_PACING_CONGESTION_AVOIDANCE_GAIN;
+#if CC_TIME_TYPE_BYTES == 4
+    return (uint64_t) (gain * cwnd * 1000.0 / estimatedRTT);
+#else
+    return (uint64_t) (gain * cwnd * 1000000.0 / estimatedRTT);
+#endif
 }
 
 // ----------------------------------------------------------------------------------------------------------------------------
@@ -393,4 +376,3 @@ bool CCRakNetSlidingWindow::IsInSlowStart() const
     return cwnd <= ssThresh || ssThresh == 0;
 }
 // ----------------------------------------------------------------------------------------------------------------------------
-#endif
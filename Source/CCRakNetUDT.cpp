@@ -11,8 +11,6 @@
 
 #include "CCRakNetUDT.h"
 
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL != 1
-
 #include "Rand.h"
 #include "MTUSize.h"
 #include <stdio.h>
@@ -74,7 +72,7 @@ void CCRakNetUDT::Init(CCTimeType curTime, uint32_t maxDatagramPayload)
     DecCount = 0;
     nextDatagramSequenceNumber = 0;
     lastPacketPairPacketArrivalTime = 0;
-    lastPacketPairSequenceNumber = (DatagramSequenceNumberType)(const uint32_t) -1;
+    lastPacketPairSequenceNumber = (DatagramSequenceNumberType)(uint32_t) -1;
     lastPacketArrivalTime = 0;
     CWND=CWND_MIN_THRESHOLD;
     lastUpdateWindowSizeAndAck = 0;
@@ -152,7 +150,7 @@ void CCRakNetUDT::Update(CCTimeType curTime, bool hasDataToSendOrResend)
     /// 500 microseconds per byte
     // printf("No incoming data, halving send rate\n");
     SND*=2.0;
-    CapMinSnd();
+    CapMinSnd(_FILE_AND_LINE_);
     ExpCount+=1.0;
     if (ExpCount>8.0)
     ExpCount=8.0;
@@ -230,16 +228,12 @@ bool CCRakNetUDT::ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToN
     return curTime >= oldestUnsentAck + SYN || estimatedTimeToNextTick+curTime < oldestUnsentAck+rto-RTT;
 }
 // ----------------------------------------------------------------------------------------------------------------------------
-DatagramSequenceNumberType CCRakNetUDT::GetNextDatagramSequenceNumber(void)
-{
-    return nextDatagramSequenceNumber;
-}
-// ----------------------------------------------------------------------------------------------------------------------------
-DatagramSequenceNumberType CCRakNetUDT::GetAndIncrementNextDatagramSequenceNumber(void)
+CCTimeType CCRakNetUDT::GetNextACKTime(CCTimeType curTime) const
 {
-    DatagramSequenceNumberType dsnt = nextDatagramSequenceNumber;
-    nextDatagramSequenceNumber++;
-    return dsnt;
+    if (GetSenderRTOForACK() == (CCTimeType) UNSET_TIME_US)
+        return curTime;
+
+    return oldestUnsentAck + SYN;
 }
 // ----------------------------------------------------------------------------------------------------------------------------
 void CCRakNetUDT::OnSendBytes(CCTimeType curTime, uint32_t numBytes)
@@ -341,20 +335,6 @@ BytesPerMicrosecond CCRakNetUDT::CalculateListMedianRecursive(const BytesPerMicr
     }
 }
 
-// ----------------------------------------------------------------------------------------------------------------------------
-bool CCRakNetUDT::GreaterThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b)
-{
-    // a > b?
-    const DatagramSequenceNumberType halfSpan =(DatagramSequenceNumberType) (((DatagramSequenceNumberType)(const uint32_t)-1)/(DatagramSequenceNumberType)2);
-    return b!=a && b-a>halfSpan;
-}
-// ----------------------------------------------------------------------------------------------------------------------------
-bool CCRakNetUDT::LessThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b)
-{
-    // a < b?
-    const DatagramSequenceNumberType halfSpan = ((DatagramSequenceNumberType) (const uint32_t) -1) / (DatagramSequenceNumberType) 2;
-    return b != a && b - a < halfSpan;
-}
 // ----------------------------------------------------------------------------------------------------------------------------
 CCTimeType CCRakNetUDT::GetSenderRTOForACK() const
 {
@@ -366,6 +346,8 @@ CCTimeType CCRakNetUDT::GetSenderRTOForACK() const
 // ----------------------------------------------------------------------------------------------------------------------------
 CCTimeType CCRakNetUDT::GetRTOForRetransmission(unsigned char timesSent) const
 {
+    (void) timesSent;
+
 #if CC_TIME_TYPE_BYTES == 4
     const CCTimeType maxThreshold = 10000;
     const CCTimeType minThreshold = 100;
@@ -389,6 +371,7 @@ CCTimeType CCRakNetUDT::GetRTOForRetransmission(unsigned char timesSent) const
 void CCRakNetUDT::OnResend(CCTimeType curTime, RakNet::TimeUS nextActionTime)
 {
     (void) curTime;
+    (void) nextActionTime;
 
     if (isInSlowStart)
     {
@@ -423,12 +406,12 @@ void CCRakNetUDT::OnNAK(CCTimeType curTime, DatagramSequenceNumberType nakSequen
     {
         // Logging
         //printf("Sending SLOWER due to NAK, Rate=%f MBPS. Rtt=%i\n", GetLocalSendRate(),  lastRtt );
-        if (pingsLastInterval.Size() > 10)
-        {
-            for (int i = 0; i < 10; i++)
-                printf("%i, ", pingsLastInterval[pingsLastInterval.Size() - 1 - i] / 1000);
-        }
-        printf("\n");
+        //if (pingsLastInterval.Size() > 10)
+        //{
+        //    for (int i = 0; i < 10; i++)
+        //        printf("%i, ", pingsLastInterval[pingsLastInterval.Size() - 1 - i] / 1000);
+        //}
+        //printf("\n");
         IncreaseTimeBetweenSends();
 
         hadPacketlossThisBlock = true;
@@ -445,7 +428,7 @@ void CCRakNetUDT::EndSlowStart(void)
 
     isInSlowStart = false;
     SND = 1.0 / AS;
-    CapMinSnd();
+    CapMinSnd(_FILE_AND_LINE_);
 
     // printf("ENDING SLOW START\n");
 #if CC_TIME_TYPE_BYTES == 4
@@ -766,7 +749,7 @@ void CCRakNetUDT::IncreaseTimeBetweenSends(void)
 
     // SND=0 then fast increase, slow decrease
     // SND=500 then slow increase, fast decrease
-    CapMinSnd();
+    CapMinSnd(_FILE_AND_LINE_);
 }
 void CCRakNetUDT::DecreaseTimeBetweenSends(void)
 {
@@ -795,5 +778,3 @@ void CCRakNetUDT::SetTimeBetweenSendsLimit(unsigned int bitsPerSecond)
         SND=limit;
 }
 */
-
-#endif
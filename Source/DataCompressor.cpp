@@ -49,7 +49,7 @@ void DataCompressor::Compress( unsigned char *userData, unsigned sizeInBytes, Ra
 unsigned DataCompressor::DecompressAndAllocate( RakNet::BitStream * input, unsigned char **output )
 {
     HuffmanEncodingTree tree;
-    unsigned int bitsUsed, destinationSizeInBytes;
+    unsigned int bitsUsed=0, destinationSizeInBytes=0;
     unsigned int decompressedBytes;
     unsigned int frequencyTable[256];
 
@@ -0,0 +1,176 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "DatagramHistory.h"
+#include "RakAssert.h"
+
+using namespace RakNet;
+
+// Datagram numbers are 24 bits. Numbers further apart than half the range cannot be ordered
+static const unsigned int MAXIMUM_DATAGRAMS = CRABNET_MAXIMUM_DATAGRAM_HISTORY < (1 << 23) ? CRABNET_MAXIMUM_DATAGRAM_HISTORY : 1 << 23;
+
+// ----------------------------------------------------------------------------------------------------------------------------
+DatagramHistory::DatagramHistory()
+{
+    datagrams = 0;
+    datagramMask = 0;
+    datagramCount = 0;
+    oldestNumber = 0;
+    messages = 0;
+    messageMask = 0;
+    messageHead = 0;
+    messageTail = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+DatagramHistory::~DatagramHistory()
+{
+    Clear();
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void DatagramHistory::Clear(void)
+{
+    delete [] datagrams;
+    datagrams = 0;
+    datagramMask = 0;
+    datagramCount = 0;
+    oldestNumber = 0;
+    delete [] messages;
+    messages = 0;
+    messageMask = 0;
+    messageHead = 0;
+    messageTail = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+MessageNumberType *DatagramHistory::Push(DatagramSequenceNumberType datagramNumber, CCTimeType timeSent, unsigned int messageCount)
+{
+    if (datagrams == 0)
+    {
+        datagrams = new Datagram[DATAGRAM_MESSAGE_ID_ARRAY_LENGTH];
+        datagramMask = DATAGRAM_MESSAGE_ID_ARRAY_LENGTH - 1;
+        messages = new MessageNumberType[DATAGRAM_MESSAGE_ID_ARRAY_LENGTH * 4];
+        messageMask = DATAGRAM_MESSAGE_ID_ARRAY_LENGTH * 4 - 1;
+    }
+
+    if (datagramCount == 0)
+        oldestNumber = datagramNumber;
+    RakAssert(datagramNumber == oldestNumber + datagramCount);
+
+    if (datagramCount == datagramMask + 1)
+    {
+        if (datagramCount < MAXIMUM_DATAGRAMS)
+            GrowDatagrams();
+        else
+            PopOldest();
+    }
+
+    // The span may not wrap around the end of the ring, so skip to the start when it would
+    unsigned int skip = 0;
+    if ((messageHead & messageMask) + messageCount > messageMask + 1)
+        skip = messageMask + 1 - (messageHead & messageMask);
+    if (messageHead - messageTail + skip + messageCount > messageMask + 1)
+    {
+        GrowMessages(messageCount);
+        skip = 0;
+    }
+
+    Datagram &datagram = datagrams[datagramNumber.val & datagramMask];
+    datagram.timeSent = timeSent;
+    datagram.messageStart = messageHead + skip;
+    datagram.messageCount = messageCount;
+    datagram.isAcked = false;
+    messageHead = datagram.messageStart + messageCount;
+    datagramCount++;
+    return messages + (datagram.messageStart & messageMask);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void DatagramHistory::PopOldest(void)
+{
+    RakAssert(datagramCount > 0);
+    const Datagram &datagram = datagrams[oldestNumber.val & datagramMask];
+    messageTail = datagram.messageStart + datagram.messageCount;
+    oldestNumber++;
+    datagramCount--;
+    if (datagramCount == 0)
+        messageTail = messageHead;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+const MessageNumberType *DatagramHistory::Get(DatagramSequenceNumberType datagramNumber, unsigned int *messageCount, CCTimeType *timeSent) const
+{
+    DatagramSequenceNumberType offset = datagramNumber - oldestNumber;
+    if (offset.val >= datagramCount)
+        return 0;
+
+    const Datagram &datagram = datagrams[datagramNumber.val & datagramMask];
+    if (datagram.isAcked || datagram.messageCount == 0)
+        return 0;
+
+    *messageCount = datagram.messageCount;
+    *timeSent = datagram.timeSent;
+    return messages + (datagram.messageStart & messageMask);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void DatagramHistory::Remove(DatagramSequenceNumberType datagramNumber)
+{
+    DatagramSequenceNumberType offset = datagramNumber - oldestNumber;
+    if (offset.val < datagramCount)
+        datagrams[datagramNumber.val & datagramMask].isAcked = true;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void DatagramHistory::GrowDatagrams(void)
+{
+    unsigned int newSize = (datagramMask + 1) * 2;
+    Datagram *newDatagrams = new Datagram[newSize];
+    DatagramSequenceNumberType datagramNumber = oldestNumber;
+    for (unsigned int i = 0; i < datagramCount; i++, datagramNumber++)
+        newDatagrams[datagramNumber.val & (newSize - 1)] = datagrams[datagramNumber.val & datagramMask];
+    delete [] datagrams;
+    datagrams = newDatagrams;
+    datagramMask = newSize - 1;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void DatagramHistory::GrowMessages(unsigned int messageCount)
+{
+    // Copy the spans in use to the start of the new ring, which removes the gaps left by skipping
+    unsigned int inUse = 0;
+    DatagramSequenceNumberType datagramNumber = oldestNumber;
+    for (unsigned int i = 0; i < datagramCount; i++, datagramNumber++)
+        inUse += datagrams[datagramNumber.val & datagramMask].messageCount;
+
+    unsigned int newSize = (messageMask + 1) * 2;
+    while (newSize < inUse + messageCount)
+        newSize *= 2;
+    MessageNumberType *newMessages = new MessageNumberType[newSize];
+
+    unsigned int newHead = 0;
+    datagramNumber = oldestNumber;
+    for (unsigned int i = 0; i < datagramCount; i++, datagramNumber++)
+    {
+        Datagram &datagram = datagrams[datagramNumber.val & datagramMask];
+        for (unsigned int j = 0; j < datagram.messageCount; j++)
+            newMessages[newHead + j] = messages[(datagram.messageStart & messageMask) + j];
+        datagram.messageStart = newHead;
+        newHead += datagram.messageCount;
+    }
+
+    delete [] messages;
+    messages = newMessages;
+    messageMask = newSize - 1;
+    messageHead = newHead;
+    messageTail = 0;
+}
@@ -0,0 +1,259 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "FecChannel.h"
+#include "BitStream.h"
+#include "RakAssert.h"
+#include <stdlib.h>
+#include <string.h>
+
+using namespace RakNet;
+
+// Received messages kept per channel. Two groups, so the previous group can still be rebuilt while the next one arrives
+static const unsigned int RECEIVED_HISTORY_SIZE = FecChannel::MAXIMUM_GROUP_SIZE * 2;
+
+// Ordering channel, member count, and XOR of the members' dataBitLength
+static const unsigned int PARITY_HEADER_BYTES = 1 + 1 + 2;
+
+// orderingIndex and sequencingIndex of one member
+static const unsigned int PARITY_MEMBER_BYTES = 3 + 3;
+
+// ----------------------------------------------------------------------------------------------------------------------------
+static bool Reserve(unsigned char **data, unsigned int *capacity, unsigned int length)
+{
+    if (length <= *capacity)
+        return true;
+    unsigned char *newData = (unsigned char *) realloc(*data, length);
+    if (newData == 0)
+        return false;
+    *data = newData;
+    *capacity = length;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+FecChannel::FecChannel()
+{
+    groupCount = 0;
+    groupData = 0;
+    groupDataLength = 0;
+    groupDataCapacity = 0;
+    groupBitLengths = 0;
+    received = 0;
+    receivedWriteIndex = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+FecChannel::~FecChannel()
+{
+    Clear();
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+unsigned int FecChannel::ClampGroupSize(unsigned int groupSize)
+{
+    // A group of one is just a copy of the message
+    if (groupSize == 1)
+        return 2;
+    if (groupSize > MAXIMUM_GROUP_SIZE)
+        return MAXIMUM_GROUP_SIZE;
+    return groupSize;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void FecChannel::Clear(void)
+{
+    ClearSending();
+
+    if (received)
+    {
+        for (unsigned int i = 0; i < RECEIVED_HISTORY_SIZE; i++)
+            free(received[i].data);
+        delete [] received;
+        received = 0;
+    }
+    receivedWriteIndex = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void FecChannel::ClearSending(void)
+{
+    free(groupData);
+    groupData = 0;
+    groupCount = 0;
+    groupDataLength = 0;
+    groupDataCapacity = 0;
+    groupBitLengths = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+unsigned int FecChannel::GetParityByteLength(BitSize_t dataBitLength) const
+{
+    unsigned int dataLength = (unsigned int) BITS_TO_BYTES(dataBitLength);
+    if (dataLength < groupDataLength)
+        dataLength = groupDataLength;
+    return PARITY_HEADER_BYTES + (groupCount + 1) * PARITY_MEMBER_BYTES + dataLength;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+unsigned int FecChannel::AddSent(const InternalPacket *internalPacket)
+{
+    RakAssert(groupCount < MAXIMUM_GROUP_SIZE);
+
+    // The parity carries the XOR of the bit lengths in 16 bits. Longer messages go out without protection
+    if (internalPacket->dataBitLength >= 65536)
+        return groupCount;
+
+    unsigned int dataLength = (unsigned int) BITS_TO_BYTES(internalPacket->dataBitLength);
+    if (!Reserve(&groupData, &groupDataCapacity, dataLength))
+        return groupCount;
+    // Shorter members are XORed as if padded with zeros
+    if (dataLength > groupDataLength)
+    {
+        memset(groupData + groupDataLength, 0, dataLength - groupDataLength);
+        groupDataLength = dataLength;
+    }
+    for (unsigned int i = 0; i < dataLength; i++)
+        groupData[i] ^= internalPacket->data[i];
+    groupBitLengths ^= (uint16_t) internalPacket->dataBitLength;
+
+    groupMembers[groupCount].orderingIndex = internalPacket->orderingIndex;
+    groupMembers[groupCount].sequencingIndex = internalPacket->sequencingIndex;
+    return ++groupCount;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void FecChannel::WriteParity(unsigned char orderingChannel, BitStream *bitStream)
+{
+    bitStream->Write(orderingChannel);
+    bitStream->Write((unsigned char) groupCount);
+    bitStream->Write(groupBitLengths);
+    for (unsigned int i = 0; i < groupCount; i++)
+    {
+        bitStream->Write(groupMembers[i].orderingIndex);
+        bitStream->Write(groupMembers[i].sequencingIndex);
+    }
+    bitStream->WriteAlignedBytes(groupData, groupDataLength);
+
+    groupCount = 0;
+    groupDataLength = 0;
+    groupBitLengths = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void FecChannel::AddReceived(const InternalPacket *internalPacket)
+{
+    if (received == 0)
+        return;
+
+    unsigned int dataLength = (unsigned int) BITS_TO_BYTES(internalPacket->dataBitLength);
+    Received &slot = received[receivedWriteIndex];
+    if (!Reserve(&slot.data, &slot.capacity, dataLength))
+        return;
+    memcpy(slot.data, internalPacket->data, dataLength);
+    slot.dataBitLength = internalPacket->dataBitLength;
+    slot.orderingIndex = internalPacket->orderingIndex;
+    slot.sequencingIndex = internalPacket->sequencingIndex;
+    receivedWriteIndex = (receivedWriteIndex + 1) % RECEIVED_HISTORY_SIZE;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+bool FecChannel::ReadParityChannel(BitStream *parity, unsigned char *orderingChannel)
+{
+    return parity->Read(*orderingChannel);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+FecChannel::RecoverResult FecChannel::Recover(BitStream *parity, InternalPacket *recovered, unsigned int *lostCount)
+{
+    *lostCount = 0;
+
+    // Start keeping what arrives. Messages before the first parity were not kept, so that group can't be checked
+    if (received == 0)
+    {
+        received = new Received[RECEIVED_HISTORY_SIZE]();
+        return FEC_NOTHING_LOST;
+    }
+
+    unsigned char count;
+    uint16_t bitLengths;
+    Member members[MAXIMUM_GROUP_SIZE];
+    if (!parity->Read(count) || !parity->Read(bitLengths) || count == 0 || count > MAXIMUM_GROUP_SIZE)
+        return FEC_UNRECOVERABLE;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (!parity->Read(members[i].orderingIndex) || !parity->Read(members[i].sequencingIndex))
+            return FEC_UNRECOVERABLE;
+    }
+    unsigned int dataLength = BITS_TO_BYTES(parity->GetNumberOfUnreadBits());
+    const unsigned char *data = parity->GetData() + BITS_TO_BYTES(parity->GetReadOffset());
+
+    const Received *found[MAXIMUM_GROUP_SIZE];
+    unsigned int missing = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        found[i] = FindReceived(members[i]);
+        if (found[i] == 0)
+        {
+            missing = i;
+            (*lostCount)++;
+        }
+    }
+    if (*lostCount == 0)
+        return FEC_NOTHING_LOST;
+    if (*lostCount > 1)
+        return FEC_UNRECOVERABLE;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (found[i])
+            bitLengths ^= (uint16_t) found[i]->dataBitLength;
+    }
+    unsigned int recoveredLength = BITS_TO_BYTES(bitLengths);
+    if (bitLengths == 0 || recoveredLength > dataLength)
+        return FEC_UNRECOVERABLE;
+
+    unsigned char *recoveredData = (unsigned char *) malloc(recoveredLength);
+    if (recoveredData == 0)
+        return FEC_UNRECOVERABLE;
+    memcpy(recoveredData, data, recoveredLength);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (found[i] == 0)
+            continue;
+        unsigned int length = BITS_TO_BYTES(found[i]->dataBitLength);
+        if (length > recoveredLength)
+            length = recoveredLength;
+        for (unsigned int j = 0; j < length; j++)
+            recoveredData[j] ^= found[i]->data[j];
+    }
+
+    recovered->reliability = UNRELIABLE_SEQUENCED;
+    recovered->orderingIndex = members[missing].orderingIndex;
+    recovered->sequencingIndex = members[missing].sequencingIndex;
+    recovered->dataBitLength = bitLengths;
+    recovered->splitPacketCount = 0;
+    recovered->allocationScheme = InternalPacket::NORMAL;
+    recovered->data = recoveredData;
+    return FEC_RECOVERED;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+const FecChannel::Received *FecChannel::FindReceived(const Member &member) const
+{
+    for (unsigned int i = 0; i < RECEIVED_HISTORY_SIZE; i++)
+    {
+        if (received[i].data != 0 && received[i].orderingIndex == member.orderingIndex &&
+            received[i].sequencingIndex == member.sequencingIndex)
+            return &received[i];
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "OrderingWindow.h"
+#include "RakAssert.h"
+#include <string.h>
+
+using namespace RakNet;
+
+static const unsigned int INITIAL_WINDOW_SIZE = 64;
+
+// Ordering indices are 24 bits. A message more than half the range ahead is taken as old, so is never held
+static const unsigned int MAXIMUM_WINDOW_SIZE = 1 << 23;
+
+// ----------------------------------------------------------------------------------------------------------------------------
+OrderingWindow::OrderingWindow()
+{
+    slots = 0;
+    mask = 0;
+    size = 0;
+    popAnySlot = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+OrderingWindow::~OrderingWindow()
+{
+    Clear();
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void OrderingWindow::Clear(void)
+{
+    delete [] slots;
+    slots = 0;
+    mask = 0;
+    size = 0;
+    popAnySlot = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+OrderingWindow::PushResult OrderingWindow::Push(InternalPacket *internalPacket, OrderingIndexType readIndex)
+{
+    unsigned int offset = (internalPacket->orderingIndex - readIndex).val;
+    RakAssert(offset > 0 && offset < MAXIMUM_WINDOW_SIZE);
+    // The slots grow to at most twice offset, so past CRABNET_MAX_ORDERING_WINDOW this keeps them under four per message held
+    if (offset >= MAXIMUM_WINDOW_SIZE || (offset >= CRABNET_MAX_ORDERING_WINDOW && offset >= (size + 1) * 2))
+        return ORDERING_TOO_FAR_AHEAD;
+
+    if (slots == 0)
+    {
+        slots = new Slot[INITIAL_WINDOW_SIZE];
+        memset(slots, 0, sizeof(Slot) * INITIAL_WINDOW_SIZE);
+        mask = INITIAL_WINDOW_SIZE - 1;
+    }
+    if (offset > mask)
+        Grow(offset, readIndex);
+
+    Slot &slot = slots[internalPacket->orderingIndex.val & mask];
+    if (internalPacket->reliability == RELIABLE_SEQUENCED || internalPacket->reliability == UNRELIABLE_SEQUENCED)
+    {
+        // Sequenced messages for one ordering index are few, so a sorted list is enough
+        InternalPacket **link = &slot.sequenced;
+        while (*link && (*link)->sequencingIndex.val <= internalPacket->sequencingIndex.val)
+            link = &(*link)->orderingNext;
+        internalPacket->orderingNext = *link;
+        *link = internalPacket;
+    }
+    else
+    {
+        if (slot.ordered)
+            return ORDERING_DUPLICATE;
+        internalPacket->orderingNext = 0;
+        slot.ordered = internalPacket;
+    }
+    size++;
+    return ORDERING_HELD;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+InternalPacket *OrderingWindow::Pop(OrderingIndexType readIndex)
+{
+    if (size == 0)
+        return 0;
+
+    // Nothing is held for an index more than mask ahead, so whatever is in the slot is for readIndex
+    Slot &slot = slots[readIndex.val & mask];
+    InternalPacket *internalPacket = slot.sequenced;
+    if (internalPacket)
+        slot.sequenced = internalPacket->orderingNext;
+    else if ((internalPacket = slot.ordered) != 0)
+        slot.ordered = 0;
+    else
+        return 0;
+
+    RakAssert(internalPacket->orderingIndex == readIndex);
+    size--;
+    return internalPacket;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+InternalPacket *OrderingWindow::PopAny(void)
+{
+    if (size == 0)
+        return 0;
+
+    for (;; popAnySlot = (popAnySlot + 1) & mask)
+    {
+        Slot &slot = slots[popAnySlot];
+        InternalPacket *internalPacket = slot.sequenced;
+        if (internalPacket)
+            slot.sequenced = internalPacket->orderingNext;
+        else if ((internalPacket = slot.ordered) != 0)
+            slot.ordered = 0;
+        else
+            continue;
+        size--;
+        return internalPacket;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void OrderingWindow::Grow(unsigned int offset, OrderingIndexType readIndex)
+{
+    unsigned int newSize = (mask + 1) * 2;
+    while (newSize <= offset)
+        newSize *= 2;
+    Slot *newSlots = new Slot[newSize];
+    memset(newSlots, 0, sizeof(Slot) * newSize);
+
+    // Every held message is within the old window from readIndex, so each slot moves as a whole
+    for (unsigned int i = 0; i <= mask; i++)
+    {
+        OrderingIndexType orderingIndex = readIndex + i;
+        newSlots[orderingIndex.val & (newSize - 1)] = slots[orderingIndex.val & mask];
+    }
+    delete [] slots;
+    slots = newSlots;
+    mask = newSize - 1;
+    popAnySlot = 0;
+}
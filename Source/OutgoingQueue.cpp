@@ -0,0 +1,155 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "OutgoingQueue.h"
+#include "RakAssert.h"
+
+using namespace RakNet;
+
+static const unsigned int INITIAL_RING_LENGTH = 64;
+
+// ----------------------------------------------------------------------------------------------------------------------------
+OutgoingQueue::OutgoingQueue()
+{
+    for (int priorityLevel = 0; priorityLevel < NUMBER_OF_PRIORITIES; priorityLevel++)
+    {
+        rings[priorityLevel].entries = 0;
+        rings[priorityLevel].mask = 0;
+        rings[priorityLevel].head = 0;
+        rings[priorityLevel].tail = 0;
+    }
+    size = 0;
+    nextPriority = 0;
+    InitWeights();
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+OutgoingQueue::~OutgoingQueue()
+{
+    Clear();
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void OutgoingQueue::Clear(void)
+{
+    for (int priorityLevel = 0; priorityLevel < NUMBER_OF_PRIORITIES; priorityLevel++)
+    {
+        delete [] rings[priorityLevel].entries;
+        rings[priorityLevel].entries = 0;
+        rings[priorityLevel].mask = 0;
+        rings[priorityLevel].head = 0;
+        rings[priorityLevel].tail = 0;
+    }
+    size = 0;
+    nextPriority = 0;
+    InitWeights();
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void OutgoingQueue::Push(InternalPacket *internalPacket)
+{
+    int priorityLevel = (int) internalPacket->priority;
+    RakAssert(priorityLevel >= 0 && priorityLevel < NUMBER_OF_PRIORITIES);
+
+    Entry entry;
+    entry.weight = GetNextWeight(priorityLevel);
+    entry.internalPacket = internalPacket;
+
+    Ring &ring = rings[priorityLevel];
+    if (ring.entries == 0 || ring.tail - ring.head == ring.mask + 1)
+        GrowRing(ring);
+    ring.entries[ring.tail & ring.mask] = entry;
+    ring.tail++;
+    size++;
+
+    // Only the new message can have become the lightest head, and only if it is alone in its ring
+    if (size == 1)
+        nextPriority = priorityLevel;
+    else if (ring.tail - ring.head == 1)
+        FindNextPriority();
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+InternalPacket *OutgoingQueue::Pop(void)
+{
+    RakAssert(size > 0);
+    Ring &ring = rings[nextPriority];
+    InternalPacket *internalPacket = ring.entries[ring.head & ring.mask].internalPacket;
+    ring.head++;
+    size--;
+    if (size > 0)
+        FindNextPriority();
+    return internalPacket;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+uint64_t OutgoingQueue::GetNextWeight(int priorityLevel)
+{
+    uint64_t next = nextWeights[priorityLevel];
+    if (size > 0)
+    {
+        int peekPL = nextPriority;
+        const Ring &ring = rings[peekPL];
+        uint64_t weight = ring.entries[ring.head & ring.mask].weight;
+        uint64_t min = weight - (1 << peekPL) * peekPL + peekPL;
+        if (next < min)
+            next = min + ((uint64_t) 1 << priorityLevel) * priorityLevel + priorityLevel;
+        nextWeights[priorityLevel] = next + ((uint64_t) 1 << priorityLevel) * (priorityLevel + 1) + priorityLevel;
+    }
+    else
+        InitWeights();
+    return next;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void OutgoingQueue::InitWeights(void)
+{
+    for (int priorityLevel = 0; priorityLevel < NUMBER_OF_PRIORITIES; priorityLevel++)
+        nextWeights[priorityLevel] = (1 << priorityLevel) * priorityLevel + priorityLevel;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void OutgoingQueue::GrowRing(Ring &ring)
+{
+    unsigned int oldSize = ring.entries ? ring.mask + 1 : 0;
+    unsigned int newSize = oldSize ? oldSize * 2 : INITIAL_RING_LENGTH;
+    Entry *newEntries = new Entry[newSize];
+    unsigned int count = ring.tail - ring.head;
+    for (unsigned int i = 0; i < count; i++)
+        newEntries[i] = ring.entries[(ring.head + i) & ring.mask];
+    delete [] ring.entries;
+    ring.entries = newEntries;
+    ring.mask = newSize - 1;
+    ring.head = 0;
+    ring.tail = count;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void OutgoingQueue::FindNextPriority(void)
+{
+    // Ties go to the more urgent priority
+    int best = -1;
+    uint64_t bestWeight = 0;
+    for (int priorityLevel = 0; priorityLevel < NUMBER_OF_PRIORITIES; priorityLevel++)
+    {
+        const Ring &ring = rings[priorityLevel];
+        if (ring.head == ring.tail)
+            continue;
+        uint64_t weight = ring.entries[ring.head & ring.mask].weight;
+        if (best == -1 || weight < bestWeight)
+        {
+            best = priorityLevel;
+            bestWeight = weight;
+        }
+    }
+    RakAssert(best != -1);
+    nextPriority = best;
+}
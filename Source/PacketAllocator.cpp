@@ -0,0 +1,212 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "PacketAllocator.h"
+#include "DS_LockFreeRing.h"
+#include "RakAssert.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+using namespace RakNet;
+
+namespace
+{
+struct PacketBlock
+{
+    Packet packet;
+#if CRABNET_PACKET_INLINE_DATA_SIZE > 0
+    unsigned char data[CRABNET_PACKET_INLINE_DATA_SIZE];
+#endif
+};
+
+struct Magazine
+{
+    unsigned int count;
+    void *blocks[CRABNET_PACKET_MAGAZINE_SIZE];
+};
+
+void FreeMagazine(Magazine *magazine)
+{
+    for (unsigned int i = 0; i < magazine->count; i++)
+        free(magazine->blocks[i]);
+    delete magazine;
+}
+
+// Set once the depot is destroyed at exit, so threads that outlive it free their caches directly
+std::atomic<bool> depotDestroyed(false);
+std::atomic<uint64_t> depotExchangeCount(0);
+
+struct Depot
+{
+    Depot()
+    {
+        fullMagazines.Init(CRABNET_PACKET_DEPOT_SIZE);
+        emptyMagazines.Init(CRABNET_PACKET_DEPOT_SIZE);
+    }
+    ~Depot()
+    {
+        depotDestroyed = true;
+        Magazine *magazine;
+        while (fullMagazines.Pop(magazine))
+            FreeMagazine(magazine);
+        while (emptyMagazines.Pop(magazine))
+            delete magazine;
+    }
+
+    /// Hand a full magazine to other threads, or free it if the depot already holds enough
+    void PushFull(Magazine *magazine)
+    {
+        depotExchangeCount.fetch_add(1, std::memory_order_relaxed);
+        if (fullMagazines.Push(magazine) == false)
+            FreeMagazine(magazine);
+    }
+    void PushEmpty(Magazine *magazine)
+    {
+        if (emptyMagazines.Push(magazine) == false)
+            delete magazine;
+    }
+    Magazine *PopFull(void)
+    {
+        Magazine *magazine;
+        if (fullMagazines.Pop(magazine))
+        {
+            depotExchangeCount.fetch_add(1, std::memory_order_relaxed);
+            return magazine;
+        }
+        return 0;
+    }
+    Magazine *PopEmpty(void)
+    {
+        Magazine *magazine;
+        if (emptyMagazines.Pop(magazine))
+            return magazine;
+        magazine = new Magazine;
+        magazine->count = 0;
+        return magazine;
+    }
+
+    DataStructures::LockFreeRing<Magazine*> fullMagazines;
+    DataStructures::LockFreeRing<Magazine*> emptyMagazines;
+};
+
+Depot &GetDepot(void)
+{
+    static Depot depot;
+    return depot;
+}
+
+// loaded is used first. When it runs out (or fills up), it is swapped with previous, and only when both are
+// unusable is a magazine exchanged with the depot. Alternating allocate and release at a magazine boundary
+// therefore never reaches the depot.
+struct ThreadCache
+{
+    ThreadCache() : loaded(0), previous(0) {}
+    ~ThreadCache()
+    {
+        ReturnMagazine(loaded);
+        ReturnMagazine(previous);
+    }
+    void ReturnMagazine(Magazine *magazine)
+    {
+        if (magazine == 0)
+            return;
+        if (depotDestroyed)
+            FreeMagazine(magazine);
+        else if (magazine->count > 0)
+            GetDepot().PushFull(magazine);
+        else
+            GetDepot().PushEmpty(magazine);
+    }
+    void Swap(void)
+    {
+        Magazine *temp = loaded;
+        loaded = previous;
+        previous = temp;
+    }
+
+    Magazine *loaded;
+    Magazine *previous;
+};
+
+thread_local ThreadCache threadCache;
+}
+
+Packet *PacketAllocator::Allocate(void)
+{
+    ThreadCache &cache = threadCache;
+    void *block = 0;
+
+    if (cache.loaded == 0 || cache.loaded->count == 0)
+    {
+        if (cache.previous != 0 && cache.previous->count > 0)
+            cache.Swap();
+        else if (depotDestroyed == false)
+        {
+            Magazine *full = GetDepot().PopFull();
+            if (full)
+            {
+                if (cache.previous)
+                    GetDepot().PushEmpty(cache.previous);
+                cache.previous = cache.loaded;
+                cache.loaded = full;
+            }
+        }
+    }
+
+    if (cache.loaded != 0 && cache.loaded->count > 0)
+        block = cache.loaded->blocks[--cache.loaded->count];
+    else
+        block = malloc(sizeof(PacketBlock));
+    RakAssert(block);
+
+    return new(block) Packet;
+}
+
+void PacketAllocator::Release(Packet *packet)
+{
+    RakAssert(packet);
+    packet->~Packet();
+
+    ThreadCache &cache = threadCache;
+    if (cache.loaded == 0 || cache.loaded->count == CRABNET_PACKET_MAGAZINE_SIZE)
+    {
+        if (cache.previous != 0 && cache.previous->count < CRABNET_PACKET_MAGAZINE_SIZE)
+            cache.Swap();
+        else if (depotDestroyed == false)
+        {
+            if (cache.previous)
+                GetDepot().PushFull(cache.previous);
+            cache.previous = cache.loaded;
+            cache.loaded = GetDepot().PopEmpty();
+        }
+    }
+
+    if (cache.loaded != 0 && cache.loaded->count < CRABNET_PACKET_MAGAZINE_SIZE)
+        cache.loaded->blocks[cache.loaded->count++] = packet;
+    else
+        free(packet);
+}
+
+unsigned char *PacketAllocator::GetInlineData(Packet *packet)
+{
+#if CRABNET_PACKET_INLINE_DATA_SIZE > 0
+    return ((PacketBlock *) packet)->data;
+#else
+    (void) packet;
+    return 0;
+#endif
+}
+
+uint64_t PacketAllocator::GetDepotExchangeCount(void)
+{
+    return depotExchangeCount.load(std::memory_order_relaxed);
+}
@@ -745,8 +745,8 @@ void FileListTransfer::OnReferencePush(Packet *packet, bool isTheFullFile)
 
     inBitStream.ReadCompressed(onFileStruct.fileIndex);
     inBitStream.ReadCompressed(onFileStruct.byteLengthOfThisFile);
-    unsigned int offset;
-    unsigned int chunkLength;
+    unsigned int offset=0;
+    unsigned int chunkLength=0;
     inBitStream.ReadCompressed(offset);
     inBitStream.ReadCompressed(chunkLength);
 
@@ -128,6 +128,10 @@ RakNetSocket2* RakNet::CreateNonblockingBoundSocket(const char *bindAddr
         bbp.pollingThreadPriority=0;
         bbp.eventHandler=eventHandler;
         bbp.remotePortRakNetWasStartedOn_PS3_PS4_PSP2=0;
+        bbp.recvBatchSize=1;
+        bbp.sendBatchSize=1;
+        bbp.sendBatchUseGSO=false;
+        bbp.reusePort=false;
         RNS2BindResult br = ((RNS2_Berkley*) r2)->Bind(&bbp);
 
         if (br==BR_FAILED_TO_BIND_SOCKET)
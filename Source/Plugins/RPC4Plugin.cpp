@@ -128,6 +128,7 @@ RPC4::RPC4()
     gotBlockingReturnValue=false;
     nextSlotRegistrationCount=0;
     interruptSignal=false;
+    bitStreamArena=nullptr;
 }
 RPC4::~RPC4()
 {
@@ -285,7 +286,7 @@ void RPC4::CallLoopback( const char* uniqueID, RakNet::BitStream * bitStream )
         return;
     }
 
-    RakNet::BitStream out;
+    RakNet::BitStream out(bitStreamArena);
     out.Write((MessageID) ID_RPC_PLUGIN);
     out.Write((MessageID) ID_RPC4_CALL);
     out.WriteCompressed(uniqueID);
@@ -317,7 +318,7 @@ void RPC4::CallLoopback( const char* uniqueID, RakNet::BitStream * bitStream )
 }
 void RPC4::Call( const char* uniqueID, RakNet::BitStream * bitStream, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast )
 {
-    RakNet::BitStream out;
+    RakNet::BitStream out(bitStreamArena);
     out.Write((MessageID) ID_RPC_PLUGIN);
     out.Write((MessageID) ID_RPC4_CALL);
     out.WriteCompressed(uniqueID);
@@ -332,7 +333,7 @@ void RPC4::Call( const char* uniqueID, RakNet::BitStream * bitStream, PacketPrio
 }
 bool RPC4::CallBlocking( const char* uniqueID, RakNet::BitStream * bitStream, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, RakNet::BitStream *returnData )
 {
-    RakNet::BitStream out;
+    RakNet::BitStream out(bitStreamArena);
     out.Write((MessageID) ID_RPC_PLUGIN);
     out.Write((MessageID) ID_RPC4_CALL);
     out.WriteCompressed(uniqueID);
@@ -410,7 +411,7 @@ bool RPC4::CallBlocking( const char* uniqueID, RakNet::BitStream * bitStream, Pa
 }
 void RPC4::Signal(const char *sharedIdentifier, RakNet::BitStream *bitStream, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, bool invokeLocal)
 {
-    RakNet::BitStream out;
+    RakNet::BitStream out(bitStreamArena);
     out.Write((MessageID) ID_RPC_PLUGIN);
     out.Write((MessageID) ID_RPC4_SIGNAL);
     out.WriteCompressed(sharedIdentifier);
@@ -499,6 +500,14 @@ void RPC4::InterruptSignal(void)
 {
     interruptSignal=true;
 }
+void RPC4::SetBitStreamArena(BitStreamArena *_bitStreamArena)
+{
+    bitStreamArena=_bitStreamArena;
+}
+BitStreamArena *RPC4::GetBitStreamArena(void) const
+{
+    return bitStreamArena;
+}
 void RPC4::OnAttach(void)
 {
     unsigned int i;
@@ -535,7 +544,7 @@ PluginReceiveResult RPC4::OnReceive(Packet *packet)
                 DataStructures::HashIndex skhi = registeredNonblockingFunctions.GetIndexOf(functionName.C_String());
                 if (skhi.IsInvalid())
                 {
-                    RakNet::BitStream bsOut;
+                    RakNet::BitStream bsOut(bitStreamArena);
                     bsOut.Write((unsigned char) ID_RPC_REMOTE_ERROR);
                     bsOut.Write((unsigned char) RPC_ERROR_FUNCTION_NOT_REGISTERED);
                     bsOut.Write(functionName.C_String(),(unsigned int) functionName.GetLength()+1);
@@ -553,7 +562,7 @@ PluginReceiveResult RPC4::OnReceive(Packet *packet)
                 DataStructures::HashIndex skhi = registeredBlockingFunctions.GetIndexOf(functionName.C_String());
                 if (skhi.IsInvalid())
                 {
-                    RakNet::BitStream bsOut;
+                    RakNet::BitStream bsOut(bitStreamArena);
                     bsOut.Write((unsigned char) ID_RPC_REMOTE_ERROR);
                     bsOut.Write((unsigned char) RPC_ERROR_FUNCTION_NOT_REGISTERED);
                     bsOut.Write(functionName.C_String(),(unsigned int) functionName.GetLength()+1);
@@ -563,11 +572,11 @@ PluginReceiveResult RPC4::OnReceive(Packet *packet)
 
                 void ( *fp ) ( RakNet::BitStream *, RakNet::BitStream *, Packet * );
                 fp = registeredBlockingFunctions.ItemAtIndex(skhi);
-                RakNet::BitStream returnData;
+                RakNet::BitStream returnData(bitStreamArena);
                 bsIn.AlignReadToByteBoundary();
                 fp(&bsIn, &returnData, packet);
 
-                RakNet::BitStream out;
+                RakNet::BitStream out(bitStreamArena);
                 out.Write((MessageID) ID_RPC_PLUGIN);
                 out.Write((MessageID) ID_RPC4_RETURN);
                 returnData.ResetReadPointer();
@@ -582,7 +591,7 @@ PluginReceiveResult RPC4::OnReceive(Packet *packet)
             bsIn.ReadCompressed(sharedIdentifier);
             DataStructures::HashIndex functionIndex;
             functionIndex = localSlots.GetIndexOf(sharedIdentifier);
-            RakNet::BitStream serializedParameters;
+            RakNet::BitStream serializedParameters(bitStreamArena);
             bsIn.AlignReadToByteBoundary();
             bsIn.Read(&serializedParameters);
             InvokeSignal(functionIndex, &serializedParameters, packet);
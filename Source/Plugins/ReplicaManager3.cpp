@@ -85,6 +85,7 @@ ReplicaManager3::ReplicaManager3()
     defaultSendParameters.sendReceipt = 0;
     autoSerializeInterval = 30;
     lastAutoSerializeOccurance = 0;
+    bitStreamArena = nullptr;
     autoCreateConnections = true;
     autoDestroyConnections = true;
     currentlyDeallocatingReplica = nullptr;
@@ -510,6 +511,20 @@ void ReplicaManager3::SetAutoSerializeInterval(RakNet::Time intervalMS)
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+void ReplicaManager3::SetBitStreamArena(BitStreamArena *_bitStreamArena)
+{
+    bitStreamArena=_bitStreamArena;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+BitStreamArena *ReplicaManager3::GetBitStreamArena(void) const
+{
+    return bitStreamArena;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 void ReplicaManager3::GetConnectionsThatHaveReplicaConstructed(Replica3 *replica, DataStructures::List<Connection_RM3*> &connectionsThatHaveConstructedThisReplica, WorldId worldId)
 {
     RakAssert(worldsArray[worldId]!=0 && "World not in use");
@@ -916,7 +931,10 @@ void ReplicaManager3::Update(void)
 
             sp.messageTimestamp=0;
             for (int i=0; i < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; i++)
+            {
                 sp.pro[i]=defaultSendParameters;
+                sp.outputBitstream[i].SetArena(bitStreamArena);
+            }
             index2=0;
             for (index=0; index < world->connectionList.Size(); index++)
             {
@@ -1270,7 +1288,7 @@ PluginReceiveResult ReplicaManager3::OnSerialize(Packet *packet, unsigned char *
 
     Replica3 *replica;
     NetworkID networkId;
-    BitSize_t bitsUsed;
+    BitSize_t bitsUsed=0;
     bsIn.Read(networkId);
     //printf("OnSerialize: %i\n",networkId.guid.g); // Removeme
     replica = world->networkIDManager->GET_OBJECT_FROM_ID<Replica3*>(networkId);
@@ -1368,7 +1386,7 @@ Replica3* ReplicaManager3::GetReplicaByNetworkID(NetworkID networkId, WorldId wo
 
 void ReplicaManager3::BroadcastDestructionList(DataStructures::List<Replica3*> &replicaListSource, const SystemAddress &exclusionAddress, WorldId worldId)
 {
-    RakNet::BitStream bsOut;
+    RakNet::BitStream bsOut(bitStreamArena);
     unsigned int i,j;
 
     RakAssert(worldsArray[worldId]!=0 && "World not in use");
@@ -1527,7 +1545,8 @@ SendSerializeIfChangedResult Connection_RM3::SendSerialize(RakNet::Replica3 *rep
             sum+=serializationData[z].GetNumberOfBitsUsed();
     }
 
-    RakNet::BitStream out;
+    // In the same arena as the serialized data, if it is temporary
+    RakNet::BitStream out(serializationData[0].GetArena());
     BitSize_t bitsPerChannel[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS];
 
     if (sum==0)
@@ -2196,7 +2215,7 @@ void Connection_RM3::SendConstruction(DataStructures::List<Replica3*> &newObject
     //    DataStructures::List<LastSerializationResult* > serializedObjects;
     BitSize_t offsetStart, offsetStart2, offsetEnd;
     unsigned int newListIndex, oldListIndex;
-    RakNet::BitStream bsOut;
+    RakNet::BitStream bsOut(replicaManager3->GetBitStreamArena());
     NetworkID networkId;
     if (isFirstConstruction)
     {
@@ -2253,7 +2272,7 @@ void Connection_RM3::SendConstruction(DataStructures::List<Replica3*> &newObject
         bsOut.SetWriteOffset(offsetEnd);
     }
 
-    RakNet::BitStream bsOut2;
+    RakNet::BitStream bsOut2(replicaManager3->GetBitStreamArena());
     for (newListIndex=0; newListIndex < newObjects.Size(); newListIndex++)
     {
         bsOut2.Reset();
@@ -2321,6 +2340,7 @@ void Connection_RM3::SendConstruction(DataStructures::List<Replica3*> &newObject
         sp.lastSentBitstream[index]=&emptyBs;
         sp.pro[index]=sendParameters;
         sp.pro[index].reliability=RELIABLE_ORDERED;
+        sp.outputBitstream[index].SetArena(replicaManager3->GetBitStreamArena());
     }
 
     sp.bitsWrittenSoFar=0;
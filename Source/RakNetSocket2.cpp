@@ -33,6 +33,12 @@ using namespace RakNet;
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#if CRABNET_SUPPORT_SENDMMSG==1
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
 #endif
 
 #ifdef TEST_NATIVE_CLIENT_ON_WINDOWS
@@ -51,6 +57,15 @@ using namespace RakNet;
 #define INVALID_SOCKET -1
 #endif
 
+void RNS2EventHandler::OnRNS2RecvBatch(RNS2RecvStruct **recvStructs, unsigned int count)
+{
+    for (unsigned int i=0; i < count; i++)
+        OnRNS2Recv(recvStructs[i]);
+}
+
+RNS2SendResult RakNetSocket2::SendBatched( RNS2_SendParameters *sendParameters ) {return Send(sendParameters);}
+void RakNetSocket2::FlushSendBatch(void) {}
+
 void RakNetSocket2Allocator::DeallocRNS2(RakNetSocket2 *s) {delete s;}
 RakNetSocket2::RakNetSocket2() : eventHandler(nullptr), socketType(RNS2Type::RNS2T_LINUX), userConnectionSocketIndex(0) {}
 RakNetSocket2::~RakNetSocket2() {}
@@ -244,6 +259,10 @@ bool IRNS2_Berkley::IsPortInUse(unsigned short port, const char *hostAddress, un
     bbp.doNotFragment = false;
     bbp.protocol = 0;
     bbp.setIPHdrIncl = false;
+    bbp.recvBatchSize = 1;
+    bbp.sendBatchSize = 1;
+    bbp.sendBatchUseGSO = false;
+    bbp.reusePort = false;
     SystemAddress boundAddress;
     RNS2_Berkley *rns2 = (RNS2_Berkley*) RakNetSocket2Allocator::AllocRNS2();
     RNS2BindResult bindResult = rns2->Bind(&bbp);
@@ -280,6 +299,7 @@ RNS2BindResult RNS2_Berkley::BindShared( RNS2_BerkleyBindParameters *bindParamet
         return BR_FAILED_SEND_TEST;
 
     memcpy(&binding, bindParameters, sizeof(RNS2_BerkleyBindParameters));
+    AllocateSendBatch();
 
     /*
 #if defined(__APPLE__)
@@ -300,7 +320,10 @@ RAK_THREAD_DECLARATION(RNS2_Berkley::RecvFromLoop)
 }
 unsigned RNS2_Berkley::RecvFromLoopInt(void)
 {
-    isRecvFromLoopThreadActive++;
+#if CRABNET_SUPPORT_RECVMMSG==1
+    if (binding.recvBatchSize > 1)
+        return RecvFromLoopBatchInt();
+#endif
 
     while ( endThreads == false )
     {
@@ -314,6 +337,7 @@ unsigned RNS2_Berkley::RecvFromLoopInt(void)
             if (recvFromStruct->bytesRead>0)
             {
                 RakAssert(recvFromStruct->systemAddress.GetPort());
+                UpdateRecvBatchStatistics(1);
                 binding.eventHandler->OnRNS2Recv(recvFromStruct);
             }
             else
@@ -322,11 +346,180 @@ unsigned RNS2_Berkley::RecvFromLoopInt(void)
                 binding.eventHandler->DeallocRNS2RecvStruct(recvFromStruct);
             }
         }
+        else
+        {
+            // Nothing to receive into until the event handler frees a struct
+            RakSleep(1);
+        }
     }
     isRecvFromLoopThreadActive--;
 
     return 0;
 }
+unsigned RNS2_Berkley::RecvFromLoopBatchInt(void)
+{
+#if CRABNET_SUPPORT_RECVMMSG==1
+    unsigned int batchSize = binding.recvBatchSize;
+    if (batchSize > RNS2_MAXIMUM_RECV_BATCH_SIZE)
+        batchSize = RNS2_MAXIMUM_RECV_BATCH_SIZE;
+
+    // Structs stay checked out between calls. Only the ones handed to the event handler are replaced.
+    RNS2RecvStruct *recvFromStructs[RNS2_MAXIMUM_RECV_BATCH_SIZE];
+    unsigned int numAllocated = 0;
+
+    while ( endThreads == false )
+    {
+        while (numAllocated < batchSize)
+        {
+            RNS2RecvStruct *recvFromStruct = binding.eventHandler->AllocRNS2RecvStruct();
+            if (recvFromStruct == NULL)
+                break;
+            recvFromStruct->socket=this;
+            recvFromStructs[numAllocated++]=recvFromStruct;
+        }
+
+        if (numAllocated == 0)
+        {
+            // The event handler is out of structs. Give it time to free some rather than spin
+            RakSleep(1);
+            continue;
+        }
+
+        int numReceived = RecvFromBlockingBatch(recvFromStructs, numAllocated);
+        if (numReceived <= 0)
+        {
+            RakSleep(0);
+            continue;
+        }
+
+        // Move empty datagrams to the back so they are reused by the next call
+        unsigned int numValid = 0;
+        for (unsigned int i=0; i < (unsigned int) numReceived; i++)
+        {
+            if (recvFromStructs[i]->bytesRead > 0)
+            {
+                RakAssert(recvFromStructs[i]->systemAddress.GetPort());
+                RNS2RecvStruct *temp = recvFromStructs[numValid];
+                recvFromStructs[numValid++] = recvFromStructs[i];
+                recvFromStructs[i] = temp;
+            }
+        }
+
+        if (numValid > 0)
+        {
+            UpdateRecvBatchStatistics(numValid);
+            binding.eventHandler->OnRNS2RecvBatch(recvFromStructs, numValid);
+
+            // The event handler owns the first numValid entries now
+            numAllocated -= numValid;
+            memmove(recvFromStructs, recvFromStructs + numValid, numAllocated * sizeof(RNS2RecvStruct*));
+        }
+    }
+
+    for (unsigned int i=0; i < numAllocated; i++)
+        binding.eventHandler->DeallocRNS2RecvStruct(recvFromStructs[i]);
+
+    isRecvFromLoopThreadActive--;
+#endif // CRABNET_SUPPORT_RECVMMSG==1
+
+    return 0;
+}
+void RNS2_Berkley::UpdateRecvBatchStatistics(unsigned int datagramCount)
+{
+    recvBatchCalls.fetch_add(1, std::memory_order_relaxed);
+    recvBatchDatagrams.fetch_add(datagramCount, std::memory_order_relaxed);
+    if (datagramCount > recvBatchLargest.load(std::memory_order_relaxed))
+        recvBatchLargest.store(datagramCount, std::memory_order_relaxed);
+}
+void RNS2_Berkley::GetRecvBatchStatistics(uint64_t *recvCalls, uint64_t *datagramsReceived, unsigned int *largestBatch) const
+{
+    *recvCalls = recvBatchCalls.load(std::memory_order_relaxed);
+    *datagramsReceived = recvBatchDatagrams.load(std::memory_order_relaxed);
+    *largestBatch = recvBatchLargest.load(std::memory_order_relaxed);
+}
+void RNS2_Berkley::GetSendBatchStatistics(uint64_t *sendCalls, uint64_t *datagramsSent) const
+{
+    *sendCalls = sendBatchCalls.load(std::memory_order_relaxed);
+    *datagramsSent = sendBatchDatagrams.load(std::memory_order_relaxed);
+}
+void RNS2_Berkley::AllocateSendBatch(void)
+{
+#if CRABNET_SUPPORT_SENDMMSG==1
+    if (binding.sendBatchSize > RNS2_MAXIMUM_SEND_BATCH_SIZE)
+        binding.sendBatchSize = RNS2_MAXIMUM_SEND_BATCH_SIZE;
+    if (binding.sendBatchSize > 1 && sendBatch == nullptr)
+        sendBatch = new SendBatchEntry[binding.sendBatchSize];
+#endif
+}
+RNS2SendResult RNS2_Berkley::SendBatched( RNS2_SendParameters *sendParameters )
+{
+    if (sendBatch == nullptr || sendParameters->ttl > 0 || sendParameters->length > MAXIMUM_MTU_SIZE)
+    {
+        sendBatchCalls.fetch_add(1, std::memory_order_relaxed);
+        sendBatchDatagrams.fetch_add(1, std::memory_order_relaxed);
+        return Send(sendParameters);
+    }
+
+    sendBatchMutex.Lock();
+    SendBatchEntry *entry = &sendBatch[sendBatchCount++];
+    memcpy(entry->data, sendParameters->data, sendParameters->length);
+    entry->length = sendParameters->length;
+    entry->systemAddress = sendParameters->systemAddress;
+
+    if (sendBatchCount == binding.sendBatchSize)
+        FlushSendBatchUnlocked();
+    sendBatchMutex.Unlock();
+    return sendParameters->length;
+}
+void RNS2_Berkley::FlushSendBatch(void)
+{
+    if (sendBatch == nullptr)
+        return;
+
+    sendBatchMutex.Lock();
+    FlushSendBatchUnlocked();
+    sendBatchMutex.Unlock();
+}
+void RNS2_Berkley::FlushSendBatchUnlocked(void)
+{
+    if (sendBatchCount == 0)
+        return;
+
+#if CRABNET_SUPPORT_SENDMMSG==1
+    unsigned int entryIndex = 0;
+    while (entryIndex < sendBatchCount)
+    {
+        int numSent = SendBatchEntries(entryIndex);
+        if (numSent > 0)
+        {
+            entryIndex += (unsigned int) numSent;
+            continue;
+        }
+
+        if (binding.sendBatchUseGSO && (numSent == -EIO || numSent == -EINVAL))
+        {
+            // Kernel or NIC does not support UDP_SEGMENT. Retry without it from now on.
+            // Transient errors such as EAGAIN or ENOBUFS keep it, and send what is left one at a time below
+            binding.sendBatchUseGSO = false;
+            continue;
+        }
+
+        // Send what is left one at a time so the datagrams are not silently lost
+        for (; entryIndex < sendBatchCount; entryIndex++)
+        {
+            RNS2_SendParameters bsp;
+            bsp.data = sendBatch[entryIndex].data;
+            bsp.length = sendBatch[entryIndex].length;
+            bsp.systemAddress = sendBatch[entryIndex].systemAddress;
+            Send(&bsp);
+            sendBatchCalls.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    sendBatchDatagrams.fetch_add(sendBatchCount, std::memory_order_relaxed);
+#endif
+
+    sendBatchCount = 0;
+}
 RNS2_Berkley::RNS2_Berkley()
 {
     binding.port = 0;
@@ -341,11 +534,24 @@ RNS2_Berkley::RNS2_Berkley()
     binding.pollingThreadPriority = 0;
     binding.eventHandler = eventHandler;
     binding.remotePortRakNetWasStartedOn_PS3_PS4_PSP2 = 0;
+    binding.recvBatchSize = 1;
     isRecvFromLoopThreadActive = 0;
+    recvBatchCalls = 0;
+    recvBatchDatagrams = 0;
+    recvBatchLargest = 0;
+    binding.sendBatchSize = 1;
+    binding.sendBatchUseGSO = false;
+    binding.reusePort = false;
+    sendBatch = nullptr;
+    sendBatchCount = 0;
+    sendBatchCalls = 0;
+    sendBatchDatagrams = 0;
     rns2Socket=(RNS2Socket)INVALID_SOCKET;
 }
 RNS2_Berkley::~RNS2_Berkley()
 {
+    delete [] sendBatch;
+
     if (rns2Socket!=INVALID_SOCKET)
     {
         /*
@@ -362,7 +568,11 @@ int RNS2_Berkley::CreateRecvPollingThread(int threadPriority)
 {
     endThreads=false;
 
+    // Counted before the thread starts, so BlockOnStopRecvPollingThread() waits for it even if it has not run yet
+    isRecvFromLoopThreadActive++;
     int errorCode = RakNet::RakThread::Create(RecvFromLoop, this, threadPriority);
+    if (errorCode != 0)
+        isRecvFromLoopThreadActive--;
 
     return errorCode;
 }
@@ -374,7 +584,13 @@ void RNS2_Berkley::BlockOnStopRecvPollingThread(void)
 {
     endThreads=true;
 
-    // Get recvfrom to unblock
+#if !defined(_WIN32)
+    // Get recvfrom to unblock. A datagram to boundAddress can't be relied on for this, as with SO_REUSEPORT the
+    // kernel may hand it to another socket on the same port
+    shutdown__(rns2Socket, SHUT_RD);
+#endif
+
+    // Get recvfrom to unblock where shutdown does not
     RNS2_SendParameters bsp;
     unsigned long zero=0;
     bsp.data=(char*) &zero;
@@ -383,12 +599,18 @@ void RNS2_Berkley::BlockOnStopRecvPollingThread(void)
     bsp.ttl=0;
     Send(&bsp);
 
+    // The socket is deleted after this returns, so wait for the thread to be done with it. Give up after a second,
+    // as before, rather than hang Shutdown() on a thread that never wakes
     RakNet::TimeMS timeout = RakNet::GetTimeMS()+1000;
+    RakNet::TimeMS nextSend = RakNet::GetTimeMS()+30;
     while (isRecvFromLoopThreadActive > 0 && RakNet::GetTimeMS() < timeout)
     {
-        // Get recvfrom to unblock
-        Send(&bsp);
-        RakSleep(30);
+        if (RakNet::GetTimeMS() >= nextSend)
+        {
+            Send(&bsp);
+            nextSend = RakNet::GetTimeMS()+30;
+        }
+        RakSleep(1);
     }
 }
 const RNS2_BerkleyBindParameters *RNS2_Berkley::GetBindings(void) const {return &binding;}
@@ -66,6 +66,19 @@ void RNS2_Berkley::SetIPHdrIncl(int ipHdrIncl)
 
         setsockopt__( rns2Socket, IPPROTO_IP, IP_HDRINCL, ( char * ) & ipHdrIncl, sizeof( ipHdrIncl ) );
 
+}
+void RNS2_Berkley::SetReusePort(bool reusePort)
+{
+    // Must be set before bind__, on every socket sharing the port
+#if CRABNET_SUPPORT_REUSEPORT==1 && defined(SO_REUSEPORT)
+    if (reusePort)
+    {
+        int opt=1;
+        setsockopt__( rns2Socket, SOL_SOCKET, SO_REUSEPORT, ( char * ) & opt, sizeof ( opt ) );
+    }
+#else
+    (void)(reusePort);
+#endif
 }
 void RNS2_Berkley::SetDoNotFragment( int opt )
 {
@@ -163,6 +176,7 @@ RNS2BindResult RNS2_Berkley::BindSharedIPV4(RNS2_BerkleyBindParameters *bindPara
     if (rns2Socket == -1)
         return BR_FAILED_TO_BIND_SOCKET;
 
+    SetReusePort(bindParameters->reusePort);
     SetSocketOptions();
     SetNonBlockingSocket(bindParameters->nonBlockingSocket);
     SetBroadcastSocket(bindParameters->setBroadcast);
@@ -269,6 +283,7 @@ RNS2BindResult RNS2_Berkley::BindSharedIPV4And6(RNS2_BerkleyBindParameters *bind
         if (rns2Socket == -1)
             return BR_FAILED_TO_BIND_SOCKET;
 
+        SetReusePort(bindParameters->reusePort);
         ret = bind__(rns2Socket, aip->ai_addr, (int) aip->ai_addrlen );
         if (ret>=0)
         {
@@ -429,6 +444,148 @@ void RNS2_Berkley::RecvFromBlocking(RNS2RecvStruct *recvFromStruct)
 #endif
 }
 
+#if CRABNET_SUPPORT_RECVMMSG==1
+int RNS2_Berkley::RecvFromBlockingBatch(RNS2RecvStruct **recvFromStructs, unsigned int count)
+{
+    struct mmsghdr msgs[RNS2_MAXIMUM_RECV_BATCH_SIZE];
+    struct iovec iovecs[RNS2_MAXIMUM_RECV_BATCH_SIZE];
+#if CRABNET_SUPPORT_IPV6==1
+    sockaddr_storage addresses[RNS2_MAXIMUM_RECV_BATCH_SIZE];
+#else
+    sockaddr_in addresses[RNS2_MAXIMUM_RECV_BATCH_SIZE];
+#endif
+
+    RakAssert(count > 0 && count <= RNS2_MAXIMUM_RECV_BATCH_SIZE);
+    memset(msgs, 0, sizeof(struct mmsghdr) * count);
+    for (unsigned int i=0; i < count; i++)
+    {
+        iovecs[i].iov_base = recvFromStructs[i]->data;
+        iovecs[i].iov_len = sizeof(recvFromStructs[i]->data);
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &addresses[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+    }
+
+    // Block for the first datagram, then take whatever else is already queued
+    int numReceived = recvmmsg(rns2Socket, msgs, count, MSG_WAITFORONE, 0);
+    if (numReceived <= 0)
+        return numReceived;
+
+    RakNet::TimeUS timeRead = RakNet::GetTimeUS();
+    for (int i=0; i < numReceived; i++)
+    {
+        RNS2RecvStruct *recvFromStruct = recvFromStructs[i];
+        recvFromStruct->bytesRead = (int) msgs[i].msg_len;
+        recvFromStruct->timeRead = timeRead;
+
+#if CRABNET_SUPPORT_IPV6==1
+        if (addresses[i].ss_family==AF_INET)
+        {
+            memcpy(&recvFromStruct->systemAddress.address.addr4,(sockaddr_in *)&addresses[i],sizeof(sockaddr_in));
+            recvFromStruct->systemAddress.debugPort=ntohs(recvFromStruct->systemAddress.address.addr4.sin_port);
+        }
+        else
+        {
+            memcpy(&recvFromStruct->systemAddress.address.addr6,(sockaddr_in6 *)&addresses[i],sizeof(sockaddr_in6));
+            recvFromStruct->systemAddress.debugPort=ntohs(recvFromStruct->systemAddress.address.addr6.sin6_port);
+        }
+#else
+        recvFromStruct->systemAddress.SetPortNetworkOrder( addresses[i].sin_port );
+        recvFromStruct->systemAddress.address.addr4.sin_addr.s_addr=addresses[i].sin_addr.s_addr;
+#endif
+    }
+
+    return numReceived;
+}
+#endif // CRABNET_SUPPORT_RECVMMSG==1
+
+#if CRABNET_SUPPORT_SENDMMSG==1
+// Returns how many queued entries were handed to the kernel, or -1 on failure
+int RNS2_Berkley::SendBatchEntries(unsigned int firstEntry)
+{
+    struct mmsghdr msgs[RNS2_MAXIMUM_SEND_BATCH_SIZE];
+    struct iovec iovecs[RNS2_MAXIMUM_SEND_BATCH_SIZE];
+    unsigned int entriesInMsg[RNS2_MAXIMUM_SEND_BATCH_SIZE];
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } control[RNS2_MAXIMUM_SEND_BATCH_SIZE];
+
+    unsigned int numMsgs = 0;
+    unsigned int entryIndex = firstEntry;
+    memset(msgs, 0, sizeof(struct mmsghdr) * (sendBatchCount - firstEntry));
+    while (entryIndex < sendBatchCount)
+    {
+        SendBatchEntry *first = &sendBatch[entryIndex];
+        struct msghdr *hdr = &msgs[numMsgs].msg_hdr;
+        hdr->msg_iov = &iovecs[entryIndex];
+        if (first->systemAddress.address.addr4.sin_family == AF_INET)
+        {
+            hdr->msg_name = (void *) &first->systemAddress.address.addr4;
+            hdr->msg_namelen = sizeof(sockaddr_in);
+        }
+#if CRABNET_SUPPORT_IPV6==1
+        else
+        {
+            hdr->msg_name = (void *) &first->systemAddress.address.addr6;
+            hdr->msg_namelen = sizeof(sockaddr_in6);
+        }
+#endif
+
+        // With UDP GSO, consecutive datagrams to the same address go out as one message the kernel splits up.
+        // Every segment except the last must be exactly the size of the first
+        unsigned int segments = 0;
+        int totalLength = 0;
+        do
+        {
+            SendBatchEntry *entry = &sendBatch[entryIndex];
+            iovecs[entryIndex].iov_base = entry->data;
+            iovecs[entryIndex].iov_len = (size_t) entry->length;
+            totalLength += entry->length;
+            segments++;
+            entryIndex++;
+            if (!binding.sendBatchUseGSO || entry->length != first->length)
+                break;
+        }
+        while (entryIndex < sendBatchCount &&
+               segments < RNS2_MAXIMUM_SEND_BATCH_SIZE &&
+               totalLength + sendBatch[entryIndex].length <= 65000 &&
+               sendBatch[entryIndex].length <= first->length &&
+               sendBatch[entryIndex].systemAddress == first->systemAddress);
+
+        hdr->msg_iovlen = segments;
+        if (segments > 1)
+        {
+            hdr->msg_control = control[numMsgs].buf;
+            hdr->msg_controllen = sizeof(control[numMsgs].buf);
+            struct cmsghdr *cm = CMSG_FIRSTHDR(hdr);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segmentSize = (uint16_t) first->length;
+            memcpy(CMSG_DATA(cm), &segmentSize, sizeof(segmentSize));
+        }
+        entriesInMsg[numMsgs++] = segments;
+    }
+
+    int numSent = sendmmsg(rns2Socket, msgs, numMsgs, 0);
+    if (numSent <= 0)
+    {
+        int error = numSent < 0 ? errno : EAGAIN;
+        CRABNET_DEBUG_PRINTF("sendmmsg failed with errno %i for %u messages.\n", error, numMsgs);
+        return -error;
+    }
+    sendBatchCalls.fetch_add(1, std::memory_order_relaxed);
+
+    int entriesSent = 0;
+    for (int i = 0; i < numSent; i++)
+        entriesSent += (int) entriesInMsg[i];
+    return entriesSent;
+}
+#endif // CRABNET_SUPPORT_SENDMMSG==1
+
 #endif // !defined(__native_client__)
 
 #endif // file header
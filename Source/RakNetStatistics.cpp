@@ -102,7 +102,14 @@ void RAK_DLL_EXPORT RakNet::StatisticsToString(RakNetStatistics *s, char *buffer
                         "Bytes in resend buffer               %" PRINTF_64_BIT_MODIFIER "u\n"
                         "Current packetloss                   %.1f%%\n"
                         "Average packetloss                   %.1f%%\n"
-                        "Elapsed connection time in seconds   %" PRINTF_64_BIT_MODIFIER "u\n",
+                        "Elapsed connection time in seconds   %" PRINTF_64_BIT_MODIFIER "u\n"
+                        "Socket receive calls                 %" PRINTF_64_BIT_MODIFIER "u\n"
+                        "Socket datagrams received            %" PRINTF_64_BIT_MODIFIER "u\n"
+                        "Largest receive batch                %u\n"
+                        "Socket send calls                    %" PRINTF_64_BIT_MODIFIER "u\n"
+                        "Socket datagrams sent                %" PRINTF_64_BIT_MODIFIER "u\n"
+                        "Receive queue contention             %" PRINTF_64_BIT_MODIFIER "u\n"
+                        "Receive queue dropped datagrams      %" PRINTF_64_BIT_MODIFIER "u\n",
                 (long long unsigned int) s->valueOverLastSecond[ACTUAL_BYTES_SENT],
                 (long long unsigned int) s->valueOverLastSecond[ACTUAL_BYTES_RECEIVED],
                 (long long unsigned int) s->valueOverLastSecond[USER_MESSAGE_BYTES_SENT],
@@ -126,7 +133,14 @@ void RAK_DLL_EXPORT RakNet::StatisticsToString(RakNetStatistics *s, char *buffer
                 (long long unsigned int) s->bytesInResendBuffer,
                 s->packetlossLastSecond * 100.0f,
                 s->packetlossTotal * 100.0f,
-                (long long unsigned int) (uint64_t) ((RakNet::GetTimeUS() - s->connectionStartTime) / 1000000)
+                (long long unsigned int) (uint64_t) ((RakNet::GetTimeUS() - s->connectionStartTime) / 1000000),
+                (long long unsigned int) s->receiveBatchCalls,
+                (long long unsigned int) s->receiveBatchDatagrams,
+                s->receiveBatchLargest,
+                (long long unsigned int) s->sendBatchCalls,
+                (long long unsigned int) s->sendBatchDatagrams,
+                (long long unsigned int) s->receiveQueueContention,
+                (long long unsigned int) s->receiveQueueDropped
         );
 
         if (s->BPSLimitByCongestionControl != 0)
@@ -148,5 +162,28 @@ void RAK_DLL_EXPORT RakNet::StatisticsToString(RakNetStatistics *s, char *buffer
             );
             strcat(buffer, buff2);
         }
+        if (s->BPSLimitByPacing != 0 || s->pacingDelays != 0)
+        {
+            char buff2[192];
+            sprintf(buff2, "Pacing                           %" PRINTF_64_BIT_MODIFIER "u bytes per second, %" PRINTF_64_BIT_MODIFIER "u delays,"
+                           " %" PRINTF_64_BIT_MODIFIER "u us average, %" PRINTF_64_BIT_MODIFIER "u us longest\n",
+                    (long long unsigned int) s->BPSLimitByPacing,
+                    (long long unsigned int) s->pacingDelays,
+                    (long long unsigned int) (s->pacingDelays ? s->pacingDelayTotal / s->pacingDelays : 0),
+                    (long long unsigned int) s->pacingDelayLongest
+            );
+            strcat(buffer, buff2);
+        }
+        if (s->fecParitySent != 0 || s->fecMessagesRecovered != 0 || s->fecMessagesLost != 0)
+        {
+            char buff2[192];
+            sprintf(buff2, "Forward error correction         %" PRINTF_64_BIT_MODIFIER "u parity sent, %" PRINTF_64_BIT_MODIFIER "u recovered,"
+                           " %" PRINTF_64_BIT_MODIFIER "u lost\n",
+                    (long long unsigned int) s->fecParitySent,
+                    (long long unsigned int) s->fecMessagesRecovered,
+                    (long long unsigned int) s->fecMessagesLost
+            );
+            strcat(buffer, buff2);
+        }
     }
 }
@@ -98,6 +98,10 @@ SocketDescriptor::SocketDescriptor()
     remotePortRakNetWasStartedOn_PS3_PSP2 = 0;
     extraSocketOptions = 0;
     socketFamily = AF_INET;
+    recvBatchSize = 1;
+    sendBatchSize = 1;
+    sendBatchUseGSO = false;
+    reusePortSocketCount = 1;
 }
 
 SocketDescriptor::SocketDescriptor(unsigned short _port, const char *_hostAddress)
@@ -116,6 +120,10 @@ SocketDescriptor::SocketDescriptor(unsigned short _port, const char *_hostAddres
         hostAddress[0] = 0;
     extraSocketOptions = 0;
     socketFamily = AF_INET;
+    recvBatchSize = 1;
+    sendBatchSize = 1;
+    sendBatchUseGSO = false;
+    reusePortSocketCount = 1;
 }
 
 // Defaults to not in peer to peer mode for NetworkIDs.  This only sends the localSystemAddress portion in the BitStream class
@@ -52,6 +52,7 @@
 #include "RakNetVersion.h"
 #include "NetworkIDManager.h"
 #include "SignaledEvent.h"
+#include "PacketAllocator.h"
 #include "SuperFastHash.h"
 #include "RakAlloca.h"
 
@@ -68,6 +69,7 @@
 namespace RakNet
 {
     RAK_THREAD_DECLARATION(UpdateNetworkLoop);
+    RAK_THREAD_DECLARATION(UpdateWorkerLoop);
     RAK_THREAD_DECLARATION(RecvFromLoop);
     RAK_THREAD_DECLARATION(UDTConnect);
 }
@@ -155,35 +157,33 @@ Packet *RakPeer::AllocPacket(unsigned dataSize)
 //     p->guid=UNASSIGNED_CRABNET_GUID;
 //     return p;
 
-    RakNet::Packet *p;
-    packetAllocationPoolMutex.Lock();
-    p = packetAllocationPool.Allocate();
-    packetAllocationPoolMutex.Unlock();
-    p = new((void *) p) Packet;
-    p->data = (unsigned char *) malloc(dataSize);
+    RakNet::Packet *p = PacketAllocator::Allocate();
+#if CRABNET_PACKET_INLINE_DATA_SIZE > 0
+    if (dataSize <= CRABNET_PACKET_INLINE_DATA_SIZE)
+        p->data = PacketAllocator::GetInlineData(p);
+    else
+#endif
+        p->data = (unsigned char *) malloc(dataSize);
     p->length = dataSize;
     p->bitSize = BYTES_TO_BITS(dataSize);
     p->deleteData = true;
     p->guid = UNASSIGNED_CRABNET_GUID;
     p->wasGeneratedLocally = false;
+    p->receiveBuffer = 0;
     return p;
 }
 
 Packet *RakPeer::AllocPacket(unsigned dataSize, unsigned char *data)
 {
     // Packet *p = (Packet *)malloc(sizeof(Packet));
-    RakNet::Packet *p;
-    packetAllocationPoolMutex.Lock();
-    p = packetAllocationPool.Allocate();
-    packetAllocationPoolMutex.Unlock();
-    p = new((void *) p) Packet;
-    RakAssert(p);
+    RakNet::Packet *p = PacketAllocator::Allocate();
     p->data = data;
     p->length = dataSize;
     p->bitSize = BYTES_TO_BITS(dataSize);
     p->deleteData = true;
     p->guid = UNASSIGNED_CRABNET_GUID;
     p->wasGeneratedLocally = false;
+    p->receiveBuffer = 0;
     return p;
 }
 
@@ -258,15 +258,30 @@ RakPeer::RakPeer()
     bufferedCommands.SetPageSize(sizeof(BufferedCommandStruct) * 16);
     socketQueryOutput.SetPageSize(sizeof(SocketQueryOutput) * 8);
 
-    packetAllocationPoolMutex.Lock();
-    packetAllocationPool.SetPageSize(sizeof(DataStructures::MemoryPool<Packet>::MemoryWithPage) * 32);
-    packetAllocationPoolMutex.Unlock();
 
     remoteSystemIndexPool.SetPageSize(sizeof(DataStructures::MemoryPool<RemoteSystemIndex>::MemoryWithPage) * 32);
 
     GenerateGUID();
 
     quitAndDataEvents.InitEvent();
+    updateThreadIsWaitingLong = false;
+    updateWorkerCount = 1;
+    updateShards = nullptr;
+    updateShardsTimeUS = 0;
+    zeroCopyReceive = false;
+    defaultCongestionControl = USE_SLIDING_WINDOW_CONGESTION_CONTROL == 1 ? CC_SLIDING_WINDOW : CC_UDT;
+    defaultPacing = false;
+    for (unsigned int i = 0; i < NUMBER_OF_ORDERED_STREAMS; i++)
+        defaultFecGroupSizes[i] = 0;
+    updateShardsPending = 0;
+    endUpdateWorkers = false;
+    updateShardsRunning = false;
+    updateShardsDoneEvent.InitEvent();
+    receiveQueueSize = CRABNET_BUFFERED_PACKETS_QUEUE_SIZE;
+    bufferedPacketsQueue.Init(receiveQueueSize);
+    bufferedPacketsFreePool.Init(receiveQueueSize);
+    bufferedPacketsDropped = 0;
+    updateShardsReceiveContention = 0;
     limitConnectionFrequencyFromTheSameIP = false;
     ResetSendReceipt();
 }
@@ -278,6 +293,9 @@ RakPeer::~RakPeer()
 {
     Shutdown(0, 0);
 
+    // Zero-copy packets deallocated after Shutdown() returned their receive buffers to the pool
+    ClearBufferedPackets();
+
     // Free the ban list.
     ClearBanList();
 
@@ -286,6 +304,7 @@ RakPeer::~RakPeer()
 #endif
 
     quitAndDataEvents.CloseEvent();
+    updateShardsDoneEvent.CloseEvent();
 
 #ifdef LIBCAT_SECURITY
     // Encryption and security
@@ -430,6 +449,14 @@ RakPeer::Startup(unsigned int maxConnections, SocketDescriptor *socketDescriptor
             bbp.pollingThreadPriority = threadPriority;
             bbp.eventHandler = this;
             bbp.remotePortRakNetWasStartedOn_PS3_PS4_PSP2 = socketDescriptors[i].remotePortRakNetWasStartedOn_PS3_PSP2;
+            bbp.recvBatchSize = socketDescriptors[i].recvBatchSize;
+            bbp.sendBatchSize = socketDescriptors[i].sendBatchSize;
+            bbp.sendBatchUseGSO = socketDescriptors[i].sendBatchUseGSO;
+#if CRABNET_SUPPORT_REUSEPORT == 1
+            bbp.reusePort = socketDescriptors[i].reusePortSocketCount > 1;
+#else
+            bbp.reusePort = false;
+#endif
             RNS2BindResult br = ((RNS2_Berkley *) r2)->Bind(&bbp);
 
             if (
@@ -458,6 +485,29 @@ br == BR_REQUIRES_CRABNET_SUPPORT_IPV6_DEFINE)
             {
                 RakAssert(br == BR_SUCCESS);
             }
+
+            if (bbp.reusePort)
+            {
+                unsigned int reusePortSocketCount = socketDescriptors[i].reusePortSocketCount;
+                if (reusePortSocketCount > RNS2_MAXIMUM_REUSEPORT_SOCKETS)
+                    reusePortSocketCount = RNS2_MAXIMUM_REUSEPORT_SOCKETS;
+
+                // Port 0 gave the first socket an ephemeral port, which the others have to share
+                bbp.port = ((RNS2_Berkley *) r2)->GetBoundAddress().GetPort();
+                for (unsigned int j = 1; j < reusePortSocketCount; j++)
+                {
+                    RakNetSocket2 *reusePortSocket = RakNetSocket2Allocator::AllocRNS2();
+                    reusePortSocket->SetUserConnectionSocketIndex(i);
+                    if (((RNS2_Berkley *) reusePortSocket)->Bind(&bbp) != BR_SUCCESS)
+                    {
+                        RakNetSocket2Allocator::DeallocRNS2(reusePortSocket);
+                        RakNetSocket2Allocator::DeallocRNS2(r2);
+                        DerefAllSockets();
+                        return SOCKET_PORT_ALREADY_IN_USE;
+                    }
+                    reusePortSocketList.Push(reusePortSocket);
+                }
+            }
         }
         else
         {
@@ -501,6 +551,8 @@ br == BR_REQUIRES_CRABNET_SUPPORT_IPV6_DEFINE)
         if (socketList[i]->IsBerkleySocket())
             ((RNS2_Berkley *) socketList[i])->CreateRecvPollingThread(threadPriority);
     }
+    for (i = 0; i < reusePortSocketList.Size(); i++)
+        ((RNS2_Berkley *) reusePortSocketList[i])->CreateRecvPollingThread(threadPriority);
 #endif
 
 // #if !defined(_XBOX) && !defined(_XBOX_720_COMPILE_AS_WINDOWS) && !defined(X360)
@@ -550,6 +602,7 @@ br == BR_REQUIRES_CRABNET_SUPPORT_IPV6_DEFINE)
             remoteSystemList[i].guid = UNASSIGNED_CRABNET_GUID;
             remoteSystemList[i].myExternalSystemAddress = UNASSIGNED_SYSTEM_ADDRESS;
             remoteSystemList[i].connectMode = RemoteSystemStruct::NO_ACTION;
+            remoteSystemList[i].isDueInShard = false;
             remoteSystemList[i].MTUSize = defaultMTUSize;
             remoteSystemList[i].remoteSystemIndex = (SystemIndex) i;
 #ifdef _DEBUG
@@ -560,6 +613,8 @@ br == BR_REQUIRES_CRABNET_SUPPORT_IPV6_DEFINE)
             activeSystemList[i] = &remoteSystemList[i];
         }
 
+        remoteSystemTimers.Init(maximumNumberOfPeers, RakNet::GetTimeUS() / 1000);
+
         for (unsigned int i = 0; i < (unsigned int) maximumNumberOfPeers * REMOTE_SYSTEM_LOOKUP_HASH_MULTIPLE; i++)
         {
             remoteSystemLookup[i] = 0;
@@ -580,6 +635,12 @@ br == BR_REQUIRES_CRABNET_SUPPORT_IPV6_DEFINE)
         ClearBufferedPackets();
         ClearSocketQueryOutput();
 
+        if (StartUpdateWorkers(threadPriority) == false)
+        {
+            Shutdown(0, 0);
+            return FAILED_TO_CREATE_NETWORK_THREAD;
+        }
+
         if (isMainLoopThreadActive == false)
         {
 #if RAKPEER_USER_THREADED != 1
@@ -821,6 +882,41 @@ void RakPeer::SetMaximumIncomingConnections(unsigned short numberAllowed)
     maximumIncomingConnections = numberAllowed;
 }
 
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetUpdateWorkerCount(unsigned int workerCount)
+{
+    if (workerCount < 1)
+        workerCount = 1;
+    else if (workerCount > CRABNET_MAXIMUM_UPDATE_WORKERS)
+        workerCount = CRABNET_MAXIMUM_UPDATE_WORKERS;
+
+    // Takes effect on the next Startup
+    if (endThreads)
+        updateWorkerCount = workerCount;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetReceiveQueueSize(unsigned int size)
+{
+    if (size < 2)
+        size = 2;
+
+    // Takes effect on the next Startup. No receive thread is using the rings while stopped
+    if (endThreads)
+    {
+        receiveQueueSize = size;
+        ClearBufferedPackets();
+        bufferedPacketsQueue.Init(receiveQueueSize);
+        bufferedPacketsFreePool.Init(receiveQueueSize);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetZeroCopyReceive(bool enabled)
+{
+    zeroCopyReceive = enabled;
+}
+
 // ---------------------------------------------------------------------------------------------------------------------
 // Description:
 // Returns the maximum number of incoming connections, which is always <= maxConnections
@@ -1022,10 +1118,11 @@ void RakPeer::Shutdown(unsigned int blockDuration, unsigned char orderingChannel
 
     activeSystemListSize = 0;
 
-    quitAndDataEvents.SetEvent();
-
+    // Before waking the update thread, so it sees endThreads rather than going back to sleep
     endThreads = true;
 
+    quitAndDataEvents.SetEvent();
+
 //    RakNet::TimeMS timeout;
 #if RAKPEER_USER_THREADED != 1
 
@@ -1037,6 +1134,8 @@ void RakPeer::Shutdown(unsigned int blockDuration, unsigned char orderingChannel
             ((RNS2_Berkley *) socketList[i])->SignalStopRecvPollingThread();
         }
     }
+    for (i = 0; i < reusePortSocketList.Size(); i++)
+        ((RNS2_Berkley *) reusePortSocketList[i])->SignalStopRecvPollingThread();
 #endif
 
     /*
@@ -1051,6 +1150,8 @@ void RakPeer::Shutdown(unsigned int blockDuration, unsigned char orderingChannel
     while (isMainLoopThreadActive)
     {
         endThreads = true;
+        // In case a datagram consumed the event before the update thread saw endThreads
+        quitAndDataEvents.SetEvent();
         RakSleep(15);
     }
 
@@ -1076,11 +1177,15 @@ void RakPeer::Shutdown(unsigned int blockDuration, unsigned char orderingChannel
             ((RNS2_Berkley *) socketList[i])->BlockOnStopRecvPollingThread();
         }
     }
+    for (i = 0; i < reusePortSocketList.Size(); i++)
+        ((RNS2_Berkley *) reusePortSocketList[i])->BlockOnStopRecvPollingThread();
 #endif
 
 
 #endif // RAKPEER_USER_THREADED!=1
 
+    StopUpdateWorkers();
+
 //    char c=0;
 //    unsigned int socketIndex;
     // remoteSystemList in Single thread
@@ -1107,9 +1212,6 @@ void RakPeer::Shutdown(unsigned int blockDuration, unsigned char orderingChannel
         DeallocatePacket(packetReturnQueue[i]);
     packetReturnQueue.Clear();
     packetReturnMutex.Unlock();
-    packetAllocationPoolMutex.Lock();
-    packetAllocationPool.Clear();
-    packetAllocationPoolMutex.Unlock();
 
     /*
     if (isRecvFromLoopThreadActive.GetValue()>0)
@@ -1138,6 +1240,7 @@ void RakPeer::Shutdown(unsigned int blockDuration, unsigned char orderingChannel
     delete[] temp;
     delete[] activeSystemList;
     activeSystemList = 0;
+    remoteSystemTimers.Clear();
 
     ClearRemoteSystemLookup();
 
@@ -1398,6 +1501,52 @@ uint32_t RakPeer::SendList(const char **data, const int *lengths, const int numP
     return usedSendReceipt;
 }
 
+// ---------------------------------------------------------------------------------------------------------------------
+// Same as Send, but data is referenced rather than copied, and handed back through releaseCallback once unused.
+// releaseCallback is called exactly once, also when this fails
+// ---------------------------------------------------------------------------------------------------------------------
+uint32_t RakPeer::SendNoCopy(const char *data, const int length, SendReleaseCallback releaseCallback, void *userData,
+                             PacketPriority priority, PacketReliability reliability, char orderingChannel,
+                             const AddressOrGUID systemIdentifier, bool broadcast, uint32_t forceReceiptNumber)
+{
+#ifdef _DEBUG
+    RakAssert(data && length > 0 && releaseCallback);
+#endif
+    RakAssert(!(reliability >= NUMBER_OF_RELIABILITIES || reliability < 0));
+    RakAssert(!(priority > NUMBER_OF_PRIORITIES || priority < 0));
+    RakAssert(!(orderingChannel >= NUMBER_OF_ORDERED_STREAMS));
+
+    if (releaseCallback == 0)
+        return 0;
+
+    if (data == 0 || length <= 0 || remoteSystemList == 0 || endThreads == true ||
+        (broadcast == false && systemIdentifier.IsUndefined()))
+    {
+        releaseCallback(data, userData);
+        return 0;
+    }
+
+    if (broadcast == false && IsLoopbackAddress(systemIdentifier, true))
+    {
+        // Loopback copies into a Packet anyway
+        uint32_t usedSendReceipt = Send(data, length, priority, reliability, orderingChannel, systemIdentifier, false,
+                                        forceReceiptNumber);
+        releaseCallback(data, userData);
+        return usedSendReceipt;
+    }
+
+    uint32_t usedSendReceipt;
+    if (forceReceiptNumber != 0)
+        usedSendReceipt = forceReceiptNumber;
+    else
+        usedSendReceipt = IncrementNextSendReceipt();
+
+    SendBufferedNoCopy(data, length * 8, releaseCallback, userData, priority, reliability, orderingChannel,
+                       systemIdentifier, broadcast, usedSendReceipt);
+
+    return usedSendReceipt;
+}
+
 // ---------------------------------------------------------------------------------------------------------------------
 // Description:
 // Gets a packet from the incoming packet queue. Use DeallocatePacket to deallocate the packet after you are done with it.
@@ -1419,9 +1568,6 @@ Packet *RakPeer::Receive(void)
 
     RakNet::Packet *packet;
 //    Packet **threadPacket;
-    PluginReceiveResult pluginResult;
-
-    int offset;
     unsigned int i;
 
     // User should call RunUpdateCycle and RunRecvFromOnce to do this commented code
@@ -1481,65 +1627,60 @@ Packet *RakPeer::Receive(void)
         if (packet == 0)
             return 0;
 
-//        unsigned char msgId;
-        if ((packet->length >= sizeof(unsigned char) + sizeof(RakNet::Time)) &&
-            ((unsigned char) packet->data[0] == ID_TIMESTAMP))
-        {
-            offset = sizeof(unsigned char);
-            ShiftIncomingTimestamp(packet->data + offset, packet->systemAddress);
-//            msgId=packet->data[sizeof(unsigned char) + sizeof( RakNet::Time )];
-        }
-//        else
-        //        msgId=packet->data[0];
+        if (FilterReceivedPacket(packet) == false)
+            packet = 0; // Will do the loop again and get another packet
+    } while (packet == 0);
+
+#ifdef _DEBUG
+    RakAssert(packet->data);
+#endif
 
-        // Some locally generated packets need to be processed by plugins, for example ID_FCM2_NEW_HOST
-        // The plugin itself should intercept these messages generated remotely
-//         if (packet->wasGeneratedLocally)
-//             return packet;
+    return packet;
+}
 
+// ---------------------------------------------------------------------------------------------------------------------
+// Description:
+// Fills packets with up to maxPackets waiting packets, taking packetReturnMutex once per refill instead of once per packet
+// ---------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::ReceiveBatch(Packet **packets, unsigned int maxPackets)
+{
+    if (!(IsActive()) || packets == 0 || maxPackets == 0)
+        return 0;
 
-        CallPluginCallbacks(pluginListTS, packet);
-        CallPluginCallbacks(pluginListNTS, packet);
+    unsigned int i;
+    for (i = 0; i < pluginListTS.Size(); i++)
+    {
+        pluginListTS[i]->Update();
+    }
+    for (i = 0; i < pluginListNTS.Size(); i++)
+    {
+        pluginListNTS[i]->Update();
+    }
 
-        for (i = 0; i < pluginListTS.Size(); i++)
+    unsigned int packetCount = 0;
+    while (packetCount < maxPackets)
+    {
+        unsigned int popped = 0;
+        packetReturnMutex.Lock();
+        while (packetCount + popped < maxPackets && packetReturnQueue.IsEmpty() == false)
         {
-            pluginResult = pluginListTS[i]->OnReceive(packet);
-            if (pluginResult == RR_STOP_PROCESSING_AND_DEALLOCATE)
-            {
-                DeallocatePacket(packet);
-                packet = 0; // Will do the loop again and get another packet
-                break; // break out of the enclosing for
-            }
-            else if (pluginResult == RR_STOP_PROCESSING)
-            {
-                packet = 0;
-                break;
-            }
+            packets[packetCount + popped] = packetReturnQueue.Pop();
+            popped++;
         }
+        packetReturnMutex.Unlock();
+        if (popped == 0)
+            break;
 
-        for (i = 0; i < pluginListNTS.Size(); i++)
+        // Packets taken by plugins leave gaps; pack the remaining ones to the front and refill the rest
+        unsigned int end = packetCount + popped;
+        for (i = packetCount; i < end; i++)
         {
-            pluginResult = pluginListNTS[i]->OnReceive(packet);
-            if (pluginResult == RR_STOP_PROCESSING_AND_DEALLOCATE)
-            {
-                DeallocatePacket(packet);
-                packet = 0; // Will do the loop again and get another packet
-                break; // break out of the enclosing for
-            }
-            else if (pluginResult == RR_STOP_PROCESSING)
-            {
-                packet = 0;
-                break;
-            }
+            if (FilterReceivedPacket(packets[i]))
+                packets[packetCount++] = packets[i];
         }
+    }
 
-    } while (packet == 0);
-
-#ifdef _DEBUG
-    RakAssert(packet->data);
-#endif
-
-    return packet;
+    return packetCount;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -1553,11 +1694,11 @@ void RakPeer::DeallocatePacket(Packet *packet)
 
     if (packet->deleteData)
     {
-        free(packet->data);
-        packet->~Packet();
-        packetAllocationPoolMutex.Lock();
-        packetAllocationPool.Release(packet);
-        packetAllocationPoolMutex.Unlock();
+        if (packet->receiveBuffer)
+            DeallocRNS2RecvStruct(packet->receiveBuffer);
+        else if (packet->data != PacketAllocator::GetInlineData(packet))
+            free(packet->data);
+        PacketAllocator::Release(packet);
     }
     else
     {
@@ -1565,6 +1706,20 @@ void RakPeer::DeallocatePacket(Packet *packet)
     }
 }
 
+// ---------------------------------------------------------------------------------------------------------------------
+// Description:
+// Call this to deallocate packets returned by ReceiveBatch
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::DeallocatePacketBatch(Packet **packets, unsigned int packetCount)
+{
+    if (packets == 0)
+        return;
+
+    // Packet headers go back to this thread's magazine and receive buffers to a lock-free pool, so nothing here locks
+    for (unsigned int i = 0; i < packetCount; i++)
+        DeallocatePacket(packets[i]);
+}
+
 // ---------------------------------------------------------------------------------------------------------------------
 // Description:
 // Return the total number of connections we are allowed
@@ -2520,6 +2675,140 @@ RakNet::TimeMS RakPeer::GetTimeoutTime(const SystemAddress target)
     return defaultTimeoutTime;
 }
 
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetCongestionControl(CongestionControlAlgorithm algorithm, const SystemAddress target)
+{
+    if (algorithm >= CC_ALGORITHM_COUNT)
+        return;
+
+    if (target == UNASSIGNED_SYSTEM_ADDRESS)
+    {
+        defaultCongestionControl = algorithm;
+
+        unsigned i;
+        for (i = 0; i < maximumNumberOfPeers; i++)
+        {
+            if (remoteSystemList[i].isActive)
+            {
+                remoteSystemList[i].reliabilityLayer.SetCongestionControl(algorithm);
+            }
+        }
+    }
+    else
+    {
+        RemoteSystemStruct *remoteSystem = GetRemoteSystemFromSystemAddress(target, false, true);
+
+        if (remoteSystem != nullptr)
+            remoteSystem->reliabilityLayer.SetCongestionControl(algorithm);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+CongestionControlAlgorithm RakPeer::GetCongestionControl(const SystemAddress target)
+{
+    if (target == UNASSIGNED_SYSTEM_ADDRESS)
+    {
+        return defaultCongestionControl;
+    }
+    else
+    {
+        RemoteSystemStruct *remoteSystem = GetRemoteSystemFromSystemAddress(target, false, true);
+
+        if (remoteSystem != nullptr)
+            return remoteSystem->reliabilityLayer.GetCongestionControl();
+    }
+    return defaultCongestionControl;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetPacing(bool enabled, const SystemAddress target)
+{
+    if (target == UNASSIGNED_SYSTEM_ADDRESS)
+    {
+        defaultPacing = enabled;
+
+        unsigned i;
+        for (i = 0; i < maximumNumberOfPeers; i++)
+        {
+            if (remoteSystemList[i].isActive)
+            {
+                remoteSystemList[i].reliabilityLayer.SetPacing(enabled);
+            }
+        }
+    }
+    else
+    {
+        RemoteSystemStruct *remoteSystem = GetRemoteSystemFromSystemAddress(target, false, true);
+
+        if (remoteSystem != nullptr)
+            remoteSystem->reliabilityLayer.SetPacing(enabled);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetPacing(const SystemAddress target)
+{
+    if (target == UNASSIGNED_SYSTEM_ADDRESS)
+    {
+        return defaultPacing;
+    }
+    else
+    {
+        RemoteSystemStruct *remoteSystem = GetRemoteSystemFromSystemAddress(target, false, true);
+
+        if (remoteSystem != nullptr)
+            return remoteSystem->reliabilityLayer.GetPacing();
+    }
+    return defaultPacing;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetForwardErrorCorrection(unsigned char orderingChannel, unsigned int groupSize, const SystemAddress target)
+{
+    if (orderingChannel >= NUMBER_OF_ORDERED_STREAMS)
+        return;
+
+    if (target == UNASSIGNED_SYSTEM_ADDRESS)
+    {
+        unsigned i;
+        for (i = 0; i < maximumNumberOfPeers; i++)
+        {
+            if (remoteSystemList[i].isActive)
+            {
+                remoteSystemList[i].reliabilityLayer.SetForwardErrorCorrection(orderingChannel, groupSize);
+            }
+        }
+        defaultFecGroupSizes[orderingChannel] = (unsigned char) FecChannel::ClampGroupSize(groupSize);
+    }
+    else
+    {
+        RemoteSystemStruct *remoteSystem = GetRemoteSystemFromSystemAddress(target, false, true);
+
+        if (remoteSystem != nullptr)
+            remoteSystem->reliabilityLayer.SetForwardErrorCorrection(orderingChannel, groupSize);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::GetForwardErrorCorrection(unsigned char orderingChannel, const SystemAddress target)
+{
+    if (orderingChannel >= NUMBER_OF_ORDERED_STREAMS)
+        return 0;
+
+    if (target == UNASSIGNED_SYSTEM_ADDRESS)
+    {
+        return defaultFecGroupSizes[orderingChannel];
+    }
+    else
+    {
+        RemoteSystemStruct *remoteSystem = GetRemoteSystemFromSystemAddress(target, false, true);
+
+        if (remoteSystem != nullptr)
+            return remoteSystem->reliabilityLayer.GetForwardErrorCorrection(orderingChannel);
+    }
+    return defaultFecGroupSizes[orderingChannel];
+}
+
 
 // ---------------------------------------------------------------------------------------------------------------------
 // Description:
@@ -2801,6 +3090,7 @@ void RakPeer::ChangeSystemAddress(RakNetGUID guid, const SystemAddress &systemAd
     bcs->systemIdentifier.rakNetGuid = guid;
     bcs->command = BufferedCommandStruct::BCS_CHANGE_SYSTEM_ADDRESS;
     bufferedCommands.Push(bcs);
+    SignalBufferedCommand(false);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -2819,6 +3109,7 @@ RakNetSocket2 *RakPeer::GetSocket(const SystemAddress target)
     bcs->systemIdentifier = target;
     bcs->data = 0;
     bufferedCommands.Push(bcs);
+    SignalBufferedCommand(true);
 
     // Block up to one second to get the socket, although it should actually take virtually no time
     SocketQueryOutput *sqo;
@@ -2858,6 +3149,7 @@ void RakPeer::GetSockets(DataStructures::List<RakNetSocket2 *> &sockets)
     bcs->systemIdentifier = UNASSIGNED_SYSTEM_ADDRESS;
     bcs->data = 0;
     bufferedCommands.Push(bcs);
+    SignalBufferedCommand(true);
 
     // Block up to one second to get the socket, although it should actually take virtually no time
     SocketQueryOutput *sqo;
@@ -3036,6 +3328,29 @@ RakNetStatistics *RakPeer::GetStatistics(const SystemAddress systemAddress, RakN
                     (*systemStats) += rnsTemp;
             }
         }
+
+        // Socket counters are shared between connections, so total them per socket instead
+        systemStats->receiveBatchCalls = 0;
+        systemStats->receiveBatchDatagrams = 0;
+        systemStats->receiveBatchLargest = 0;
+        systemStats->sendBatchCalls = 0;
+        systemStats->sendBatchDatagrams = 0;
+        for (unsigned int i = 0; i < socketList.Size() + reusePortSocketList.Size(); i++)
+        {
+            RakNetStatistics rnsTemp;
+            if (i < socketList.Size())
+                FillSocketStatistics(socketList[i], &rnsTemp);
+            else
+                FillSocketStatistics(reusePortSocketList[i - socketList.Size()], &rnsTemp);
+            systemStats->receiveBatchCalls += rnsTemp.receiveBatchCalls;
+            systemStats->receiveBatchDatagrams += rnsTemp.receiveBatchDatagrams;
+            if (rnsTemp.receiveBatchLargest > systemStats->receiveBatchLargest)
+                systemStats->receiveBatchLargest = rnsTemp.receiveBatchLargest;
+            systemStats->sendBatchCalls += rnsTemp.sendBatchCalls;
+            systemStats->sendBatchDatagrams += rnsTemp.sendBatchDatagrams;
+        }
+        // Every socket feeds the same receive queues, so these are already totals
+        FillReceiveQueueStatistics(systemStats);
         return systemStats;
     }
     else
@@ -3045,6 +3360,7 @@ RakNetStatistics *RakPeer::GetStatistics(const SystemAddress systemAddress, RakN
         if (rss && endThreads == false)
         {
             rss->reliabilityLayer.GetStatistics(systemStats);
+            FillSocketStatistics(rss->rakNetSocket, systemStats);
             return systemStats;
         }
     }
@@ -3071,6 +3387,7 @@ void RakPeer::GetStatisticsList(DataStructures::List<SystemAddress> &addresses,
             guids.Push((activeSystemList[i])->guid);
             RakNetStatistics rns;
             (activeSystemList[i])->reliabilityLayer.GetStatistics(&rns);
+            FillSocketStatistics((activeSystemList[i])->rakNetSocket, &rns);
             statistics.Push(rns);
         }
     }
@@ -3082,31 +3399,388 @@ bool RakPeer::GetStatistics(const unsigned int index, RakNetStatistics *rns)
     if (index < maximumNumberOfPeers && remoteSystemList[index].isActive)
     {
         remoteSystemList[index].reliabilityLayer.GetStatistics(rns);
+        FillSocketStatistics(remoteSystemList[index].rakNetSocket, rns);
         return true;
     }
     return false;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
-unsigned int RakPeer::GetReceiveBufferSize(void)
+void RakPeer::SignalBufferedCommand(bool immediate)
 {
-    unsigned int size;
-    packetReturnMutex.Lock();
-    size = packetReturnQueue.Size();
-    packetReturnMutex.Unlock();
-    return size;
+    // Without this, the update thread only sees the command when its current wait ends
+    if (immediate || updateThreadIsWaitingLong)
+        quitAndDataEvents.SetEvent();
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
-int RakPeer::GetIndexFromSystemAddress(const SystemAddress systemAddress, bool calledFromNetworkThread) const
+void RakPeer::ScheduleRemoteSystemUpdate(RemoteSystemStruct *remoteSystem)
 {
-    if (systemAddress == UNASSIGNED_SYSTEM_ADDRESS)
-        return -1;
-
-    if (systemAddress.systemIndex != (SystemIndex) -1 && systemAddress.systemIndex < maximumNumberOfPeers &&
-        remoteSystemList[systemAddress.systemIndex].systemAddress == systemAddress &&
-        remoteSystemList[systemAddress.systemIndex].isActive)
-        return systemAddress.systemIndex;
+    // Time 0 is clamped to the current tick, so the next RunUpdateCycle visits this system
+    if (remoteSystem->isActive)
+        remoteSystemTimers.Schedule(remoteSystem->remoteSystemIndex, 0);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+static void ShortenWaitToDeadline(RakNet::Time timeMS, RakNet::Time deadline, RakNet::TimeUS *waitUS)
+{
+    RakNet::TimeUS untilDeadline = deadline > timeMS ? (RakNet::TimeUS) (deadline - timeMS) * 1000 : 0;
+    if (untilDeadline < *waitUS)
+        *waitUS = untilDeadline;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+RakNet::TimeUS RakPeer::GetRemoteSystemTimeToNextUpdate(RemoteSystemStruct *remoteSystem, RakNet::TimeUS timeUS, RakNet::TimeMS timeMS)
+{
+    RakNet::TimeUS waitUS = remoteSystem->reliabilityLayer.GetTimeToNextUpdate(timeUS,
+        (RakNet::TimeUS) CRABNET_REMOTE_SYSTEM_MAX_UPDATE_INTERVAL_MS * 1000);
+
+    // The checks in RunUpdateCycle use >, so wake one millisecond past each deadline
+    if (remoteSystem->connectMode == RemoteSystemStruct::CONNECTED)
+    {
+        ShortenWaitToDeadline(timeMS, remoteSystem->lastReliableSend + remoteSystem->reliabilityLayer.GetTimeoutTime() / 2 + 1, &waitUS);
+        if (occasionalPing || remoteSystem->lowestPing == (unsigned short) -1)
+            ShortenWaitToDeadline(timeMS, remoteSystem->nextPingTime + 1, &waitUS);
+    }
+    else if (remoteSystem->connectMode == RemoteSystemStruct::REQUESTED_CONNECTION ||
+             remoteSystem->connectMode == RemoteSystemStruct::HANDLING_CONNECTION_REQUEST ||
+             remoteSystem->connectMode == RemoteSystemStruct::UNVERIFIED_SENDER)
+        ShortenWaitToDeadline(timeMS, remoteSystem->connectionTime + 10000 + 1, &waitUS);
+
+    // Update() drops a connection once its reliable messages go unacknowledged for the timeout, and so does DISCONNECT_ON_NO_ACK
+    if (remoteSystem->reliabilityLayer.GetMessagesInResendBuffer() != 0 ||
+        remoteSystem->connectMode == RemoteSystemStruct::DISCONNECT_ON_NO_ACK)
+        ShortenWaitToDeadline(timeMS, remoteSystem->reliabilityLayer.GetAckTimeoutTime() + 1, &waitUS);
+
+    return waitUS;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+bool RakPeer::StartUpdateWorkers(int threadPriority)
+{
+#if RAKPEER_USER_THREADED != 1
+    if (updateWorkerCount <= 1)
+        return true;
+
+    updateShards = new UpdateShard[updateWorkerCount];
+    updateShardsPending = 0;
+    endUpdateWorkers = false;
+    for (unsigned int i = 0; i < updateWorkerCount; i++)
+    {
+        updateShards[i].rakPeer = this;
+        updateShards[i].shardIndex = i;
+        updateShards[i].receivedDatagrams.Init(receiveQueueSize);
+        updateShards[i].numTimedRemoteSystems = 0;
+        // Each worker draws from its own generator, so don't give them all the same sequence
+        updateShards[i].rnr.SeedMT(GenerateSeedFromGuid() + i);
+        updateShards[i].startEvent.InitEvent();
+        updateShards[i].hasWork = false;
+        updateShards[i].isThreadActive = false;
+    }
+    updateShardsRunning = true;
+
+    // Shard 0 is run by whichever thread calls RunUpdateCycle
+    for (unsigned int i = 1; i < updateWorkerCount; i++)
+    {
+        // Set here rather than by the thread, so StopUpdateWorkers() waits for threads that have not started yet
+        updateShards[i].isThreadActive = true;
+        if (RakNet::RakThread::Create(UpdateWorkerLoop, &updateShards[i], threadPriority) != 0)
+        {
+            updateShards[i].isThreadActive = false;
+            return false;
+        }
+    }
+#else
+    // No threads to run the other shards on
+    (void) threadPriority;
+#endif // RAKPEER_USER_THREADED!=1
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::StopUpdateWorkers(void)
+{
+    if (updateShards == nullptr)
+        return;
+
+    updateShardsRunning = false;
+    endUpdateWorkers = true;
+    for (unsigned int i = 1; i < updateWorkerCount; i++)
+    {
+        updateShards[i].startEvent.SetEvent();
+        while (updateShards[i].isThreadActive)
+            RakSleep(1);
+    }
+
+    for (unsigned int i = 0; i < updateWorkerCount; i++)
+    {
+        // Whatever arrived or was sent after the last RunUpdateCycle
+        RNS2RecvStruct *recvStruct;
+        while (updateShards[i].receivedDatagrams.Pop(recvStruct))
+            DeallocRNS2RecvStruct(recvStruct);
+        updateShardsReceiveContention.fetch_add(updateShards[i].receivedDatagrams.GetContentionCount(), std::memory_order_relaxed);
+        updateShards[i].receivedDatagrams.Clear();
+        while (!updateShards[i].bufferedCommands.IsEmpty())
+        {
+            BufferedCommandStruct *bcs = updateShards[i].bufferedCommands.Pop();
+            if (bcs->releaseCallback)
+                bcs->releaseCallback(bcs->data, bcs->releaseUserData);
+            else
+                free(bcs->data);
+            bufferedCommands.Deallocate(bcs);
+        }
+        updateShards[i].startEvent.CloseEvent();
+    }
+    delete[] updateShards;
+    updateShards = nullptr;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::GetUpdateShardIndex(const SystemAddress &sa) const
+{
+    // Hashed like remoteSystemLookup, so the receive and user threads can find the worker from an address alone
+    return RemoteSystemLookupHashIndex(sa) % updateWorkerCount;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+bool RakPeer::UpdateShardHasWork(UpdateShard *shard)
+{
+    if (shard->dueRemoteSystems.Size() > 0 || shard->receivedDatagrams.Size() > 0)
+        return true;
+
+    shard->bufferedCommandsMutex.Lock();
+    bool hasCommands = !shard->bufferedCommands.IsEmpty();
+    shard->bufferedCommandsMutex.Unlock();
+    return hasCommands;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::AddShardRemoteSystem(UpdateShard *shard, RemoteSystemStruct *remoteSystem)
+{
+    // Once per cycle, however many datagrams and sends the system had
+    if (remoteSystem->isDueInShard)
+        return;
+
+    remoteSystem->isDueInShard = true;
+    shard->dueRemoteSystems.Push(remoteSystem->remoteSystemIndex);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::RunUpdateShard(UpdateShard *shard)
+{
+    // Only this shard's connections are touched here. Everything that needs the rest of RakPeer is handed back to the
+    // update thread, which picks it up once the workers are done
+    shard->numTimedRemoteSystems = shard->dueRemoteSystems.Size();
+    for (unsigned int i = 0; i < shard->numTimedRemoteSystems; i++)
+        remoteSystemList[shard->dueRemoteSystems[i]].isDueInShard = true;
+
+    // Datagrams that arrive from here on wait for the next cycle, so a flood can't keep the worker in this loop
+    RNS2RecvStruct *recvStruct;
+    for (unsigned int numDatagrams = shard->receivedDatagrams.Size(); numDatagrams > 0; numDatagrams--)
+    {
+        if (!shard->receivedDatagrams.Pop(recvStruct))
+            break;
+        ProcessShardDatagram(shard, recvStruct);
+    }
+
+    BufferedCommandStruct *bcs;
+    for (;;)
+    {
+        shard->bufferedCommandsMutex.Lock();
+        bcs = shard->bufferedCommands.IsEmpty() ? 0 : shard->bufferedCommands.Pop();
+        shard->bufferedCommandsMutex.Unlock();
+        if (bcs == 0)
+            break;
+
+        RunBufferedSend(bcs, updateShardsTimeUS, shard);
+        bufferedCommands.Deallocate(bcs);
+    }
+
+    for (unsigned int i = 0; i < shard->dueRemoteSystems.Size(); i++)
+    {
+        RemoteSystemStruct *remoteSystem = remoteSystemList + shard->dueRemoteSystems[i];
+        remoteSystem->isDueInShard = false;
+        if (!remoteSystem->isActive)
+            continue;
+
+        remoteSystem->reliabilityLayer.Update(remoteSystem->rakNetSocket, remoteSystem->systemAddress,
+                                              remoteSystem->MTUSize, updateShardsTimeUS, maxOutgoingBPS, pluginListNTS,
+                                              &shard->rnr, shard->updateBitStream);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::UpdateDueRemoteSystems(RakNet::TimeUS timeUS, BitStream &updateBitStream)
+{
+    if (updateShards == nullptr)
+    {
+        for (unsigned int i = 0; i < dueRemoteSystems.Size(); i++)
+        {
+            RemoteSystemStruct *remoteSystem = remoteSystemList + dueRemoteSystems[i];
+            if (!remoteSystem->isActive)
+                continue;
+
+            // systemAddress only used for the internet simulator test
+            remoteSystem->reliabilityLayer.Update(remoteSystem->rakNetSocket, remoteSystem->systemAddress,
+                                                  remoteSystem->MTUSize, timeUS, maxOutgoingBPS, pluginListNTS, &rnr,
+                                                  updateBitStream);
+        }
+        return;
+    }
+
+    updateShardsTimeUS = timeUS;
+    unsigned int numWorkItems = dueRemoteSystems.Size();
+    for (unsigned int i = 0; i < dueRemoteSystems.Size(); i++)
+    {
+        RemoteSystemStruct *remoteSystem = remoteSystemList + dueRemoteSystems[i];
+        updateShards[GetUpdateShardIndex(remoteSystem->systemAddress)].dueRemoteSystems.Push(dueRemoteSystems[i]);
+    }
+    for (unsigned int i = 0; i < updateWorkerCount; i++)
+        numWorkItems += updateShards[i].receivedDatagrams.Size();
+
+    if (numWorkItems < CRABNET_UPDATE_WORKER_MIN_SYSTEMS || endUpdateWorkers)
+    {
+        for (unsigned int i = 0; i < updateWorkerCount; i++)
+            RunUpdateShard(&updateShards[i]);
+    }
+    else
+    {
+        // Hold a count of our own until every worker with work has been started, so none can finish the cycle early.
+        // Workers read updateShardsTimeUS and the shard lists after seeing hasWork
+        updateShardsPending = 1;
+        for (unsigned int i = 1; i < updateWorkerCount; i++)
+        {
+            if (!UpdateShardHasWork(&updateShards[i]))
+                continue;
+            updateShardsPending++;
+            updateShards[i].hasWork = true;
+            updateShards[i].startEvent.SetEvent();
+        }
+
+        RunUpdateShard(&updateShards[0]);
+
+        updateShardsPending--;
+        while (updateShardsPending != 0)
+            updateShardsDoneEvent.WaitOnEvent(1);
+    }
+
+    // The systems the workers received from or sent to were updated as well. Take them off the timers so the rest of
+    // RunUpdateCycle handles their messages and reschedules them
+    for (unsigned int i = 0; i < updateWorkerCount; i++)
+    {
+        UpdateShard *shard = &updateShards[i];
+        for (unsigned int j = shard->numTimedRemoteSystems; j < shard->dueRemoteSystems.Size(); j++)
+        {
+            remoteSystemTimers.Cancel(shard->dueRemoteSystems[j]);
+            dueRemoteSystems.Push(shard->dueRemoteSystems[j]);
+        }
+        shard->dueRemoteSystems.Clear(true);
+        shard->numTimedRemoteSystems = 0;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+BitSize_t RakPeer::ReceiveFromReliabilityLayer(RemoteSystemStruct *remoteSystem, unsigned char **data,
+                                               RNS2RecvStruct **receiveBuffer)
+{
+    BitSize_t bitSize = remoteSystem->reliabilityLayer.Receive(data, receiveBuffer);
+    if (*receiveBuffer == 0)
+        return bitSize;
+
+    // Only the user message branch of RunUpdateCycle passes the receive buffer on to a Packet
+    if ((*data)[0] < (MessageID) ID_TIMESTAMP || remoteSystem->connectMode == RemoteSystemStruct::UNVERIFIED_SENDER ||
+        !remoteSystem->isActive)
+    {
+        unsigned char *copy = (unsigned char *) malloc(BITS_TO_BYTES(bitSize));
+        memcpy(copy, *data, BITS_TO_BYTES(bitSize));
+        DeallocRNS2RecvStruct(*receiveBuffer);
+        *receiveBuffer = 0;
+        *data = copy;
+    }
+    return bitSize;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+int RakPeer::GetUpdateThreadWaitTime(void)
+{
+    // Callbacks installed with SetUserUpdateThread expect to run on the old fixed interval
+    if (userUpdateThreadPtr)
+        return 10;
+
+    requestedConnectionQueueMutex.Lock();
+    bool isIdle = activeSystemListSize == 0 && requestedConnectionQueue.IsEmpty();
+    requestedConnectionQueueMutex.Unlock();
+
+    RakNet::TimeUS waitUS = (RakNet::TimeUS) (isIdle ? CRABNET_UPDATE_THREAD_IDLE_WAIT_MS : CRABNET_UPDATE_THREAD_MAX_WAIT_MS) * 1000;
+    waitUS = remoteSystemTimers.GetTimeToNextExpiry(RakNet::GetTimeUS() / 1000, waitUS / 1000) * 1000;
+
+    if (waitUS > 10000)
+    {
+        // Publish the long wait before looking at the queue one last time. A user thread that pushes a command
+        // concurrently either sees the flag and sets the event, or its command is seen here
+        updateThreadIsWaitingLong = true;
+        if (HasBufferedCommands())
+            waitUS = 0;
+    }
+
+    // Round up, waking a little late is cheaper than spinning until the deadline
+    return (int) ((waitUS + 999) / 1000);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::FillSocketStatistics(RakNetSocket2 *s, RakNetStatistics *rns) const
+{
+    rns->receiveBatchCalls = 0;
+    rns->receiveBatchDatagrams = 0;
+    rns->receiveBatchLargest = 0;
+    rns->sendBatchCalls = 0;
+    rns->sendBatchDatagrams = 0;
+    FillReceiveQueueStatistics(rns);
+#if !defined(__native_client__)
+    if (s && s->IsBerkleySocket())
+    {
+        ((RNS2_Berkley *) s)->GetRecvBatchStatistics(&rns->receiveBatchCalls, &rns->receiveBatchDatagrams, &rns->receiveBatchLargest);
+        ((RNS2_Berkley *) s)->GetSendBatchStatistics(&rns->sendBatchCalls, &rns->sendBatchDatagrams);
+    }
+#else
+    (void) s;
+#endif
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::FillReceiveQueueStatistics(RakNetStatistics *rns) const
+{
+    rns->receiveQueueContention = bufferedPacketsQueue.GetContentionCount() + bufferedPacketsFreePool.GetContentionCount() +
+                                  updateShardsReceiveContention.load(std::memory_order_relaxed);
+    if (updateShardsRunning)
+    {
+        for (unsigned int i = 0; i < updateWorkerCount; i++)
+            rns->receiveQueueContention += updateShards[i].receivedDatagrams.GetContentionCount();
+    }
+    rns->receiveQueueDropped = bufferedPacketsDropped.load(std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::GetReceiveBufferSize(void)
+{
+    unsigned int size;
+    packetReturnMutex.Lock();
+    size = packetReturnQueue.Size();
+    packetReturnMutex.Unlock();
+    return size;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+int RakPeer::GetIndexFromSystemAddress(const SystemAddress systemAddress, bool calledFromNetworkThread) const
+{
+    if (systemAddress == UNASSIGNED_SYSTEM_ADDRESS)
+        return -1;
+
+    if (systemAddress.systemIndex != (SystemIndex) -1 && systemAddress.systemIndex < maximumNumberOfPeers &&
+        remoteSystemList[systemAddress.systemIndex].systemAddress == systemAddress &&
+        remoteSystemList[systemAddress.systemIndex].isActive)
+        return systemAddress.systemIndex;
 
     if (calledFromNetworkThread)
         return GetRemoteSystemIndex(systemAddress);
@@ -3276,6 +3950,7 @@ RakPeer::SendConnectionRequest(const char *host, unsigned short remotePort, cons
     }
     requestedConnectionQueue.Push(rcs);
     requestedConnectionQueueMutex.Unlock();
+    SignalBufferedCommand(true);
 
     return CONNECTION_ATTEMPT_STARTED;
 }
@@ -3334,6 +4009,7 @@ RakPeer::SendConnectionRequest(const char *host, unsigned short remotePort, cons
     }
     requestedConnectionQueue.Push(rcs);
     requestedConnectionQueueMutex.Unlock();
+    SignalBufferedCommand(true);
 
     return CONNECTION_ATTEMPT_STARTED;
 }
@@ -3602,6 +4278,10 @@ RakPeer::AssignSystemAddressToRemoteSystemList(const SystemAddress systemAddress
             if (incomingMTU > remoteSystem->MTUSize)
                 remoteSystem->MTUSize = incomingMTU;
             RakAssert(remoteSystem->MTUSize <= MAXIMUM_MTU_SIZE);
+            remoteSystem->reliabilityLayer.SetCongestionControl(defaultCongestionControl);
+            remoteSystem->reliabilityLayer.SetPacing(defaultPacing);
+            for (unsigned int i = 0; i < NUMBER_OF_ORDERED_STREAMS; i++)
+                remoteSystem->reliabilityLayer.SetForwardErrorCorrection((unsigned char) i, defaultFecGroupSizes[i]);
             remoteSystem->reliabilityLayer.Reset(true, remoteSystem->MTUSize, useSecurity);
             remoteSystem->reliabilityLayer.SetSplitMessageProgressInterval(splitMessageProgressInterval);
             remoteSystem->reliabilityLayer.SetUnreliableTimeout(unreliableTimeout);
@@ -3776,6 +4456,7 @@ void RakPeer::ClearRemoteSystemLookup(void)
 void RakPeer::AddToActiveSystemList(unsigned int remoteSystemListIndex)
 {
     activeSystemList[activeSystemListSize++] = remoteSystemList + remoteSystemListIndex;
+    remoteSystemTimers.Schedule(remoteSystemListIndex, 0);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -3786,6 +4467,7 @@ void RakPeer::RemoveFromActiveSystemList(const SystemAddress &sa)
         RemoteSystemStruct *rss = activeSystemList[i];
         if (rss->systemAddress == sa)
         {
+            remoteSystemTimers.Cancel(rss->remoteSystemIndex);
             activeSystemList[i] = activeSystemList[activeSystemListSize - 1];
             activeSystemListSize--;
             return;
@@ -3877,40 +4559,34 @@ bool RakPeer::AllowIncomingConnections(void) const
 // ---------------------------------------------------------------------------------------------------------------------
 void RakPeer::DeallocRNS2RecvStruct(RNS2RecvStruct *s)
 {
-    bufferedPacketsFreePoolMutex.Lock();
-    bufferedPacketsFreePool.Push(s);
-    bufferedPacketsFreePoolMutex.Unlock();
+    // Zero-copy packets may still point into s
+    if (s->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    // Keep no more spares than the pool holds
+    if (!bufferedPacketsFreePool.Push(s))
+        delete s;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 RNS2RecvStruct *RakPeer::AllocRNS2RecvStruct()
 {
-    bufferedPacketsFreePoolMutex.Lock();
-    if (bufferedPacketsFreePool.Size() > 0)
-    {
-        RNS2RecvStruct *s = bufferedPacketsFreePool.Pop();
-        bufferedPacketsFreePoolMutex.Unlock();
-        return s;
-    }
-    else
-    {
-        bufferedPacketsFreePoolMutex.Unlock();
-        return new RNS2RecvStruct;
-    }
+    RNS2RecvStruct *s;
+    if (!bufferedPacketsFreePool.Pop(s))
+        s = new RNS2RecvStruct;
+    s->refCount.store(1, std::memory_order_relaxed);
+    s->eventHandler = this;
+    return s;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 void RakPeer::ClearBufferedPackets(void)
 {
-    bufferedPacketsFreePoolMutex.Lock();
-    while (bufferedPacketsFreePool.Size() > 0)
-        delete bufferedPacketsFreePool.Pop();
-    bufferedPacketsFreePoolMutex.Unlock();
-
-    bufferedPacketsQueueMutex.Lock();
-    while (bufferedPacketsQueue.Size() > 0)
-        delete bufferedPacketsQueue.Pop();
-    bufferedPacketsQueueMutex.Unlock();
+    RNS2RecvStruct *s;
+    while (bufferedPacketsFreePool.Pop(s))
+        delete s;
+    while (bufferedPacketsQueue.Pop(s))
+        delete s;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -3921,22 +4597,37 @@ void RakPeer::SetupBufferedPackets(void)
 // ---------------------------------------------------------------------------------------------------------------------
 void RakPeer::PushBufferedPacket(RNS2RecvStruct *p)
 {
-    bufferedPacketsQueueMutex.Lock();
-    bufferedPacketsQueue.Push(p);
-    bufferedPacketsQueueMutex.Unlock();
+    if (!bufferedPacketsQueue.Push(p))
+    {
+        // The update thread is too far behind
+        bufferedPacketsDropped.fetch_add(1, std::memory_order_relaxed);
+        DeallocRNS2RecvStruct(p);
+    }
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
-RNS2RecvStruct *RakPeer::PopBufferedPacket(void)
+void RakPeer::PushReceivedDatagram(RNS2RecvStruct *p)
 {
-    bufferedPacketsQueueMutex.Lock();
-    if (bufferedPacketsQueue.Size() > 0)
+    if (!updateShardsRunning)
     {
-        RNS2RecvStruct *s = bufferedPacketsQueue.Pop();
-        bufferedPacketsQueueMutex.Unlock();
-        return s;
+        PushBufferedPacket(p);
+        return;
     }
-    bufferedPacketsQueueMutex.Unlock();
+
+    // With update workers, each datagram goes straight to the worker that owns its sender
+    if (!updateShards[GetUpdateShardIndex(p->systemAddress)].receivedDatagrams.Push(p))
+    {
+        bufferedPacketsDropped.fetch_add(1, std::memory_order_relaxed);
+        DeallocRNS2RecvStruct(p);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+RNS2RecvStruct *RakPeer::PopBufferedPacket(void)
+{
+    RNS2RecvStruct *s;
+    if (bufferedPacketsQueue.Pop(s))
+        return s;
     return 0;
 }
 
@@ -4018,6 +4709,7 @@ void RakPeer::CloseConnectionInternal(const AddressOrGUID &systemIdentifier, boo
             bcs->orderingChannel = orderingChannel;
             bcs->priority = disconnectionNotificationPriority;
             bufferedCommands.Push(bcs);
+            SignalBufferedCommand(false);
         }
     }
 }
@@ -4050,14 +4742,41 @@ void RakPeer::SendBuffered(const char *data, BitSize_t numberOfBitsToSend, Packe
     bcs->broadcast = broadcast;
     bcs->connectionMode = connectionMode;
     bcs->receipt = receipt;
+    bcs->releaseCallback = 0;
     bcs->command = BufferedCommandStruct::BCS_SEND;
-    bufferedCommands.Push(bcs);
+    PushBufferedCommand(bcs);
 
-    if (priority == IMMEDIATE_PRIORITY)
-    {
-        // Forces pending sends to go out now, rather than waiting to the next update interval
-        quitAndDataEvents.SetEvent();
-    }
+    // Immediate priority forces pending sends to go out now, rather than waiting to the next update interval
+    SignalBufferedCommand(priority == IMMEDIATE_PRIORITY);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::SendBufferedNoCopy(const char *data, BitSize_t numberOfBitsToSend, SendReleaseCallback releaseCallback,
+                                 void *releaseUserData, PacketPriority priority, PacketReliability reliability,
+                                 char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast,
+                                 uint32_t receipt)
+{
+    RakAssert(!(reliability >= NUMBER_OF_RELIABILITIES || reliability < 0));
+    RakAssert(!(priority > NUMBER_OF_PRIORITIES || priority < 0));
+    RakAssert(!(orderingChannel >= NUMBER_OF_ORDERED_STREAMS));
+
+    BufferedCommandStruct *bcs = bufferedCommands.Allocate();
+    bcs->data = (char *) data;
+    bcs->numberOfBitsToSend = numberOfBitsToSend;
+    bcs->priority = priority;
+    bcs->reliability = reliability;
+    bcs->orderingChannel = orderingChannel;
+    bcs->systemIdentifier = systemIdentifier;
+    bcs->broadcast = broadcast;
+    bcs->connectionMode = RemoteSystemStruct::NO_ACTION;
+    bcs->receipt = receipt;
+    bcs->releaseCallback = releaseCallback;
+    bcs->releaseUserData = releaseUserData;
+    bcs->command = BufferedCommandStruct::BCS_SEND;
+    PushBufferedCommand(bcs);
+
+    // Immediate priority forces pending sends to go out now, rather than waiting to the next update interval
+    SignalBufferedCommand(priority == IMMEDIATE_PRIORITY);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -4112,17 +4831,150 @@ void RakPeer::SendBufferedList(const char **data, const int *lengths, const int
     bcs->broadcast = broadcast;
     bcs->connectionMode = connectionMode;
     bcs->receipt = receipt;
+    bcs->releaseCallback = 0;
     bcs->command = BufferedCommandStruct::BCS_SEND;
-    bufferedCommands.Push(bcs);
+    PushBufferedCommand(bcs);
+
+    // Immediate priority forces pending sends to go out now, rather than waiting to the next update interval
+    SignalBufferedCommand(priority == IMMEDIATE_PRIORITY);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Application data sent to several connections, which each release it on their own
+struct SendReleaseReference
+{
+    SendReleaseCallback releaseCallback;
+    void *releaseUserData;
+    std::atomic<unsigned int> references;
+};
+
+static void ReleaseSendReference(const char *data, void *userData)
+{
+    SendReleaseReference *releaseReference = (SendReleaseReference *) userData;
+    if (--releaseReference->references == 0)
+    {
+        releaseReference->releaseCallback(data, releaseReference->releaseUserData);
+        delete releaseReference;
+    }
+}
 
-    if (priority == IMMEDIATE_PRIORITY)
-        quitAndDataEvents.SetEvent(); // Forces pending sends to go out now, rather than waiting to the next update interval
+static void FreeSendData(const char *data, void *userData)
+{
+    (void) userData;
+    free((void *) data);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::PushBufferedCommand(BufferedCommandStruct *bcs)
+{
+    if (!updateShardsRunning)
+    {
+        bufferedCommands.Push(bcs);
+        return;
+    }
+
+    // A send to an address goes to the worker that owns that address
+    if (!bcs->broadcast && bcs->systemIdentifier.systemAddress != UNASSIGNED_SYSTEM_ADDRESS)
+    {
+        UpdateShard *shard = &updateShards[GetUpdateShardIndex(bcs->systemIdentifier.systemAddress)];
+        shard->bufferedCommandsMutex.Lock();
+        shard->bufferedCommands.Push(bcs);
+        shard->bufferedCommandsMutex.Unlock();
+        return;
+    }
+
+    // Broadcasts, and sends by guid alone, go to every worker, which each send to their own connections. The workers
+    // share the data, and the last one done with it frees it or hands it back to the application
+    SendReleaseReference *releaseReference = new SendReleaseReference;
+    if (bcs->releaseCallback)
+    {
+        releaseReference->releaseCallback = bcs->releaseCallback;
+        releaseReference->releaseUserData = bcs->releaseUserData;
+    }
+    else
+    {
+        releaseReference->releaseCallback = FreeSendData;
+        releaseReference->releaseUserData = 0;
+    }
+    releaseReference->references = updateWorkerCount;
+    bcs->releaseCallback = ReleaseSendReference;
+    bcs->releaseUserData = releaseReference;
+
+    for (unsigned int i = 0; i < updateWorkerCount; i++)
+    {
+        BufferedCommandStruct *shardCommand = bcs;
+        if (i + 1 < updateWorkerCount)
+        {
+            shardCommand = bufferedCommands.Allocate();
+            shardCommand->data = bcs->data;
+            shardCommand->numberOfBitsToSend = bcs->numberOfBitsToSend;
+            shardCommand->priority = bcs->priority;
+            shardCommand->reliability = bcs->reliability;
+            shardCommand->orderingChannel = bcs->orderingChannel;
+            shardCommand->systemIdentifier = bcs->systemIdentifier;
+            shardCommand->broadcast = bcs->broadcast;
+            shardCommand->connectionMode = bcs->connectionMode;
+            shardCommand->receipt = bcs->receipt;
+            shardCommand->releaseCallback = bcs->releaseCallback;
+            shardCommand->releaseUserData = bcs->releaseUserData;
+            shardCommand->command = bcs->command;
+        }
+        updateShards[i].bufferedCommandsMutex.Lock();
+        updateShards[i].bufferedCommands.Push(shardCommand);
+        updateShards[i].bufferedCommandsMutex.Unlock();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::RunBufferedSend(BufferedCommandStruct *bcs, RakNet::TimeUS currentTime, UpdateShard *shard)
+{
+    if (bcs->releaseCallback)
+    {
+        // Hands the data back to the application itself once no connection references it
+        SendImmediate((char *) bcs->data, bcs->numberOfBitsToSend, bcs->priority, bcs->reliability,
+                      bcs->orderingChannel, bcs->systemIdentifier, bcs->broadcast, false, currentTime, bcs->receipt,
+                      bcs->releaseCallback, bcs->releaseUserData, shard);
+    }
+    else
+    {
+        bool callerDataAllocationUsed = SendImmediate((char *) bcs->data, bcs->numberOfBitsToSend, bcs->priority,
+                                                      bcs->reliability, bcs->orderingChannel, bcs->systemIdentifier,
+                                                      bcs->broadcast, true, currentTime, bcs->receipt, 0, 0, shard);
+        if (!callerDataAllocationUsed)
+            free(bcs->data);
+    }
+
+    // Set the new connection state AFTER we call sendImmediate in case we are setting it to a disconnection state, which does not allow further sends
+    if (bcs->connectionMode != RemoteSystemStruct::NO_ACTION)
+    {
+        RakPeer::RemoteSystemStruct *remoteSystem = GetRemoteSystem(bcs->systemIdentifier, true, true);
+        if (remoteSystem && (shard == 0 || GetUpdateShardIndex(remoteSystem->systemAddress) == shard->shardIndex))
+            remoteSystem->connectMode = bcs->connectionMode;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+bool RakPeer::HasBufferedCommands(void)
+{
+    if (!bufferedCommands.IsEmpty())
+        return true;
+
+    for (unsigned int i = 0; updateShards != nullptr && i < updateWorkerCount; i++)
+    {
+        updateShards[i].bufferedCommandsMutex.Lock();
+        bool isEmpty = updateShards[i].bufferedCommands.IsEmpty();
+        updateShards[i].bufferedCommandsMutex.Unlock();
+        if (!isEmpty)
+            return true;
+    }
+    return false;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 bool RakPeer::SendImmediate(char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability,
                             char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast,
-                            bool useCallerDataAllocation, RakNet::TimeUS currentTime, uint32_t receipt)
+                            bool useCallerDataAllocation, RakNet::TimeUS currentTime, uint32_t receipt,
+                            SendReleaseCallback releaseCallback, void *releaseUserData, UpdateShard *shard)
 {
     unsigned remoteSystemIndex; // Iterates into the list of remote systems
     if (systemIdentifier.systemAddress != UNASSIGNED_SYSTEM_ADDRESS)
@@ -4137,8 +4989,14 @@ bool RakPeer::SendImmediate(char *data, BitSize_t numberOfBitsToSend, PacketPrio
     // 03/06/06 - If broadcast is false, use the optimized version of GetIndexFromSystemAddress
     if (!broadcast)
     {
-        if (remoteSystemIndex == (unsigned int) -1)
+        // A worker only sends to its own connections. Sends by guid alone reach every worker
+        if (remoteSystemIndex == (unsigned int) -1 ||
+            (shard && GetUpdateShardIndex(remoteSystemList[remoteSystemIndex].systemAddress) != shard->shardIndex))
+        {
+            if (releaseCallback)
+                releaseCallback(data, releaseUserData);
             return false;
+        }
 
 #if USE_ALLOCA == 1
         sendList = (unsigned *) alloca(sizeof(unsigned));
@@ -4170,7 +5028,8 @@ bool RakPeer::SendImmediate(char *data, BitSize_t numberOfBitsToSend, PacketPrio
             if (remoteSystemIndex != (unsigned int) -1 && idx == remoteSystemIndex)
                 continue;
 
-            if (remoteSystemList[idx].isActive && remoteSystemList[idx].systemAddress != UNASSIGNED_SYSTEM_ADDRESS)
+            if (remoteSystemList[idx].isActive && remoteSystemList[idx].systemAddress != UNASSIGNED_SYSTEM_ADDRESS &&
+                (shard == 0 || GetUpdateShardIndex(remoteSystemList[idx].systemAddress) == shard->shardIndex))
                 sendList[sendListSize++] = idx;
         }
     }
@@ -4180,20 +5039,49 @@ bool RakPeer::SendImmediate(char *data, BitSize_t numberOfBitsToSend, PacketPrio
 #if !defined(USE_ALLOCA)
         free(sendList);
 #endif
+        if (releaseCallback)
+            releaseCallback(data, releaseUserData);
         return false;
     }
 
+    // Each connection holds a reference to the application's data, and so do we until every connection has one
+    SendReleaseReference *releaseReference = 0;
+    if (releaseCallback)
+    {
+        releaseReference = new SendReleaseReference;
+        releaseReference->releaseCallback = releaseCallback;
+        releaseReference->releaseUserData = releaseUserData;
+        releaseReference->references = 1;
+    }
+
     bool callerDataAllocationUsed = false;
     for (unsigned sendListIndex = 0; sendListIndex < sendListSize; sendListIndex++)
     {
-        // Send may split the packet and thus deallocate data.  Don't assume data is valid if we use the callerAllocationData
-        bool useData = useCallerDataAllocation && !callerDataAllocationUsed && sendListIndex + 1 == sendListSize;
-        remoteSystemList[sendList[sendListIndex]].reliabilityLayer.Send(data, numberOfBitsToSend, priority, reliability,
-                                                                        orderingChannel, !useData,
-                                                                        remoteSystemList[sendList[sendListIndex]].MTUSize,
-                                                                        currentTime, receipt);
-        if (useData)
-            callerDataAllocationUsed = true;
+        if (releaseReference)
+        {
+            releaseReference->references++;
+            if (!remoteSystemList[sendList[sendListIndex]].reliabilityLayer.Send(data, numberOfBitsToSend, priority,
+                                                                                reliability, orderingChannel, false,
+                                                                                remoteSystemList[sendList[sendListIndex]].MTUSize,
+                                                                                currentTime, receipt,
+                                                                                ReleaseSendReference, releaseReference))
+                releaseReference->references--;
+        }
+        else
+        {
+            // Send may split the packet and thus deallocate data.  Don't assume data is valid if we use the callerAllocationData
+            bool useData = useCallerDataAllocation && !callerDataAllocationUsed && sendListIndex + 1 == sendListSize;
+            remoteSystemList[sendList[sendListIndex]].reliabilityLayer.Send(data, numberOfBitsToSend, priority, reliability,
+                                                                            orderingChannel, !useData,
+                                                                            remoteSystemList[sendList[sendListIndex]].MTUSize,
+                                                                            currentTime, receipt);
+            if (useData)
+                callerDataAllocationUsed = true;
+        }
+        if (shard)
+            AddShardRemoteSystem(shard, &remoteSystemList[sendList[sendListIndex]]);
+        else
+            ScheduleRemoteSystemUpdate(&remoteSystemList[sendList[sendListIndex]]);
 
         if (reliability == RELIABLE ||
             reliability == RELIABLE_ORDERED ||
@@ -4211,6 +5099,9 @@ bool RakPeer::SendImmediate(char *data, BitSize_t numberOfBitsToSend, PacketPrio
     free(sendList);
 #endif
 
+    if (releaseReference)
+        ReleaseSendReference(data, releaseReference);
+
     // Return value only meaningful if true was passed for useCallerDataAllocation.
     // Means the reliability layer used that data copy, so the caller should not deallocate it
     return callerDataAllocationUsed;
@@ -4256,7 +5147,9 @@ void RakPeer::ClearBufferedCommands(void)
     BufferedCommandStruct *bcs;
     while ((bcs = bufferedCommands.Pop()) != 0)
     {
-        if (bcs->data)
+        if (bcs->command == BufferedCommandStruct::BCS_SEND && bcs->releaseCallback)
+            bcs->releaseCallback(bcs->data, bcs->releaseUserData);
+        else if (bcs->data)
             free(bcs->data);
 
         bufferedCommands.Deallocate(bcs);
@@ -4314,6 +5207,52 @@ void RakPeer::GenerateGUID(void)
 // ---------------------------------------------------------------------------------------------------------------------
 namespace RakNet
 {
+    bool IsOfflineMessage(const char *data, unsigned int length)
+    {
+        // The reason for all this is that the reliability layer has no way to tell between offline messages that arrived late for a player that is now connected,
+        // and a regular encoding. So I insert OFFLINE_MESSAGE_DATA_ID into the stream, the encoding of which is essentially impossible to hit by chance
+        if (length <= 2)
+            return true;
+        if (((unsigned char) data[0] == ID_UNCONNECTED_PING || (unsigned char) data[0] == ID_UNCONNECTED_PING_OPEN_CONNECTIONS) &&
+                length >= sizeof(unsigned char) + sizeof(RakNet::Time) + sizeof(OFFLINE_MESSAGE_DATA_ID))
+        {
+            return memcmp(data + sizeof(unsigned char) + sizeof(RakNet::Time), OFFLINE_MESSAGE_DATA_ID,
+                          sizeof(OFFLINE_MESSAGE_DATA_ID)) == 0;
+        }
+        if ((unsigned char) data[0] == ID_UNCONNECTED_PONG && (size_t) length >=
+                                                                   sizeof(unsigned char) + sizeof(RakNet::TimeMS) +
+                                                                   RakNetGUID::size() + sizeof(OFFLINE_MESSAGE_DATA_ID))
+        {
+            return memcmp(data + sizeof(unsigned char) + sizeof(RakNet::Time) + RakNetGUID::size(),
+                          OFFLINE_MESSAGE_DATA_ID, sizeof(OFFLINE_MESSAGE_DATA_ID)) == 0;
+        }
+        if ((unsigned char) data[0] == ID_OUT_OF_BAND_INTERNAL &&
+                (size_t) length >= sizeof(MessageID) + RakNetGUID::size() + sizeof(OFFLINE_MESSAGE_DATA_ID))
+        {
+            return memcmp(data + sizeof(MessageID) + RakNetGUID::size(), OFFLINE_MESSAGE_DATA_ID,
+                          sizeof(OFFLINE_MESSAGE_DATA_ID)) == 0;
+        }
+        if (((unsigned char) data[0] == ID_OPEN_CONNECTION_REPLY_1 ||
+                  (unsigned char) data[0] == ID_OPEN_CONNECTION_REPLY_2 ||
+                  (unsigned char) data[0] == ID_OPEN_CONNECTION_REQUEST_1 ||
+                  (unsigned char) data[0] == ID_OPEN_CONNECTION_REQUEST_2 ||
+                  (unsigned char) data[0] == ID_CONNECTION_ATTEMPT_FAILED ||
+                  (unsigned char) data[0] == ID_NO_FREE_INCOMING_CONNECTIONS ||
+                  (unsigned char) data[0] == ID_CONNECTION_BANNED ||
+                  (unsigned char) data[0] == ID_ALREADY_CONNECTED ||
+                  (unsigned char) data[0] == ID_IP_RECENTLY_CONNECTED) &&
+                 (size_t) length >= sizeof(MessageID) + RakNetGUID::size() + sizeof(OFFLINE_MESSAGE_DATA_ID))
+        {
+            return memcmp(data + sizeof(MessageID), OFFLINE_MESSAGE_DATA_ID, sizeof(OFFLINE_MESSAGE_DATA_ID)) == 0;
+        }
+        if (((unsigned char) data[0] == ID_INCOMPATIBLE_PROTOCOL_VERSION &&
+                  (size_t) length == sizeof(MessageID) * 2 + RakNetGUID::size() + sizeof(OFFLINE_MESSAGE_DATA_ID)))
+        {
+            return memcmp(data + sizeof(MessageID) * 2, OFFLINE_MESSAGE_DATA_ID, sizeof(OFFLINE_MESSAGE_DATA_ID)) == 0;
+        }
+        return false;
+    }
+
     bool ProcessOfflineNetworkPacket(SystemAddress systemAddress, const char *data, unsigned int length, RakPeer *rakPeer,
                                      RakNetSocket2 *rakNetSocket, bool *isOfflineMessage, RakNet::TimeUS timeRead)
     {
@@ -4354,49 +5293,7 @@ namespace RakNet
 
 
 
-        // The reason for all this is that the reliability layer has no way to tell between offline messages that arrived late for a player that is now connected,
-        // and a regular encoding. So I insert OFFLINE_MESSAGE_DATA_ID into the stream, the encoding of which is essentially impossible to hit by chance
-        if (length <= 2)
-            *isOfflineMessage = true;
-        else if (((unsigned char) data[0] == ID_UNCONNECTED_PING || (unsigned char) data[0] == ID_UNCONNECTED_PING_OPEN_CONNECTIONS) &&
-                length >= sizeof(unsigned char) + sizeof(RakNet::Time) + sizeof(OFFLINE_MESSAGE_DATA_ID))
-        {
-            *isOfflineMessage = memcmp(data + sizeof(unsigned char) + sizeof(RakNet::Time), OFFLINE_MESSAGE_DATA_ID,
-                                       sizeof(OFFLINE_MESSAGE_DATA_ID)) == 0;
-        }
-        else if ((unsigned char) data[0] == ID_UNCONNECTED_PONG && (size_t) length >=
-                                                                   sizeof(unsigned char) + sizeof(RakNet::TimeMS) +
-                                                                   RakNetGUID::size() + sizeof(OFFLINE_MESSAGE_DATA_ID))
-        {
-            *isOfflineMessage = memcmp(data + sizeof(unsigned char) + sizeof(RakNet::Time) + RakNetGUID::size(),
-                                       OFFLINE_MESSAGE_DATA_ID, sizeof(OFFLINE_MESSAGE_DATA_ID)) == 0;
-        }
-        else if ((unsigned char) data[0] == ID_OUT_OF_BAND_INTERNAL &&
-                (size_t) length >= sizeof(MessageID) + RakNetGUID::size() + sizeof(OFFLINE_MESSAGE_DATA_ID))
-        {
-            *isOfflineMessage = memcmp(data + sizeof(MessageID) + RakNetGUID::size(), OFFLINE_MESSAGE_DATA_ID,
-                                       sizeof(OFFLINE_MESSAGE_DATA_ID)) == 0;
-        }
-        else if (((unsigned char) data[0] == ID_OPEN_CONNECTION_REPLY_1 ||
-                  (unsigned char) data[0] == ID_OPEN_CONNECTION_REPLY_2 ||
-                  (unsigned char) data[0] == ID_OPEN_CONNECTION_REQUEST_1 ||
-                  (unsigned char) data[0] == ID_OPEN_CONNECTION_REQUEST_2 ||
-                  (unsigned char) data[0] == ID_CONNECTION_ATTEMPT_FAILED ||
-                  (unsigned char) data[0] == ID_NO_FREE_INCOMING_CONNECTIONS ||
-                  (unsigned char) data[0] == ID_CONNECTION_BANNED ||
-                  (unsigned char) data[0] == ID_ALREADY_CONNECTED ||
-                  (unsigned char) data[0] == ID_IP_RECENTLY_CONNECTED) &&
-                 (size_t) length >= sizeof(MessageID) + RakNetGUID::size() + sizeof(OFFLINE_MESSAGE_DATA_ID))
-        {
-            *isOfflineMessage = memcmp(data + sizeof(MessageID), OFFLINE_MESSAGE_DATA_ID, sizeof(OFFLINE_MESSAGE_DATA_ID)) == 0;
-        }
-        else if (((unsigned char) data[0] == ID_INCOMPATIBLE_PROTOCOL_VERSION &&
-                  (size_t) length == sizeof(MessageID) * 2 + RakNetGUID::size() + sizeof(OFFLINE_MESSAGE_DATA_ID)))
-        {
-            *isOfflineMessage = memcmp(data + sizeof(MessageID) * 2, OFFLINE_MESSAGE_DATA_ID, sizeof(OFFLINE_MESSAGE_DATA_ID)) == 0;
-        }
-        else
-            *isOfflineMessage = false;
+        *isOfflineMessage = IsOfflineMessage(data, length);
 
         if (*isOfflineMessage)
         {
@@ -4621,11 +5518,16 @@ namespace RakNet
 
                         // Binding address
                         bsOut.Write(rcs->systemAddress);
+                        // Answer from the socket Connect() was given. With SO_REUSEPORT the reply may have arrived on
+                        // any socket bound to the same port
+                        RakNetSocket2 *connectionSocket = rcs->socket ? rcs->socket : rakPeer->socketList[rcs->socketIndex];
                         rakPeer->requestedConnectionQueueMutex.Unlock();
                         // MTU
                         bsOut.Write(mtu);
                         // Our guid
                         bsOut.Write(rakPeer->GetGuidFromSystemAddress(UNASSIGNED_SYSTEM_ADDRESS));
+                        // ReliabilityFeature flags we offer. Older servers ignore this
+                        bsOut.Write((unsigned char) CRABNET_RELIABILITY_FEATURES);
 
                         for (i = 0; i < rakPeer->pluginListNTS.Size(); i++)
                             rakPeer->pluginListNTS[i]->OnDirectSocketSend((const char *) bsOut.GetData(), bsOut.GetNumberOfBitsUsed(),
@@ -4637,7 +5539,7 @@ namespace RakNet
                         bsp.data = (char *) bsOut.GetData();
                         bsp.length = bsOut.GetNumberOfBytesUsed();
                         bsp.systemAddress = systemAddress;
-                        rakNetSocket->Send(&bsp);
+                        connectionSocket->Send(&bsp);
 
                         return true;
                     }
@@ -4674,6 +5576,10 @@ namespace RakNet
                 }
                 cat::ClientEasyHandshake *client_handshake = 0;
 #endif // LIBCAT_SECURITY
+                // Older servers do not send feature flags
+                unsigned char reliabilityFeatures = 0;
+                bs.Read(reliabilityFeatures);
+                reliabilityFeatures &= CRABNET_RELIABILITY_FEATURES;
 
                 bool unlock = true;
                 rakPeer->requestedConnectionQueueMutex.Lock();
@@ -4714,10 +5620,11 @@ namespace RakNet
                         // You might get this when already connected because of cross-connections
                         bool thisIPConnectedRecently = false;
                         remoteSystem = rakPeer->GetRemoteSystemFromSystemAddress(systemAddress, true, true);
+                        // Keep the socket Connect() was given, not whichever SO_REUSEPORT socket the reply arrived on
                         if (remoteSystem == 0)
                             remoteSystem = rakPeer->AssignSystemAddressToRemoteSystemList(systemAddress,
                                                                                           RakPeer::RemoteSystemStruct::UNVERIFIED_SENDER,
-                                                                                          rcs->socket ? rcs->socket : rakNetSocket,
+                                                                                          rcs->socket ? rcs->socket : rakPeer->socketList[rcs->socketIndex],
                                                                                           &thisIPConnectedRecently, bindingAddress,
                                                                                           mtu, guid, doSecurity);
 
@@ -4764,6 +5671,7 @@ namespace RakNet
 
                                 remoteSystem->weInitiatedTheConnection = true;
                                 remoteSystem->connectMode = RakPeer::RemoteSystemStruct::REQUESTED_CONNECTION;
+                                remoteSystem->reliabilityLayer.SetReliabilityFeatures(reliabilityFeatures);
                                 if (rcs->timeoutTime != 0)
                                     remoteSystem->reliabilityLayer.SetTimeoutTime(rcs->timeoutTime);
 
@@ -4997,6 +5905,10 @@ namespace RakNet
                 uint16_t mtu;
                 bs.Read(mtu);
                 bs.Read(guid);
+                // Older clients do not send feature flags
+                unsigned char reliabilityFeatures = 0;
+                bs.Read(reliabilityFeatures);
+                reliabilityFeatures &= CRABNET_RELIABILITY_FEATURES;
 
                 RakPeer::RemoteSystemStruct *rssFromSA = rakPeer->GetRemoteSystemFromSystemAddress(systemAddress, true, true);
                 bool IPAddrInUse = rssFromSA != 0 && rssFromSA->isActive;
@@ -5052,6 +5964,7 @@ namespace RakNet
                                                    sizeof(rssFromSA->answer));
                     }
 #endif // LIBCAT_SECURITY
+                    bsAnswer.Write(rssFromSA->reliabilityLayer.GetReliabilityFeatures());
 
                     unsigned int i;
                     for (i = 0; i < rakPeer->pluginListNTS.Size(); i++)
@@ -5154,6 +6067,9 @@ namespace RakNet
                     bsAnswer.WriteAlignedBytes((const unsigned char *) rssFromSA->answer, sizeof(rssFromSA->answer));
                 }
 #endif // LIBCAT_SECURITY
+                // The flags both sides offer. Older clients ignore this
+                rssFromSA->reliabilityLayer.SetReliabilityFeatures(reliabilityFeatures);
+                bsAnswer.Write(reliabilityFeatures);
                 for (unsigned i = 0; i < rakPeer->pluginListNTS.Size(); i++)
                     rakPeer->pluginListNTS[i]->OnDirectSocketSend((const char *) bsAnswer.GetData(), bsAnswer.GetNumberOfBitsUsed(), systemAddress);
                 // SocketLayer::SendTo( rakNetSocket, (const char*) bsAnswer.GetData(), bsAnswer.GetNumberOfBytesUsed(), systemAddress );
@@ -5173,11 +6089,12 @@ namespace RakNet
     void ProcessNetworkPacket(SystemAddress systemAddress, const char *data, unsigned int length, RakPeer *rakPeer,
                               RakNet::TimeUS timeRead, BitStream &updateBitStream)
     {
-        ProcessNetworkPacket(systemAddress, data, length, rakPeer, rakPeer->socketList[0], timeRead, updateBitStream);
+        ProcessNetworkPacket(systemAddress, data, length, rakPeer, rakPeer->socketList[0], timeRead, updateBitStream, 0);
     }
 
     void ProcessNetworkPacket(SystemAddress systemAddress, const char *data, unsigned int length, RakPeer *rakPeer,
-                              RakNetSocket2 *rakNetSocket, RakNet::TimeUS timeRead, BitStream &updateBitStream)
+                              RakNetSocket2 *rakNetSocket, RakNet::TimeUS timeRead, BitStream &updateBitStream,
+                              RNS2RecvStruct *receiveBuffer)
     {
 #ifdef LIBCAT_SECURITY
 #ifdef CAT_AUDIT
@@ -5201,10 +6118,54 @@ namespace RakNet
             // HandleSocketReceiveFromConnectedPlayer is only safe to be called from the same thread as Update, which is this thread
             remoteSystem->reliabilityLayer.HandleSocketReceiveFromConnectedPlayer(data, length, systemAddress,
                                                                                   rakPeer->pluginListNTS, remoteSystem->MTUSize,
-                                                                                  rakNetSocket, &rnr, timeRead, updateBitStream);
+                                                                                  rakNetSocket, &rnr, timeRead, updateBitStream,
+                                                                                  receiveBuffer);
+            rakPeer->ScheduleRemoteSystemUpdate(remoteSystem);
         }
     }
+}
 
+// ---------------------------------------------------------------------------------------------------------------------
+void RakPeer::ProcessShardDatagram(UpdateShard *shard, RNS2RecvStruct *recvStruct)
+{
+#ifdef LIBCAT_SECURITY
+#ifdef CAT_AUDIT
+    printf("AUDIT: RECV ");
+    for (int ii = 0; ii < recvStruct->bytesRead; ++ii)
+        printf("%02x", (cat::u8)recvStruct->data[ii]);
+    printf("\n");
+#endif
+#endif // LIBCAT_SECURITY
+
+    RakAssert(recvStruct->systemAddress.GetPort());
+
+    // The worker only handles datagrams for its connections. Offline messages, banned senders and unknown senders
+    // go back to the update thread, which looks at bufferedPacketsQueue while the workers are idle
+    RemoteSystemStruct *remoteSystem = 0;
+    if (!IsOfflineMessage(recvStruct->data, recvStruct->bytesRead))
+    {
+        char str1[64];
+        recvStruct->systemAddress.ToString(false, str1);
+        if (!IsBanned(str1))
+            remoteSystem = GetRemoteSystemFromSystemAddress(recvStruct->systemAddress, true, true);
+    }
+    if (remoteSystem == 0)
+    {
+        PushBufferedPacket(recvStruct);
+        quitAndDataEvents.SetEvent();
+        return;
+    }
+
+    // The lookup only finds systems by their own address, so this one hashes to this shard
+    RakAssert(GetUpdateShardIndex(remoteSystem->systemAddress) == shard->shardIndex);
+    remoteSystem->reliabilityLayer.HandleSocketReceiveFromConnectedPlayer(recvStruct->data, recvStruct->bytesRead,
+                                                                          recvStruct->systemAddress, pluginListNTS,
+                                                                          remoteSystem->MTUSize, recvStruct->socket,
+                                                                          &shard->rnr, recvStruct->timeRead,
+                                                                          shard->updateBitStream,
+                                                                          zeroCopyReceive ? recvStruct : 0);
+    AddShardRemoteSystem(shard, remoteSystem);
+    DeallocRNS2RecvStruct(recvStruct);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -5238,6 +6199,10 @@ void RakPeer::DerefAllSockets(void)
         delete socketList[i];
     }
     socketList.Clear(false);
+
+    for (i = 0; i < reusePortSocketList.Size(); i++)
+        delete reusePortSocketList[i];
+    reusePortSocketList.Clear(false);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -5311,7 +6276,6 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream)
     //SystemAddress authoritativeClientSystemAddress;
     unsigned char *data;
     SystemAddress systemAddress;
-    bool callerDataAllocationUsed;
     RakNetStatistics *rnss;
     RakNet::TimeUS timeNS = 0;
     RakNet::Time timeMS = 0;
@@ -5326,7 +6290,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream)
         do {
             len = ((RNS2_Windows*)socketList[0])->GetSocketLayerOverride()->RakNetRecvFrom(dataOut,&sender,true);
             if (len>0)
-                ProcessNetworkPacket( sender, dataOut, len, this, socketList[0], RakNet::GetTimeUS(), updateBitStream );
+                ProcessNetworkPacket( sender, dataOut, len, this, socketList[0], RakNet::GetTimeUS(), updateBitStream, 0 );
         } while (len>0);
     }
 #endif
@@ -5343,8 +6307,10 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream)
         }
         if (socketListIndex!=socketList.Size())
         */
+        // With update workers, only what they handed back lands here
         ProcessNetworkPacket(recvFromStruct->systemAddress, recvFromStruct->data, recvFromStruct->bytesRead, this,
-                             recvFromStruct->socket, recvFromStruct->timeRead, updateBitStream);
+                             recvFromStruct->socket, recvFromStruct->timeRead, updateBitStream,
+                             zeroCopyReceive ? recvFromStruct : 0);
         DeallocRNS2RecvStruct(recvFromStruct);
     }
 
@@ -5358,21 +6324,10 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream)
             {
                 timeNS = RakNet::GetTimeUS();
                 timeMS = (RakNet::TimeMS) (timeNS / (RakNet::TimeUS) 1000);
+                //CRABNET_DEBUG_PRINTF("timeNS = %I64i timeMS=%i\n", timeNS, timeMS);
             }
 
-            callerDataAllocationUsed = SendImmediate((char *) bcs->data, bcs->numberOfBitsToSend, bcs->priority,
-                                                     bcs->reliability, bcs->orderingChannel, bcs->systemIdentifier,
-                                                     bcs->broadcast, true, timeNS, bcs->receipt);
-            if (!callerDataAllocationUsed)
-                free(bcs->data);
-
-            // Set the new connection state AFTER we call sendImmediate in case we are setting it to a disconnection state, which does not allow further sends
-            if (bcs->connectionMode != RemoteSystemStruct::NO_ACTION)
-            {
-                RakPeer::RemoteSystemStruct *remoteSystem = GetRemoteSystem(bcs->systemIdentifier, true, true);
-                if (remoteSystem)
-                    remoteSystem->connectMode = bcs->connectionMode;
-            }
+            RunBufferedSend(bcs, timeNS, 0);
         }
         else if (bcs->command == BufferedCommandStruct::BCS_CLOSE_CONNECTION)
             CloseConnectionInternal(bcs->systemIdentifier, false, true, bcs->orderingChannel, bcs->priority);
@@ -5550,31 +6505,22 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream)
         requestedConnectionQueueMutex.Unlock();
     }
 
-    // remoteSystemList in network thread
-    for (unsigned activeSystemListIndex = 0; activeSystemListIndex < activeSystemListSize; ++activeSystemListIndex)
-        //for ( remoteSystemIndex = 0; remoteSystemIndex < remoteSystemListSize; ++remoteSystemIndex )
+    if (timeNS == 0)
     {
-        // I'm using systemAddress from remoteSystemList but am not locking it because this loop is called very frequently and it doesn't
-        // matter if we miss or do an extra update.  The reliability layers themselves never care which player they are associated with
-        //systemAddress = remoteSystemList[ remoteSystemIndex ].systemAddress;
-        // Allow the systemAddress for this remote system list to change.  We don't care if it changes now.
-        //    remoteSystemList[ remoteSystemIndex ].allowSystemAddressAssigment=true;
-
-
-        // Found an active remote system
-        RakPeer::RemoteSystemStruct *remoteSystem = activeSystemList[activeSystemListIndex];
-        systemAddress = remoteSystem->systemAddress;
-        RakAssert(systemAddress != UNASSIGNED_SYSTEM_ADDRESS);
-        // Update is only safe to call from the same thread that calls HandleSocketReceiveFromConnectedPlayer,
-        // which is this thread
+        timeNS = RakNet::GetTimeUS();
+        timeMS = (RakNet::TimeMS) (timeNS / (RakNet::TimeUS) 1000);
+    }
 
-        if (timeNS == 0)
-        {
-            timeNS = RakNet::GetTimeUS();
-            timeMS = (RakNet::TimeMS) (timeNS / (RakNet::TimeUS) 1000);
-            //CRABNET_DEBUG_PRINTF("timeNS = %I64i timeMS=%i\n", timeNS, timeMS);
-        }
+    // Only visit systems whose timer expired, or that received datagrams or were sent messages since their last update
+    dueRemoteSystems.Clear(true);
+    remoteSystemTimers.Advance(timeNS / 1000, dueRemoteSystems);
 
+    // Keepalives first, since PingInternal sends through SendImmediate which is only safe on this thread
+    for (unsigned dueRemoteSystemIndex = 0; dueRemoteSystemIndex < dueRemoteSystems.Size(); ++dueRemoteSystemIndex)
+    {
+        RakPeer::RemoteSystemStruct *remoteSystem = remoteSystemList + dueRemoteSystems[dueRemoteSystemIndex];
+        if (!remoteSystem->isActive)
+            continue;
 
         if (timeMS > remoteSystem->lastReliableSend &&
             timeMS - remoteSystem->lastReliableSend > remoteSystem->reliabilityLayer.GetTimeoutTime() / 2 &&
@@ -5585,16 +6531,35 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream)
             rnss = remoteSystem->reliabilityLayer.GetStatistics(&rakNetStatistics);
             if (rnss->messagesInResendBuffer == 0)
             {
-                PingInternal(systemAddress, true, RELIABLE);
+                PingInternal(remoteSystem->systemAddress, true, RELIABLE);
 
                 //remoteSystem->lastReliableSend=timeMS+remoteSystem->reliabilityLayer.GetTimeoutTime();
                 remoteSystem->lastReliableSend = timeMS;
             }
         }
+    }
+
+    // Update is only safe to call from the same thread that calls HandleSocketReceiveFromConnectedPlayer,
+    // which is this thread, or the system's update worker when there are several
+    UpdateDueRemoteSystems(timeNS, updateBitStream);
+
+    // remoteSystemList in network thread
+    for (unsigned dueRemoteSystemIndex = 0; dueRemoteSystemIndex < dueRemoteSystems.Size(); ++dueRemoteSystemIndex)
+        //for ( remoteSystemIndex = 0; remoteSystemIndex < remoteSystemListSize; ++remoteSystemIndex )
+    {
+        // I'm using systemAddress from remoteSystemList but am not locking it because this loop is called very frequently and it doesn't
+        // matter if we miss or do an extra update.  The reliability layers themselves never care which player they are associated with
+        //systemAddress = remoteSystemList[ remoteSystemIndex ].systemAddress;
+        // Allow the systemAddress for this remote system list to change.  We don't care if it changes now.
+        //    remoteSystemList[ remoteSystemIndex ].allowSystemAddressAssigment=true;
 
-        remoteSystem->reliabilityLayer.Update(remoteSystem->rakNetSocket, systemAddress, remoteSystem->MTUSize, timeNS,
-                                              maxOutgoingBPS, pluginListNTS, &rnr,
-                                              updateBitStream); // systemAddress only used for the internet simulator test
+
+        // Found an active remote system, unless it was closed earlier in this cycle
+        RakPeer::RemoteSystemStruct *remoteSystem = remoteSystemList + dueRemoteSystems[dueRemoteSystemIndex];
+        if (!remoteSystem->isActive)
+            continue;
+        systemAddress = remoteSystem->systemAddress;
+        RakAssert(systemAddress != UNASSIGNED_SYSTEM_ADDRESS);
 
         // Check for failure conditions
         if (remoteSystem->reliabilityLayer.IsDeadConnection() ||
@@ -5666,7 +6631,8 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream)
 
         // Does the reliability layer have any packets waiting for us?
         // To be thread safe, this has to be called in the same thread as HandleSocketReceiveFromConnectedPlayer
-        BitSize_t bitSize = remoteSystem->reliabilityLayer.Receive(&data);
+        RNS2RecvStruct *receiveBuffer;
+        BitSize_t bitSize = ReceiveFromReliabilityLayer(remoteSystem, &data, &receiveBuffer);
 
         while (bitSize > 0)
         {
@@ -5952,6 +6918,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream)
                          data[0] == ID_SND_RECEIPT_LOSS) && remoteSystem->isActive)
                     {
                         packet = AllocPacket(byteSize, data);
+                        packet->receiveBuffer = receiveBuffer;
                         packet->bitSize = bitSize;
                         packet->systemAddress = systemAddress;
                         packet->systemAddress.systemIndex = remoteSystem->remoteSystemIndex;
@@ -5966,11 +6933,32 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream)
 
             // Does the reliability layer have any more packets waiting for us?
             // To be thread safe, this has to be called in the same thread as HandleSocketReceiveFromConnectedPlayer
-            bitSize = remoteSystem->reliabilityLayer.Receive(&data);
+            bitSize = ReceiveFromReliabilityLayer(remoteSystem, &data, &receiveBuffer);
         }
 
     }
 
+    for (unsigned dueRemoteSystemIndex = 0; dueRemoteSystemIndex < dueRemoteSystems.Size(); ++dueRemoteSystemIndex)
+    {
+        unsigned int remoteSystemIndex = dueRemoteSystems[dueRemoteSystemIndex];
+        RakPeer::RemoteSystemStruct *remoteSystem = remoteSystemList + remoteSystemIndex;
+
+        // Datagrams from reliabilityLayer.Update() may be held by sockets that batch sends. Push them out once per cycle
+        if (remoteSystem->rakNetSocket)
+            remoteSystem->rakNetSocket->FlushSendBatch();
+
+        // Skip systems that were closed, or that were sent something after their update and so are already due again
+        if (!remoteSystem->isActive || remoteSystemTimers.IsScheduled(remoteSystemIndex))
+            continue;
+
+        RakNet::TimeUS waitUS = GetRemoteSystemTimeToNextUpdate(remoteSystem, timeNS, (RakNet::TimeMS) timeMS);
+        remoteSystemTimers.Schedule(remoteSystemIndex, (timeNS + waitUS + 999) / 1000);
+    }
+    for (unsigned i = 0; i < socketList.Size(); i++)
+        socketList[i]->FlushSendBatch();
+    for (unsigned i = 0; i < reusePortSocketList.Size(); i++)
+        reusePortSocketList[i]->FlushSendBatch();
+
     return true;
 }
 
@@ -5981,12 +6969,30 @@ void RakPeer::OnRNS2Recv(RNS2RecvStruct *recvStruct)
     if (incomingDatagramEventHandler && !incomingDatagramEventHandler(recvStruct))
         return;
 
-    PushBufferedPacket(recvStruct);
+    PushReceivedDatagram(recvStruct);
     quitAndDataEvents.SetEvent();
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+void RakPeer::OnRNS2RecvBatch(RNS2RecvStruct **recvStructs, unsigned int count)
+{
+    // Wake the update thread once for the whole batch
+    unsigned int numPushed = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (incomingDatagramEventHandler && !incomingDatagramEventHandler(recvStructs[i]))
+            continue;
+        PushReceivedDatagram(recvStructs[i]);
+        numPushed++;
+    }
+
+    if (numPushed > 0)
+        quitAndDataEvents.SetEvent();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 /*
 RAK_THREAD_DECLARATION(RakNet::RecvFromLoop)
 {
@@ -6069,8 +7075,9 @@ RAK_THREAD_DECLARATION(RakNet::UpdateNetworkLoop)
 
         rakPeer->RunUpdateCycle(updateBitStream);
 
-        // Pending sends go out this often, unless quitAndDataEvents is set
-        rakPeer->quitAndDataEvents.WaitOnEvent(10);
+        // Sleep until the next connection deadline, unless quitAndDataEvents is set by a datagram or command first
+        rakPeer->quitAndDataEvents.WaitOnEvent(rakPeer->GetUpdateThreadWaitTime());
+        rakPeer->updateThreadIsWaitingLong = false;
 
         /*
 
@@ -6118,6 +7125,27 @@ RAK_THREAD_DECLARATION(RakNet::UpdateNetworkLoop)
     return 0;
 }
 
+// ---------------------------------------------------------------------------------------------------------------------
+RAK_THREAD_DECLARATION(RakNet::UpdateWorkerLoop)
+{
+    RakPeer::UpdateShard *shard = (RakPeer::UpdateShard *) arguments;
+    RakPeer *rakPeer = shard->rakPeer;
+
+    while (rakPeer->endUpdateWorkers == false)
+    {
+        shard->startEvent.WaitOnEvent(CRABNET_UPDATE_THREAD_IDLE_WAIT_MS);
+        if (shard->hasWork.exchange(false))
+        {
+            rakPeer->RunUpdateShard(shard);
+            if (rakPeer->updateShardsPending.fetch_sub(1) == 1)
+                rakPeer->updateShardsDoneEvent.SetEvent();
+        }
+    }
+
+    shard->isThreadActive = false;
+    return 0;
+}
+
 void RakPeer::CallPluginCallbacks(DataStructures::List<PluginInterface2 *> &pluginList, Packet *packet)
 {
     for (unsigned i = 0; i < pluginList.Size(); i++)
@@ -6170,6 +7198,48 @@ void RakPeer::CallPluginCallbacks(DataStructures::List<PluginInterface2 *> &plug
     }
 }
 
+bool RakPeer::FilterReceivedPacket(Packet *packet)
+{
+    if ((packet->length >= sizeof(unsigned char) + sizeof(RakNet::Time)) &&
+        ((unsigned char) packet->data[0] == ID_TIMESTAMP))
+    {
+        ShiftIncomingTimestamp(packet->data + sizeof(unsigned char), packet->systemAddress);
+    }
+
+    // Some locally generated packets need to be processed by plugins, for example ID_FCM2_NEW_HOST
+    // The plugin itself should intercept these messages generated remotely
+    CallPluginCallbacks(pluginListTS, packet);
+    CallPluginCallbacks(pluginListNTS, packet);
+
+    unsigned int i;
+    PluginReceiveResult pluginResult;
+    for (i = 0; i < pluginListTS.Size(); i++)
+    {
+        pluginResult = pluginListTS[i]->OnReceive(packet);
+        if (pluginResult == RR_STOP_PROCESSING_AND_DEALLOCATE)
+        {
+            DeallocatePacket(packet);
+            return false;
+        }
+        else if (pluginResult == RR_STOP_PROCESSING)
+            return false;
+    }
+
+    for (i = 0; i < pluginListNTS.Size(); i++)
+    {
+        pluginResult = pluginListNTS[i]->OnReceive(packet);
+        if (pluginResult == RR_STOP_PROCESSING_AND_DEALLOCATE)
+        {
+            DeallocatePacket(packet);
+            return false;
+        }
+        else if (pluginResult == RR_STOP_PROCESSING)
+            return false;
+    }
+
+    return true;
+}
+
 void RakPeer::FillIPList(void)
 {
     if (ipList[0] != UNASSIGNED_SYSTEM_ADDRESS)
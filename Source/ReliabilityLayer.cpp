@@ -55,6 +55,8 @@ static const CCTimeType MAX_TIME_BETWEEN_PACKETS = 350000; // 350 milliseconds
 #endif
 static const int DEFAULT_HAS_RECEIVED_PACKET_QUEUE_SIZE = 512;
 static const CCTimeType STARTING_TIME_BETWEEN_PACKETS = MAX_TIME_BETWEEN_PACKETS;
+// Reliability written for FecChannel parity messages. ACK receipt types are never written, so the value is free on the wire
+static const unsigned char FEC_PARITY_WIRE_RELIABILITY = UNRELIABLE_WITH_ACK_RECEIPT;
 //static const long double TIME_BETWEEN_PACKETS_INCREASE_MULTIPLIER_DEFAULT=.02;
 //static const long double TIME_BETWEEN_PACKETS_DECREASE_MULTIPLIER_DEFAULT=1.0 / 9.0;
 
@@ -138,6 +140,7 @@ struct DatagramHeaderFormat
     bool hasBAndAS;
     bool isContinuousSend;
     bool needsBAndAs;
+    bool isBitmap; // ACK or NAK ranges were written with SerializeBitmap()
     bool isValid; // To differentiate between what I serialized, and offline data
 
     static BitSize_t GetDataHeaderBitLength()
@@ -167,6 +170,7 @@ struct DatagramHeaderFormat
         {
             b->Write(true);
             b->Write(hasBAndAS);
+            b->Write(isBitmap);
             b->AlignWriteToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
             RakNet::TimeMS timeMSLow=(RakNet::TimeMS) sourceSystemTime&0xFFFFFFFF; b->Write(timeMSLow);
@@ -181,6 +185,7 @@ struct DatagramHeaderFormat
         {
             b->Write(false);
             b->Write(true);
+            b->Write(isBitmap);
         }
         else
         {
@@ -210,6 +215,8 @@ struct DatagramHeaderFormat
             isNAK = false;
             isPacketPair = false;
             b->Read(hasBAndAS);
+            // Older versions leave this bit 0
+            b->Read(isBitmap);
             b->AlignReadToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
             RakNet::TimeMS timeMS; b->Read(timeMS); sourceSystemTime=(CCTimeType) timeMS;
@@ -224,7 +231,10 @@ struct DatagramHeaderFormat
         {
             b->Read(isNAK);
             if (isNAK)
+            {
                 isPacketPair = false;
+                b->Read(isBitmap);
+            }
             else
             {
                 b->Read(isPacketPair);
@@ -260,17 +270,10 @@ using namespace RakNet;
 
 int RakNet::SplitPacketChannelComp(SplitPacketIdType const &key, SplitPacketChannel *const &data)
 {
-#if PREALLOCATE_LARGE_MESSAGES == 1
-    if (key < data->returnedPacket->splitPacketId)
-        return -1;
-    if (key == data->returnedPacket->splitPacketId)
-        return 0;
-#else
     if (key < data->splitPacketList.id())
         return -1;
     if (key == data->splitPacketList.id())
         return 0;
-#endif
     return 1;
 }
 
@@ -336,8 +339,15 @@ ReliabilityLayer::ReliabilityLayer()
         fp = fopen("reliableorderedoutput.txt", "wt");
 #endif
 
+    requestedCongestionControl = USE_SLIDING_WINDOW_CONGESTION_CONTROL == 1 ? CC_SLIDING_WINDOW : CC_UDT;
+    pacingEnabled = false;
+    for (unsigned int i = 0; i < NUMBER_OF_ORDERED_STREAMS; i++)
+        fecGroupSizes[i] = 0;
+    congestionManager = CCRakNetCongestionControl::GetInstance(requestedCongestionControl);
+    // Reset() sets the real MTU. Until then a controller swap still needs a valid one to carry over
+    congestionManager->Init(RakNet::GetTimeUS(), MAXIMUM_MTU_SIZE - UDP_HEADER_SIZE);
+
     InitializeVariables();
-    datagramHistoryMessagePool.SetPageSize(sizeof(MessageNumberNode) * 128);
     internalPacketPool.SetPageSize(sizeof(InternalPacket) * INTERNAL_PACKET_PAGE_SIZE);
     refCountedDataPool.SetPageSize(sizeof(InternalPacketRefCountedData) * 32);
 }
@@ -348,6 +358,7 @@ ReliabilityLayer::ReliabilityLayer()
 ReliabilityLayer::~ReliabilityLayer()
 {
     FreeMemory(true); // Free all memory immediately
+    CCRakNetCongestionControl::DestroyInstance(congestionManager);
 }
 
 //-------------------------------------------------------------------------------------------------------
@@ -370,7 +381,9 @@ void ReliabilityLayer::Reset(bool resetVariables, int MTUSize, bool _useSecurity
 #else
         (void) _useSecurity;
 #endif // LIBCAT_SECURITY
-        congestionManager.Init(RakNet::GetTimeUS(), MTUSize - UDP_HEADER_SIZE);
+        CCTimeType time = RakNet::GetTimeUS();
+        ApplyRequestedCongestionControl(time);
+        congestionManager->Init(time, MTUSize - UDP_HEADER_SIZE);
     }
 }
 
@@ -390,6 +403,162 @@ RakNet::TimeMS ReliabilityLayer::GetTimeoutTime(void)
     return timeoutTime;
 }
 
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetCongestionControl(CongestionControlAlgorithm algorithm)
+{
+    if (algorithm < CC_ALGORITHM_COUNT)
+        requestedCongestionControl = algorithm;
+}
+
+//-------------------------------------------------------------------------------------------------------
+CongestionControlAlgorithm ReliabilityLayer::GetCongestionControl(void) const
+{
+    return requestedCongestionControl;
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetPacing(bool enabled)
+{
+    pacingEnabled = enabled;
+}
+
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetPacing(void) const
+{
+    return pacingEnabled;
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetForwardErrorCorrection(unsigned char orderingChannel, unsigned int groupSize)
+{
+    if (orderingChannel >= NUMBER_OF_ORDERED_STREAMS)
+        return;
+    fecGroupSizes[orderingChannel] = (unsigned char) FecChannel::ClampGroupSize(groupSize);
+}
+
+//-------------------------------------------------------------------------------------------------------
+unsigned int ReliabilityLayer::GetForwardErrorCorrection(unsigned char orderingChannel) const
+{
+    if (orderingChannel >= NUMBER_OF_ORDERED_STREAMS)
+        return 0;
+    return fecGroupSizes[orderingChannel];
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetReliabilityFeatures(unsigned char features)
+{
+    reliabilityFeatures = features;
+}
+
+//-------------------------------------------------------------------------------------------------------
+unsigned char ReliabilityLayer::GetReliabilityFeatures(void) const
+{
+    return reliabilityFeatures;
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::ApplyRequestedCongestionControl(CCTimeType time)
+{
+    CongestionControlAlgorithm algorithm = requestedCongestionControl;
+    if (algorithm == congestionManager->GetAlgorithm())
+        return;
+
+    // The remote system keeps acking and NAKing by datagram number, so the new controller carries on counting from the old one
+    CCRakNetCongestionControl *previous = congestionManager;
+    congestionManager = CCRakNetCongestionControl::GetInstance(algorithm);
+    congestionManager->Init(time, previous->GetMTU());
+    congestionManager->ContinueSequenceNumbers(*previous);
+    CCRakNetCongestionControl::DestroyInstance(previous);
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Lowers what congestion control allows this update to what the pacer has accumulated since the last one
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::ApplyPacing(CCTimeType time, int *transmissionBandwidth, int *retransmissionBandwidth)
+{
+#if CC_TIME_TYPE_BYTES == 4
+    const double ticksPerSecond = 1000.0;
+    const double maxBurstTicks = CRABNET_PACING_MAX_BURST_US / 1000.0;
+#else
+    const double ticksPerSecond = 1000000.0;
+    const double maxBurstTicks = CRABNET_PACING_MAX_BURST_US;
+#endif
+
+    uint64_t bytesPerSecond = congestionManager->GetBytesPerSecondLimitByCongestionControl();
+    statistics.BPSLimitByPacing = bytesPerSecond;
+    if (bytesPerSecond == 0)
+    {
+        // No rate estimate yet, so only the congestion window limits sends
+        pacingBytesPerTick = 0;
+        pacingBudget = 0;
+        lastPacingRefill = time;
+        return;
+    }
+
+    pacingBytesPerTick = (double) bytesPerSecond / ticksPerSecond;
+    if (time > lastPacingRefill)
+        pacingBudget += pacingBytesPerTick * (double) (time - lastPacingRefill);
+    lastPacingRefill = time;
+
+    // Do not save up more than a short burst while idle, or while the update thread woke up late
+    double maxBudget = pacingBytesPerTick * maxBurstTicks;
+    if (maxBudget < 2.0 * congestionManager->GetMTU())
+        maxBudget = 2.0 * congestionManager->GetMTU();
+    if (pacingBudget > maxBudget)
+        pacingBudget = maxBudget;
+
+    int allowed = pacingBudget > 0 ? (int) pacingBudget : 0;
+    if (*transmissionBandwidth > allowed)
+    {
+        if (outgoingPacketBuffer.Size() > 0)
+            statistics.isLimitedByPacing = true;
+        *transmissionBandwidth = allowed;
+    }
+    if (*retransmissionBandwidth > allowed)
+    {
+        if (!resendQueue.IsEmpty() && time - resendQueue.Peek()->nextActionTime < (((CCTimeType) -1) / 2))
+            statistics.isLimitedByPacing = true;
+        *retransmissionBandwidth = allowed;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Counts how long data the pacer held back waited, once some of it goes out
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::RecordPacingDelay(CCTimeType time, bool sentDatagrams)
+{
+    if (pacingHoldStart != 0 && (sentDatagrams || !statistics.isLimitedByPacing))
+    {
+        if (sentDatagrams)
+        {
+#if CC_TIME_TYPE_BYTES == 4
+            RakNet::TimeUS delay = (RakNet::TimeUS) (time - pacingHoldStart) * 1000;
+#else
+            RakNet::TimeUS delay = (RakNet::TimeUS) (time - pacingHoldStart);
+#endif
+            statistics.pacingDelays++;
+            statistics.pacingDelayTotal += delay;
+            if (delay > statistics.pacingDelayLongest)
+                statistics.pacingDelayLongest = delay;
+        }
+        pacingHoldStart = 0;
+    }
+
+    if (statistics.isLimitedByPacing && pacingHoldStart == 0)
+        pacingHoldStart = time;
+}
+
+//-------------------------------------------------------------------------------------------------------
+// When the pacing budget covers another full datagram
+//-------------------------------------------------------------------------------------------------------
+CCTimeType ReliabilityLayer::GetNextPacedSendTime(void) const
+{
+    double needed = (double) congestionManager->GetMTU() - pacingBudget;
+    if (needed <= 0 || pacingBytesPerTick <= 0)
+        return lastPacingRefill;
+    return lastPacingRefill + (CCTimeType) (needed / pacingBytesPerTick) + 1;
+}
+
 //-------------------------------------------------------------------------------------------------------
 // Initialize the variables
 //-------------------------------------------------------------------------------------------------------
@@ -400,10 +569,10 @@ void ReliabilityLayer::InitializeVariables(void)
     memset(orderedReadIndex, 0, NUMBER_OF_ORDERED_STREAMS * sizeof(OrderingIndexType));
     memset(highestSequencedReadIndex, 0, NUMBER_OF_ORDERED_STREAMS * sizeof(OrderingIndexType));
     memset(&statistics, 0, sizeof(statistics));
-    memset(&heapIndexOffsets, 0, sizeof(heapIndexOffsets));
 
     statistics.connectionStartTime = RakNet::GetTimeUS();
     splitPacketId = 0;
+    splitPacketBytesReserved = 0;
     elapsedTimeSinceLastUpdate = 0;
     throughputCapCountdown = 0;
     sendReliableMessageNumberIndex = 0;
@@ -412,6 +581,11 @@ void ReliabilityLayer::InitializeVariables(void)
     unreliableLinkedListHead = 0;
     lastUpdateTime = RakNet::GetTimeUS();
     bandwidthExceededStatistic = false;
+    pacingBudget = 0;
+    pacingBytesPerTick = 0;
+    lastPacingRefill = lastUpdateTime;
+    pacingHoldStart = 0;
+    reliabilityFeatures = 0;
     remoteSystemTime = 0;
     unreliableTimeout = 0;
     lastBpsClear = 0;
@@ -450,12 +624,8 @@ void ReliabilityLayer::InitializeVariables(void)
     //    histogramStart=(CCTimeType)0;
     //    histogramBitsSent=0;
     unacknowledgedBytes = 0;
-    resendLinkedListHead = 0;
     totalUserDataBytesAcked = 0;
 
-    datagramHistoryPopCount = 0;
-
-    InitHeapWeights();
     for (int i = 0; i < NUMBER_OF_PRIORITIES; i++)
     {
         statistics.messageInSendBuffer[i] = 0;
@@ -480,23 +650,11 @@ void ReliabilityLayer::FreeThreadSafeMemory(void)
 
     ClearPacketsAndDatagrams();
 
+    // Deleting a channel releases the fragments it still holds
     for (unsigned i = 0; i < splitPacketChannelList.Size(); i++)
-    {
-        for (unsigned j = 0; j < splitPacketChannelList[i]->splitPacketList.size(); j++)
-        {
-            FreeInternalPacketData(splitPacketChannelList[i]->splitPacketList[j]);
-            ReleaseToInternalPacketPool(splitPacketChannelList[i]->splitPacketList[j]);
-        }
-#if PREALLOCATE_LARGE_MESSAGES == 1
-        if (splitPacketChannelList[i]->returnedPacket)
-        {
-            FreeInternalPacketData(splitPacketChannelList[i]->returnedPacket );
-            ReleaseToInternalPacketPool( splitPacketChannelList[i]->returnedPacket );
-        }
-#endif
         delete splitPacketChannelList[i];
-    }
     splitPacketChannelList.Clear(false);
+    splitPacketBytesReserved = 0;
 
     while (outputQueue.Size() > 0)
     {
@@ -533,55 +691,48 @@ void ReliabilityLayer::FreeThreadSafeMemory(void)
 
     for (unsigned i = 0; i < NUMBER_OF_ORDERED_STREAMS; i++)
     {
-        for (unsigned j = 0; j < orderingHeaps[i].Size(); j++)
+        InternalPacket *internalPacket;
+        while ((internalPacket = orderingWindows[i].PopAny()) != 0)
         {
-            FreeInternalPacketData(orderingHeaps[i][j]);
-            ReleaseToInternalPacketPool(orderingHeaps[i][j]);
+            FreeInternalPacketData(internalPacket);
+            ReleaseToInternalPacketPool(internalPacket);
         }
-        orderingHeaps[i].Clear(true);
+        orderingWindows[i].Clear();
+        fecChannels[i].Clear();
+    }
+
+    for (unsigned int i = 0; i < fecPendingParity.Size(); i++)
+    {
+        FreeInternalPacketData(fecPendingParity[i]);
+        ReleaseToInternalPacketPool(fecPendingParity[i]);
     }
+    fecPendingParity.Clear(false);
 
     //resendList.ForEachData(DeleteInternalPacket);
     //    resendTree.Clear();
-    memset(resendBuffer, 0, sizeof(resendBuffer));
     statistics.messagesInResendBuffer = 0;
     statistics.bytesInResendBuffer = 0;
 
-    if (resendLinkedListHead)
+    for (unsigned int i = 0; i < resendQueue.Size(); i++)
     {
-        InternalPacket *prev;
-        InternalPacket *iter = resendLinkedListHead;
-
-#ifdef _MSC_VER
-#pragma warning( disable : 4127 ) // warning C4127: conditional expression is constant
-#endif
-        while (1)
-        {
-            if (iter->data)
-                FreeInternalPacketData(iter);
-            prev = iter;
-            iter = iter->resendNext;
-            if (iter == resendLinkedListHead)
-            {
-                ReleaseToInternalPacketPool(prev);
-                break;
-            }
-            ReleaseToInternalPacketPool(prev);
-        }
-        resendLinkedListHead = 0;
+        if (resendQueue[i]->data)
+            FreeInternalPacketData(resendQueue[i]);
+        ReleaseToInternalPacketPool(resendQueue[i]);
     }
+    resendQueue.Clear();
     unacknowledgedBytes = 0;
 
     //    acknowlegements.Clear();
 
-    for (unsigned j = 0; j < outgoingPacketBuffer.Size(); j++)
+    while (!outgoingPacketBuffer.IsEmpty())
     {
-        if (outgoingPacketBuffer[j]->data)
-            FreeInternalPacketData(outgoingPacketBuffer[j]);
-        ReleaseToInternalPacketPool(outgoingPacketBuffer[j]);
+        InternalPacket *internalPacket = outgoingPacketBuffer.Pop();
+        if (internalPacket->data)
+            FreeInternalPacketData(internalPacket);
+        ReleaseToInternalPacketPool(internalPacket);
     }
 
-    outgoingPacketBuffer.Clear(true);
+    outgoingPacketBuffer.Clear();
 
 #ifdef _DEBUG
     for (unsigned i = 0; i < delayList.Size(); i++)
@@ -617,14 +768,7 @@ void ReliabilityLayer::FreeThreadSafeMemory(void)
     datagramMessageIDPool.Clear();
     */
 
-    while (datagramHistory.Size())
-    {
-        RemoveFromDatagramHistory(datagramHistoryPopCount);
-        datagramHistory.Pop();
-        datagramHistoryPopCount++;
-    }
-    datagramHistoryMessagePool.Clear();
-    datagramHistoryPopCount = 0;
+    datagramHistory.Clear();
 
     acknowlegements.Clear();
     NAKs.Clear();
@@ -644,7 +788,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
         const char *buffer, unsigned int length, SystemAddress &systemAddress,
         DataStructures::List<PluginInterface2 *> &messageHandlerList, int MTUSize,
         RakNetSocket2 *s, RakNetRandom *rnr, CCTimeType timeRead,
-        BitStream &updateBitStream)
+        BitStream &updateBitStream, RNS2RecvStruct *receiveBuffer)
 {
     RakAssert(buffer != nullptr);
 
@@ -714,7 +858,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 #endif
         {
             // Sanity check. This could happen due to type overflow, especially since I only send the low 4 bytes to reduce bandwidth
-            rtt=(CCTimeType) congestionManager.GetRTT();
+            rtt=(CCTimeType) congestionManager->GetRTT();
         }
         //    RakAssert(rtt < 500000);
         //    printf("%i ", (RakNet::TimeMS)(rtt/1000));
@@ -728,11 +872,11 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
             dhf.AS = 0;
         }
 #endif
-        //        congestionManager.OnAck(timeRead, rtt, dhf.hasBAndAS, dhf.B, dhf.AS, totalUserDataBytesAcked );
+        //        congestionManager->OnAck(timeRead, rtt, dhf.hasBAndAS, dhf.B, dhf.AS, totalUserDataBytesAcked );
 
 
         incomingAcks.Clear();
-        if (!incomingAcks.Deserialize(&socketData))
+        if (!(dhf.isBitmap ? incomingAcks.DeserializeBitmap(&socketData) : incomingAcks.Deserialize(&socketData)))
         {
             for (unsigned int messageHandlerIndex = 0;
                  messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
@@ -778,38 +922,37 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                 }
 
                 CCTimeType whenSent;
-                MessageNumberNode *messageNumberNode = GetMessageNumberNodeByDatagramIndex(datagramNumber, &whenSent);
-                if (messageNumberNode)
+                unsigned int messageCount;
+                const MessageNumberType *messageNumbers = datagramHistory.Get(datagramNumber, &messageCount, &whenSent);
+                if (messageNumbers)
                 {
                     //    printf("%p Got ack for %i\n", this, datagramNumber.val);
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
-                    congestionManager.OnAck(timeRead, rtt, dhf.hasBAndAS, 0, dhf.AS, totalUserDataBytesAcked, bandwidthExceededStatistic, datagramNumber );
+                    congestionManager->OnAck(timeRead, rtt, dhf.hasBAndAS, 0, dhf.AS, totalUserDataBytesAcked, bandwidthExceededStatistic, datagramNumber );
 #else
                     CCTimeType ping;
                     if (timeRead > whenSent)
                         ping = timeRead - whenSent;
                     else
                         ping = 0;
-                    congestionManager.OnAck(timeRead, ping, dhf.hasBAndAS, 0, dhf.AS, totalUserDataBytesAcked,
+                    congestionManager->OnAck(timeRead, ping, dhf.hasBAndAS, 0, dhf.AS, totalUserDataBytesAcked,
                                             bandwidthExceededStatistic, datagramNumber);
 #endif
-                    while (messageNumberNode)
+                    for (unsigned int messageIndex = 0; messageIndex < messageCount; messageIndex++)
                     {
-
-                        RemovePacketFromResendListAndDeleteOlderReliableSequenced(messageNumberNode->messageNumber,
+                        RemovePacketFromResendListAndDeleteOlderReliableSequenced(messageNumbers[messageIndex],
                                                                                   timeRead, messageHandlerList,
                                                                                   systemAddress);
-                        messageNumberNode = messageNumberNode->next;
                     }
 
-                    RemoveFromDatagramHistory(datagramNumber);
+                    datagramHistory.Remove(datagramNumber);
                 }
 //                 else if (isReliable)
 //                 {
 //                     // Previously used slot, rather than empty unreliable slot
 //                     printf("%p Ack %i is duplicate\n", this, datagramNumber.val);
 // 
-//                      congestionManager.OnDuplicateAck(timeRead, datagramNumber);
+//                      congestionManager->OnDuplicateAck(timeRead, datagramNumber);
 //                 }
             }
         }
@@ -817,7 +960,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
     else if (dhf.isNAK)
     {
         DataStructures::RangeList<DatagramSequenceNumberType> incomingNAKs;
-        if (!incomingNAKs.Deserialize(&socketData))
+        if (!(dhf.isBitmap ? incomingNAKs.DeserializeBitmap(&socketData) : incomingNAKs.Deserialize(&socketData)))
         {
             for (unsigned int messageHandlerIndex = 0;
                  messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
@@ -838,30 +981,35 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 
                 return false;
             }
-            // Sanity check
-            //RakAssert(incomingNAKs.ranges[i].maxIndex.val-incomingNAKs.ranges[i].minIndex.val<1000);
-            for (DatagramSequenceNumberType messageNumber = incomingNAKs.ranges[i].minIndex;
-                 messageNumber < incomingNAKs.ranges[i].maxIndex;
-                 messageNumber++)
+            // Clamp the range to the datagrams in the history, so the loop is no longer than the history however wide
+            // the remote system makes the range. Datagrams outside it were already dealt with, or were never sent
+            if (datagramHistory.IsEmpty())
+                continue;
+            const DatagramSequenceNumberType oldestNumber = datagramHistory.GetOldestNumber();
+            DatagramSequenceNumberType messageNumber = incomingNAKs.ranges[i].minIndex;
+            if ((messageNumber - oldestNumber) >= datagramHistory.Size())
             {
-                congestionManager.OnNAK(timeRead, messageNumber);
+                if (oldestNumber < messageNumber || oldestNumber >= incomingNAKs.ranges[i].maxIndex)
+                    continue;
+                messageNumber = oldestNumber;
+            }
+            for (; messageNumber < incomingNAKs.ranges[i].maxIndex; messageNumber++)
+            {
+                // Past the newest datagram sent
+                if ((messageNumber - oldestNumber) >= datagramHistory.Size())
+                    break;
 
-                if ((messageNumber - datagramHistoryPopCount) >= datagramHistory.Size())
-                {
-                    ++receivePacketCount;
-                    return true;
-                }
+                congestionManager->OnNAK(timeRead, messageNumber);
 
                 CCTimeType timeSent;
-                MessageNumberNode *messageNumberNode = GetMessageNumberNodeByDatagramIndex(messageNumber, &timeSent);
-                while (messageNumberNode != nullptr)
+                unsigned int messageCount = 0;
+                const MessageNumberType *messageNumbers = datagramHistory.Get(messageNumber, &messageCount, &timeSent);
+                for (unsigned int messageIndex = 0; messageIndex < messageCount; messageIndex++)
                 {
                     // Update timers so resends occur immediately
-                    InternalPacket *internalPacket = resendBuffer[messageNumberNode->messageNumber & (uint32_t) RESEND_BUFFER_ARRAY_MASK];
+                    InternalPacket *internalPacket = resendQueue.Get(messageNumbers[messageIndex]);
                     if ((internalPacket != nullptr) && internalPacket->nextActionTime != 0)
-                        internalPacket->nextActionTime = timeRead;
-
-                    messageNumberNode = messageNumberNode->next;
+                        resendQueue.SetNextActionTime(internalPacket, timeRead);
                 }
             }
         }
@@ -869,16 +1017,16 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
     else
     {
         uint32_t skippedMessageCount;
-        if (!congestionManager.OnGotPacket(dhf.datagramNumber, dhf.isContinuousSend, timeRead, length, &skippedMessageCount))
+        if (!congestionManager->OnGotPacket(dhf.datagramNumber, dhf.isContinuousSend, timeRead, length, &skippedMessageCount))
         {
             for (unsigned int messageHandlerIndex = 0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
                 messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification(
-                        "congestionManager.OnGotPacket failed", BYTES_TO_BITS(length), systemAddress, true);
+                        "congestionManager->OnGotPacket failed", BYTES_TO_BITS(length), systemAddress, true);
 
             return true;
         }
         if (dhf.isPacketPair)
-            congestionManager.OnGotPacketPair(dhf.datagramNumber, length, timeRead);
+            congestionManager->OnGotPacketPair(dhf.datagramNumber, length, timeRead);
 
         for (uint32_t skippedMessageOffset = skippedMessageCount; skippedMessageOffset > 0; skippedMessageOffset--)
             NAKs.Insert(dhf.datagramNumber - skippedMessageOffset);
@@ -892,7 +1040,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
         SendAcknowledgementPacket(dhf.datagramNumber, 0);
 #endif
 
-        InternalPacket *internalPacket = CreateInternalPacketFromBitStream(&socketData, timeRead);
+        InternalPacket *internalPacket = CreateInternalPacketFromBitStream(&socketData, timeRead, receiveBuffer);
         if (internalPacket == nullptr)
         {
             for (unsigned int messageHandlerIndex = 0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
@@ -902,6 +1050,10 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
             return true;
         }
 
+        // A message FecChannel rebuilt, handled as if it came next in the datagram
+        InternalPacket *recoveredPacket = nullptr;
+        bool isRecoveredPacket = false;
+
         while (internalPacket)
         {
             for (unsigned int messageHandlerIndex = 0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
@@ -949,6 +1101,35 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                 }
             }
 
+            if (internalPacket->fecParity)
+            {
+                RakNet::BitStream parity(internalPacket->data, BITS_TO_BYTES(internalPacket->dataBitLength), false);
+                unsigned char orderingChannel;
+                if (internalPacket->splitPacketCount == 0 && FecChannel::ReadParityChannel(&parity, &orderingChannel) &&
+                    orderingChannel < NUMBER_OF_ORDERED_STREAMS)
+                {
+                    recoveredPacket = AllocateFromInternalPacketPool();
+                    unsigned int lostCount;
+                    FecChannel::RecoverResult result = fecChannels[orderingChannel].Recover(&parity, recoveredPacket, &lostCount);
+                    if (result == FecChannel::FEC_RECOVERED)
+                    {
+                        // Counted in fecMessagesRecovered once it is returned, as it may turn out to be too old
+                        recoveredPacket->orderingChannel = orderingChannel;
+                        recoveredPacket->creationTime = timeRead;
+                    }
+                    else
+                    {
+                        statistics.fecMessagesLost += lostCount;
+                        ReleaseToInternalPacketPool(recoveredPacket);
+                        recoveredPacket = nullptr;
+                    }
+                }
+
+                FreeInternalPacketData(internalPacket);
+                ReleaseToInternalPacketPool(internalPacket);
+                goto CONTINUE_SOCKET_DATA_PARSE_LOOP;
+            }
+
             // 8/12/09 was previously not checking if the message was reliable. However, on packetloss this would mean you'd eventually exceed the
             // hole count because unreliable messages were never resent, and you'd stop getting messages
             if (internalPacket->reliability == RELIABLE || internalPacket->reliability == RELIABLE_SEQUENCED ||
@@ -1248,9 +1429,11 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                     internalPacket->reliability != UNRELIABLE_SEQUENCED)
                     internalPacket->orderingChannel = 255; // Use 255 to designate not sequenced and not ordered
 
+                // The split packet list takes the fragment
+                SplitPacketIdType splitPacketId = internalPacket->splitPacketId;
                 InsertIntoSplitPacketList(internalPacket, timeRead);
 
-                internalPacket = BuildPacketFromSplitPacketList(internalPacket->splitPacketId, timeRead, s,
+                internalPacket = BuildPacketFromSplitPacketList(splitPacketId, timeRead, s,
                                                                 systemAddress, rnr, updateBitStream);
 
                 if (internalPacket == nullptr)
@@ -1265,6 +1448,10 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                 }
             }
 
+            // Keep a copy in case a parity for the group arrives and another member of it does not
+            if (internalPacket->reliability == UNRELIABLE_SEQUENCED)
+                fecChannels[internalPacket->orderingChannel].AddReceived(internalPacket);
+
 #ifdef PRINT_TO_FILE_RELIABLE_ORDERED_TEST
             unsigned char packetId;
             char *type="UNDEFINED";
@@ -1341,6 +1528,8 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                             // Means a duplicated RELIABLE_SEQUENCED or UNRELIABLE_SEQUENCED packet would be returned to the user
                             highestSequencedReadIndex[internalPacket->orderingChannel] =
                                     internalPacket->sequencingIndex + (OrderingIndexType) 1;
+                            if (isRecoveredPacket)
+                                statistics.fecMessagesRecovered++;
 
                             // Fallthrough, returned to user below
                         }
@@ -1377,10 +1566,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                         if (packetId==ID_USER_PACKET_ENUM+1 && fp)
                         {
                             fprintf(fp, "outputting immediate %i, %s. OI=%i. SI=%i.", receivedPacketNumber, type, internalPacket->orderingIndex.val, internalPacket->sequencingIndex);
-                            if (orderingHeaps[internalPacket->orderingChannel].Size()==0)
-                                fprintf(fp, "heap empty\n");
-                            else
-                                fprintf(fp, "heap head=%i\n", orderingHeaps[internalPacket->orderingChannel].Peek()->orderingIndex.val);
+                            fprintf(fp, "held=%i\n", orderingWindows[internalPacket->orderingChannel].Size());
 
                             if (receivedPacketNumber<packetNumber)
                             {
@@ -1399,12 +1585,11 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                         orderedReadIndex[internalPacket->orderingChannel]++;
                         highestSequencedReadIndex[internalPacket->orderingChannel] = 0;
 
-                        // Return off heap until order lost
-                        while (orderingHeaps[internalPacket->orderingChannel].Size() > 0 &&
-                               orderingHeaps[internalPacket->orderingChannel].Peek()->orderingIndex ==
-                               orderedReadIndex[internalPacket->orderingChannel])
+                        // Return held messages until order lost
+                        OrderingWindow &orderingWindow = orderingWindows[internalPacket->orderingChannel];
+                        unsigned char orderingChannel = internalPacket->orderingChannel;
+                        while ((internalPacket = orderingWindow.Pop(orderedReadIndex[orderingChannel])) != 0)
                         {
-                            internalPacket = orderingHeaps[internalPacket->orderingChannel].Pop(0);
 
 #ifdef PRINT_TO_FILE_RELIABLE_ORDERED_TEST
                             BitStream bitStream2(internalPacket->data, BITS_TO_BYTES(internalPacket->dataBitLength), false);
@@ -1422,14 +1607,14 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 
                             if (packetId==ID_USER_PACKET_ENUM+1 && fp)
                             {
-                                fprintf(fp, "Heap pop %i, %s. OI=%i. SI=%i.\n", receivedPacketNumber, type, internalPacket->orderingIndex.val, internalPacket->sequencingIndex);
+                                fprintf(fp, "Window pop %i, %s. OI=%i. SI=%i.\n", receivedPacketNumber, type, internalPacket->orderingIndex.val, internalPacket->sequencingIndex);
                                 fflush(fp);
 
                                 if (receivedPacketNumber<packetNumber)
                                 {
                                     if (packetId==ID_USER_PACKET_ENUM+1 && fp)
                                     {
-                                        fprintf(fp, "Out of order packet from heap! Expecting %i got %i\n", receivedPacketNumber, packetNumber);
+                                        fprintf(fp, "Out of order packet from window! Expecting %i got %i\n", receivedPacketNumber, packetNumber);
                                         fflush(fp);
                                     }
                                 }
@@ -1456,26 +1641,34 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                 {
                     // internalPacket->_orderingIndex is greater
                     // If a message has a greater ordering index, and is sequenced or ordered, buffer it
-                    // Sequenced has a lower heap weight, ordered has max sequenced weight
+                    // Sequenced ones are returned before the ordered one with the same index
 
-                    // Keep orderedHoleCount count small
-                    if (orderingHeaps[internalPacket->orderingChannel].Size() == 0)
-                        heapIndexOffsets[internalPacket->orderingChannel] = orderedReadIndex[internalPacket->orderingChannel];
+                    OrderingWindow::PushResult pushResult = orderingWindows[internalPacket->orderingChannel].Push(
+                            internalPacket, orderedReadIndex[internalPacket->orderingChannel]);
+                    if (pushResult != OrderingWindow::ORDERING_HELD)
+                    {
+                        // A reliable message too far ahead was already acked, so it will not be resent, and the channel
+                        // would wait for it forever. A sender only gets that far ahead if it ignores the window
+                        if (pushResult == OrderingWindow::ORDERING_TOO_FAR_AHEAD &&
+                            internalPacket->reliability != UNRELIABLE_SEQUENCED)
+                        {
+                            for (unsigned int messageHandlerIndex = 0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
+                                messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification(
+                                        "Reliable message too far ahead of its ordering channel", BYTES_TO_BITS(length), systemAddress, true);
 
-                    reliabilityHeapWeightType orderedHoleCount =
-                            internalPacket->orderingIndex - heapIndexOffsets[internalPacket->orderingChannel];
-                    reliabilityHeapWeightType weight = orderedHoleCount * 1048576;
-                    if (internalPacket->reliability == RELIABLE_SEQUENCED ||
-                        internalPacket->reliability == UNRELIABLE_SEQUENCED)
-                        weight += internalPacket->sequencingIndex;
-                    else
-                        weight += (1048576 - 1);
-                    orderingHeaps[internalPacket->orderingChannel].Push(weight, internalPacket);
+                            KillConnection();
+                        }
+
+                        // Same ordered message twice, or too far ahead to hold
+                        FreeInternalPacketData(internalPacket);
+                        ReleaseToInternalPacketPool(internalPacket);
+                        goto CONTINUE_SOCKET_DATA_PARSE_LOOP;
+                    }
 
 #ifdef PRINT_TO_FILE_RELIABLE_ORDERED_TEST
                     if (packetId==ID_USER_PACKET_ENUM+1 && fp)
                     {
-                    fprintf(fp, "Heap push %i, %s, weight=%" PRINTF_64_BIT_MODIFIER "u. OI=%i. waiting on %i. SI=%i.\n", receivedPacketNumber, type, weight, internalPacket->orderingIndex.val, orderedReadIndex[internalPacket->orderingChannel].val, internalPacket->sequencingIndex);
+                    fprintf(fp, "Window push %i, %s. OI=%i. waiting on %i. SI=%i.\n", receivedPacketNumber, type, internalPacket->orderingIndex.val, orderedReadIndex[internalPacket->orderingChannel].val, internalPacket->sequencingIndex);
                     fflush(fp);
                     }
 #endif
@@ -1485,6 +1678,10 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                         messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification("Larger number ordered packet leaving holes", BYTES_TO_BITS(length), systemAddress, false);
 #endif
 
+                    // Returned once the messages before it arrive
+                    if (isRecoveredPacket)
+                        statistics.fecMessagesRecovered++;
+
                     // Buffered, nothing to do
                     goto CONTINUE_SOCKET_DATA_PARSE_LOOP;
                 }
@@ -1516,8 +1713,17 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
             // Used for a goto to jump to the resendNext packet immediately
 
             CONTINUE_SOCKET_DATA_PARSE_LOOP:
-            // Parse the bitstream to create an internal packet
-            internalPacket = CreateInternalPacketFromBitStream(&socketData, timeRead);
+            isRecoveredPacket = recoveredPacket != nullptr;
+            if (recoveredPacket)
+            {
+                internalPacket = recoveredPacket;
+                recoveredPacket = nullptr;
+            }
+            else
+            {
+                // Parse the bitstream to create an internal packet
+                internalPacket = CreateInternalPacketFromBitStream(&socketData, timeRead, receiveBuffer);
+            }
         }
 
     }
@@ -1531,10 +1737,13 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 //-------------------------------------------------------------------------------------------------------
 // This gets an end-user packet already parsed out. Returns number of BITS put into the buffer
 //-------------------------------------------------------------------------------------------------------
-BitSize_t ReliabilityLayer::Receive(unsigned char **data)
+BitSize_t ReliabilityLayer::Receive(unsigned char **data, RNS2RecvStruct **receiveBuffer)
 {
     InternalPacket *internalPacket;
 
+    if (receiveBuffer)
+        *receiveBuffer = 0;
+
     if (outputQueue.Size() > 0)
     {
         //  #ifdef _DEBUG
@@ -1543,8 +1752,24 @@ BitSize_t ReliabilityLayer::Receive(unsigned char **data)
         internalPacket = outputQueue.Pop();
 
         BitSize_t bitLength;
-        *data = internalPacket->data;
         bitLength = internalPacket->dataBitLength;
+        if (internalPacket->allocationScheme == InternalPacket::RECEIVE_BUFFER)
+        {
+            if (receiveBuffer)
+            {
+                // Hand our reference to the caller
+                *data = internalPacket->data;
+                *receiveBuffer = internalPacket->receiveBuffer;
+            }
+            else
+            {
+                *data = (unsigned char *) malloc(BITS_TO_BYTES(bitLength));
+                memcpy(*data, internalPacket->data, BITS_TO_BYTES(bitLength));
+                FreeInternalPacketData(internalPacket);
+            }
+        }
+        else
+            *data = internalPacket->data;
         ReleaseToInternalPacketPool(internalPacket);
         return bitLength;
     }
@@ -1564,7 +1789,7 @@ BitSize_t ReliabilityLayer::Receive(unsigned char **data)
 bool
 ReliabilityLayer::Send(char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability,
                        unsigned char orderingChannel, bool makeDataCopy, int MTUSize, CCTimeType currentTime,
-                       uint32_t receipt)
+                       uint32_t receipt, SendReleaseCallback releaseCallback, void *releaseUserData)
 {
 #ifdef _DEBUG
     RakAssert(!(reliability >= NUMBER_OF_RELIABILITIES || reliability < 0));
@@ -1605,7 +1830,15 @@ ReliabilityLayer::Send(char *data, BitSize_t numberOfBitsToSend, PacketPriority
 
     internalPacket->creationTime = currentTime;
 
-    if (makeDataCopy)
+    if (releaseCallback)
+    {
+        // The application keeps the data, and gets it back once this message and any parts it is split into are done
+        InternalPacketRefCountedData *refCounter = nullptr;
+        AllocInternalPacketData(internalPacket, &refCounter, (unsigned char *) data, (unsigned char *) data);
+        refCounter->releaseCallback = releaseCallback;
+        refCounter->releaseUserData = releaseUserData;
+    }
+    else if (makeDataCopy)
     {
         AllocInternalPacketData(internalPacket, numberOfBytesToSend, true);
         //internalPacket->data = (unsigned char*) malloc(( numberOfBytesToSend);
@@ -1696,12 +1929,34 @@ ReliabilityLayer::Send(char *data, BitSize_t numberOfBitsToSend, PacketPriority
         return true;
     }
 
+    if (internalPacket->reliability == UNRELIABLE_SEQUENCED && (reliabilityFeatures & RF_FEC_PARITY))
+    {
+        FecChannel &fecChannel = fecChannels[orderingChannel];
+        unsigned int groupSize = fecGroupSizes[orderingChannel];
+        if (groupSize == 0)
+        {
+            // Turned off partway through a group. The remote system sees a group without parity, as if the parity was lost.
+            // Only the sending side is reset, so parities the remote system still sends can be used
+            if (fecChannel.GetGroupCount() > 0)
+                fecChannel.ClearSending();
+        }
+        else
+        {
+            // The parity has to fit in one datagram, so close the group early rather than let it split
+            if (fecChannel.GetGroupCount() > 0 && fecChannel.GetParityByteLength(numberOfBitsToSend) > maxDataSizeBytes)
+                QueueFecParity(orderingChannel, priority, currentTime);
+            if (fecChannel.GetParityByteLength(numberOfBitsToSend) <= maxDataSizeBytes &&
+                fecChannel.AddSent(internalPacket) >= groupSize)
+                QueueFecParity(orderingChannel, priority, currentTime);
+        }
+    }
+
     RakAssert(internalPacket->dataBitLength < BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
     AddToUnreliableLinkedList(internalPacket);
 
     RakAssert(internalPacket->dataBitLength < BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
     RakAssert(!internalPacket->messageNumberAssigned);
-    outgoingPacketBuffer.Push(GetNextWeight(internalPacket->priority), internalPacket);
+    outgoingPacketBuffer.Push(internalPacket);
     RakAssert(outgoingPacketBuffer.Size() == 0 ||
               outgoingPacketBuffer.Peek()->dataBitLength < BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
     statistics.messageInSendBuffer[(int) internalPacket->priority]++;
@@ -1712,6 +1967,29 @@ ReliabilityLayer::Send(char *data, BitSize_t numberOfBitsToSend, PacketPriority
     return true;
 }
 
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::QueueFecParity(unsigned char orderingChannel, PacketPriority priority, CCTimeType time)
+{
+    RakNet::BitStream parity;
+    fecChannels[orderingChannel].WriteParity(orderingChannel, &parity);
+
+    InternalPacket *internalPacket = AllocateFromInternalPacketPool();
+    if (internalPacket == 0)
+        return;
+    AllocInternalPacketData(internalPacket, parity.GetNumberOfBytesUsed(), true);
+    memcpy(internalPacket->data, parity.GetData(), parity.GetNumberOfBytesUsed());
+    internalPacket->dataBitLength = BYTES_TO_BITS(parity.GetNumberOfBytesUsed());
+    internalPacket->fecParity = true;
+    internalPacket->creationTime = time;
+    internalPacket->messageInternalOrder = internalOrderIndex++;
+    internalPacket->priority = priority;
+    internalPacket->reliability = UNRELIABLE;
+    internalPacket->orderingChannel = 0;
+    internalPacket->sendReceiptSerial = 0;
+    fecPendingParity.Push(internalPacket);
+    statistics.fecParitySent++;
+}
+
 //-------------------------------------------------------------------------------------------------------
 // Run this once per game cycle.  Handles internal lists and actually does the send
 //-------------------------------------------------------------------------------------------------------
@@ -1762,6 +2040,7 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
 
     CCTimeType timeSinceLastTick = time - lastUpdateTime;
     lastUpdateTime = time;
+    ApplyRequestedCongestionControl(time);
 #if CC_TIME_TYPE_BYTES == 4
     if (timeSinceLastTick>100)
         timeSinceLastTick=100;
@@ -1829,7 +2108,7 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
         return;
     }
 
-    if (congestionManager.ShouldSendACKs(time, timeSinceLastTick))
+    if (congestionManager->ShouldSendACKs(time, timeSinceLastTick))
         SendACKs(s, systemAddress, time, rnr, updateBitStream);
 
     if (NAKs.Size() > 0)
@@ -1839,13 +2118,17 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
         dhfNAK.isNAK = true;
         dhfNAK.isACK = false;
         dhfNAK.isPacketPair = false;
+        dhfNAK.isBitmap = (reliabilityFeatures & RF_BITMAP_ACKS) != 0;
         dhfNAK.Serialize(&updateBitStream);
-        NAKs.Serialize(&updateBitStream, GetMaxDatagramSizeExcludingMessageHeaderBits(), true);
+        if (dhfNAK.isBitmap)
+            NAKs.SerializeBitmap(&updateBitStream, GetMaxDatagramSizeExcludingMessageHeaderBits(), true);
+        else
+            NAKs.Serialize(&updateBitStream, GetMaxDatagramSizeExcludingMessageHeaderBits(), true);
         SendBitStream(s, systemAddress, &updateBitStream, rnr, time);
     }
 
     DatagramHeaderFormat dhf;
-    dhf.needsBAndAs = congestionManager.GetIsInSlowStart();
+    dhf.needsBAndAs = congestionManager->GetIsInSlowStart();
     dhf.isContinuousSend = bandwidthExceededStatistic;
     //     bandwidthExceededStatistic=sendPacketSet[0].IsEmpty()==false ||
     //         sendPacketSet[1].IsEmpty()==false ||
@@ -1855,10 +2138,10 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
 
     const bool hasDataToSendOrResend = !IsResendQueueEmpty() || bandwidthExceededStatistic;
     RakAssert(NUMBER_OF_PRIORITIES == 4);
-    congestionManager.Update(time, hasDataToSendOrResend);
+    congestionManager->Update(time, hasDataToSendOrResend);
 
     statistics.BPSLimitByOutgoingBandwidthLimit = BITS_TO_BYTES(bitsPerSecondLimit);
-    statistics.BPSLimitByCongestionControl = congestionManager.GetBytesPerSecondLimitByCongestionControl();
+    statistics.BPSLimitByCongestionControl = congestionManager->GetBytesPerSecondLimitByCongestionControl();
 
     if (time > lastBpsClear +
                #if CC_TIME_TYPE_BYTES == 4
@@ -1904,8 +2187,16 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
         dhf.hasBAndAS = false;
         ResetPacketsAndDatagrams();
 
-        int transmissionBandwidth = congestionManager.GetTransmissionBandwidth(time, timeSinceLastTick, unacknowledgedBytes, dhf.isContinuousSend);
-        int retransmissionBandwidth = congestionManager.GetRetransmissionBandwidth(time, timeSinceLastTick, unacknowledgedBytes, dhf.isContinuousSend);
+        int transmissionBandwidth = congestionManager->GetTransmissionBandwidth(time, timeSinceLastTick, unacknowledgedBytes, dhf.isContinuousSend);
+        int retransmissionBandwidth = congestionManager->GetRetransmissionBandwidth(time, timeSinceLastTick, unacknowledgedBytes, dhf.isContinuousSend);
+        statistics.isLimitedByPacing = false;
+        if (pacingEnabled)
+            ApplyPacing(time, &transmissionBandwidth, &retransmissionBandwidth);
+        else
+        {
+            pacingBytesPerTick = 0;
+            statistics.BPSLimitByPacing = 0;
+        }
         if (retransmissionBandwidth > 0 || transmissionBandwidth > 0)
         {
             statistics.isLimitedByCongestionControl = false;
@@ -1918,9 +2209,9 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
                 bool pushedAnything = false;
 
                 // Fill one datagram, then break
-                while (!IsResendQueueEmpty())
+                while (!resendQueue.IsEmpty())
                 {
-                    InternalPacket *internalPacket = resendLinkedListHead;
+                    InternalPacket *internalPacket = resendQueue.Peek();
                     RakAssert(internalPacket->messageNumberAssigned);
 
                     //if ( internalPacket->nextActionTime < time )
@@ -1934,31 +2225,26 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
                             break;
                         }
 
-                        PopListHead(false);
-
                         CC_DEBUG_PRINTF_2("Rs %i ", internalPacket->reliableMessageNumber.val);
 
                         bpsMetrics[(int) USER_MESSAGE_BYTES_RESENT].Push1(time, BITS_TO_BYTES(internalPacket->dataBitLength));
 
                         PushPacket(time, internalPacket, true); // Affects GetNewTransmissionBandwidth()
                         internalPacket->timesSent++;
-                        congestionManager.OnResend(time, internalPacket->nextActionTime);
-                        internalPacket->retransmissionTime = congestionManager.GetRTOForRetransmission(
+                        congestionManager->OnResend(time, internalPacket->nextActionTime);
+                        internalPacket->retransmissionTime = congestionManager->GetRTOForRetransmission(
                                 internalPacket->timesSent);
-                        internalPacket->nextActionTime = internalPacket->retransmissionTime + time;
+                        // Moves it back to its place in the resend queue
+                        resendQueue.SetNextActionTime(internalPacket, internalPacket->retransmissionTime + time);
 
                         pushedAnything = true;
 
                         for (unsigned int messageHandlerIndex = 0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
                             messageHandlerList[messageHandlerIndex]->OnInternalPacket(internalPacket,
                                                                                       packetsToSendThisUpdateDatagramBoundaries.Size() +
-                                                                                      congestionManager.GetNextDatagramSequenceNumber(),
+                                                                                      congestionManager->GetNextDatagramSequenceNumber(),
                                                                                       systemAddress, timeMs, true);
 
-                        // Put the packet back into the resend list at the correct spot
-                        // Don't make a copy since I'm reinserting an allocated struct
-                        InsertPacketIntoResendList(internalPacket, time, false, false);
-
                         // Removeme
                         //                        printf("Resend:%i ", internalPacket->reliableMessageNumber);
                     }
@@ -1976,7 +2262,7 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
             }
         }
         else
-            statistics.isLimitedByCongestionControl = true;
+            statistics.isLimitedByCongestionControl = !statistics.isLimitedByPacing;
 
         if ((int) BITS_TO_BYTES(allDatagramSizesSoFar) < transmissionBandwidth)
         {
@@ -2008,7 +2294,7 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
                     if (internalPacket->data == 0)
                     {
                         //sendPacketSet[i].Pop();
-                        outgoingPacketBuffer.Pop(0);
+                        outgoingPacketBuffer.Pop();
                         RakAssert(outgoingPacketBuffer.Size() == 0 ||
                                   outgoingPacketBuffer.Peek()->dataBitLength < BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
                         statistics.messageInSendBuffer[(int) internalPacket->priority]--;
@@ -2036,7 +2322,7 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
                                       internalPacket->reliability == RELIABLE_ORDERED_WITH_ACK_RECEIPT;
 
                     //sendPacketSet[ i ].Pop();
-                    outgoingPacketBuffer.Pop(0);
+                    outgoingPacketBuffer.Pop();
                     RakAssert(outgoingPacketBuffer.Size() == 0 || outgoingPacketBuffer.Peek()->dataBitLength < BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
                     RakAssert(!internalPacket->messageNumberAssigned);
                     statistics.messageInSendBuffer[(int) internalPacket->priority]--;
@@ -2072,7 +2358,7 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
                     {
                         internalPacket->messageNumberAssigned = true;
                         internalPacket->reliableMessageNumber = sendReliableMessageNumberIndex;
-                        internalPacket->retransmissionTime = congestionManager.GetRTOForRetransmission(internalPacket->timesSent + 1);
+                        internalPacket->retransmissionTime = congestionManager->GetRTOForRetransmission(internalPacket->timesSent + 1);
                         internalPacket->nextActionTime = internalPacket->retransmissionTime + time;
 #if CC_TIME_TYPE_BYTES == 4
                         const CCTimeType threshhold = 10000;
@@ -2082,14 +2368,6 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
                         if (internalPacket->nextActionTime - time > threshhold)
                             RakAssert(time - internalPacket->nextActionTime < threshhold);
 
-                        //resendTree.Insert( internalPacket->reliableMessageNumber, internalPacket);
-                        if (resendBuffer[internalPacket->reliableMessageNumber & (uint32_t) RESEND_BUFFER_ARRAY_MASK] != 0)
-                        {
-                            // bool overflow = ResendBufferOverflow();
-                            RakAssert(0);
-                        }
-                        resendBuffer[internalPacket->reliableMessageNumber &
-                                     (uint32_t) RESEND_BUFFER_ARRAY_MASK] = internalPacket;
                         statistics.messagesInResendBuffer++;
                         statistics.bytesInResendBuffer += BITS_TO_BYTES(internalPacket->dataBitLength);
 
@@ -2103,9 +2381,9 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
                     }
                     else if (internalPacket->reliability == UNRELIABLE_WITH_ACK_RECEIPT)
                         unreliableWithAckReceiptHistory.Push(UnreliableWithAckReceiptNode(
-                                congestionManager.GetNextDatagramSequenceNumber() + packetsToSendThisUpdateDatagramBoundaries.Size(),
+                                congestionManager->GetNextDatagramSequenceNumber() + packetsToSendThisUpdateDatagramBoundaries.Size(),
                                 internalPacket->sendReceiptSerial,
-                                congestionManager.GetRTOForRetransmission(internalPacket->timesSent + 1) + time));
+                                congestionManager->GetRTOForRetransmission(internalPacket->timesSent + 1) + time));
 
                     // If isReliable is false, the packet and its contents will be added to a list to be freed in ClearPacketsAndDatagrams
                     // However, the internalPacket structure will remain allocated and be in the resendBuffer list if it requires a receipt
@@ -2119,7 +2397,7 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
                     {
                         messageHandlerList[messageHandlerIndex]->OnInternalPacket(internalPacket,
                                                                                   packetsToSendThisUpdateDatagramBoundaries.Size() +
-                                                                                  congestionManager.GetNextDatagramSequenceNumber(),
+                                                                                  congestionManager->GetNextDatagramSequenceNumber(),
                                                                                   systemAddress, timeMs, true);
                     }
 
@@ -2145,8 +2423,7 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
         {
             if (datagramIndex > 0)
                 dhf.isContinuousSend = true;
-            MessageNumberNode *messageNumberNode = 0;
-            dhf.datagramNumber = congestionManager.GetAndIncrementNextDatagramSequenceNumber();
+            dhf.datagramNumber = congestionManager->GetAndIncrementNextDatagramSequenceNumber();
             dhf.isPacketPair = datagramsToSendThisUpdateIsPair[datagramIndex];
 
             //printf("%p pushing datagram %i\n", this, dhf.datagramNumber.val);
@@ -2172,18 +2449,21 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
             dhf.Serialize(&updateBitStream);
             CC_DEBUG_PRINTF_2("S%i ", dhf.datagramNumber.val);
 
+            // Store what message ids were sent with this datagram
+            unsigned int reliableMessageCount = 0;
+            for (unsigned int i = msgIndex; i < msgTerm; i++)
+            {
+                // If reliable or needs receipt
+                if (packetsToSendThisUpdate[i]->reliability != UNRELIABLE && packetsToSendThisUpdate[i]->reliability != UNRELIABLE_SEQUENCED)
+                    reliableMessageCount++;
+            }
+            MessageNumberType *datagramMessageNumbers = AddToDatagramHistory(dhf.datagramNumber, time, reliableMessageCount);
+
             while (msgIndex < msgTerm)
             {
                 auto &packet = packetsToSendThisUpdate[msgIndex];
-                // If reliable or needs receipt
-                if (packet->reliability != UNRELIABLE && packet->reliability != UNRELIABLE_SEQUENCED
-                        )
-                {
-                    if (messageNumberNode == 0)
-                        messageNumberNode = AddFirstToDatagramHistory(dhf.datagramNumber, packet->reliableMessageNumber, time);
-                    else
-                        messageNumberNode = AddSubsequentToDatagramHistory(messageNumberNode, packet->reliableMessageNumber);
-                }
+                if (packet->reliability != UNRELIABLE && packet->reliability != UNRELIABLE_SEQUENCED)
+                    *datagramMessageNumbers++ = packet->reliableMessageNumber;
 
                 RakAssert(updateBitStream.GetNumberOfBytesUsed() <= MAXIMUM_MTU_SIZE - UDP_HEADER_SIZE);
                 WriteToBitStreamFromInternalPacket(&updateBitStream, packet, time);
@@ -2199,13 +2479,12 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
                 RakAssert(updateBitStream.GetNumberOfBytesUsed() <= MAXIMUM_MTU_SIZE - UDP_HEADER_SIZE);
             }
 
-            if (messageNumberNode == 0)
-                AddFirstToDatagramHistory(dhf.datagramNumber, time);  // Unreliable, add dummy node
-
-            // Store what message ids were sent with this datagram
             //    datagramMessageIDTree.Insert(dhf.datagramNumber,idList);
 
-            congestionManager.OnSendBytes(time, UDP_HEADER_SIZE + DatagramHeaderFormat::GetDataHeaderByteLength());
+            congestionManager->OnSendBytes(time, UDP_HEADER_SIZE + DatagramHeaderFormat::GetDataHeaderByteLength());
+            congestionManager->OnSendDatagram(time, dhf.datagramNumber, UDP_HEADER_SIZE + (uint32_t) updateBitStream.GetNumberOfBytesUsed());
+            if (pacingBytesPerTick > 0)
+                pacingBudget -= (double) (UDP_HEADER_SIZE + updateBitStream.GetNumberOfBytesUsed());
 
             SendBitStream(s, systemAddress, &updateBitStream, rnr, time);
 
@@ -2223,6 +2502,10 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
                 timeOfLastContinualSend = 0;
         }
 
+        // With a datagram's worth of budget left, something else held the rest back, such as a full resend buffer
+        if (statistics.isLimitedByPacing && pacingBudget >= (double) congestionManager->GetMTU())
+            statistics.isLimitedByPacing = false;
+        RecordPacingDelay(time, packetsToSendThisUpdateDatagramBoundaries.Size() > 0);
         ClearPacketsAndDatagrams();
 
         // Any data waiting to send after attempting to send, then bandwidth is exceeded
@@ -2233,6 +2516,17 @@ void ReliabilityLayer::Update(RakNetSocket2 *s, SystemAddress &systemAddress, in
         //             sendPacketSet[3].IsEmpty()==false;
     }
 
+    // Parity completed by messages sent above goes out next Update(), in a different datagram from them
+    for (unsigned int i = 0; i < fecPendingParity.Size(); i++)
+    {
+        InternalPacket *internalPacket = fecPendingParity[i];
+        AddToUnreliableLinkedList(internalPacket);
+        outgoingPacketBuffer.Push(internalPacket);
+        statistics.messageInSendBuffer[(int) internalPacket->priority]++;
+        statistics.bytesInSendBuffer[(int) internalPacket->priority] += (double) BITS_TO_BYTES(
+                internalPacket->dataBitLength);
+    }
+    fecPendingParity.Clear(true);
 
     // Keep on top of deleting old unreliable split packets so they don't clog the list.
     //DeleteOldUnreliableSplitPackets( time );
@@ -2312,7 +2606,7 @@ void ReliabilityLayer::SendBitStream(RakNetSocket2 *s, SystemAddress &systemAddr
 
     bpsMetrics[(int) ACTUAL_BYTES_SENT].Push1(currentTime, length);
 
-    RakAssert(length <= congestionManager.GetMTU());
+    RakAssert(length <= congestionManager->GetMTU());
 
 #ifdef USE_THREADED_SEND
     SendToThread::SendToThreadBlock *block = SendToThread::AllocateBlock();
@@ -2330,7 +2624,7 @@ void ReliabilityLayer::SendBitStream(RakNetSocket2 *s, SystemAddress &systemAddr
     bsp.data = (char *) bitStream->GetData();
     bsp.length = length;
     bsp.systemAddress = systemAddress;
-    s->Send(&bsp);
+    s->SendBatched(&bsp);
 #endif
 }
 
@@ -2458,12 +2752,10 @@ ReliabilityLayer::RemovePacketFromResendListAndDeleteOlderReliableSequenced(cons
 
     //    bool deleted;
     //    deleted=resendTree.Delete(messageNumber, internalPacket);
-    InternalPacket *internalPacket = resendBuffer[messageNumber & RESEND_BUFFER_ARRAY_MASK];
     // May ask to remove twice, for example resend twice, then second ack
-    if (internalPacket && internalPacket->reliableMessageNumber == messageNumber)
+    InternalPacket *internalPacket = resendQueue.Remove(messageNumber);
+    if (internalPacket)
     {
-        //    ValidateResendList();
-        resendBuffer[messageNumber & RESEND_BUFFER_ARRAY_MASK] = 0;
         CC_DEBUG_PRINTF_2("AckRcv %i ", messageNumber);
 
         statistics.messagesInResendBuffer--;
@@ -2492,7 +2784,11 @@ ReliabilityLayer::RemovePacketFromResendListAndDeleteOlderReliableSequenced(cons
                            //            internalPacket->reliability == RELIABLE_SEQUENCED_WITH_ACK_RECEIPT  ||
                            internalPacket->reliability == RELIABLE_ORDERED_WITH_ACK_RECEIPT);
 
-        RemoveFromList(internalPacket, isReliable);
+        if (isReliable)
+        {
+            RakAssert(unacknowledgedBytes >= BITS_TO_BYTES(internalPacket->headerLength + internalPacket->dataBitLength));
+            unacknowledgedBytes -= BITS_TO_BYTES(internalPacket->headerLength + internalPacket->dataBitLength);
+        }
         FreeInternalPacketData(internalPacket);
         ReleaseToInternalPacketPool(internalPacket);
 
@@ -2589,7 +2885,9 @@ BitSize_t ReliabilityLayer::WriteToBitStreamFromInternalPacket(RakNet::BitStream
 
     // (Incoming data may be all zeros due to padding)
     bitStream->AlignWriteToByteBoundary(); // Potentially unaligned
-    if (internalPacket->reliability == UNRELIABLE_WITH_ACK_RECEIPT)
+    if (internalPacket->fecParity)
+        tempChar = FEC_PARITY_WIRE_RELIABILITY;
+    else if (internalPacket->reliability == UNRELIABLE_WITH_ACK_RECEIPT)
         tempChar = UNRELIABLE;
     else if (internalPacket->reliability == RELIABLE_WITH_ACK_RECEIPT)
         tempChar = RELIABLE;
@@ -2651,7 +2949,8 @@ BitSize_t ReliabilityLayer::WriteToBitStreamFromInternalPacket(RakNet::BitStream
 //-------------------------------------------------------------------------------------------------------
 // Parse a bitstream and create an internal packet to represent this data
 //-------------------------------------------------------------------------------------------------------
-InternalPacket *ReliabilityLayer::CreateInternalPacketFromBitStream(RakNet::BitStream *bitStream, CCTimeType time)
+InternalPacket *ReliabilityLayer::CreateInternalPacketFromBitStream(RakNet::BitStream *bitStream, CCTimeType time,
+                                                                    RNS2RecvStruct *receiveBuffer)
 {
     if (bitStream->GetNumberOfUnreadBits() < (int) sizeof(MessageNumberType) * 8)
         return nullptr; // leftover bits
@@ -2670,6 +2969,11 @@ InternalPacket *ReliabilityLayer::CreateInternalPacketFromBitStream(RakNet::BitS
     unsigned char tempChar;
     bitStream->ReadBits(&(tempChar), 3);
     internalPacket->reliability = (const PacketReliability) tempChar;
+    if (tempChar == FEC_PARITY_WIRE_RELIABILITY && (reliabilityFeatures & RF_FEC_PARITY))
+    {
+        internalPacket->fecParity = true;
+        internalPacket->reliability = UNRELIABLE;
+    }
     bool hasSplitPacket = false;
     bool readSuccess = bitStream->Read(hasSplitPacket); // Read 1 bit to indicate if splitPacketCount>0
     bitStream->AlignReadToByteBoundary();
@@ -2733,6 +3037,24 @@ InternalPacket *ReliabilityLayer::CreateInternalPacketFromBitStream(RakNet::BitS
         return nullptr;
     }
 
+    if (receiveBuffer && !hasSplitPacket)
+    {
+        // Point into the datagram instead of copying out of it. The message is byte aligned in the datagram
+        bitStream->AlignReadToByteBoundary();
+        if (bitStream->GetNumberOfUnreadBits() < (BitSize_t) BITS_TO_BYTES(internalPacket->dataBitLength) * 8)
+        {
+            RakAssert("Couldn't read all the data" && 0);
+            ReleaseToInternalPacketPool(internalPacket);
+            return nullptr;
+        }
+        internalPacket->allocationScheme = InternalPacket::RECEIVE_BUFFER;
+        internalPacket->data = bitStream->GetData() + BITS_TO_BYTES(bitStream->GetReadOffset());
+        internalPacket->receiveBuffer = receiveBuffer;
+        receiveBuffer->refCount.fetch_add(1, std::memory_order_relaxed);
+        bitStream->IgnoreBytes(BITS_TO_BYTES(internalPacket->dataBitLength));
+        return internalPacket;
+    }
+
     // Allocate memory to hold our data
     AllocInternalPacketData(internalPacket, BITS_TO_BYTES(internalPacket->dataBitLength), false);
     RakAssert(BITS_TO_BYTES(internalPacket->dataBitLength) < MAXIMUM_MTU_SIZE);
@@ -2925,7 +3247,10 @@ void ReliabilityLayer::SplitPacket(InternalPacket *internalPacket)
     // This identifies which packet this is in the set
     SplitPacketIndexType splitPacketIndex = 0;
 
+    // Data the application lent us is already reference counted, so the parts share that count
     InternalPacketRefCountedData *refCounter = nullptr;
+    if (internalPacket->allocationScheme == InternalPacket::REF_COUNTED)
+        refCounter = internalPacket->refCountedData;
 
     // Do a loop to send out all the packets
     do
@@ -2959,10 +3284,8 @@ void ReliabilityLayer::SplitPacket(InternalPacket *internalPacket)
 
     //    InternalPacket *workingPacket;
 
-    // Tell the heap we are going to push a list of elements where each element in the list follows the heap order
     RakAssert(outgoingPacketBuffer.Size() == 0 ||
               outgoingPacketBuffer.Peek()->dataBitLength < BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
-    outgoingPacketBuffer.StartSeries();
 
     // Copy all the new packets into the split packet list
     for (int i = 0; i < (int) internalPacket->splitPacketCount; i++)
@@ -2973,7 +3296,7 @@ void ReliabilityLayer::SplitPacket(InternalPacket *internalPacket)
         //        sendPacketSet[ internalPacket->priority ].Push( internalPacketArray[ i ],   );
         RakAssert(internalPacketArray[i]->dataBitLength < BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
         RakAssert(!internalPacketArray[i]->messageNumberAssigned);
-        outgoingPacketBuffer.PushSeries(GetNextWeight(internalPacketArray[i]->priority), internalPacketArray[i]);
+        outgoingPacketBuffer.Push(internalPacketArray[i]);
         RakAssert(outgoingPacketBuffer.Size() == 0 || outgoingPacketBuffer.Peek()->dataBitLength < BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
         statistics.messageInSendBuffer[(int) internalPacketArray[i]->priority]++;
         statistics.bytesInSendBuffer[(int) (int) internalPacketArray[i]->priority] += (double) BITS_TO_BYTES(internalPacketArray[i]->dataBitLength);
@@ -2983,7 +3306,9 @@ void ReliabilityLayer::SplitPacket(InternalPacket *internalPacket)
     }
 
     // Do not delete, original is referenced by all split packets to avoid numerous allocations. See AllocInternalPacketData above
-    //    FreeInternalPacketData(internalPacket,  );
+    // If it was already reference counted, only drop the reference the original held
+    if (internalPacket->allocationScheme == InternalPacket::REF_COUNTED)
+        FreeInternalPacketData(internalPacket);
     ReleaseToInternalPacketPool(internalPacket);
 
     if (!usedAlloca)
@@ -2996,145 +3321,81 @@ void ReliabilityLayer::SplitPacket(InternalPacket *internalPacket)
 void ReliabilityLayer::InsertIntoSplitPacketList(InternalPacket *internalPacket, CCTimeType time)
 {
     bool objectExists;
+    // A reliable message that is refused can never complete, because its fragments are acknowledged anyway
+    bool isReliable = internalPacket->reliability == RELIABLE ||
+                      internalPacket->reliability == RELIABLE_ORDERED ||
+                      internalPacket->reliability == RELIABLE_SEQUENCED;
+    uint64_t splitPacketBytesAvailable = splitPacketBytesReserved < CRABNET_MAX_SPLIT_BYTES_PER_CONNECTION ?
+                                         CRABNET_MAX_SPLIT_BYTES_PER_CONNECTION - splitPacketBytesReserved : 0;
     // Find in splitPacketChannelList if a SplitPacketChannel with this splitPacketId was already allocated. If not, allocate and insert the channel into the list.
     unsigned index = splitPacketChannelList.GetIndexFromKey(internalPacket->splitPacketId, &objectExists);
     if (!objectExists)
     {
         auto newChannel = new SplitPacketChannel;
-#if PREALLOCATE_LARGE_MESSAGES == 1
-        index=splitPacketChannelList.Insert(internalPacket->splitPacketId, newChannel, true, );
-        newChannel->returnedPacket=CreateInternalPacketCopy( internalPacket, 0, 0, time );
-        newChannel->gotFirstPacket=false;
-        newChannel->splitPacketsArrived=0;
-        AllocInternalPacketData(newChannel->returnedPacket, BITS_TO_BYTES( internalPacket->dataBitLength*internalPacket->splitPacketCount ),  false );
-        RakAssert(newChannel->returnedPacket->data);
-#else
-        newChannel->firstPacket = nullptr;
-        index = splitPacketChannelList.Insert(internalPacket->splitPacketId, newChannel, true);
-        // Preallocate to the final size, to avoid runtime copies
         newChannel->splitPacketList.reliabilityLayer = this;
-        newChannel->splitPacketList.prealloc(internalPacket->splitPacketCount, internalPacket->splitPacketId);
-
-#endif
-    }
-
-#if PREALLOCATE_LARGE_MESSAGES == 1
-    splitPacketChannelList[index]->lastUpdateTime=time;
-    splitPacketChannelList[index]->splitPacketsArrived++;
-    splitPacketChannelList[index]->returnedPacket->dataBitLength+=internalPacket->dataBitLength;
-
-    bool dealloc;
-    if (internalPacket->splitPacketIndex==0)
-    {
-        splitPacketChannelList[index]->gotFirstPacket=true;
-        splitPacketChannelList[index]->stride=BITS_TO_BYTES(internalPacket->dataBitLength);
-
-        for (unsigned int j=0; j < splitPacketChannelList[index]->splitPacketList.size(); j++)
+        if (!newChannel->splitPacketList.prealloc(internalPacket->splitPacketCount, internalPacket->splitPacketId,
+                                                  splitPacketBytesAvailable))
         {
-            memcpy(splitPacketChannelList[index]->returnedPacket->data+internalPacket->splitPacketIndex*splitPacketChannelList[index]->stride, internalPacket->data, (size_t) BITS_TO_BYTES(internalPacket->dataBitLength));
-            FreeInternalPacketData(splitPacketChannelList[index]->splitPacketList[j] );
-            ReleaseToInternalPacketPool(splitPacketChannelList[index]->splitPacketList[j]);
+            // Too large to accept
+            delete newChannel;
+            FreeInternalPacketData(internalPacket);
+            ReleaseToInternalPacketPool(internalPacket);
+            if (isReliable)
+                KillConnection();
+            return;
         }
-
-        memcpy(splitPacketChannelList[index]->returnedPacket->data, internalPacket->data, (size_t) BITS_TO_BYTES(internalPacket->dataBitLength));
-        splitPacketChannelList[index]->splitPacketList.Clear(true);
-        dealloc=true;
+        index = splitPacketChannelList.Insert(internalPacket->splitPacketId, newChannel, true);
+        splitPacketBytesReserved += newChannel->splitPacketList.reservedBytes();
+        splitPacketBytesAvailable -= newChannel->splitPacketList.reservedBytes();
     }
-    else
+
+    // Copy the fragment into the message buffer. This releases the fragment
+    SplitPacketList &splitPacketList = splitPacketChannelList[index]->splitPacketList;
+    SplitPacketIndexType splitPacketCount = internalPacket->splitPacketCount;
+    uint64_t reservedBytes = splitPacketList.reservedBytes();
+    if (!splitPacketList.insert(internalPacket, splitPacketBytesAvailable))
     {
-        if (splitPacketChannelList[index]->gotFirstPacket==true)
-        {
-            memcpy(splitPacketChannelList[index]->returnedPacket->data+internalPacket->splitPacketIndex*splitPacketChannelList[index]->stride, internalPacket->data, (size_t) BITS_TO_BYTES(internalPacket->dataBitLength));
-            dealloc=true;
-        }
-        else
+        if (splitPacketList.overLimit())
         {
-            splitPacketChannelList[index]->splitPacketList.Push(internalPacket);
-            dealloc=false;
+            // The connection holds too many unfinished split messages to buffer this one, so drop all of it
+            splitPacketBytesReserved -= reservedBytes;
+            delete splitPacketChannelList[index];
+            splitPacketChannelList.RemoveAtIndex(index);
+            if (isReliable)
+                KillConnection();
         }
-    }
-
-    if (splitPacketChannelList[index]->gotFirstPacket==true &&
-        splitMessageProgressInterval &&
-        //         splitPacketChannelList[index]->firstPacket &&
-        //         splitPacketChannelList[index]->splitPacketList.size()!=splitPacketChannelList[index]->firstPacket->splitPacketCount &&
-        //         (splitPacketChannelList[index]->splitPacketList.size()%splitMessageProgressInterval)==0
-        splitPacketChannelList[index]->gotFirstPacket &&
-        splitPacketChannelList[index]->splitPacketsArrived!=splitPacketChannelList[index]->returnedPacket->splitPacketCount &&
-        (splitPacketChannelList[index]->splitPacketsArrived%splitMessageProgressInterval)==0
-        )
-    {
-        // Return ID_DOWNLOAD_PROGRESS
-        // Write splitPacketIndex (SplitPacketIndexType)
-        // Write splitPacketCount (SplitPacketIndexType)
-        // Write byteLength (4)
-        // Write data, splitPacketChannelList[index]->splitPacketList[0]->data
-        InternalPacket *progressIndicator = AllocateFromInternalPacketPool();
-        //        unsigned int len = sizeof(MessageID) + sizeof(unsigned int)*2 + sizeof(unsigned int) + (unsigned int) BITS_TO_BYTES(splitPacketChannelList[index]->firstPacket->dataBitLength);
-        unsigned int l = (unsigned int) splitPacketChannelList[index]->stride;
-        const unsigned int len = sizeof(MessageID) + sizeof(unsigned int)*2 + sizeof(unsigned int) + l;
-        AllocInternalPacketData(progressIndicator, len,  false );
-        progressIndicator->dataBitLength=BYTES_TO_BITS(len);
-        progressIndicator->data[0]=(MessageID)ID_DOWNLOAD_PROGRESS;
-        unsigned int temp;
-        //    temp=splitPacketChannelList[index]->splitPacketList.size();
-        temp=splitPacketChannelList[index]->splitPacketsArrived;
-        memcpy(progressIndicator->data+sizeof(MessageID), &temp, sizeof(unsigned int));
-        temp=(unsigned int)internalPacket->splitPacketCount;
-        memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*1, &temp, sizeof(unsigned int));
-        //        temp=(unsigned int) BITS_TO_BYTES(splitPacketChannelList[index]->firstPacket->dataBitLength);
-        temp=(unsigned int) BITS_TO_BYTES(l);
-        memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*2, &temp, sizeof(unsigned int));
-        //memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*3, splitPacketChannelList[index]->firstPacket->data, (size_t) BITS_TO_BYTES(splitPacketChannelList[index]->firstPacket->dataBitLength));
-        memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*3, splitPacketChannelList[index]->returnedPacket->data, (size_t) BITS_TO_BYTES(l));
-    }
-
-    if (dealloc)
-    {
-        FreeInternalPacketData(internalPacket );
-        ReleaseToInternalPacketPool(internalPacket);
-    }
-#else
-    // Insert the packet into the SplitPacketChannel
-    if(!splitPacketChannelList[index]->splitPacketList.insert(internalPacket))
         return;
+    }
+    splitPacketBytesReserved += splitPacketList.reservedBytes() - reservedBytes;
     splitPacketChannelList[index]->lastUpdateTime = time;
 
-    // If the index is 0, then this is the first packet. Record this so it can be returned to the user with download progress
-    if (internalPacket->splitPacketIndex == 0)
-        splitPacketChannelList[index]->firstPacket = internalPacket;
-
-    auto &firstPacket = splitPacketChannelList[index]->firstPacket;
-
     // Return download progress if we have the first packet, the list is not complete, and there are enough packets to justify it
-    if (splitMessageProgressInterval && firstPacket &&
-        splitPacketChannelList[index]->splitPacketList.count() != firstPacket->splitPacketCount &&
-        (splitPacketChannelList[index]->splitPacketList.count() % splitMessageProgressInterval) == 0)
+    unsigned int firstLength;
+    const unsigned char *firstData = splitPacketList.firstData(&firstLength);
+    if (splitMessageProgressInterval && firstData &&
+        splitPacketList.count() != splitPacketList.size() &&
+        (splitPacketList.count() % splitMessageProgressInterval) == 0)
     {
         // Return ID_DOWNLOAD_PROGRESS
         // Write splitPacketIndex (SplitPacketIndexType)
         // Write splitPacketCount (SplitPacketIndexType)
         // Write byteLength (4)
-        // Write data, splitPacketChannelList[index]->splitPacketList[0]->data
+        // Write data, the first fragment
         InternalPacket *progressIndicator = AllocateFromInternalPacketPool();
-        unsigned int length = sizeof(MessageID) + sizeof(unsigned int) * 2 + sizeof(unsigned int) +
-                              (unsigned int) BITS_TO_BYTES(firstPacket->dataBitLength);
+        unsigned int length = sizeof(MessageID) + sizeof(unsigned int) * 2 + sizeof(unsigned int) + firstLength;
         AllocInternalPacketData(progressIndicator, length, false);
         progressIndicator->dataBitLength = BYTES_TO_BITS(length);
         progressIndicator->data[0] = (MessageID) ID_DOWNLOAD_PROGRESS;
-        unsigned int temp = splitPacketChannelList[index]->splitPacketList.count();
+        unsigned int temp = splitPacketList.count();
         memcpy(progressIndicator->data + sizeof(MessageID), &temp, sizeof(unsigned int));
-        temp = (unsigned int) internalPacket->splitPacketCount;
+        temp = (unsigned int) splitPacketCount;
         memcpy(progressIndicator->data + sizeof(MessageID) + sizeof(unsigned int) * 1, &temp, sizeof(unsigned int));
-        temp = (unsigned int) BITS_TO_BYTES(firstPacket->dataBitLength);
+        temp = firstLength;
         memcpy(progressIndicator->data + sizeof(MessageID) + sizeof(unsigned int) * 2, &temp, sizeof(unsigned int));
 
-        memcpy(progressIndicator->data + sizeof(MessageID) + sizeof(unsigned int) * 3, firstPacket->data,
-               (size_t) BITS_TO_BYTES(firstPacket->dataBitLength));
+        memcpy(progressIndicator->data + sizeof(MessageID) + sizeof(unsigned int) * 3, firstData, (size_t) firstLength);
         outputQueue.Push(progressIndicator);
     }
-
-#endif
 }
 
 //-------------------------------------------------------------------------------------------------------
@@ -3145,40 +3406,17 @@ void ReliabilityLayer::InsertIntoSplitPacketList(InternalPacket *internalPacket,
 InternalPacket *
 ReliabilityLayer::BuildPacketFromSplitPacketList(SplitPacketChannel *splitPacketChannel, CCTimeType time)
 {
-#if PREALLOCATE_LARGE_MESSAGES == 1
-    InternalPacket *returnedPacket=splitPacketChannel->returnedPacket;
-    delete splitPacketChannel;
-    (void) time;
-    return returnedPacket;
-#else
-    // Reconstruct
-    InternalPacket *internalPacket = CreateInternalPacketCopy(splitPacketChannel->splitPacketList[0], 0, 0, time);
-    internalPacket->dataBitLength = 0;
-    for (unsigned j = 0; j < splitPacketChannel->splitPacketList.size(); j++)
-        internalPacket->dataBitLength += splitPacketChannel->splitPacketList[j]->dataBitLength;
-
-    internalPacket->data = (unsigned char *) malloc((size_t) BITS_TO_BYTES(internalPacket->dataBitLength));
-    RakAssert(internalPacket->data);
+    // The fragments are already in place, so the buffer becomes the message data
+    SplitPacketList &splitPacketList = splitPacketChannel->splitPacketList;
+    splitPacketBytesReserved -= splitPacketList.reservedBytes();
+    InternalPacket *internalPacket = CreateInternalPacketCopy(splitPacketList.header, 0, 0, time);
+    internalPacket->data = splitPacketList.buffer;
+    internalPacket->dataBitLength = splitPacketList.bitLength;
     internalPacket->allocationScheme = InternalPacket::NORMAL;
-
-    BitSize_t offset = 0;
-    for (unsigned j = 0; j < splitPacketChannel->splitPacketList.size(); j++)
-    {
-        InternalPacket *splitPacket = splitPacketChannel->splitPacketList[j];
-        size_t splitPacketPartLength = BITS_TO_BYTES(splitPacketChannel->splitPacketList[j]->dataBitLength);
-        memcpy(internalPacket->data + BITS_TO_BYTES(offset), splitPacket->data, splitPacketPartLength);
-        offset += splitPacketChannel->splitPacketList[j]->dataBitLength;
-    }
-
-    for (unsigned j = 0; j < splitPacketChannel->splitPacketList.size(); j++)
-    {
-        FreeInternalPacketData(splitPacketChannel->splitPacketList[j]);
-        ReleaseToInternalPacketPool(splitPacketChannel->splitPacketList[j]);
-    }
+    splitPacketList.buffer = nullptr;
     delete splitPacketChannel;
 
     return internalPacket;
-#endif
 }
 
 //-------------------------------------------------------------------------------------------------------
@@ -3190,13 +3428,12 @@ InternalPacket *ReliabilityLayer::BuildPacketFromSplitPacketList(SplitPacketIdTy
     bool objectExists;
     // Find in splitPacketChannelList the SplitPacketChannel with this splitPacketId
     unsigned int i = splitPacketChannelList.GetIndexFromKey(splitPacketId, &objectExists);
+    // The message was refused in InsertIntoSplitPacketList
+    if (!objectExists)
+        return 0;
     SplitPacketChannel *splitPacketChannel = splitPacketChannelList[i];
 
-#if PREALLOCATE_LARGE_MESSAGES == 1
-    if (splitPacketChannel->splitPacketsArrived==splitPacketChannel->returnedPacket->splitPacketCount)
-#else
     if (splitPacketChannel->splitPacketList.count() == splitPacketChannel->splitPacketList.size())
-#endif
     {
         // Ack immediately, because for large files this can take a long time
         SendACKs(s, systemAddress, time, rnr, updateBitStream);
@@ -3269,11 +3506,6 @@ ReliabilityLayer::CreateInternalPacketCopy(InternalPacket *original, int dataByt
     copy->reliableMessageNumber = original->reliableMessageNumber;
     copy->priority = original->priority;
     copy->reliability = original->reliability;
-#if PREALLOCATE_LARGE_MESSAGES == 1
-    copy->splitPacketCount = original->splitPacketCount;
-    copy->splitPacketId = original->splitPacketId;
-    copy->splitPacketIndex = original->splitPacketIndex;
-#endif
 
     return copy;
 }
@@ -3299,7 +3531,7 @@ void ReliabilityLayer::AddToOrderingList( InternalPacket * internalPacket )
 */
 
 //-------------------------------------------------------------------------------------------------------
-// Inserts a packet into the resend list in order
+// Inserts a packet into the resend queue, ordered by nextActionTime
 //-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::InsertPacketIntoResendList(InternalPacket *internalPacket, CCTimeType time, bool firstResend,
                                                   bool modifyUnacknowledgedBytes)
@@ -3307,9 +3539,11 @@ void ReliabilityLayer::InsertPacketIntoResendList(InternalPacket *internalPacket
     (void) firstResend;
     (void) time;
 
-    AddToListTail(internalPacket, modifyUnacknowledgedBytes);
-    RakAssert(internalPacket->nextActionTime != 0);
+    if (modifyUnacknowledgedBytes)
+        unacknowledgedBytes += BITS_TO_BYTES(internalPacket->headerLength + internalPacket->dataBitLength);
 
+    RakAssert(internalPacket->nextActionTime != 0);
+    resendQueue.Push(internalPacket);
 }
 
 //-------------------------------------------------------------------------------------------------------
@@ -3395,6 +3629,91 @@ CCTimeType ReliabilityLayer::GetNextSendTime(void) const
     return nextSendTime;
 }
 
+//-------------------------------------------------------------------------------------------------------
+// Shortens *wait to reach deadline. Returns true if the deadline already passed, compared the same way Update() does to survive wraparound
+static bool ShortenWaitToDeadline(CCTimeType time, CCTimeType deadline, CCTimeType *wait)
+{
+    if (time - deadline < (((CCTimeType) -1) / 2))
+        return true;
+    if (deadline - time < *wait)
+        *wait = deadline - time;
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------------
+CCTimeType ReliabilityLayer::GetTimeToNextUpdate(CCTimeType time, CCTimeType maxWait) const
+{
+    CCTimeType wait = maxWait;
+
+    if (deadConnection || NAKs.Size() > 0)
+        return 0;
+
+    if (outgoingPacketBuffer.Size() > 0)
+    {
+        // Pushed since the last Update(), so it has not been tried yet
+        if (!bandwidthExceededStatistic)
+            return 0;
+
+        // A rate based controller opens up again with time
+        CCTimeType nextSendTime;
+        if (congestionManager->GetNextSendTime(time, &nextSendTime) && ShortenWaitToDeadline(time, nextSendTime, &wait))
+            return 0;
+
+        // So does the pacer
+        if (statistics.isLimitedByPacing && ShortenWaitToDeadline(time, GetNextPacedSendTime(), &wait))
+            return 0;
+
+        // Left over by the congestion window, which opens when acks arrive or a resend times out, both handled below.
+        // The outgoing bandwidth limit instead opens up with time
+        if (statistics.isLimitedByOutgoingBandwidthLimit)
+        {
+#if CC_TIME_TYPE_BYTES == 4
+            ShortenWaitToDeadline(time, time + 10, &wait);
+#else
+            ShortenWaitToDeadline(time, time + 10000, &wait);
+#endif
+        }
+    }
+
+    if (acknowlegements.Size() > 0 && ShortenWaitToDeadline(time, congestionManager->GetNextACKTime(time), &wait))
+        return 0;
+
+    // The resend queue is ordered by nextActionTime, so the head is the first to time out. If the pacer or a rate based
+    // controller held it back, it goes out once they allow
+    if (!IsResendQueueEmpty())
+    {
+        CCTimeType resendTime = resendQueue.Peek()->nextActionTime;
+        if (time - resendTime < (((CCTimeType) -1) / 2))
+        {
+            CCTimeType nextSendTime;
+            if (statistics.isLimitedByPacing)
+                resendTime = GetNextPacedSendTime();
+            else if (congestionManager->GetNextSendTime(time, &nextSendTime))
+                resendTime = nextSendTime;
+        }
+        if (ShortenWaitToDeadline(time, resendTime, &wait))
+            return 0;
+    }
+
+    for (unsigned int i = 0; i < unreliableWithAckReceiptHistory.Size(); i++)
+    {
+        if (ShortenWaitToDeadline(time, unreliableWithAckReceiptHistory[i].nextActionTime, &wait))
+            return 0;
+    }
+
+#ifdef _DEBUG
+#if CC_TIME_TYPE_BYTES == 4
+    if (delayList.Size() > 0 && ShortenWaitToDeadline(time, (CCTimeType) delayList.Peek()->sendTime, &wait))
+        return 0;
+#else
+    if (delayList.Size() > 0 && ShortenWaitToDeadline(time, (CCTimeType) delayList.Peek()->sendTime * 1000, &wait))
+        return 0;
+#endif
+#endif
+
+    return wait;
+}
+
 //-------------------------------------------------------------------------------------------------------
 CCTimeType ReliabilityLayer::GetTimeBetweenPackets(void) const
 {
@@ -3441,7 +3760,7 @@ void ReliabilityLayer::PushPacket(CCTimeType time, InternalPacket *internalPacke
 //         RakNet::TimeMS diff = curTime-t;
 //     }
 
-    congestionManager.OnSendBytes(time, BITS_TO_BYTES(internalPacket->dataBitLength) +
+    congestionManager->OnSendBytes(time, BITS_TO_BYTES(internalPacket->dataBitLength) +
                                         BITS_TO_BYTES(internalPacket->headerLength));
 }
 
@@ -3498,83 +3817,10 @@ void ReliabilityLayer::ClearPacketsAndDatagrams(void)
     packetsToDeallocThisUpdate.Clear(true);
 }
 
-//-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::MoveToListHead(InternalPacket *internalPacket)
-{
-    if (internalPacket == resendLinkedListHead)
-        return;
-    if (resendLinkedListHead == 0)
-    {
-        internalPacket->resendNext = internalPacket;
-        internalPacket->resendPrev = internalPacket;
-        resendLinkedListHead = internalPacket;
-        return;
-    }
-    internalPacket->resendPrev->resendNext = internalPacket->resendNext;
-    internalPacket->resendNext->resendPrev = internalPacket->resendPrev;
-    internalPacket->resendNext = resendLinkedListHead;
-    internalPacket->resendPrev = resendLinkedListHead->resendPrev;
-    internalPacket->resendPrev->resendNext = internalPacket;
-    resendLinkedListHead->resendPrev = internalPacket;
-    resendLinkedListHead = internalPacket;
-    RakAssert(internalPacket->headerLength + internalPacket->dataBitLength > 0);
-
-    //ValidateResendList();
-}
-
-//-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::RemoveFromList(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes)
-{
-    InternalPacket *newPosition;
-    internalPacket->resendPrev->resendNext = internalPacket->resendNext;
-    internalPacket->resendNext->resendPrev = internalPacket->resendPrev;
-    newPosition = internalPacket->resendNext;
-    if (internalPacket == resendLinkedListHead)
-        resendLinkedListHead = newPosition;
-    if (resendLinkedListHead == internalPacket)
-        resendLinkedListHead = 0;
-
-    if (modifyUnacknowledgedBytes)
-    {
-        RakAssert(unacknowledgedBytes >= BITS_TO_BYTES(internalPacket->headerLength + internalPacket->dataBitLength));
-        unacknowledgedBytes -= BITS_TO_BYTES(internalPacket->headerLength + internalPacket->dataBitLength);
-//        ValidateResendList();
-    }
-}
-
-//-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::AddToListTail(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes)
-{
-    if (modifyUnacknowledgedBytes)
-        unacknowledgedBytes += BITS_TO_BYTES(internalPacket->headerLength + internalPacket->dataBitLength);
-
-    if (resendLinkedListHead == 0)
-    {
-        internalPacket->resendNext = internalPacket;
-        internalPacket->resendPrev = internalPacket;
-        resendLinkedListHead = internalPacket;
-        return;
-    }
-    internalPacket->resendNext = resendLinkedListHead;
-    internalPacket->resendPrev = resendLinkedListHead->resendPrev;
-    internalPacket->resendPrev->resendNext = internalPacket;
-    resendLinkedListHead->resendPrev = internalPacket;
-
-//    ValidateResendList();
-
-}
-
-//-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::PopListHead(bool modifyUnacknowledgedBytes)
-{
-    RakAssert(resendLinkedListHead != 0);
-    RemoveFromList(resendLinkedListHead, modifyUnacknowledgedBytes);
-}
-
 //-------------------------------------------------------------------------------------------------------
 bool ReliabilityLayer::IsResendQueueEmpty(void) const
 {
-    return resendLinkedListHead == 0;
+    return resendQueue.IsEmpty();
 }
 
 //-------------------------------------------------------------------------------------------------------
@@ -3591,6 +3837,7 @@ void ReliabilityLayer::SendACKs(RakNetSocket2 *s, SystemAddress &systemAddress,
         dhf.isACK = true;
         dhf.isNAK = false;
         dhf.isPacketPair = false;
+        dhf.isBitmap = (reliabilityFeatures & RF_BITMAP_ACKS) != 0;
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
         dhf.sourceSystemTime=time;
 #endif
@@ -3599,7 +3846,7 @@ void ReliabilityLayer::SendACKs(RakNetSocket2 *s, SystemAddress &systemAddress,
         bool hasBAndAS;
         if (remoteSystemNeedsBAndAS)
         {
-            congestionManager.OnSendAckGetBAndAS(time, &hasBAndAS, &B, &AS);
+            congestionManager->OnSendAckGetBAndAS(time, &hasBAndAS, &B, &AS);
             dhf.AS = (float) AS;
             dhf.hasBAndAS = hasBAndAS;
         }
@@ -3612,12 +3859,15 @@ void ReliabilityLayer::SendACKs(RakNetSocket2 *s, SystemAddress &systemAddress,
         updateBitStream.Reset();
         dhf.Serialize(&updateBitStream);
         CC_DEBUG_PRINTF_1("AckSnd ");
-        acknowlegements.Serialize(&updateBitStream, maxDatagramPayload, true);
+        if (dhf.isBitmap)
+            acknowlegements.SerializeBitmap(&updateBitStream, maxDatagramPayload, true);
+        else
+            acknowlegements.Serialize(&updateBitStream, maxDatagramPayload, true);
         SendBitStream(s, systemAddress, &updateBitStream, rnr, time);
-        congestionManager.OnSendAck(time, updateBitStream.GetNumberOfBytesUsed());
+        congestionManager->OnSendAck(time, updateBitStream.GetNumberOfBytesUsed());
 
         // I think this is causing a bug where if the estimated bandwidth is very low for the recipient, only acks ever get sent
-        //    congestionManager.OnSendBytes(time,UDP_HEADER_SIZE+updateBitStream.GetNumberOfBytesUsed());
+        //    congestionManager->OnSendBytes(time,UDP_HEADER_SIZE+updateBitStream.GetNumberOfBytesUsed());
     }
 }
 /*
@@ -3650,6 +3900,7 @@ InternalPacket *ReliabilityLayer::AllocateFromInternalPacketPool(void)
     ip->allocationScheme = InternalPacket::NORMAL;
     ip->data = 0;
     ip->timesSent = 0;
+    ip->fecParity = false;
     return ip;
 }
 
@@ -3729,91 +3980,34 @@ void ReliabilityLayer::ValidateResendList(void) const
 //-------------------------------------------------------------------------------------------------------
 bool ReliabilityLayer::ResendBufferOverflow(void) const
 {
-    int index1 = sendReliableMessageNumberIndex & (uint32_t) RESEND_BUFFER_ARRAY_MASK;
-    //    int index2 = (sendReliableMessageNumberIndex+(uint32_t)1) & (uint32_t) RESEND_BUFFER_ARRAY_MASK;
-    RakAssert(index1 < RESEND_BUFFER_ARRAY_LENGTH);
-    return resendBuffer[index1] != 0; // || resendBuffer[index2]!=0;
-
-}
-
-//-------------------------------------------------------------------------------------------------------
-ReliabilityLayer::MessageNumberNode *ReliabilityLayer::GetMessageNumberNodeByDatagramIndex(DatagramSequenceNumberType index, CCTimeType *timeSent)
-{
-    if (datagramHistory.IsEmpty())
-        return 0;
-
-    if (congestionManager.LessThan(index, datagramHistoryPopCount))
-        return 0;
-
-    DatagramSequenceNumberType offsetIntoList = index - datagramHistoryPopCount;
-    if (offsetIntoList >= datagramHistory.Size())
-        return 0;
-
-    *timeSent = datagramHistory[offsetIntoList].timeSent;
-    return datagramHistory[offsetIntoList].head;
-}
-
-//-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::RemoveFromDatagramHistory(DatagramSequenceNumberType index)
-{
-    DatagramSequenceNumberType offsetIntoList = index - datagramHistoryPopCount;
-    MessageNumberNode *mnm = datagramHistory[offsetIntoList].head;
-    MessageNumberNode *next;
-    while (mnm)
-    {
-        next = mnm->next;
-        datagramHistoryMessagePool.Release(mnm);
-        mnm = next;
-    }
-    datagramHistory[offsetIntoList].head = 0;
+    return !resendQueue.HasRoomFor(sendReliableMessageNumberIndex);
 }
 
 //-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::AddFirstToDatagramHistory(DatagramSequenceNumberType datagramNumber, CCTimeType timeSent)
-{
-    (void) datagramNumber;
-    if (datagramHistory.Size() > DATAGRAM_MESSAGE_ID_ARRAY_LENGTH)
-    {
-        RemoveFromDatagramHistory(datagramHistoryPopCount);
-        datagramHistory.Pop();
-        datagramHistoryPopCount++;
-    }
-
-    datagramHistory.Push(DatagramHistoryNode(0, timeSent));
-    // printf("%p Pushed empty DatagramHistoryNode to datagram history at index %i\n", this, datagramHistory.Size()-1);
-}
-
+// Datagrams stay in the history until nothing in them can still be acked, so acks for any datagram in flight are applied
 //-------------------------------------------------------------------------------------------------------
-ReliabilityLayer::MessageNumberNode *
-ReliabilityLayer::AddFirstToDatagramHistory(DatagramSequenceNumberType datagramNumber,
-                                            DatagramSequenceNumberType messageNumber, CCTimeType timeSent)
+MessageNumberType *ReliabilityLayer::AddToDatagramHistory(DatagramSequenceNumberType datagramNumber, CCTimeType timeSent,
+                                                          unsigned int messageCount)
 {
-    (void) datagramNumber;
-//    RakAssert(datagramHistoryPopCount+(unsigned int) datagramHistory.Size()==datagramNumber);
-    if (datagramHistory.Size() > DATAGRAM_MESSAGE_ID_ARRAY_LENGTH)
+    while (!datagramHistory.IsEmpty())
     {
-        RemoveFromDatagramHistory(datagramHistoryPopCount);
-        datagramHistory.Pop();
-        datagramHistoryPopCount++;
+        // The oldest datagram is kept while a message it carried waits for an ack, even if the message was resent in a later datagram.
+        // Push() drops it anyway once the history holds CRABNET_MAXIMUM_DATAGRAM_HISTORY datagrams
+        unsigned int oldestMessageCount;
+        CCTimeType oldestTimeSent;
+        const MessageNumberType *messageNumbers = datagramHistory.Get(datagramHistory.GetOldestNumber(), &oldestMessageCount, &oldestTimeSent);
+        if (messageNumbers)
+        {
+            unsigned int messageIndex = 0;
+            while (messageIndex < oldestMessageCount && resendQueue.Get(messageNumbers[messageIndex]) == 0)
+                messageIndex++;
+            if (messageIndex < oldestMessageCount)
+                break;
+        }
+        datagramHistory.PopOldest();
     }
 
-    MessageNumberNode *mnm = datagramHistoryMessagePool.Allocate();
-    mnm->next = 0;
-    mnm->messageNumber = messageNumber;
-    datagramHistory.Push(DatagramHistoryNode(mnm, timeSent));
-    // printf("%p Pushed message %i to DatagramHistoryNode to datagram history at index %i\n", this, messageNumber.val, datagramHistory.Size()-1);
-    return mnm;
-}
-
-//-------------------------------------------------------------------------------------------------------
-ReliabilityLayer::MessageNumberNode *
-ReliabilityLayer::AddSubsequentToDatagramHistory(MessageNumberNode *messageNumberNode,
-                                                 DatagramSequenceNumberType messageNumber)
-{
-    messageNumberNode->next = datagramHistoryMessagePool.Allocate();
-    messageNumberNode->next->messageNumber = messageNumber;
-    messageNumberNode->next->next = 0;
-    return messageNumberNode->next;
+    return datagramHistory.Push(datagramNumber, timeSent, messageCount);
 }
 
 //-------------------------------------------------------------------------------------------------------
@@ -3829,6 +4023,8 @@ ReliabilityLayer::AllocInternalPacketData(InternalPacket *internalPacket, Intern
         // *refCounter =new InternalPacketRefCountedData;
         (*refCounter)->refCount = 1;
         (*refCounter)->sharedDataBlock = externallyAllocatedPtr;
+        (*refCounter)->releaseCallback = 0;
+        (*refCounter)->releaseUserData = 0;
     }
     else
         (*refCounter)->refCount++;
@@ -3871,7 +4067,12 @@ void ReliabilityLayer::FreeInternalPacketData(InternalPacket *internalPacket)
         internalPacket->refCountedData->refCount--;
         if (internalPacket->refCountedData->refCount == 0)
         {
-            free(internalPacket->refCountedData->sharedDataBlock);
+            if (internalPacket->refCountedData->releaseCallback)
+                internalPacket->refCountedData->releaseCallback(
+                        (const char *) internalPacket->refCountedData->sharedDataBlock,
+                        internalPacket->refCountedData->releaseUserData);
+            else
+                free(internalPacket->refCountedData->sharedDataBlock);
             internalPacket->refCountedData->sharedDataBlock = 0;
             // delete internalPacket->refCountedData;
             refCountedDataPool.Release(internalPacket->refCountedData);
@@ -3886,6 +4087,15 @@ void ReliabilityLayer::FreeInternalPacketData(InternalPacket *internalPacket)
         free(internalPacket->data);
         internalPacket->data = 0;
     }
+    else if (internalPacket->allocationScheme == InternalPacket::RECEIVE_BUFFER)
+    {
+        if (internalPacket->receiveBuffer == 0)
+            return;
+
+        internalPacket->receiveBuffer->eventHandler->DeallocRNS2RecvStruct(internalPacket->receiveBuffer);
+        internalPacket->receiveBuffer = 0;
+        internalPacket->data = 0;
+    }
     else // Data was on stack
         internalPacket->data = 0;
 }
@@ -3893,7 +4103,7 @@ void ReliabilityLayer::FreeInternalPacketData(InternalPacket *internalPacket)
 //-------------------------------------------------------------------------------------------------------
 unsigned int ReliabilityLayer::GetMaxDatagramSizeExcludingMessageHeaderBytes(void)
 {
-    unsigned int val = congestionManager.GetMTU() - DatagramHeaderFormat::GetDataHeaderByteLength();
+    unsigned int val = congestionManager->GetMTU() - DatagramHeaderFormat::GetDataHeaderByteLength();
 
 #ifdef LIBCAT_SECURITY
     if (useSecurity)
@@ -3909,32 +4119,6 @@ BitSize_t ReliabilityLayer::GetMaxDatagramSizeExcludingMessageHeaderBits(void)
     return BYTES_TO_BITS(GetMaxDatagramSizeExcludingMessageHeaderBytes());
 }
 
-//-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::InitHeapWeights(void)
-{
-    for (int priorityLevel = 0; priorityLevel < NUMBER_OF_PRIORITIES; priorityLevel++)
-        outgoingPacketBufferNextWeights[priorityLevel] = (1 << priorityLevel) * priorityLevel + priorityLevel;
-}
-
-//-------------------------------------------------------------------------------------------------------
-reliabilityHeapWeightType ReliabilityLayer::GetNextWeight(int priorityLevel)
-{
-    uint64_t next = outgoingPacketBufferNextWeights[priorityLevel];
-    if (outgoingPacketBuffer.Size() > 0)
-    {
-        int peekPL = outgoingPacketBuffer.Peek()->priority;
-        reliabilityHeapWeightType weight = outgoingPacketBuffer.PeekWeight();
-        reliabilityHeapWeightType min = weight - (1 << peekPL) * peekPL + peekPL;
-        if (next < min)
-            next = min + ((uint64_t) 1 << priorityLevel) * priorityLevel + priorityLevel;
-        outgoingPacketBufferNextWeights[priorityLevel] =
-                next + ((uint64_t) 1 << priorityLevel) * (priorityLevel + 1) + priorityLevel;
-    }
-    else
-        InitHeapWeights();
-    return next;
-}
-
 //-------------------------------------------------------------------------------------------------------
 // #if defined(RELIABILITY_LAYER_NEW_UNDEF_ALLOCATING_QUEUE)
 // #pragma pop_macro("new")
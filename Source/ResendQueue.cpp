@@ -0,0 +1,206 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "ResendQueue.h"
+#include "RakAssert.h"
+#include <string.h>
+
+using namespace RakNet;
+
+// Message numbers are 24 bits, and the receiver takes a number more than half the range behind as a duplicate.
+// So no more than half the range may be unacknowledged at once
+static const unsigned int MAXIMUM_INDEX_SIZE = 1 << 23;
+
+// Is a due before b, accounting for variable overflow?
+static inline bool IsEarlier(RakNet::TimeUS a, RakNet::TimeUS b)
+{
+    return a != b && b - a < (((RakNet::TimeUS) -1) / 2);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+ResendQueue::ResendQueue()
+{
+    index = 0;
+    indexMask = 0;
+    heap = 0;
+    heapSize = 0;
+    heapCapacity = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+ResendQueue::~ResendQueue()
+{
+    Clear();
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void ResendQueue::Clear(void)
+{
+    delete [] index;
+    index = 0;
+    indexMask = 0;
+    delete [] heap;
+    heap = 0;
+    heapSize = 0;
+    heapCapacity = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+bool ResendQueue::HasRoomFor(MessageNumberType messageNumber) const
+{
+    if (index == 0 || indexMask + 1 < MAXIMUM_INDEX_SIZE)
+        return true;
+    return index[messageNumber.val & indexMask] == 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void ResendQueue::Push(InternalPacket *internalPacket)
+{
+    if (index == 0)
+    {
+        index = new InternalPacket *[RESEND_BUFFER_ARRAY_LENGTH];
+        memset(index, 0, sizeof(InternalPacket *) * RESEND_BUFFER_ARRAY_LENGTH);
+        indexMask = RESEND_BUFFER_ARRAY_LENGTH - 1;
+    }
+
+    // An older message is still unacknowledged in this slot. Doubling separates them, since their numbers differ
+    while (index[internalPacket->reliableMessageNumber.val & indexMask] != 0)
+    {
+        RakAssert(indexMask + 1 < MAXIMUM_INDEX_SIZE);
+        GrowIndex();
+    }
+    index[internalPacket->reliableMessageNumber.val & indexMask] = internalPacket;
+
+    if (heapSize == heapCapacity)
+        GrowHeap();
+    HeapNode node;
+    node.nextActionTime = internalPacket->nextActionTime;
+    node.internalPacket = internalPacket;
+    Place(heapSize, node);
+    heapSize++;
+    SiftUp(heapSize - 1);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+InternalPacket *ResendQueue::Get(MessageNumberType messageNumber) const
+{
+    if (index == 0)
+        return 0;
+    InternalPacket *internalPacket = index[messageNumber.val & indexMask];
+    // A later message may use the slot of one that was acknowledged
+    if (internalPacket == 0 || internalPacket->reliableMessageNumber != messageNumber)
+        return 0;
+    return internalPacket;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+InternalPacket *ResendQueue::Remove(MessageNumberType messageNumber)
+{
+    InternalPacket *internalPacket = Get(messageNumber);
+    if (internalPacket == 0)
+        return 0;
+
+    index[messageNumber.val & indexMask] = 0;
+
+    unsigned int heapIndex = internalPacket->resendQueueIndex;
+    RakAssert(heapIndex < heapSize && heap[heapIndex].internalPacket == internalPacket);
+    heapSize--;
+    if (heapIndex != heapSize)
+    {
+        // Fill the hole with the last node, which may belong above or below it
+        InternalPacket *moved = heap[heapSize].internalPacket;
+        Place(heapIndex, heap[heapSize]);
+        SiftUp(heapIndex);
+        SiftDown(moved->resendQueueIndex);
+    }
+    return internalPacket;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void ResendQueue::SetNextActionTime(InternalPacket *internalPacket, RakNet::TimeUS nextActionTime)
+{
+    unsigned int heapIndex = internalPacket->resendQueueIndex;
+    RakAssert(heapIndex < heapSize && heap[heapIndex].internalPacket == internalPacket);
+
+    RakNet::TimeUS previous = heap[heapIndex].nextActionTime;
+    internalPacket->nextActionTime = nextActionTime;
+    heap[heapIndex].nextActionTime = nextActionTime;
+    if (IsEarlier(nextActionTime, previous))
+        SiftUp(heapIndex);
+    else
+        SiftDown(heapIndex);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void ResendQueue::GrowIndex(void)
+{
+    unsigned int newSize = (indexMask + 1) * 2;
+    InternalPacket **newIndex = new InternalPacket *[newSize];
+    memset(newIndex, 0, sizeof(InternalPacket *) * newSize);
+    for (unsigned int i = 0; i < heapSize; i++)
+        newIndex[heap[i].internalPacket->reliableMessageNumber.val & (newSize - 1)] = heap[i].internalPacket;
+    delete [] index;
+    index = newIndex;
+    indexMask = newSize - 1;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void ResendQueue::GrowHeap(void)
+{
+    unsigned int newCapacity = heapCapacity ? heapCapacity * 2 : RESEND_BUFFER_ARRAY_LENGTH;
+    HeapNode *newHeap = new HeapNode[newCapacity];
+    if (heapSize)
+        memcpy(newHeap, heap, sizeof(HeapNode) * heapSize);
+    delete [] heap;
+    heap = newHeap;
+    heapCapacity = newCapacity;
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void ResendQueue::SiftUp(unsigned int heapIndex)
+{
+    HeapNode node = heap[heapIndex];
+    while (heapIndex > 0)
+    {
+        unsigned int parentIndex = (heapIndex - 1) / 2;
+        if (!IsEarlier(node.nextActionTime, heap[parentIndex].nextActionTime))
+            break;
+        Place(heapIndex, heap[parentIndex]);
+        heapIndex = parentIndex;
+    }
+    Place(heapIndex, node);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void ResendQueue::SiftDown(unsigned int heapIndex)
+{
+    HeapNode node = heap[heapIndex];
+    for (;;)
+    {
+        unsigned int childIndex = heapIndex * 2 + 1;
+        if (childIndex >= heapSize)
+            break;
+        if (childIndex + 1 < heapSize && IsEarlier(heap[childIndex + 1].nextActionTime, heap[childIndex].nextActionTime))
+            childIndex++;
+        if (!IsEarlier(heap[childIndex].nextActionTime, node.nextActionTime))
+            break;
+        Place(heapIndex, heap[childIndex]);
+        heapIndex = childIndex;
+    }
+    Place(heapIndex, node);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------
+void ResendQueue::Place(unsigned int heapIndex, const HeapNode &node)
+{
+    heap[heapIndex] = node;
+    node.internalPacket->resendQueueIndex = heapIndex;
+}
@@ -4,40 +4,82 @@
 
 #include "SplitPacketList.h"
 #include <ReliabilityLayer.h>
+#include <string.h>
+#include <stdlib.h>
 
-RakNet::SplitPacketList::SplitPacketList() : splitPacketId(0), inUse(0), reliabilityLayer(nullptr)
+RakNet::SplitPacketList::SplitPacketList() : buffer(nullptr), stride(0), bitLength(0), header(nullptr),
+    pendingLast(nullptr), splitPacketId(0), total(0), inUse(0), isOverLimit(false), reliabilityLayer(nullptr)
 {
 
 }
 
-void RakNet::SplitPacketList::prealloc(unsigned count, SplitPacketIdType splitPacketId)
+RakNet::SplitPacketList::~SplitPacketList()
+{
+    clear();
+}
+
+bool RakNet::SplitPacketList::prealloc(unsigned count, SplitPacketIdType splitPacketId, uint64_t maxBytes)
 {
     RakAssert(count > 0);
+    // Every fragment carries at least one byte
+    if (count > CRABNET_MAX_SPLIT_MESSAGE_SIZE || (uint64_t) (count + 63) / 64 * sizeof(uint64_t) > maxBytes)
+        return false;
     this->splitPacketId = splitPacketId;
-    packets.resize(count);
+    total = count;
+    arrived.assign((count + 63) / 64, 0);
+    return true;
 }
 
-bool RakNet::SplitPacketList::insert(RakNet::InternalPacket *internalPacket)
+bool RakNet::SplitPacketList::insert(RakNet::InternalPacket *internalPacket, uint64_t maxBytes)
 {
-    RakAssert(internalPacket->splitPacketIndex < size());
     RakAssert(splitPacketId == internalPacket->splitPacketId);
 
-    if (packets[internalPacket->splitPacketIndex] == nullptr)
+    SplitPacketIndexType index = internalPacket->splitPacketIndex;
+    unsigned byteLength = (unsigned) BITS_TO_BYTES(internalPacket->dataBitLength);
+    bool isLast = index + 1 == total;
+
+    // A fragment of another message with the same id, or there was an attempt to rewrite packet ptr
+    if (index >= total || hasArrived(index) || byteLength == 0)
+    {
+        release(internalPacket);
+        return false;
+    }
+
+    if (!isLast)
+    {
+        // Every fragment but the last is the same number of whole bytes
+        if ((internalPacket->dataBitLength & 7) != 0 || (stride != 0 && byteLength != stride) ||
+            (stride == 0 && !setStride(byteLength, maxBytes)))
+        {
+            release(internalPacket);
+            return false;
+        }
+    }
+    else if (stride == 0 && total > 1)
     {
-        packets[internalPacket->splitPacketIndex] = internalPacket;
+        // Its offset is not known yet, so hold it until another fragment tells the stride
+        setArrived(index, true);
         ++inUse;
+        bitLength += internalPacket->dataBitLength;
+        pendingLast = internalPacket;
         return true;
     }
+    else if (total == 1 ? !setStride(byteLength, maxBytes) : byteLength > stride)
+    {
+        release(internalPacket);
+        return false;
+    }
 
-    // There was an attempt to rewrite packet ptr
-    reliabilityLayer->FreeInternalPacketData(internalPacket);
-    reliabilityLayer->ReleaseToInternalPacketPool(internalPacket);
-    return false;
+    setArrived(index, true);
+    ++inUse;
+    bitLength += internalPacket->dataBitLength;
+    place(internalPacket);
+    return true;
 }
 
 unsigned RakNet::SplitPacketList::size() const
 {
-    return static_cast<unsigned>(packets.size());
+    return total;
 }
 
 unsigned RakNet::SplitPacketList::count() const
@@ -45,13 +87,105 @@ unsigned RakNet::SplitPacketList::count() const
     return inUse;
 }
 
-RakNet::InternalPacket *RakNet::SplitPacketList::operator[](unsigned n)
+uint64_t RakNet::SplitPacketList::reservedBytes() const
+{
+    uint64_t bytes = (uint64_t) arrived.size() * sizeof(uint64_t);
+    if (buffer)
+        bytes += (uint64_t) stride * total;
+    return bytes;
+}
+
+bool RakNet::SplitPacketList::overLimit() const
 {
-    RakAssert(n < size());
-    return packets[n];
+    return isOverLimit;
 }
 
 RakNet::SplitPacketIdType RakNet::SplitPacketList::id() const
 {
     return splitPacketId;
 }
+
+const unsigned char *RakNet::SplitPacketList::firstData(unsigned *byteLength) const
+{
+    if (buffer == nullptr || !hasArrived(0))
+        return nullptr;
+    *byteLength = total == 1 ? (unsigned) BITS_TO_BYTES(bitLength) : stride;
+    return buffer;
+}
+
+void RakNet::SplitPacketList::clear()
+{
+    free(buffer);
+    buffer = nullptr;
+    if (header)
+        reliabilityLayer->ReleaseToInternalPacketPool(header);
+    header = nullptr;
+    if (pendingLast)
+        release(pendingLast);
+    pendingLast = nullptr;
+}
+
+bool RakNet::SplitPacketList::hasArrived(SplitPacketIndexType index) const
+{
+    return (arrived[index / 64] >> (index % 64) & 1) != 0;
+}
+
+void RakNet::SplitPacketList::setArrived(SplitPacketIndexType index, bool arrived)
+{
+    if (arrived)
+        this->arrived[index / 64] |= (uint64_t) 1 << (index % 64);
+    else
+        this->arrived[index / 64] &= ~((uint64_t) 1 << (index % 64));
+}
+
+bool RakNet::SplitPacketList::setStride(unsigned byteLength, uint64_t maxBytes)
+{
+    // splitPacketCount comes from the remote system, so bound what it can make us allocate
+    uint64_t bufferLength = (uint64_t) byteLength * total;
+    if (bufferLength > CRABNET_MAX_SPLIT_MESSAGE_SIZE || bufferLength != (size_t) bufferLength)
+        return false;
+    if (bufferLength > maxBytes)
+    {
+        isOverLimit = true;
+        return false;
+    }
+    buffer = (unsigned char *) malloc((size_t) bufferLength);
+    if (buffer == nullptr)
+        return false;
+    stride = byteLength;
+
+    if (pendingLast)
+    {
+        InternalPacket *last = pendingLast;
+        pendingLast = nullptr;
+        if (BITS_TO_BYTES(last->dataBitLength) > stride)
+        {
+            setArrived(last->splitPacketIndex, false);
+            --inUse;
+            bitLength -= last->dataBitLength;
+            release(last);
+        }
+        else
+            place(last);
+    }
+    return true;
+}
+
+void RakNet::SplitPacketList::place(RakNet::InternalPacket *internalPacket)
+{
+    memcpy(buffer + (size_t) internalPacket->splitPacketIndex * stride, internalPacket->data,
+           (size_t) BITS_TO_BYTES(internalPacket->dataBitLength));
+    if (header == nullptr)
+    {
+        reliabilityLayer->FreeInternalPacketData(internalPacket);
+        header = internalPacket;
+    }
+    else
+        release(internalPacket);
+}
+
+void RakNet::SplitPacketList::release(RakNet::InternalPacket *internalPacket)
+{
+    reliabilityLayer->FreeInternalPacketData(internalPacket);
+    reliabilityLayer->ReleaseToInternalPacketPool(internalPacket);
+}
@@ -0,0 +1,227 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "DS_TimerWheel.h"
+#include "RakAssert.h"
+
+using namespace DataStructures;
+
+static const unsigned int LEVEL0_BITS = 8;
+static const unsigned int LEVEL1_BITS = 6;
+static const unsigned int LEVEL2_BITS = 6;
+static const unsigned int LEVEL0_SLOTS = 1 << LEVEL0_BITS;
+static const unsigned int LEVEL1_SLOTS = 1 << LEVEL1_BITS;
+static const unsigned int LEVEL2_SLOTS = 1 << LEVEL2_BITS;
+static const unsigned int LEVEL1_FIRST_SLOT = LEVEL0_SLOTS;
+static const unsigned int LEVEL2_FIRST_SLOT = LEVEL0_SLOTS + LEVEL1_SLOTS;
+static const unsigned int TOTAL_SLOTS = LEVEL0_SLOTS + LEVEL1_SLOTS + LEVEL2_SLOTS;
+// Holds elements scheduled for a tick the wheel already turned past. Drained first by every Advance()
+static const unsigned int EXPIRED_SLOT = TOTAL_SLOTS;
+static const uint64_t LEVEL1_SPAN = (uint64_t) 1 << (LEVEL0_BITS + LEVEL1_BITS);
+static const uint64_t LEVEL2_SPAN = (uint64_t) 1 << (LEVEL0_BITS + LEVEL1_BITS + LEVEL2_BITS);
+static const unsigned int INVALID_NODE = (unsigned int) -1;
+static const unsigned short NOT_SCHEDULED = (unsigned short) -1;
+
+static unsigned int GetLevel(unsigned short slot)
+{
+    if (slot < LEVEL1_FIRST_SLOT || slot == EXPIRED_SLOT)
+        return 0;
+    if (slot < LEVEL2_FIRST_SLOT)
+        return 1;
+    return 2;
+}
+
+TimerWheel::TimerWheel()
+{
+    nodes = 0;
+    numNodes = 0;
+    slotHeads = 0;
+    levelCount[0] = levelCount[1] = levelCount[2] = 0;
+    scheduledCount = 0;
+    currentTick = 0;
+}
+
+TimerWheel::~TimerWheel()
+{
+    Clear();
+}
+
+void TimerWheel::Init(unsigned int numElements, uint64_t curTime)
+{
+    Clear();
+
+    numNodes = numElements;
+    nodes = new Node[numNodes];
+    for (unsigned int i = 0; i < numNodes; i++)
+        nodes[i].slot = NOT_SCHEDULED;
+
+    slotHeads = new unsigned int[TOTAL_SLOTS + 1];
+    for (unsigned int i = 0; i < TOTAL_SLOTS + 1; i++)
+        slotHeads[i] = INVALID_NODE;
+
+    currentTick = curTime;
+}
+
+void TimerWheel::Clear(void)
+{
+    delete[] nodes;
+    nodes = 0;
+    numNodes = 0;
+    delete[] slotHeads;
+    slotHeads = 0;
+    levelCount[0] = levelCount[1] = levelCount[2] = 0;
+    scheduledCount = 0;
+}
+
+void TimerWheel::Schedule(unsigned int element, uint64_t expireTime)
+{
+    RakAssert(element < numNodes);
+    if (nodes[element].slot != NOT_SCHEDULED)
+        Unlink(element);
+    Insert(element, expireTime);
+}
+
+void TimerWheel::Cancel(unsigned int element)
+{
+    RakAssert(element < numNodes);
+    if (nodes[element].slot != NOT_SCHEDULED)
+        Unlink(element);
+}
+
+bool TimerWheel::IsScheduled(unsigned int element) const
+{
+    RakAssert(element < numNodes);
+    return nodes[element].slot != NOT_SCHEDULED;
+}
+
+void TimerWheel::Insert(unsigned int element, uint64_t expireTime)
+{
+    unsigned short slot;
+    uint64_t delta = expireTime < currentTick ? 0 : expireTime - currentTick;
+    if (delta >= LEVEL2_SPAN)
+    {
+        expireTime = currentTick + LEVEL2_SPAN - 1;
+        delta = LEVEL2_SPAN - 1;
+    }
+
+    if (expireTime < currentTick)
+        slot = (unsigned short) EXPIRED_SLOT;
+    else if (delta < LEVEL0_SLOTS)
+        slot = (unsigned short) (expireTime & (LEVEL0_SLOTS - 1));
+    else if (delta < LEVEL1_SPAN)
+        slot = (unsigned short) (LEVEL1_FIRST_SLOT + ((expireTime >> LEVEL0_BITS) & (LEVEL1_SLOTS - 1)));
+    else
+        slot = (unsigned short) (LEVEL2_FIRST_SLOT + ((expireTime >> (LEVEL0_BITS + LEVEL1_BITS)) & (LEVEL2_SLOTS - 1)));
+
+    Node &node = nodes[element];
+    node.expireTime = expireTime;
+    node.slot = slot;
+    node.prev = INVALID_NODE;
+    node.next = slotHeads[slot];
+    if (node.next != INVALID_NODE)
+        nodes[node.next].prev = element;
+    slotHeads[slot] = element;
+
+    levelCount[GetLevel(slot)]++;
+    scheduledCount++;
+}
+
+void TimerWheel::Unlink(unsigned int element)
+{
+    Node &node = nodes[element];
+    if (node.prev != INVALID_NODE)
+        nodes[node.prev].next = node.next;
+    else
+        slotHeads[node.slot] = node.next;
+    if (node.next != INVALID_NODE)
+        nodes[node.next].prev = node.prev;
+
+    levelCount[GetLevel(node.slot)]--;
+    scheduledCount--;
+    node.slot = NOT_SCHEDULED;
+}
+
+void TimerWheel::Cascade(unsigned int slot)
+{
+    // Detach the whole slot first, since reinserting can never land back in it
+    unsigned int element = slotHeads[slot];
+    slotHeads[slot] = INVALID_NODE;
+    while (element != INVALID_NODE)
+    {
+        unsigned int next = nodes[element].next;
+        levelCount[GetLevel(nodes[element].slot)]--;
+        scheduledCount--;
+        Insert(element, nodes[element].expireTime);
+        element = next;
+    }
+}
+
+void TimerWheel::Advance(uint64_t curTime, List<unsigned int> &output)
+{
+    while (slotHeads[EXPIRED_SLOT] != INVALID_NODE)
+    {
+        unsigned int element = slotHeads[EXPIRED_SLOT];
+        Unlink(element);
+        output.Push(element);
+    }
+
+    if (scheduledCount == 0)
+    {
+        if (curTime >= currentTick)
+            currentTick = curTime + 1;
+        return;
+    }
+
+    while (currentTick <= curTime)
+    {
+        if ((currentTick & (LEVEL0_SLOTS - 1)) == 0)
+        {
+            if (((currentTick >> LEVEL0_BITS) & (LEVEL1_SLOTS - 1)) == 0)
+                Cascade(LEVEL2_FIRST_SLOT + (unsigned int) ((currentTick >> (LEVEL0_BITS + LEVEL1_BITS)) & (LEVEL2_SLOTS - 1)));
+            Cascade(LEVEL1_FIRST_SLOT + (unsigned int) ((currentTick >> LEVEL0_BITS) & (LEVEL1_SLOTS - 1)));
+        }
+
+        unsigned int slot = (unsigned int) (currentTick & (LEVEL0_SLOTS - 1));
+        while (slotHeads[slot] != INVALID_NODE)
+        {
+            unsigned int element = slotHeads[slot];
+            Unlink(element);
+            output.Push(element);
+        }
+
+        currentTick++;
+        if (scheduledCount == 0 && currentTick <= curTime)
+            currentTick = curTime + 1;
+    }
+}
+
+uint64_t TimerWheel::GetTimeToNextExpiry(uint64_t curTime, uint64_t maxWait) const
+{
+    if (scheduledCount == 0)
+        return maxWait;
+
+    // Ticks up to curTime have not been turned yet
+    if (slotHeads[EXPIRED_SLOT] != INVALID_NODE || currentTick <= curTime)
+        return 0;
+
+    bool outerLevelsUsed = levelCount[1] + levelCount[2] > 0;
+    for (uint64_t tick = currentTick; tick < currentTick + LEVEL0_SLOTS && tick - curTime < maxWait; tick++)
+    {
+        // Elements cascading in from the outer levels may expire soon after this tick. Advance() cascades at the start of
+        // a tick, so that includes currentTick itself
+        if (outerLevelsUsed && (tick & (LEVEL0_SLOTS - 1)) == 0)
+            return tick - curTime;
+        if (slotHeads[tick & (LEVEL0_SLOTS - 1)] != INVALID_NODE)
+            return tick - curTime;
+    }
+
+    return maxWait;
+}
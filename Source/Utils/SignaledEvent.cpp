@@ -18,12 +18,20 @@
 #include <unistd.h>
 #endif
 
+#if CRABNET_SUPPORT_EVENTFD==1
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <stdint.h>
+#endif
+
 using namespace RakNet;
 
 SignaledEvent::SignaledEvent()
 {
 #ifdef _WIN32
     eventList = INVALID_HANDLE_VALUE;
+#elif CRABNET_SUPPORT_EVENTFD==1
+    eventFd = -1;
 #else
     isSignaled = false;
 #endif
@@ -39,6 +47,9 @@ void SignaledEvent::InitEvent()
         eventList = CreateEventEx(0, 0, 0, 0);
 #elif defined(_WIN32)
         eventList = CreateEvent(0, false, false, 0);
+#elif CRABNET_SUPPORT_EVENTFD==1
+        eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        RakAssert(eventFd >= 0);
 #else
 #if !defined(ANDROID)
         pthread_condattr_init(&condAttr);
@@ -59,6 +70,12 @@ void SignaledEvent::CloseEvent()
         CloseHandle(eventList);
         eventList=INVALID_HANDLE_VALUE;
     }
+#elif CRABNET_SUPPORT_EVENTFD==1
+    if (eventFd >= 0)
+    {
+        close(eventFd);
+        eventFd = -1;
+    }
 #else
     pthread_cond_destroy(&eventList);
     pthread_mutex_destroy(&hMutex);
@@ -73,6 +90,11 @@ void SignaledEvent::SetEvent()
 {
 #ifdef _WIN32
     ::SetEvent(eventList);
+#elif CRABNET_SUPPORT_EVENTFD==1
+    // The counter stays readable until the waiter drains it, so this cannot be missed. EAGAIN means it is already set
+    uint64_t one = 1;
+    ssize_t written = write(eventFd, &one, sizeof(one));
+    (void) written;
 #else
     // Different from SetEvent which stays signaled.
     // We have to record manually that the event was signaled
@@ -94,6 +116,18 @@ void SignaledEvent::WaitOnEvent(int timeoutMs)
 //        false,
 //        timeoutMs);
     WaitForSingleObjectEx(eventList, timeoutMs, FALSE);
+#elif CRABNET_SUPPORT_EVENTFD==1
+    struct pollfd pfd;
+    pfd.fd = eventFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, timeoutMs) > 0)
+    {
+        // Reset to unsignaled
+        uint64_t count;
+        ssize_t numRead = read(eventFd, &count, sizeof(count));
+        (void) numRead;
+    }
 #else
 
     // If was previously set signaled, just unset and return
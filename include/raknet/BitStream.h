@@ -25,6 +25,7 @@
 #include "RakAssert.h"
 #include <math.h>
 #include <float.h>
+#include <type_traits>
 
 #ifdef _MSC_VER
 #pragma warning( push )
@@ -37,6 +38,8 @@
 
 namespace RakNet
 {
+    class BitStreamArena;
+
     /// This class allows you to write and read native types as a string of bits.
     ///  BitStream is used extensively throughout RakNet and is designed to be used by users as well.
     /// \sa BitStreamSample.txt
@@ -47,6 +50,15 @@ namespace RakNet
         // GetInstance() and DestroyInstance(instance*)
         STATIC_FACTORY_DECLARATIONS(BitStream)
 
+        /// \brief How WriteCompressedDelta() writes a value that changed
+        enum DeltaEncoding
+        {
+            /// The current value, with WriteCompressed()
+            DELTA_COMPRESSED,
+            /// The difference from the last value, with WriteVarInt(). For integers only
+            DELTA_VARINT
+        };
+
         /// Default Constructor
         BitStream();
 
@@ -57,6 +69,12 @@ namespace RakNet
         /// \param[in] initialBytesToAllocate the number of bytes to pre-allocate.
         BitStream(unsigned int initialBytesToAllocate);
 
+        /// \brief Create the bitstream, taking its memory from \a _arena rather than the heap once it outgrows
+        /// BITSTREAM_STACK_ALLOCATION_SIZE.
+        /// \details For temporary streams, which must be destroyed before the arena is reset.
+        /// \param[in] _arena Where memory comes from. 0 for the heap
+        explicit BitStream(BitStreamArena *_arena);
+
         /// \brief Initialize the BitStream, immediately setting the data it contains to a predefined pointer.
         /// \details Set \a _copyData to true if you want to make an internal copy of the data you are passing.
         /// Set it to false to just save a pointer to the data.
@@ -77,6 +95,17 @@ namespace RakNet
         /// Resets the bitstream for reuse.
         void Reset();
 
+        /// \brief Take memory from \a _arena rather than the heap once the stream outgrows BITSTREAM_STACK_ALLOCATION_SIZE.
+        /// \details Only before it has, for streams that can't be given the arena in the constructor, such as arrays
+        /// \param[in] _arena Where memory comes from. 0 for the heap
+        void SetArena(BitStreamArena *_arena);
+
+        /// \return What was passed to SetArena() or the constructor, or 0 for the heap
+        BitStreamArena *GetArena(void) const {return arena;}
+
+        /// \return How many times any BitStream allocated or reallocated its data on the heap
+        static uint64_t GetHeapAllocationCount(void);
+
         /// \brief Bidirectional serialize/deserialize any integral type to/from a bitstream.
         /// \details Undefine __BITSTREAM_NATIVE_END if you need endian swapping.
         /// \param[in] writeToBitstream true to write from your data to this bitstream.  False to read from this bitstream and write to your data
@@ -138,6 +167,26 @@ namespace RakNet
         template<class templateType>
         bool SerializeCompressedDelta(bool writeToBitstream, templateType &inOutTemplateVar);
 
+        /// \brief Bidirectional version of WriteCompressedDelta() and ReadCompressedDelta() with a DeltaEncoding
+        /// \param[in] writeToBitstream true to write from your data to this bitstream.  False to read from this bitstream and write to your data
+        /// \param[in] inOutCurrentValue The current value to write
+        /// \param[in] lastValue The last value to compare against.  With DELTA_VARINT, also what the difference read is added to
+        /// \param[in] encoding How a changed value is written
+        /// \return true if \a writeToBitstream is true.  true if \a writeToBitstream is false and the read was successful.
+        ///  false if \a writeToBitstream is false and the read was not successful.
+        template<class templateType>
+        bool SerializeCompressedDelta(bool writeToBitstream, templateType &inOutCurrentValue,
+                                      const templateType &lastValue, DeltaEncoding encoding);
+
+        /// \brief Bidirectional serialize/deserialize an integer as a varint.
+        /// \param[in] writeToBitstream true to write from your data to this bitstream.  False to read from this bitstream and write to your data
+        /// \param[in] inOutTemplateVar The value to write
+        /// \return true if \a writeToBitstream is true.  true if \a writeToBitstream is false and the read was successful.
+        ///  false if \a writeToBitstream is false and the read was not successful.
+        /// \sa WriteVarInt()
+        template<class templateType>
+        bool SerializeVarInt(bool writeToBitstream, templateType &inOutTemplateVar);
+
         /// \brief Bidirectional serialize/deserialize an array or casted stream or raw data.
         ///  This does NOT do endian swapping.
         /// \param[in] writeToBitstream true to write from your data to this bitstream.  False to read from this
@@ -305,6 +354,27 @@ namespace RakNet
         template<class templateType>
         void WriteCompressedDelta(const templateType &currentValue);
 
+        /// \brief Write any integral or enum type to a bitstream, choosing how a changed value is written.
+        /// \details With DELTA_COMPRESSED this is WriteCompressedDelta(currentValue, lastValue).
+        /// With DELTA_VARINT a changed value is written as its difference from \a lastValue, so a counter or
+        /// coordinate that moves by a little takes a byte whatever its size.  The difference wraps around like the type.
+        /// \param[in] currentValue The current value to write
+        /// \param[in] lastValue The last value to compare against
+        /// \param[in] encoding How a changed value is written
+        template<class templateType>
+        void WriteCompressedDelta(const templateType &currentValue, const templateType &lastValue,
+                                  DeltaEncoding encoding);
+
+        /// \brief Write any integral type to a bitstream as a varint.
+        /// \details The value is written in whole bytes of seven bits each, the low bits first, with the high bit of
+        /// each byte set if another follows (LEB128).  Signed types are zigzag encoded first, so -1 is written as 1,
+        /// 1 as 2 and so on.  Values under 128, or from -64 to 63 for signed types, take 8 bits, and 300 takes 16.
+        /// The bytes are not aligned, but are copied straight to the stream when it is at a byte boundary.
+        /// There is no endian swapping, the encoding is the same on every system.
+        /// \param[in] inTemplateVar The value to write
+        template<class templateType>
+        void WriteVarInt(const templateType &inTemplateVar);
+
         /// \brief Read any integral type from a bitstream.
         /// \details Define __BITSTREAM_NATIVE_END if you need endian swapping.
         /// \param[in] outTemplateVar The value to read
@@ -344,6 +414,21 @@ namespace RakNet
         template<class templateType>
         bool ReadCompressedDelta(templateType &outTemplateVar);
 
+        /// \brief Read what WriteCompressedDelta() wrote with a DeltaEncoding.
+        /// \details With DELTA_VARINT \a inOutTemplateVar must hold the value the write function compared against,
+        /// and the difference is added to it.  Like the write function, only takes integral and enum types
+        /// \param[in] inOutTemplateVar The value to read
+        /// \param[in] encoding The encoding WriteCompressedDelta() used
+        /// \return true on success, false on failure.
+        template<class templateType>
+        bool ReadCompressedDelta(templateType &inOutTemplateVar, DeltaEncoding encoding);
+
+        /// \brief Read an integer written with WriteVarInt().
+        /// \param[in] outTemplateVar The value to read
+        /// \return true on success, false on failure, or if the value read does not fit in \a outTemplateVar.
+        template<class templateType>
+        bool ReadVarInt(templateType &outTemplateVar);
+
         /// \brief Read one bitstream to another.
         /// \param[in] numberOfBits bits to read
         /// \param bitStream the bitstream to read into from
@@ -833,6 +918,15 @@ namespace RakNet
         static void ReverseBytes(unsigned char *inByteArray, unsigned char *inOutByteArray, unsigned int length);
         static void ReverseBytesInPlace(unsigned char *inOutData, unsigned int length);
 
+        /// \brief The bytes of a 1, 2, 4 or 8 byte value in network order, as the top of a big endian word
+        /// \details In network order the value is the integer itself, whatever the order of this system
+        template<class templateType>
+        static uint64_t ToNetworkOrderWord(const templateType &inTemplateVar);
+
+        /// \brief The reverse of ToNetworkOrderWord()
+        template<class templateType>
+        static void FromNetworkOrderWord(uint64_t word, templateType &outTemplateVar);
+
     private:
 
         BitStream(const BitStream &/*invalid*/)
@@ -853,6 +947,14 @@ namespace RakNet
         /// \brief Assume the input source points to a compressed native type. Decompress and read it.
         bool ReadCompressed(unsigned char *inOutByteArray, unsigned int size, bool unsignedData);
 
+        /// \brief WriteCompressed() and ReadCompressed() for types of 1 to 8 bytes, a word at a time rather than a byte
+        /// \details The bytes are the top of \a word, the first of them the most significant
+        void WriteCompressedWord(uint64_t word, unsigned int byteCount, bool unsignedData);
+        bool ReadCompressedWord(uint64_t &word, unsigned int byteCount, bool unsignedData);
+
+        /// \brief WriteVarInt() and ReadVarInt() after zigzag encoding
+        void WriteVarIntWord(uint64_t word);
+        bool ReadVarIntWord(uint64_t &word);
 
         BitSize_t numberOfBitsUsed;
 
@@ -868,6 +970,9 @@ namespace RakNet
         /// BitStreams that use less than BITSTREAM_STACK_ALLOCATION_SIZE use the stack, rather than the heap to store data.
         /// It switches over if BITSTREAM_STACK_ALLOCATION_SIZE is exceeded
         unsigned char stackData[BITSTREAM_STACK_ALLOCATION_SIZE];
+
+        /// Where data comes from once stackData is too small, or 0 for the heap
+        BitStreamArena *arena;
     };
 
     template<class templateType>
@@ -933,6 +1038,31 @@ namespace RakNet
         return true;
     }
 
+    template<class templateType>
+    inline bool BitStream::SerializeCompressedDelta(bool writeToBitstream, templateType &inOutCurrentValue,
+                                                    const templateType &lastValue, DeltaEncoding encoding)
+    {
+        if (writeToBitstream)
+            WriteCompressedDelta(inOutCurrentValue, lastValue, encoding);
+        else
+        {
+            if (encoding == DELTA_VARINT)
+                inOutCurrentValue = lastValue;
+            return ReadCompressedDelta(inOutCurrentValue, encoding);
+        }
+        return true;
+    }
+
+    template<class templateType>
+    inline bool BitStream::SerializeVarInt(bool writeToBitstream, templateType &inOutTemplateVar)
+    {
+        if (writeToBitstream)
+            WriteVarInt(inOutTemplateVar);
+        else
+            return ReadVarInt(inOutTemplateVar);
+        return true;
+    }
+
     inline bool BitStream::Serialize(bool writeToBitstream, char *inOutByteArray, unsigned int numberOfBytes)
     {
         if (writeToBitstream)
@@ -1074,10 +1204,17 @@ namespace RakNet
     template<>
     inline void BitStream::Write(const bool &inTemplateVar)
     {
-        if (inTemplateVar)
-            Write1();
-        else
-            Write0();
+        // Only reallocate once the allocated bits are used up, as Write0() and Write1() do
+        if (numberOfBitsUsed >= numberOfBitsAllocated)
+            AddBitsAndReallocate(1);
+
+        BitSize_t numberOfBitsMod8 = numberOfBitsUsed & 7;
+        if (numberOfBitsMod8 == 0)
+            data[numberOfBitsUsed >> 3] = inTemplateVar ? 0x80 : 0; // New bytes need to be zeroed
+        else if (inTemplateVar)
+            data[numberOfBitsUsed >> 3] |= 0x80 >> numberOfBitsMod8; // Set the bit to 1
+
+        numberOfBitsUsed++;
     }
 
 
@@ -1224,6 +1361,10 @@ namespace RakNet
 #endif
         if (sizeof(inTemplateVar) == 1)
             WriteCompressed((unsigned char *) &inTemplateVar, sizeof(templateType) * 8, true);
+#ifndef __BITSTREAM_NATIVE_END
+        else if (sizeof(inTemplateVar) == 2 || sizeof(inTemplateVar) == 4 || sizeof(inTemplateVar) == 8)
+            WriteCompressedWord(ToNetworkOrderWord(inTemplateVar), sizeof(templateType), true);
+#endif
         else
         {
 #ifndef __BITSTREAM_NATIVE_END
@@ -1243,6 +1384,47 @@ namespace RakNet
         }
     }
 
+    template<class templateType>
+    inline uint64_t BitStream::ToNetworkOrderWord(const templateType &inTemplateVar)
+    {
+        if (sizeof(templateType) == 1)
+            return (uint64_t) *(const unsigned char *) &inTemplateVar << 56;
+        if (sizeof(templateType) == 2)
+        {
+            uint16_t value;
+            memcpy(&value, &inTemplateVar, sizeof(value));
+            return (uint64_t) value << 48;
+        }
+        if (sizeof(templateType) == 4)
+        {
+            uint32_t value;
+            memcpy(&value, &inTemplateVar, sizeof(value));
+            return (uint64_t) value << 32;
+        }
+        uint64_t value;
+        memcpy(&value, &inTemplateVar, sizeof(value));
+        return value;
+    }
+
+    template<class templateType>
+    inline void BitStream::FromNetworkOrderWord(uint64_t word, templateType &outTemplateVar)
+    {
+        if (sizeof(templateType) == 1)
+            *(unsigned char *) &outTemplateVar = (unsigned char) (word >> 56);
+        else if (sizeof(templateType) == 2)
+        {
+            uint16_t value = (uint16_t) (word >> 48);
+            memcpy(&outTemplateVar, &value, sizeof(value));
+        }
+        else if (sizeof(templateType) == 4)
+        {
+            uint32_t value = (uint32_t) (word >> 32);
+            memcpy(&outTemplateVar, &value, sizeof(value));
+        }
+        else
+            memcpy(&outTemplateVar, &word, sizeof(word));
+    }
+
     template<>
     inline void BitStream::WriteCompressed(const SystemAddress &inTemplateVar)
     {
@@ -1380,6 +1562,52 @@ namespace RakNet
         Write(currentValue);
     }
 
+    /// \brief Write any integral or enum type to a bitstream, choosing how a changed value is written.
+    /// \param[in] currentValue The current value to write
+    /// \param[in] lastValue The last value to compare against
+    /// \param[in] encoding How a changed value is written
+    template<class templateType>
+    inline void BitStream::WriteCompressedDelta(const templateType &currentValue, const templateType &lastValue,
+                                                DeltaEncoding encoding)
+    {
+        // DELTA_VARINT does integer arithmetic on the value, and the encoding is only known at run time
+        static_assert(std::is_integral<templateType>::value || std::is_enum<templateType>::value,
+                      "WriteCompressedDelta with a DeltaEncoding needs an integral or enum type");
+        if (encoding == DELTA_COMPRESSED)
+        {
+            WriteCompressedDelta(currentValue, lastValue);
+            return;
+        }
+
+        bool c = currentValue != lastValue;
+        Write(c);
+        if (c)
+        {
+            // The difference modulo the size of the type, taken as signed, so going from 255 to 0 in an unsigned char is +1
+            const unsigned int unusedBits = 64 - 8 * sizeof(templateType);
+            const uint64_t difference = (uint64_t) (int64_t) currentValue - (uint64_t) (int64_t) lastValue;
+            WriteVarInt((int64_t) (difference << unusedBits) >> unusedBits);
+        }
+    }
+
+    /// \brief Write any integral type to a bitstream as a varint.
+    /// \param[in] inTemplateVar The value to write
+    template<class templateType>
+    inline void BitStream::WriteVarInt(const templateType &inTemplateVar)
+    {
+#ifdef _MSC_VER
+#pragma warning(disable:4127)   // conditional expression is constant
+#endif
+        if ((templateType) -1 < (templateType) 0)
+        {
+            // Zigzag, interleaving the negative values with the positive ones
+            const int64_t value = (int64_t) inTemplateVar;
+            WriteVarIntWord((uint64_t) value << 1 ^ (uint64_t) (value >> 63));
+        }
+        else
+            WriteVarIntWord((uint64_t) inTemplateVar);
+    }
+
     /// \brief Read any integral type from a bitstream.  Define __BITSTREAM_NATIVE_END if you need endian swapping.
     /// \param[in] outTemplateVar The value to read
     template<class templateType>
@@ -1562,6 +1790,16 @@ namespace RakNet
 #endif
         if (sizeof(outTemplateVar) == 1)
             return ReadCompressed((unsigned char *) &outTemplateVar, sizeof(templateType) * 8, true);
+#ifndef __BITSTREAM_NATIVE_END
+        else if (sizeof(outTemplateVar) == 2 || sizeof(outTemplateVar) == 4 || sizeof(outTemplateVar) == 8)
+        {
+            uint64_t word;
+            if (!ReadCompressedWord(word, sizeof(templateType), true))
+                return false;
+            FromNetworkOrderWord(word, outTemplateVar);
+            return true;
+        }
+#endif
         else
         {
 #ifndef __BITSTREAM_NATIVE_END
@@ -1690,6 +1928,57 @@ namespace RakNet
         return Read(outTemplateVar);
     }
 
+    /// \brief Read what WriteCompressedDelta() wrote with a DeltaEncoding.
+    /// \param[in] inOutTemplateVar The value to read
+    /// \param[in] encoding The encoding WriteCompressedDelta() used
+    template<class templateType>
+    inline bool BitStream::ReadCompressedDelta(templateType &inOutTemplateVar, DeltaEncoding encoding)
+    {
+        static_assert(std::is_integral<templateType>::value || std::is_enum<templateType>::value,
+                      "ReadCompressedDelta with a DeltaEncoding needs an integral or enum type");
+        if (encoding == DELTA_COMPRESSED)
+            return ReadCompressedDelta(inOutTemplateVar);
+
+        bool dataWritten;
+        if (!Read(dataWritten))
+            return false;
+        if (dataWritten)
+        {
+            int64_t difference;
+            if (!ReadVarInt(difference))
+                return false;
+            inOutTemplateVar = (templateType) ((uint64_t) (int64_t) inOutTemplateVar + (uint64_t) difference);
+        }
+        return true;
+    }
+
+    /// \brief Read an integer written with WriteVarInt().
+    /// \param[in] outTemplateVar The value to read
+    template<class templateType>
+    inline bool BitStream::ReadVarInt(templateType &outTemplateVar)
+    {
+#ifdef _MSC_VER
+#pragma warning(disable:4127)   // conditional expression is constant
+#endif
+        uint64_t word;
+        if (!ReadVarIntWord(word))
+            return false;
+        if ((templateType) -1 < (templateType) 0)
+        {
+            const int64_t value = (int64_t) (word >> 1) ^ -(int64_t) (word & 1);
+            if ((int64_t) (templateType) value != value)
+                return false;
+            outTemplateVar = (templateType) value;
+        }
+        else
+        {
+            if ((uint64_t) (templateType) word != word)
+                return false;
+            outTemplateVar = (templateType) word;
+        }
+        return true;
+    }
+
     template<class destinationType, class sourceType>
     void BitStream::WriteCasted(const sourceType &value)
     {
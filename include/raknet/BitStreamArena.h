@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file BitStreamArena.h
+/// \brief Bump allocator for the data of temporary BitStreams, reset once a frame
+///
+
+
+#ifndef __BITSTREAM_ARENA_H
+#define __BITSTREAM_ARENA_H
+
+#include "Export.h"
+#include "RakNetDefines.h"
+#include <stddef.h>
+#include <stdint.h>
+
+namespace RakNet
+{
+/// \brief Memory for BitStreams that outgrow BITSTREAM_STACK_ALLOCATION_SIZE, without the heap.
+/// \details Pass one to the BitStream constructor or BitStream::SetArena(). Once the stream no longer fits its stack
+/// buffer it takes memory from the arena, which hands out consecutive pieces of large blocks. A stream at the end of
+/// what was handed out grows in place, and gives its memory back at once when destroyed, so streams built and
+/// destroyed in nested scopes reuse the same bytes. Everything else comes back on Reset().
+/// Call Reset() once a frame or once per RakPeerInterface::Receive() loop, when no stream using the arena is alive.
+/// Not thread safe. Use one arena per thread.
+class RAK_DLL_EXPORT BitStreamArena
+{
+public:
+    /// \param[in] _blockSize Bytes taken from the heap at once. Larger allocations get a block of their own
+    BitStreamArena(unsigned int _blockSize = CRABNET_BITSTREAM_ARENA_BLOCK_SIZE);
+    ~BitStreamArena();
+
+    /// \return \a size bytes, aligned to 8
+    void *Allocate(size_t size);
+
+    /// Grow \a data, \a size bytes from this arena, to \a newSize bytes. It moves unless it is at the end of what
+    /// was handed out and the block has room
+    void *Reallocate(void *data, size_t size, size_t newSize);
+
+    /// Give back \a data, \a size bytes from this arena. Its bytes are reused before Reset() only if it is at the end
+    /// of what was handed out
+    void Release(void *data, size_t size);
+
+    /// Give back all memory allocated since the last Reset(). If that took more than one block, they are replaced by
+    /// one block large enough for the most that was in use at once
+    /// \pre No allocation is still in use
+    void Reset(void);
+
+    /// \return How many allocations were made from this arena
+    uint64_t GetAllocationCount(void) const {return allocationCount;}
+
+    /// \return How many blocks this arena took from the heap
+    uint64_t GetHeapAllocationCount(void) const {return heapAllocationCount;}
+
+    /// \return How many allocations were not given back with Release() yet
+    unsigned int GetLiveAllocationCount(void) const {return liveAllocationCount;}
+
+    /// \return Bytes handed out since the last Reset(), including bytes given back but not reused
+    size_t GetBytesUsed(void) const;
+
+    /// \return The most GetBytesUsed() was since the last Reset()
+    size_t GetPeakBytesUsed(void) const {return peakBytesUsed;}
+
+protected:
+    struct Block
+    {
+        Block *next;
+        size_t size;
+    };
+
+    BitStreamArena(const BitStreamArena &);
+    BitStreamArena &operator=(const BitStreamArena &);
+
+    static unsigned char *GetBlockData(Block *block) {return (unsigned char *) (block + 1);}
+    void AddBlock(size_t size);
+    void UpdatePeakBytesUsed(void);
+
+    size_t blockSize;
+    // The block allocations come from, at the head of the list. The others are full
+    Block *blocks;
+    unsigned char *top;
+    unsigned char *end;
+    // Bytes handed out from the full blocks
+    size_t fullBlockBytes;
+    size_t peakBytesUsed;
+
+    uint64_t allocationCount;
+    uint64_t heapAllocationCount;
+    unsigned int liveAllocationCount;
+};
+
+} // namespace RakNet
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file BitStreamSchema.h
+/// \brief Serializes the fields of a struct through BitStream, from a list of the fields declared at compile time
+///
+
+
+#ifndef __BITSTREAM_SCHEMA_H
+#define __BITSTREAM_SCHEMA_H
+
+#include "BitStream.h"
+#include <string.h>
+#include <type_traits>
+
+namespace RakNet
+{
+
+/// \brief Encodes a field as BitStream::Write() and BitStream::Read() do
+/// \details For integers, enums, floats and doubles of 1, 2, 4 or 8 bytes
+template <class T>
+struct SchemaValue
+{
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                  "SchemaValue encodes integers, enums, floats and doubles");
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8,
+                  "SchemaValue encodes values of 1, 2, 4 or 8 bytes");
+
+    static const BitSize_t BITS = sizeof(T) * 8;
+
+    static uint64_t Encode(const T &value)
+    {
+#ifndef __BITSTREAM_NATIVE_END
+        return BitStream::ToNetworkOrderWord(value);
+#else
+        uint64_t word = 0;
+        const unsigned char *bytes = (const unsigned char *) &value;
+        for (unsigned int i = 0; i < sizeof(T); i++)
+            word |= (uint64_t) bytes[i] << (56 - 8 * i);
+        return word;
+#endif
+    }
+
+    static void Decode(uint64_t word, T &value)
+    {
+#ifndef __BITSTREAM_NATIVE_END
+        BitStream::FromNetworkOrderWord(word, value);
+#else
+        unsigned char *bytes = (unsigned char *) &value;
+        for (unsigned int i = 0; i < sizeof(T); i++)
+            bytes[i] = (unsigned char) (word >> (56 - 8 * i));
+#endif
+    }
+};
+
+/// \brief A bool is a single bit, as BitStream::Write(bool) writes it
+template <>
+struct SchemaValue<bool>
+{
+    static const BitSize_t BITS = 1;
+
+    static uint64_t Encode(const bool &value)
+    {
+        return value ? (uint64_t) 1 << 63 : 0;
+    }
+
+    static void Decode(uint64_t word, bool &value)
+    {
+        value = word != 0;
+    }
+};
+
+/// \internal
+/// \brief Number of bits needed to hold \a range
+inline constexpr BitSize_t SchemaBitsFor(uint64_t range)
+{
+    return range == 0 ? 0 : 1 + SchemaBitsFor(range >> 1);
+}
+
+/// \brief Encodes an integer between \a MINIMUM and \a MAXIMUM as BitStream::WriteBitsFromIntegerRange() does
+/// \details The value less \a MINIMUM is written in the bits needed for \a MAXIMUM less \a MINIMUM, low byte first
+/// The value must be in the range. There is no escape for values outside it, as with \a allowOutsideRange
+template <class T, T MINIMUM, T MAXIMUM>
+struct SchemaIntegerRange
+{
+    static_assert(MAXIMUM >= MINIMUM, "The range of a SchemaIntegerRange is empty");
+    static_assert(sizeof(T) <= 8, "SchemaIntegerRange holds at most 64 bits");
+
+    static const BitSize_t BITS = SchemaBitsFor((uint64_t) (T) (MAXIMUM - MINIMUM) &
+                                                (~(uint64_t) 0 >> (64 - 8 * sizeof(T))));
+
+    static uint64_t Encode(const T &value)
+    {
+        RakAssert(value >= MINIMUM && value <= MAXIMUM);
+        const uint64_t offset = (uint64_t) (T) (value - MINIMUM);
+        uint64_t word = 0;
+        for (BitSize_t i = 0; i < BITS / 8; i++)
+            word |= (offset >> (8 * i) & 0xFF) << (56 - 8 * i);
+        if ((BITS & 7) != 0)
+            word |= (offset >> (BITS & ~7) & ((1u << (BITS & 7)) - 1)) << (64 - BITS);
+        return word;
+    }
+
+    static void Decode(uint64_t word, T &value)
+    {
+        uint64_t offset = 0;
+        for (BitSize_t i = 0; i < BITS / 8; i++)
+            offset |= (word >> (56 - 8 * i) & 0xFF) << (8 * i);
+        if ((BITS & 7) != 0)
+            offset |= (word >> (64 - BITS) & ((1u << (BITS & 7)) - 1)) << (BITS & ~7);
+        value = (T) ((T) offset + MINIMUM);
+    }
+};
+
+/// \brief Encodes a float between \a MINIMUM / \a DIVISOR and \a MAXIMUM / \a DIVISOR in 16 bits, as
+/// BitStream::WriteFloat16() does
+template <int MINIMUM, int MAXIMUM, int DIVISOR = 1>
+struct SchemaFloat16
+{
+    static_assert(MAXIMUM > MINIMUM && DIVISOR > 0, "The range of a SchemaFloat16 is empty");
+
+    static const BitSize_t BITS = 16;
+
+    static uint64_t Encode(const float &value)
+    {
+        const float floatMin = (float) MINIMUM / (float) DIVISOR;
+        const float floatMax = (float) MAXIMUM / (float) DIVISOR;
+        float percentile = 65535.0f * (value - floatMin) / (floatMax - floatMin);
+        if (percentile < 0.0)
+            percentile = 0.0;
+        if (percentile > 65535.0f)
+            percentile = 65535.0f;
+        return SchemaValue<unsigned short>::Encode((unsigned short) percentile);
+    }
+
+    static void Decode(uint64_t word, float &value)
+    {
+        const float floatMin = (float) MINIMUM / (float) DIVISOR;
+        const float floatMax = (float) MAXIMUM / (float) DIVISOR;
+        unsigned short percentile;
+        SchemaValue<unsigned short>::Decode(word, percentile);
+        value = floatMin + ((float) percentile / 65535.0f) * (floatMax - floatMin);
+        if (value < floatMin)
+            value = floatMin;
+        else if (value > floatMax)
+            value = floatMax;
+    }
+};
+
+/// \brief One member of \a Owner, and how it is encoded
+/// \details Usually declared with RAKNET_SCHEMA_VALUE, RAKNET_SCHEMA_INTEGER_RANGE or RAKNET_SCHEMA_FLOAT16
+template <class Owner, class T, T Owner::*MEMBER, class Encoding>
+struct SchemaField
+{
+    static_assert(Encoding::BITS <= 64, "A schema field holds at most 64 bits");
+
+    static const BitSize_t BITS = Encoding::BITS;
+
+    /// ORs the field into \a buffer, which is zeroed, at \a OFFSET bits from its start
+    template <BitSize_t OFFSET>
+    static void Pack(const Owner &object, unsigned char *buffer)
+    {
+        if (BITS == 0)
+            return;
+        const uint64_t word = Encoding::Encode(object.*MEMBER);
+        unsigned char *out = buffer + OFFSET / 8;
+        const unsigned int shift = OFFSET % 8;
+        for (unsigned int i = 0; i < 8 && i < (shift + BITS + 7) / 8; i++)
+            out[i] |= (unsigned char) (word >> shift >> (56 - 8 * i));
+        if (shift + BITS > 64)
+            out[8] |= (unsigned char) (word << (8 - shift));
+    }
+
+    /// Reads the field from \a buffer, at \a OFFSET bits from its start
+    template <BitSize_t OFFSET>
+    static void Unpack(Owner &object, const unsigned char *buffer)
+    {
+        if (BITS == 0)
+        {
+            Encoding::Decode(0, object.*MEMBER);
+            return;
+        }
+        const unsigned char *in = buffer + OFFSET / 8;
+        const unsigned int shift = OFFSET % 8;
+        uint64_t word = 0;
+        for (unsigned int i = 0; i < 8 && i < (shift + BITS + 7) / 8; i++)
+            word |= (uint64_t) in[i] << (56 - 8 * i);
+        word <<= shift;
+        if (shift + BITS > 64)
+            word |= in[8] >> (8 - shift);
+        if (BITS < 64)
+            word &= ~(~(uint64_t) 0 >> BITS);
+        Encoding::Decode(word, object.*MEMBER);
+    }
+};
+
+/// \internal
+template <BitSize_t OFFSET, class... Fields>
+struct SchemaFieldList;
+
+/// \internal
+template <BitSize_t OFFSET>
+struct SchemaFieldList<OFFSET>
+{
+    static const BitSize_t BITS = 0;
+
+    template <class Owner>
+    static void Pack(const Owner &, unsigned char *) {}
+
+    template <class Owner>
+    static void Unpack(Owner &, const unsigned char *) {}
+};
+
+/// \internal
+/// \brief The fields after \a OFFSET bits, each at the offset the ones before it leave
+template <BitSize_t OFFSET, class First, class... Rest>
+struct SchemaFieldList<OFFSET, First, Rest...>
+{
+    static const BitSize_t BITS = First::BITS + SchemaFieldList<OFFSET + First::BITS, Rest...>::BITS;
+
+    template <class Owner>
+    static void Pack(const Owner &object, unsigned char *buffer)
+    {
+        First::template Pack<OFFSET>(object, buffer);
+        SchemaFieldList<OFFSET + First::BITS, Rest...>::Pack(object, buffer);
+    }
+
+    template <class Owner>
+    static void Unpack(Owner &object, const unsigned char *buffer)
+    {
+        First::template Unpack<OFFSET>(object, buffer);
+        SchemaFieldList<OFFSET + First::BITS, Rest...>::Unpack(object, buffer);
+    }
+};
+
+/// \brief Writes and reads the fields of \a Owner listed in \a Fields, in order
+/// \details Every encoding has a fixed number of bits, so the size of the whole struct is known at compile time.
+/// The fields are packed into a buffer on the stack at offsets known at compile time, and the buffer goes to the
+/// BitStream in one WriteBits() call, so the stream is checked and grown once rather than once per field.
+/// Reading is the reverse. The bits are the same as writing the fields one by one with the calls each encoding names,
+/// so either side can be written by hand.
+///
+/// \code
+/// struct PlayerState
+/// {
+///     unsigned int id;
+///     int health;
+///     float x, y;
+///     bool alive;
+/// };
+///
+/// typedef RakNet::BitStreamSchema<PlayerState,
+///     RAKNET_SCHEMA_VALUE(PlayerState, id),
+///     RAKNET_SCHEMA_INTEGER_RANGE(PlayerState, health, 0, 100),
+///     RAKNET_SCHEMA_FLOAT16(PlayerState, x, -4096, 4096),
+///     RAKNET_SCHEMA_FLOAT16(PlayerState, y, -4096, 4096),
+///     RAKNET_SCHEMA_VALUE(PlayerState, alive)> PlayerStateSchema;
+///
+/// PlayerStateSchema::Write(playerState, &bitStream);
+/// \endcode
+template <class Owner, class... Fields>
+class BitStreamSchema
+{
+public:
+    /// Bits each struct is written in
+    static const BitSize_t BITS = SchemaFieldList<0, Fields...>::BITS;
+
+    /// Bytes each struct is written in, rounded up
+    static const BitSize_t BYTES = (BITS + 7) / 8;
+
+    /// \brief Write the fields of \a object to \a bitStream
+    static void Write(const Owner &object, BitStream *bitStream)
+    {
+        if (BITS == 0)
+            return;
+        unsigned char buffer[BYTES + 1];
+        memset(buffer, 0, sizeof(buffer));
+        SchemaFieldList<0, Fields...>::Pack(object, buffer);
+        bitStream->WriteBits(buffer, BITS, false);
+    }
+
+    /// \brief Read the fields of \a object from \a bitStream
+    /// \return false if \a bitStream is too short, in which case \a object is unchanged
+    static bool Read(Owner &object, BitStream *bitStream)
+    {
+        if (BITS == 0)
+            return true;
+        unsigned char buffer[BYTES + 1];
+        if (!bitStream->ReadBits(buffer, BITS, false))
+            return false;
+        SchemaFieldList<0, Fields...>::Unpack(object, buffer);
+        return true;
+    }
+
+    /// \brief Write() or Read(), as BitStream::Serialize() does
+    static bool Serialize(bool writeToBitstream, Owner &object, BitStream *bitStream)
+    {
+        if (writeToBitstream)
+        {
+            Write(object, bitStream);
+            return true;
+        }
+        return Read(object, bitStream);
+    }
+};
+
+} // namespace RakNet
+
+/// \brief A member of \a Owner written as BitStream::Write() does
+#define RAKNET_SCHEMA_VALUE(Owner, member) \
+    RakNet::SchemaField<Owner, decltype(Owner::member), &Owner::member, RakNet::SchemaValue<decltype(Owner::member)> >
+
+/// \brief A member of \a Owner written as BitStream::WriteBitsFromIntegerRange() does
+#define RAKNET_SCHEMA_INTEGER_RANGE(Owner, member, minimum, maximum) \
+    RakNet::SchemaField<Owner, decltype(Owner::member), &Owner::member, \
+        RakNet::SchemaIntegerRange<decltype(Owner::member), minimum, maximum> >
+
+/// \brief A float member of \a Owner written as BitStream::WriteFloat16() does
+/// \details Takes integer bounds \a minimum and \a maximum, and optionally a divisor for both after them, so
+/// RAKNET_SCHEMA_FLOAT16(Owner, member, -15, 15, 10) writes between -1.5 and 1.5
+#define RAKNET_SCHEMA_FLOAT16(Owner, member, ...) \
+    RakNet::SchemaField<Owner, float, &Owner::member, RakNet::SchemaFloat16<__VA_ARGS__> >
+
+#endif
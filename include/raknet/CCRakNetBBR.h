@@ -0,0 +1,201 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/*
+Model based congestion control, after BBR (Cardwell et al., "BBR: Congestion-Based Congestion Control", ACM Queue 2016)
+
+Instead of reacting to loss, the sender keeps two estimates:
+btlBw = highest delivery rate measured over the last 10 round trips
+minRtt = lowest round trip time measured over the last 10 seconds
+
+Sends are paced at pacingGain*btlBw, and at most cwndGain*btlBw*minRtt bytes are left unacknowledged.
+
+Startup:
+pacingGain=cwndGain=2/ln(2), doubling the rate each round trip, until btlBw grows less than 25% three rounds in a row
+Drain:
+pacingGain=ln(2)/2 until no more than btlBw*minRtt is in flight, emptying the queue startup built up
+ProbeBW:
+pacingGain cycles through 1.25, 0.75, 1, 1, 1, 1, 1, 1, one minRtt each, to find out if more bandwidth became available
+ProbeRTT:
+If minRtt was not lowered for 10 seconds, cwnd drops to 4 datagrams for 200 milliseconds so queues drain and minRtt can be measured again
+
+Loss does not lower the rate, so random loss on wireless links does not collapse throughput.
+*/
+
+#ifndef __CONGESTION_CONTROL_BBR_H
+#define __CONGESTION_CONTROL_BBR_H
+
+#include "CCRakNetCongestionControl.h"
+
+namespace RakNet
+{
+
+/// How many sent datagrams are remembered to measure the delivery rate when their ack arrives
+#define CC_BBR_SEND_HISTORY_LENGTH 1024
+/// btlBw is the maximum delivery rate over this many round trips
+#define CC_BBR_BANDWIDTH_FILTER_ROUNDS 10
+
+class CCRakNetBBR : public CCRakNetCongestionControl
+{
+    public:
+
+    CCRakNetBBR();
+    ~CCRakNetBBR() = default;
+
+    CongestionControlAlgorithm GetAlgorithm(void) const {return CC_BBR;}
+
+    /// Reset all variables to their initial states, for a new connection
+    void Init(CCTimeType curTime, uint32_t maxDatagramPayload);
+
+    /// Update over time
+    void Update(CCTimeType curTime, bool hasDataToSendOrResend);
+
+    int GetRetransmissionBandwidth(CCTimeType curTime, CCTimeType timeSinceLastTick, uint32_t unacknowledgedBytes, bool isContinuousSend);
+    int GetTransmissionBandwidth(CCTimeType curTime, CCTimeType timeSinceLastTick, uint32_t unacknowledgedBytes, bool isContinuousSend);
+
+    /// Acks are buffered for at most SYN, as with CCRakNetSlidingWindow
+    bool ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToNextTick);
+    CCTimeType GetNextACKTime(CCTimeType curTime) const;
+
+    /// Takes \a numBytes from what pacing allows to send
+    void OnSendBytes(CCTimeType curTime, uint32_t numBytes);
+
+    /// Remembers how much had been delivered when the datagram went out, to measure the delivery rate when it is acked
+    void OnSendDatagram(CCTimeType curTime, DatagramSequenceNumberType datagramSequenceNumber, uint32_t sizeInBytes);
+
+    /// When pacing allows another full datagram, unless the window is full
+    bool GetNextSendTime(CCTimeType curTime, CCTimeType *sendTime) const;
+
+    void OnGotPacketPair(DatagramSequenceNumberType datagramSequenceNumber, uint32_t sizeInBytes, CCTimeType curTime);
+    bool OnGotPacket(DatagramSequenceNumberType datagramSequenceNumber, bool isContinuousSend, CCTimeType curTime, uint32_t sizeInBytes, uint32_t *skippedMessageCount);
+
+    /// Loss is not a congestion signal for this controller, so these do nothing
+    void OnResend(CCTimeType curTime, RakNet::TimeUS nextActionTime);
+    void OnNAK(CCTimeType curTime, DatagramSequenceNumberType nakSequenceNumber);
+
+    /// Takes an RTT sample, and a delivery rate sample if \a sequenceNumber is still in the send history
+    void OnAck(CCTimeType curTime, CCTimeType rtt, bool hasBAndAS, BytesPerMicrosecond _B, BytesPerMicrosecond _AS, double totalUserDataBytesAcked, bool isContinuousSend, DatagramSequenceNumberType sequenceNumber );
+    void OnDuplicateAck( CCTimeType curTime, DatagramSequenceNumberType sequenceNumber );
+
+    void OnSendAckGetBAndAS(CCTimeType curTime, bool *hasBAndAS, BytesPerMicrosecond *_B, BytesPerMicrosecond *_AS);
+    void OnSendAck(CCTimeType curTime, uint32_t numBytes);
+    void OnSendNACK(CCTimeType curTime, uint32_t numBytes);
+
+    /// RTO = 2 * RTT + 4 * RTTVar + 30 milliseconds, at most 2 seconds
+    CCTimeType GetRTOForRetransmission(unsigned char timesSent) const;
+
+    void SetMTU(uint32_t bytes);
+    uint32_t GetMTU(void) const;
+
+    /// Query for statistics
+    BytesPerMicrosecond GetLocalReceiveRate(CCTimeType currentTime) const;
+    double GetRTT(void) const;
+    bool GetIsInSlowStart(void) const {return mode == STARTUP;}
+    uint64_t GetBytesPerSecondLimitByCongestionControl(void) const;
+
+    /// Bottleneck bandwidth estimate. 0 until the first delivery rate sample
+    BytesPerMicrosecond GetBottleneckBandwidth(void) const {return btlBw;}
+
+    /// Minimum round trip time over the last 10 seconds. 0 until the first ack
+    CCTimeType GetMinRTT(void) const {return minRttSet ? minRtt : 0;}
+
+    protected:
+
+    enum Mode
+    {
+        STARTUP,
+        DRAIN,
+        PROBE_BW,
+        PROBE_RTT
+    };
+
+    struct SendRecord
+    {
+        DatagramSequenceNumberType datagramNumber;
+        bool isValid;
+        bool isAppLimited;
+        uint32_t sizeInBytes;
+        /// delivered and deliveredTime when the datagram was sent
+        uint64_t delivered;
+        CCTimeType deliveredTime;
+    };
+
+    void EnterStartup(void);
+    void EnterProbeBW(CCTimeType curTime);
+    void UpdateBandwidthFilter(BytesPerMicrosecond deliveryRate, bool isAppLimited);
+    void CheckFullBandwidthReached(bool isAppLimited);
+    void UpdateMode(CCTimeType curTime);
+    void UpdateMinRTT(CCTimeType curTime, CCTimeType rtt);
+    void UpdateCongestionWindow(uint32_t bytesAcked);
+    double GetBDP(void) const;
+    BytesPerMicrosecond GetPacingRate(void) const;
+    void RefillPacing(CCTimeType curTime);
+
+    Mode mode;
+    double pacingGain;
+    double cwndGain;
+
+    // Maximum amount of bytes that the user can send, e.g. the size of one full datagram
+    uint32_t MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+
+    /// Max bytes unacknowledged at once
+    double cwnd;
+    /// cwnd before PROBE_RTT lowered it
+    double priorCwnd;
+
+    /// Bytes that may be sent before pacing holds further data back. Goes negative when a datagram overshoots
+    double pacingBudget;
+    CCTimeType lastPacingRefill;
+
+    /// Running total of bytes in acked datagrams, and when it last grew
+    uint64_t delivered;
+    CCTimeType deliveredTime;
+
+    /// A round trip ends when a datagram sent after the previous round ended is acked
+    uint32_t roundCount;
+    uint64_t nextRoundDelivered;
+    bool roundStart;
+
+    BytesPerMicrosecond bandwidthSamples[CC_BBR_BANDWIDTH_FILTER_ROUNDS];
+    BytesPerMicrosecond btlBw;
+
+    /// Startup ends after btlBw grows less than 25% for 3 rounds
+    BytesPerMicrosecond fullBw;
+    uint32_t fullBwCount;
+    bool fullBwReached;
+
+    CCTimeType minRtt;
+    CCTimeType minRttStamp;
+    bool minRttSet;
+    bool minRttExpired;
+    CCTimeType probeRttDoneStamp;
+    bool probeRttRoundDone;
+
+    unsigned int cycleIndex;
+    CCTimeType cycleStamp;
+
+    /// From the last GetTransmissionBandwidth()
+    uint32_t lastUnacknowledgedBytes;
+    bool lastIsContinuousSend;
+
+    SendRecord sendHistory[CC_BBR_SEND_HISTORY_LENGTH];
+
+    /// Smoothed RTT for the retransmission timeout
+    double lastRtt, estimatedRTT, deviationRtt;
+
+    /// When we get an ack, if oldestUnsentAck==0, set it to the current time
+    /// When we send out acks, set oldestUnsentAck to 0
+    CCTimeType oldestUnsentAck;
+};
+
+}
+
+#endif
@@ -0,0 +1,179 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file CCRakNetCongestionControl.h
+/// \brief Interface shared by the congestion controllers a ReliabilityLayer can use
+///
+
+
+#ifndef __CONGESTION_CONTROL_H
+#define __CONGESTION_CONTROL_H
+
+#include "RakNetDefines.h"
+#include "Export.h"
+#include <stdint.h>
+#include "RakNetTime.h"
+#include "RakNetTypes.h"
+
+/// Sizeof an UDP header in byte
+#define UDP_HEADER_SIZE 28
+
+#define CC_DEBUG_PRINTF_1(x)
+#define CC_DEBUG_PRINTF_2(x,y)
+#define CC_DEBUG_PRINTF_3(x,y,z)
+#define CC_DEBUG_PRINTF_4(x,y,z,a)
+#define CC_DEBUG_PRINTF_5(x,y,z,a,b)
+//#define CC_DEBUG_PRINTF_1(x) printf(x)
+//#define CC_DEBUG_PRINTF_2(x,y) printf(x,y)
+//#define CC_DEBUG_PRINTF_3(x,y,z) printf(x,y,z)
+//#define CC_DEBUG_PRINTF_4(x,y,z,a) printf(x,y,z,a)
+//#define CC_DEBUG_PRINTF_5(x,y,z,a,b) printf(x,y,z,a,b)
+
+#define CC_TIME_TYPE_BYTES 8
+
+#if CC_TIME_TYPE_BYTES==8
+typedef RakNet::TimeUS CCTimeType;
+#else
+typedef RakNet::TimeMS CCTimeType;
+#endif
+
+typedef RakNet::uint24_t DatagramSequenceNumberType;
+typedef double BytesPerMicrosecond;
+typedef double BytesPerSecond;
+typedef double MicrosecondsPerByte;
+
+namespace RakNet
+{
+
+/// Congestion controllers that can be selected with RakPeerInterface::SetCongestionControl()
+enum CongestionControlAlgorithm
+{
+    /// Loss based window, halved on resends. See CCRakNetSlidingWindow.h
+    CC_SLIDING_WINDOW,
+    /// Rate based, from the UDT protocol. See CCRakNetUDT.h
+    CC_UDT,
+    /// Paces at the measured bottleneck bandwidth and keeps about one bandwidth-delay product in flight. See CCRakNetBBR.h
+    CC_BBR,
+    CC_ALGORITHM_COUNT
+};
+
+/// \brief Decides how much a ReliabilityLayer may send and resend each update, and assigns datagram sequence numbers.
+/// \details Every connection owns one instance. The receiving side is also driven through this class: it tracks which datagram
+/// sequence numbers arrived, so it can request NAKs, and decides when buffered acks go out.
+/// Both ends of a connection may use different algorithms.
+class RAK_DLL_EXPORT CCRakNetCongestionControl
+{
+    public:
+
+    /// \param[in] algorithm Which implementation to create
+    /// \return A new controller. Call Init() before use. Free with DestroyInstance()
+    static CCRakNetCongestionControl *GetInstance(CongestionControlAlgorithm algorithm);
+    static void DestroyInstance(CCRakNetCongestionControl *instance);
+
+    CCRakNetCongestionControl() : nextDatagramSequenceNumber(0), expectedNextSequenceNumber(0) {}
+    virtual ~CCRakNetCongestionControl() = default;
+
+    virtual CongestionControlAlgorithm GetAlgorithm(void) const=0;
+
+    /// Reset all variables to their initial states, for a new connection
+    virtual void Init(CCTimeType curTime, uint32_t maxDatagramPayload)=0;
+
+    /// Update over time
+    virtual void Update(CCTimeType curTime, bool hasDataToSendOrResend)=0;
+
+    virtual int GetRetransmissionBandwidth(CCTimeType curTime, CCTimeType timeSinceLastTick, uint32_t unacknowledgedBytes, bool isContinuousSend)=0;
+    virtual int GetTransmissionBandwidth(CCTimeType curTime, CCTimeType timeSinceLastTick, uint32_t unacknowledgedBytes, bool isContinuousSend)=0;
+
+    /// Acks do not have to be sent immediately. Instead, they can be buffered up such that groups of acks are sent at a time
+    /// Should call once per update tick, and send if needed
+    virtual bool ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToNextTick)=0;
+
+    /// Latest time at which ShouldSendACKs() returns true for acks that are already buffered
+    virtual CCTimeType GetNextACKTime(CCTimeType curTime) const=0;
+
+    /// Every data packet sent must contain a sequence number
+    /// Call this function to get it. The sequence number is passed into OnGotPacketPair()
+    DatagramSequenceNumberType GetAndIncrementNextDatagramSequenceNumber(void);
+    DatagramSequenceNumberType GetNextDatagramSequenceNumber(void);
+
+    /// Take over the datagram numbering of the controller this one replaces, so a connection can change controllers while connected
+    void ContinueSequenceNumbers(const CCRakNetCongestionControl &previous);
+
+    /// Call this when you send packets
+    virtual void OnSendBytes(CCTimeType curTime, uint32_t numBytes)=0;
+
+    /// Call this for every datagram sent, with its size including the UDP header
+    virtual void OnSendDatagram(CCTimeType curTime, DatagramSequenceNumberType datagramSequenceNumber, uint32_t sizeInBytes) {(void) curTime; (void) datagramSequenceNumber; (void) sizeInBytes;}
+
+    /// For controllers that pace their sends: when GetTransmissionBandwidth() allows more data again without waiting for an ack
+    /// \return false if only acks or resend timeouts let more data out
+    virtual bool GetNextSendTime(CCTimeType curTime, CCTimeType *sendTime) const {(void) curTime; (void) sendTime; return false;}
+
+    /// Call this when you get a packet pair
+    virtual void OnGotPacketPair(DatagramSequenceNumberType datagramSequenceNumber, uint32_t sizeInBytes, CCTimeType curTime)=0;
+
+    /// Call this when you get a packet (including packet pairs)
+    /// If the DatagramSequenceNumberType is out of order, skippedMessageCount will be non-zero
+    /// In that case, send a NAK for every sequence number up to that count
+    virtual bool OnGotPacket(DatagramSequenceNumberType datagramSequenceNumber, bool isContinuousSend, CCTimeType curTime, uint32_t sizeInBytes, uint32_t *skippedMessageCount)=0;
+
+    /// Call when a message is resent, or when you get a NAK with the sequence number of the lost datagram
+    virtual void OnResend(CCTimeType curTime, RakNet::TimeUS nextActionTime)=0;
+    virtual void OnNAK(CCTimeType curTime, DatagramSequenceNumberType nakSequenceNumber)=0;
+
+    /// Call this when an ACK arrives.
+    /// \param[in] totalUserDataBytesAcked Running total of message bytes acknowledged on this connection
+    virtual void OnAck(CCTimeType curTime, CCTimeType rtt, bool hasBAndAS, BytesPerMicrosecond _B, BytesPerMicrosecond _AS, double totalUserDataBytesAcked, bool isContinuousSend, DatagramSequenceNumberType sequenceNumber )=0;
+    virtual void OnDuplicateAck( CCTimeType curTime, DatagramSequenceNumberType sequenceNumber )=0;
+
+    /// Call when you send an ack, to see if the ack should have the B and AS parameters transmitted
+    /// Call before calling OnSendAck()
+    virtual void OnSendAckGetBAndAS(CCTimeType curTime, bool *hasBAndAS, BytesPerMicrosecond *_B, BytesPerMicrosecond *_AS)=0;
+
+    /// Call when we send an ack
+    virtual void OnSendAck(CCTimeType curTime, uint32_t numBytes)=0;
+
+    /// Call when we send a NACK
+    virtual void OnSendNACK(CCTimeType curTime, uint32_t numBytes)=0;
+
+    /// Retransmission time out for the sender
+    virtual CCTimeType GetRTOForRetransmission(unsigned char timesSent) const=0;
+
+    /// Set the maximum amount of data that can be sent in one datagram
+    virtual void SetMTU(uint32_t bytes)=0;
+
+    /// Return what was set by SetMTU()
+    virtual uint32_t GetMTU(void) const=0;
+
+    /// Query for statistics
+    virtual BytesPerMicrosecond GetLocalReceiveRate(CCTimeType currentTime) const=0;
+    virtual double GetRTT(void) const=0;
+    virtual bool GetIsInSlowStart(void) const=0;
+    virtual uint64_t GetBytesPerSecondLimitByCongestionControl(void) const=0;
+
+    /// Is a > b, accounting for variable overflow?
+    static bool GreaterThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b);
+    /// Is a < b, accounting for variable overflow?
+    static bool LessThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b);
+
+    protected:
+
+    /// Every outgoing datagram is assigned a sequence number, which increments by 1 every assignment
+    DatagramSequenceNumberType nextDatagramSequenceNumber;
+
+    /// Track which datagram sequence numbers have arrived.
+    /// If a sequence number is skipped, send a NAK for all skipped messages
+    DatagramSequenceNumberType expectedNextSequenceNumber;
+};
+
+}
+
+#endif
@@ -11,84 +11,24 @@
 #ifndef __CONGESTION_CONTROL_UDT_H
 #define __CONGESTION_CONTROL_UDT_H
 
-#include "RakNetDefines.h"
-
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL!=1
-
-#include <stdint.h>
-#include "RakNetTime.h"
-#include "RakNetTypes.h"
+#include "CCRakNetCongestionControl.h"
 #include "DS_Queue.h"
 
-#define CC_TIME_TYPE_BYTES 8
-
 namespace RakNet
 {
 
-#if CC_TIME_TYPE_BYTES==8
-typedef uint64_t CCTimeType;
-#else
-typedef uint32_t CCTimeType;
-#endif
-
-typedef uint24_t DatagramSequenceNumberType;
-typedef double BytesPerMicrosecond;
-typedef double BytesPerSecond;
-typedef double MicrosecondsPerByte;
-
-/// CC_CRABNET_UDT_PACKET_HISTORY_LENGTH should be a power of 2 for the writeIndex variables to wrap properly
 #define CC_CRABNET_UDT_PACKET_HISTORY_LENGTH 64
 #define RTT_HISTORY_LENGTH 64
 
-/// Sizeof an UDP header in byte
-#define UDP_HEADER_SIZE 28
-
-#define CC_DEBUG_PRINTF_1(x)
-#define CC_DEBUG_PRINTF_2(x,y)
-#define CC_DEBUG_PRINTF_3(x,y,z)
-#define CC_DEBUG_PRINTF_4(x,y,z,a)
-#define CC_DEBUG_PRINTF_5(x,y,z,a,b)
-//#define CC_DEBUG_PRINTF_1(x) printf(x)
-//#define CC_DEBUG_PRINTF_2(x,y) printf(x,y)
-//#define CC_DEBUG_PRINTF_3(x,y,z) printf(x,y,z)
-//#define CC_DEBUG_PRINTF_4(x,y,z,a) printf(x,y,z,a)
-//#define CC_DEBUG_PRINTF_5(x,y,z,a,b) printf(x,y,z,a,b)
-
-/// \brief Encapsulates UDT congestion control, as used by RakNet
-/// Requirements:
-/// <OL>
-/// <LI>Each datagram is no more than MAXIMUM_MTU_SIZE, after accounting for the UDP header
-/// <LI>Each datagram containing a user message has a sequence number which is set after calling OnSendBytes(). Set it by calling GetAndIncrementNextDatagramSequenceNumber()
-/// <LI>System is designed to be used from a single thread.
-/// <LI>Each packet should have a timeout time based on GetSenderRTOForACK(). If this time elapses, add the packet to the head of the send list for retransmission.
-/// </OL>
-///
-/// Recommended:
-/// <OL>
-/// <LI>Call sendto in its own thread. This takes a significant amount of time in high speed networks.
-/// </OL>
-///
-/// Algorithm:
-/// <OL>
-/// <LI>On a new connection, call Init()
-/// <LI>On a periodic interval (SYN time is the best) call Update(). Also call ShouldSendACKs(), and send buffered ACKS if it returns true.
-/// <LI>Call OnSendAck() when sending acks.
-/// <LI>When you want to send or resend data, call GetNumberOfBytesToSend(). It will return you enough bytes to keep you busy for \a estimatedTimeToNextTick. You can send more than this to fill out a datagram, or to send packet pairs
-/// <LI>Call OnSendBytes() when sending datagrams.
-/// <LI>When data arrives, record the sequence number and buffer an ACK for it, to be sent from Update() if ShouldSendACKs() returns true
-/// <LI>Every 16 packets that you send, send two of them back to back (a packet pair) as long as both packets are the same size. If you don't have two packets the same size, it is fine to defer this until you do.
-/// <LI>When you get a packet, call OnGotPacket(). If the packet is also either of a packet pair, call OnGotPacketPair()
-/// <LI>If you get a packet, and the sequence number is not 1 + the last sequence number, send a NAK. On the remote system, call OnNAK() and resend that message.
-/// <LI>If you get an ACK, remove that message from retransmission. Call OnNonDuplicateAck().
-/// <LI>If a message is not ACKed for GetRTOForRetransmission(), resend it.
-/// </OL>
-class CCRakNetUDT
+class CCRakNetUDT : public CCRakNetCongestionControl
 {
     public:
 
     CCRakNetUDT();
     ~CCRakNetUDT();
 
+    CongestionControlAlgorithm GetAlgorithm(void) const {return CC_UDT;}
+
     /// Reset all variables to their initial states, for a new connection
     void Init(CCTimeType curTime, uint32_t maxDatagramPayload);
 
@@ -104,10 +44,8 @@ class CCRakNetUDT
     /// Should call once per update tick, and send if needed
     bool ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToNextTick);
 
-    /// Every data packet sent must contain a sequence number
-    /// Call this function to get it. The sequence number is passed into OnGotPacketPair()
-    DatagramSequenceNumberType GetAndIncrementNextDatagramSequenceNumber(void);
-    DatagramSequenceNumberType GetNextDatagramSequenceNumber(void);
+    /// Latest time at which ShouldSendACKs() returns true for acks that are already buffered
+    CCTimeType GetNextACKTime(CCTimeType curTime) const;
 
     /// Call this when you send packets
     /// Every 15th and 16th packets should be sent as a packet pair if possible
@@ -180,10 +118,6 @@ class CCRakNetUDT
     uint32_t GetCWNDLimit(void) const {return (uint32_t) (CWND*MAXIMUM_MTU_INCLUDING_UDP_HEADER);}
 
 
-    /// Is a > b, accounting for variable overflow?
-    static bool GreaterThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b);
-    /// Is a < b, accounting for variable overflow?
-    static bool LessThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b);
 //    void SetTimeBetweenSendsLimit(unsigned int bitsPerSecond);
     uint64_t GetBytesPerSecondLimitByCongestionControl(void) const;
 
@@ -281,9 +215,6 @@ class CCRakNetUDT
     /// Every DecInterval NAKs per congestion period, we decrease the send rate
     uint32_t DecInterval;
 
-    /// Every outgoing datagram is assigned a sequence number, which increments by 1 every assignment
-    DatagramSequenceNumberType nextDatagramSequenceNumber;
-
     /// If a packet is marked as a packet pair, lastPacketPairPacketArrivalTime is set to the time it arrives
     /// This is used so when the 2nd packet of the pair arrives, we can calculate the time interval between the two
     CCTimeType lastPacketPairPacketArrivalTime;
@@ -317,10 +248,6 @@ class CCRakNetUDT
     // Max window size
     double CWND_MAX_THRESHOLD;
 
-    /// Track which datagram sequence numbers have arrived.
-    /// If a sequence number is skipped, send a NAK for all skipped messages
-    DatagramSequenceNumberType expectedNextSequenceNumber;
-
     // How many times have we sent B and AS? Used to force it to send at least CC_CRABNET_UDT_PACKET_HISTORY_LENGTH times
     // Otherwise, the default values in the array generate inaccuracy
     uint32_t sendBAndASCount;
@@ -399,5 +326,3 @@ class CCRakNetUDT
 }
 
 #endif
-
-#endif
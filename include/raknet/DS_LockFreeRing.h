@@ -0,0 +1,206 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DS_LockFreeRing.h
+/// \internal
+/// \brief Bounded queue any number of threads may push to and pop from without a mutex
+///
+
+
+#ifndef __LOCK_FREE_RING_H
+#define __LOCK_FREE_RING_H
+
+#include "Export.h"
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/// The namespace DataStructures was only added to avoid compiler errors for commonly named data structures
+/// As these data structures are stand-alone, you can use them outside of RakNet for your own projects if you wish.
+namespace DataStructures
+{
+    /// \brief A fixed size ring where each slot carries a sequence number, so producers and consumers claim slots with one compare and swap.
+    /// \details Push fails instead of growing when the ring is full, and Pop fails when it is empty. Elements should be cheap to copy, such as pointers.
+    /// Every failed compare and swap is counted, which shows how often threads collide on the ring.
+    template <class ring_type>
+    class RAK_DLL_EXPORT LockFreeRing
+    {
+    public:
+        LockFreeRing();
+        ~LockFreeRing();
+
+        /// Allocate the ring. Not threadsafe.
+        /// \param[in] capacity Rounded up to a power of two
+        void Init(unsigned int capacity);
+
+        /// Free the ring. Not threadsafe. Elements still queued are discarded
+        void Clear(void);
+
+        /// \return false if the ring is full or was never initialized
+        bool Push(const ring_type &input);
+
+        /// \return false if the ring is empty
+        bool Pop(ring_type &output);
+
+        /// An estimate, since other threads may push or pop at the same time
+        unsigned int Size(void) const;
+
+        unsigned int GetCapacity(void) const {return mask + 1;}
+
+        /// How many times a thread lost a race for a slot and had to try again
+        uint64_t GetContentionCount(void) const {return contentionCount.load(std::memory_order_relaxed);}
+
+    protected:
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            ring_type data;
+        };
+
+        // Keep the producer and consumer positions on separate cache lines
+        Cell *cells;
+        size_t mask;
+        char pad0[64];
+        std::atomic<size_t> pushPosition;
+        char pad1[64];
+        std::atomic<size_t> popPosition;
+        char pad2[64];
+        std::atomic<uint64_t> contentionCount;
+    };
+
+    template <class ring_type>
+    LockFreeRing<ring_type>::LockFreeRing()
+    {
+        cells = 0;
+        mask = (size_t) -1;
+        pushPosition = 0;
+        popPosition = 0;
+        contentionCount = 0;
+    }
+
+    template <class ring_type>
+    LockFreeRing<ring_type>::~LockFreeRing()
+    {
+        Clear();
+    }
+
+    template <class ring_type>
+    void LockFreeRing<ring_type>::Init(unsigned int capacity)
+    {
+        Clear();
+
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+
+        cells = new Cell[size];
+        for (size_t i = 0; i < size; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        mask = size - 1;
+        pushPosition = 0;
+        popPosition = 0;
+    }
+
+    template <class ring_type>
+    void LockFreeRing<ring_type>::Clear(void)
+    {
+        delete [] cells;
+        cells = 0;
+        mask = (size_t) -1;
+        pushPosition = 0;
+        popPosition = 0;
+    }
+
+    template <class ring_type>
+    bool LockFreeRing<ring_type>::Push(const ring_type &input)
+    {
+        if (cells == 0)
+            return false;
+
+        Cell *cell;
+        size_t position = pushPosition.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &cells[position & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+            if (difference == 0)
+            {
+                // Slot is free for this lap. Claim it
+                if (pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+                contentionCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if (difference < 0)
+            {
+                // The consumer has not emptied this slot since the last lap
+                return false;
+            }
+            else
+            {
+                // Another producer claimed the slot first
+                position = pushPosition.load(std::memory_order_relaxed);
+                contentionCount.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = input;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <class ring_type>
+    bool LockFreeRing<ring_type>::Pop(ring_type &output)
+    {
+        if (cells == 0)
+            return false;
+
+        Cell *cell;
+        size_t position = popPosition.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &cells[position & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t) sequence - (intptr_t) (position + 1);
+            if (difference == 0)
+            {
+                if (popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+                contentionCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if (difference < 0)
+            {
+                // Nothing written to this slot yet
+                return false;
+            }
+            else
+            {
+                position = popPosition.load(std::memory_order_relaxed);
+                contentionCount.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        output = cell->data;
+        // Free the slot for the producer one lap ahead
+        cell->sequence.store(position + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <class ring_type>
+    unsigned int LockFreeRing<ring_type>::Size(void) const
+    {
+        size_t pushed = pushPosition.load(std::memory_order_relaxed);
+        size_t popped = popPosition.load(std::memory_order_relaxed);
+        return pushed > popped ? (unsigned int) (pushed - popped) : 0;
+    }
+}
+
+#endif
@@ -21,9 +21,35 @@
 #include "DS_OrderedList.h"
 #include "BitStream.h"
 #include "RakAssert.h"
+#if defined(_MSC_VER) && defined(_WIN64)
+#include <intrin.h>
+#endif
 
 namespace DataStructures
 {
+    /// How many 64 bit masks can follow the run of one block written by RangeList::SerializeBitmap()
+    #define RANGE_LIST_MAX_BITMAP_WORDS 32
+
+    /// Index of the lowest set bit.  word may not be 0
+    inline unsigned int RangeListLowestBit(uint64_t word)
+    {
+#if defined(_MSC_VER) && defined(_WIN64)
+        unsigned long index;
+        _BitScanForward64(&index, word);
+        return (unsigned int) index;
+#elif defined(__GNUC__)
+        return (unsigned int) __builtin_ctzll(word);
+#else
+        unsigned int index=0;
+        while ((word & 1)==0)
+        {
+            word>>=1;
+            index++;
+        }
+        return index;
+#endif
+    }
+
     template <class range_type>
     struct RangeNode
     {
@@ -58,6 +84,12 @@ namespace DataStructures
         RakNet::BitSize_t Serialize(RakNet::BitStream *in, RakNet::BitSize_t maxBits, bool clearSerialized);
         bool Deserialize(RakNet::BitStream *out);
 
+        /// Like Serialize(), but as blocks of a run of consecutive values followed by up to RANGE_LIST_MAX_BITMAP_WORDS 64 bit masks of the values after it.
+        /// A gap costs one bit instead of a new range, so this is smaller when values are missing here and there, as with packetloss.
+        /// Masks are built and read 64 values at a time.
+        RakNet::BitSize_t SerializeBitmap(RakNet::BitStream *in, RakNet::BitSize_t maxBits, bool clearSerialized);
+        bool DeserializeBitmap(RakNet::BitStream *out);
+
         DataStructures::OrderedList<range_type, RangeNode<range_type> , RangeNodeComp<range_type> > ranges{};
     };
 
@@ -143,6 +175,147 @@ namespace DataStructures
         return true;
     }
 
+    template <class range_type>
+    RakNet::BitSize_t RangeList<range_type>::SerializeBitmap(RakNet::BitStream *in, RakNet::BitSize_t maxBits, bool clearSerialized)
+    {
+        const RakNet::BitSize_t blockHeaderBits=(RakNet::BitSize_t) sizeof(range_type)*8*2+8;
+        uint64_t words[RANGE_LIST_MAX_BITMAP_WORDS];
+        unsigned short countWritten=0;
+        unsigned rangesWritten=0;
+
+        in->AlignWriteToByteBoundary();
+        RakNet::BitSize_t countOffset=in->GetWriteOffset();
+        in->Write(countWritten); // Dummy value
+        RakNet::BitSize_t bitsWritten=in->GetWriteOffset()-countOffset;
+
+        while (rangesWritten < ranges.Size() && countWritten < (unsigned short)-1)
+        {
+            if (bitsWritten+blockHeaderBits>maxBits)
+                break;
+
+            uint32_t base=(uint32_t) ranges[rangesWritten].minIndex;
+            uint32_t runLength=(uint32_t) ranges[rangesWritten].maxIndex-base+1;
+            uint32_t bitmapStart=base+runLength;
+            unsigned int wordCount=0;
+            rangesWritten++;
+
+            while (rangesWritten < ranges.Size())
+            {
+                uint32_t first=(uint32_t) ranges[rangesWritten].minIndex-bitmapStart;
+                uint32_t last=(uint32_t) ranges[rangesWritten].maxIndex-bitmapStart;
+                // A long range is smaller as the run of a new block, and so is anything past an empty mask
+                if (last-first>=64 || first/64>wordCount || last/64>=RANGE_LIST_MAX_BITMAP_WORDS)
+                    break;
+                if (bitsWritten+blockHeaderBits+(last/64+1)*64>maxBits)
+                    break;
+
+                for (; wordCount<=last/64; wordCount++)
+                    words[wordCount]=0;
+                for (uint32_t wordIndex=first/64; wordIndex<=last/64; wordIndex++)
+                {
+                    uint64_t mask=(uint64_t)-1;
+                    if (wordIndex==first/64)
+                        mask&=(uint64_t)-1 << (first%64);
+                    if (wordIndex==last/64)
+                        mask&=(uint64_t)-1 >> (63-last%64);
+                    words[wordIndex]|=mask;
+                }
+                rangesWritten++;
+            }
+
+            in->Write(range_type(base));
+            in->Write(range_type(runLength));
+            in->Write((unsigned char) wordCount);
+            for (unsigned int wordIndex=0; wordIndex < wordCount; wordIndex++)
+                in->Write(words[wordIndex]);
+            bitsWritten+=blockHeaderBits+wordCount*64;
+            countWritten++;
+        }
+
+        // Go back and write how many blocks there are
+        RakNet::BitSize_t endOffset=in->GetWriteOffset();
+        in->SetWriteOffset(countOffset);
+        in->Write(countWritten);
+        in->SetWriteOffset(endOffset);
+
+        if (clearSerialized && rangesWritten)
+        {
+            unsigned rangeSize=ranges.Size();
+            for (unsigned i=0; i < rangeSize-rangesWritten; i++)
+                ranges[i]=ranges[i+rangesWritten];
+            ranges.RemoveFromEnd(rangesWritten);
+        }
+
+        return bitsWritten;
+    }
+
+    template <class range_type>
+    bool RangeList<range_type>::DeserializeBitmap(RakNet::BitStream *out)
+    {
+        ranges.Clear(true);
+        unsigned short count;
+        out->AlignReadToByteBoundary();
+        if (out->Read(count)==false)
+            return false;
+
+        for (unsigned short i=0; i < count; i++)
+        {
+            range_type base, runLength;
+            unsigned char wordCount;
+            if (out->Read(base)==false || out->Read(runLength)==false || out->Read(wordCount)==false)
+                return false;
+            if ((uint32_t) runLength==0 || wordCount>RANGE_LIST_MAX_BITMAP_WORDS)
+                return false;
+
+            uint32_t bitmapStart=(uint32_t) base+(uint32_t) runLength;
+            for (unsigned int wordIndex=0; wordIndex <= wordCount; wordIndex++)
+            {
+                uint32_t min=0, max=0;
+                uint64_t word=0;
+                if (wordIndex==0)
+                {
+                    min=(uint32_t) base;
+                    max=bitmapStart-1;
+                }
+                else
+                {
+                    if (out->Read(word)==false)
+                        return false;
+                    if (word==0)
+                        continue;
+                }
+
+                for (;;)
+                {
+                    if (wordIndex>0)
+                    {
+                        // Next run of set bits
+                        unsigned int start=RangeListLowestBit(word);
+                        uint64_t rest=~(word>>start);
+                        unsigned int length=rest ? RangeListLowestBit(rest) : 64-start;
+                        min=bitmapStart+(wordIndex-1)*64+start;
+                        max=min+length-1;
+                        word=start+length>=64 ? 0 : word & ((uint64_t)-1 << (start+length));
+                    }
+
+                    // Values must not wrap around
+                    if ((uint32_t) range_type(max)!=max)
+                        return false;
+
+                    // Runs continue across masks
+                    if (ranges.Size() && (uint32_t) ranges[ranges.Size()-1].maxIndex+1==min)
+                        ranges[ranges.Size()-1].maxIndex=range_type(max);
+                    else
+                        ranges.InsertAtEnd(RangeNode<range_type>(range_type(min),range_type(max)));
+
+                    if (word==0)
+                        break;
+                }
+            }
+        }
+        return true;
+    }
+
     template <class range_type>
     RangeList<range_type>::RangeList()
     {
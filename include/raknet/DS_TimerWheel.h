@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DS_TimerWheel.h
+/// \internal
+/// \brief Hierarchical timer wheel keyed by a fixed range of element indices
+///
+
+
+#ifndef __TIMER_WHEEL_H
+#define __TIMER_WHEEL_H
+
+#include "DS_List.h"
+#include "Export.h"
+#include <stdint.h>
+
+namespace DataStructures
+{
+    /// \brief Tracks one expiration time per element in [0, numElements), with O(1) schedule, cancel and expire.
+    /// Time is in ticks (RakPeer uses milliseconds). Three levels of 256, 64 and 64 slots cover 2^20 ticks;
+    /// later times are clamped to the end of the wheel. Elements in the outer levels are moved inward as the wheel turns.
+    class RAK_DLL_EXPORT TimerWheel
+    {
+    public:
+        TimerWheel();
+        ~TimerWheel();
+
+        /// Allocate room for \a numElements elements and start the wheel at \a curTime
+        void Init(unsigned int numElements, uint64_t curTime);
+
+        /// Free memory. Init() must be called again before use
+        void Clear(void);
+
+        /// Schedule or reschedule \a element. Times the wheel already turned past, such as 0, expire on the next Advance()
+        void Schedule(unsigned int element, uint64_t expireTime);
+
+        /// Remove \a element if it is scheduled
+        void Cancel(unsigned int element);
+
+        bool IsScheduled(unsigned int element) const;
+
+        /// Turn the wheel up to and including \a curTime, appending every expired element to \a output
+        void Advance(uint64_t curTime, List<unsigned int> &output);
+
+        /// How many ticks from \a curTime until an element may expire, no more than \a maxWait
+        uint64_t GetTimeToNextExpiry(uint64_t curTime, uint64_t maxWait) const;
+
+        unsigned int GetScheduledCount(void) const {return scheduledCount;}
+
+    protected:
+        void Insert(unsigned int element, uint64_t expireTime);
+        void Unlink(unsigned int element);
+        void Cascade(unsigned int slot);
+
+        struct Node
+        {
+            unsigned int next, prev;
+            unsigned short slot;
+            uint64_t expireTime;
+        };
+
+        Node *nodes;
+        unsigned int numNodes;
+        unsigned int *slotHeads;
+        unsigned int levelCount[3];
+        unsigned int scheduledCount;
+        uint64_t currentTick;
+    };
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DatagramHistory.h
+/// \internal
+/// \brief Which reliable messages went out in each sent datagram, so an ack or NAK of the datagram can be applied to them
+///
+
+
+#ifndef __DATAGRAM_HISTORY_H
+#define __DATAGRAM_HISTORY_H
+
+#include "InternalPacket.h"
+#include "CCRakNetCongestionControl.h"
+
+namespace RakNet
+{
+
+/// \brief Sent datagrams of one connection, from the oldest one still tracked to the newest.
+/// \details Datagrams are kept in a ring indexed by datagramNumber & mask. The message numbers of each datagram are kept next to each other
+/// in a second ring, so acking a datagram reads one contiguous span. Both rings grow by doubling, and nothing is allocated per datagram.
+/// Past CRABNET_MAXIMUM_DATAGRAM_HISTORY datagrams, Push() drops the oldest.
+class DatagramHistory
+{
+public:
+    DatagramHistory();
+    ~DatagramHistory();
+
+    /// Forget every datagram and release the arrays
+    void Clear(void);
+
+    bool IsEmpty(void) const {return datagramCount == 0;}
+    unsigned int Size(void) const {return datagramCount;}
+
+    /// Number of the oldest datagram tracked. Later ones follow it without gaps
+    DatagramSequenceNumberType GetOldestNumber(void) const {return oldestNumber;}
+
+    /// Add the datagram after the newest one
+    /// \param[in] messageCount How many reliable messages the datagram carries
+    /// \return Where to write the \a messageCount message numbers. Valid until the next call to Push()
+    MessageNumberType *Push(DatagramSequenceNumberType datagramNumber, CCTimeType timeSent, unsigned int messageCount);
+
+    /// Stop tracking the oldest datagram
+    void PopOldest(void);
+
+    /// \param[out] messageCount How many message numbers are returned
+    /// \param[out] timeSent When the datagram was sent
+    /// \return The reliable messages of the datagram. 0 if it carried none, was already acked, or is not tracked
+    const MessageNumberType *Get(DatagramSequenceNumberType datagramNumber, unsigned int *messageCount, CCTimeType *timeSent) const;
+
+    /// The datagram was acked. Get() returns 0 for it from now on
+    void Remove(DatagramSequenceNumberType datagramNumber);
+
+protected:
+    struct Datagram
+    {
+        CCTimeType timeSent;
+        // Offset of the first message number into messages. Keeps counting up, and is masked on use
+        unsigned int messageStart;
+        unsigned int messageCount;
+        bool isAcked;
+    };
+
+    void GrowDatagrams(void);
+    void GrowMessages(unsigned int messageCount);
+
+    Datagram *datagrams;
+    unsigned int datagramMask;
+    unsigned int datagramCount;
+    DatagramSequenceNumberType oldestNumber;
+
+    // messages[messageTail & messageMask] to messages[messageHead & messageMask] are in use
+    MessageNumberType *messages;
+    unsigned int messageMask;
+    unsigned int messageHead;
+    unsigned int messageTail;
+};
+
+} // namespace RakNet
+
+#endif
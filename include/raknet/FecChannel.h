@@ -0,0 +1,122 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file FecChannel.h
+/// \internal
+/// \brief XOR parity over groups of UNRELIABLE_SEQUENCED messages of one ordering channel
+///
+
+
+#ifndef __FEC_CHANNEL_H
+#define __FEC_CHANNEL_H
+
+#include "InternalPacket.h"
+
+namespace RakNet
+{
+
+class BitStream;
+
+/// \brief Forward error correction for the UNRELIABLE_SEQUENCED messages of one ordering channel.
+/// \details The sender XORs each group of messages into one parity message, which lists the orderingIndex and sequencingIndex of every member.
+/// The receiver keeps copies of the messages it recently got, so when one member of a group is lost, XORing the parity with the others rebuilds it.
+/// One parity covers a single loss per group. The same object holds the sending and the receiving side of the channel.
+class FecChannel
+{
+public:
+    /// Most messages one parity covers
+    static const unsigned int MAXIMUM_GROUP_SIZE = 32;
+
+    enum RecoverResult
+    {
+        /// Every member of the group arrived
+        FEC_NOTHING_LOST,
+        /// One member was lost, and was rebuilt
+        FEC_RECOVERED,
+        /// More than one member was lost, or the parity was malformed
+        FEC_UNRECOVERABLE
+    };
+
+    FecChannel();
+    ~FecChannel();
+
+    /// \return \a groupSize limited to 2 to MAXIMUM_GROUP_SIZE, or 0 if 0
+    static unsigned int ClampGroupSize(unsigned int groupSize);
+
+    /// Forget the group being sent and the messages received, and release their memory
+    void Clear(void);
+
+    /// Forget the group being sent and release its memory. The messages received are kept, so parities from the remote system
+    /// can still be checked
+    void ClearSending(void);
+
+    /// Number of messages in the group being sent
+    unsigned int GetGroupCount(void) const {return groupCount;}
+
+    /// Size of the parity if a message of \a dataBitLength was added to the group being sent
+    unsigned int GetParityByteLength(BitSize_t dataBitLength) const;
+
+    /// Add a sent message to the group. Messages of 65536 bits or more are left out
+    /// \pre GetGroupCount() < MAXIMUM_GROUP_SIZE
+    /// \return The number of messages in the group now
+    unsigned int AddSent(const InternalPacket *internalPacket);
+
+    /// Write the parity of the group to \a bitStream, and start the next group
+    void WriteParity(unsigned char orderingChannel, BitStream *bitStream);
+
+    /// Keep a copy of a received message, in case a parity needs it. Does nothing until a parity arrived on this channel
+    void AddReceived(const InternalPacket *internalPacket);
+
+    /// Read the ordering channel a parity written by WriteParity() is for
+    /// \return false if \a parity is too short
+    static bool ReadParityChannel(BitStream *parity, unsigned char *orderingChannel);
+
+    /// Check the rest of a parity against the messages received, and rebuild the missing one
+    /// \param[in] parity Read past the ordering channel
+    /// \param[out] recovered With FEC_RECOVERED, gets the ordering fields, dataBitLength and data, allocated with malloc
+    /// \param[out] lostCount How many members did not arrive, rebuilt or not
+    RecoverResult Recover(BitStream *parity, InternalPacket *recovered, unsigned int *lostCount);
+
+protected:
+    struct Member
+    {
+        OrderingIndexType orderingIndex;
+        OrderingIndexType sequencingIndex;
+    };
+
+    struct Received
+    {
+        OrderingIndexType orderingIndex;
+        OrderingIndexType sequencingIndex;
+        BitSize_t dataBitLength;
+        unsigned char *data;
+        unsigned int capacity;
+    };
+
+    const Received *FindReceived(const Member &member) const;
+
+    // Sending
+    Member groupMembers[MAXIMUM_GROUP_SIZE];
+    unsigned int groupCount;
+    // XOR of the members' data, as long as the longest of them
+    unsigned char *groupData;
+    unsigned int groupDataLength;
+    unsigned int groupDataCapacity;
+    uint16_t groupBitLengths;
+
+    // Receiving. A ring of the latest messages, allocated when the first parity arrives
+    Received *received;
+    unsigned int receivedWriteIndex;
+};
+
+} // namespace RakNet
+
+#endif
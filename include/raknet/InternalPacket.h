@@ -21,14 +21,12 @@
 #include "RakNetDefines.h"
 #include <stdint.h>
 #include "RakNetDefines.h"
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL!=1
-#include "CCRakNetUDT.h"
-#else
-#include "CCRakNetSlidingWindow.h"
-#endif
+#include "CCRakNetCongestionControl.h"
 
 namespace RakNet {
 
+struct RNS2RecvStruct;
+
 typedef uint16_t SplitPacketIdType;
 typedef uint32_t SplitPacketIndexType;
 
@@ -72,6 +70,9 @@ struct InternalPacketRefCountedData
 {
     unsigned char *sharedDataBlock;
     unsigned int refCount;
+    /// If set, sharedDataBlock belongs to the application and is handed back through this rather than freed
+    SendReleaseCallback releaseCallback;
+    void *releaseUserData;
 };
 
 /// Holds a user message, and related information
@@ -107,9 +108,14 @@ struct InternalPacket : public InternalPacketFixedSizeTransmissionHeader
 
         /// If allocation scheme is STACK, data points to stackData and should not be deallocated
         /// This is only used when sending. Received packets are deallocated in RakPeer
-        STACK
+        STACK,
+
+        /// data points into the datagram it was received in. receiveBuffer holds a reference to that datagram
+        /// This is only used when receiving
+        RECEIVE_BUFFER
     } allocationScheme;
     InternalPacketRefCountedData *refCountedData;
+    RNS2RecvStruct *receiveBuffer;
     /// How many attempts we made at sending this message
     unsigned char timesSent;
     /// The priority level of this packet
@@ -117,9 +123,15 @@ struct InternalPacket : public InternalPacketFixedSizeTransmissionHeader
     /// If the reliability type requires a receipt, then return this number with it
     uint32_t sendReceiptSerial;
 
-    // Used for the resend queue
+    /// Position in ResendQueue, so an ack or NAK can move or remove it without searching
+    unsigned int resendQueueIndex;
+    /// Next message OrderingWindow holds for the same ordering index
+    InternalPacket *orderingNext;
+    /// A FecChannel parity rather than a user message
+    bool fecParity;
+    // Used for the unreliable timeout list
     // Linked list implementation so I can remove from the list via a pointer, without finding it in the list
-    InternalPacket *resendPrev, *resendNext,*unreliablePrev,*unreliableNext;
+    InternalPacket *unreliablePrev, *unreliableNext;
 
     unsigned char stackData[128];
 };
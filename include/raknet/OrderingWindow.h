@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file OrderingWindow.h
+/// \internal
+/// \brief Ordered and sequenced messages of one ordering channel that arrived before the ordering index they wait for
+///
+
+
+#ifndef __ORDERING_WINDOW_H
+#define __ORDERING_WINDOW_H
+
+#include "InternalPacket.h"
+
+namespace RakNet
+{
+
+/// \brief Holds the messages of one ordering channel whose orderingIndex is after the next one expected.
+/// \details Slots are indexed by orderingIndex & mask, so holding a message and finding the next one to return are O(1).
+/// A slot holds the ordered message with that index, and the sequenced messages sent before it, linked through
+/// InternalPacket::orderingNext in sequencingIndex order. The slots grow by doubling when a message arrives further ahead than they reach,
+/// up to CRABNET_MAX_ORDERING_WINDOW and past it only as far as the messages held justify.
+/// The window does not own the messages, and never frees them.
+class OrderingWindow
+{
+public:
+    enum PushResult
+    {
+        /// The window holds the message
+        ORDERING_HELD,
+        /// An ordered message with the same orderingIndex is already held
+        ORDERING_DUPLICATE,
+        /// The message is too far ahead to hold. See CRABNET_MAX_ORDERING_WINDOW
+        ORDERING_TOO_FAR_AHEAD
+    };
+
+    OrderingWindow();
+    ~OrderingWindow();
+
+    /// Forget every message and release the slots
+    void Clear(void);
+
+    bool IsEmpty(void) const {return size == 0;}
+    unsigned int Size(void) const {return size;}
+
+    /// Hold a message until \a readIndex reaches its orderingIndex
+    /// \pre internalPacket->orderingIndex is after readIndex
+    /// \return ORDERING_HELD, or why the window did not take the message
+    PushResult Push(InternalPacket *internalPacket, OrderingIndexType readIndex);
+
+    /// Remove the next message held for \a readIndex: the sequenced ones by sequencingIndex, then the ordered one
+    /// \return The message, or 0 if none is held for \a readIndex
+    InternalPacket *Pop(OrderingIndexType readIndex);
+
+    /// Remove any message, for releasing them all
+    /// \return The message, or 0 if empty
+    InternalPacket *PopAny(void);
+
+protected:
+    struct Slot
+    {
+        InternalPacket *sequenced;
+        InternalPacket *ordered;
+    };
+
+    void Grow(unsigned int offset, OrderingIndexType readIndex);
+
+    Slot *slots;
+    unsigned int mask;
+    unsigned int size;
+    // Where PopAny() continues looking
+    unsigned int popAnySlot;
+};
+
+} // namespace RakNet
+
+#endif
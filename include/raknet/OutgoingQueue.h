@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file OutgoingQueue.h
+/// \internal
+/// \brief Messages waiting for their first send, in the order the priorities share the bandwidth
+///
+
+
+#ifndef __OUTGOING_QUEUE_H
+#define __OUTGOING_QUEUE_H
+
+#include "InternalPacket.h"
+
+namespace RakNet
+{
+
+/// \brief Holds the messages of one connection that were not sent yet, one FIFO ring per PacketPriority.
+/// \details Every message gets a weight when it is pushed, and messages go out by lowest weight first.
+/// The weight of a priority advances by (2^priority)*(priority+1)+priority per message, so while every priority has messages waiting,
+/// IMMEDIATE_PRIORITY sends 5 messages for each HIGH_PRIORITY one, 14 for each MEDIUM_PRIORITY one and 35 for each LOW_PRIORITY one.
+/// The weights of one priority only go up, so each ring stays in weight order and the next message is the lightest of at most
+/// NUMBER_OF_PRIORITIES ring heads. Push and Pop are O(1). The queue does not own the messages, and never frees them.
+class OutgoingQueue
+{
+public:
+    OutgoingQueue();
+    ~OutgoingQueue();
+
+    /// Forget every message and release the rings
+    void Clear(void);
+
+    bool IsEmpty(void) const {return size == 0;}
+    unsigned int Size(void) const {return size;}
+
+    /// Add a message behind the others of its InternalPacket::priority
+    void Push(InternalPacket *internalPacket);
+
+    /// \return The message to send next. 0 if empty
+    InternalPacket *Peek(void) const {return size ? rings[nextPriority].entries[rings[nextPriority].head & rings[nextPriority].mask].internalPacket : 0;}
+
+    /// Remove the message Peek() returns
+    /// \pre !IsEmpty()
+    InternalPacket *Pop(void);
+
+protected:
+    struct Entry
+    {
+        uint64_t weight;
+        InternalPacket *internalPacket;
+    };
+
+    struct Ring
+    {
+        Entry *entries;
+        unsigned int mask;
+        // entries[head & mask] to entries[tail & mask] are in use. Both keep counting up
+        unsigned int head;
+        unsigned int tail;
+    };
+
+    uint64_t GetNextWeight(int priorityLevel);
+    void InitWeights(void);
+    void GrowRing(Ring &ring);
+    void FindNextPriority(void);
+
+    Ring rings[NUMBER_OF_PRIORITIES];
+    uint64_t nextWeights[NUMBER_OF_PRIORITIES];
+    unsigned int size;
+    // Ring whose head has the lowest weight
+    int nextPriority;
+};
+
+} // namespace RakNet
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file PacketAllocator.h
+/// \internal
+/// \brief Allocates Packet headers from per-thread caches, so threads allocating and freeing packets do not share a lock
+///
+
+
+#ifndef __PACKET_ALLOCATOR_H
+#define __PACKET_ALLOCATOR_H
+
+#include "Export.h"
+#include "RakNetDefines.h"
+#include "RakNetTypes.h"
+#include <stdint.h>
+
+namespace RakNet
+{
+/// \brief Fixed size blocks holding a Packet followed by CRABNET_PACKET_INLINE_DATA_SIZE bytes for its data.
+/// \details Each thread keeps two magazines of free blocks and only touches the shared depot when both are empty (on
+/// Allocate) or both are full (on Release). The depot is lock-free, so the network thread allocating packets and the
+/// application thread freeing them never wait on each other.
+/// Blocks may be released by a different thread than the one that allocated them. Shared by every RakPeer in the process.
+class RAK_DLL_EXPORT PacketAllocator
+{
+public:
+    /// \return A default constructed Packet. data is not set
+    static Packet *Allocate(void);
+
+    /// Destroys \a packet and returns its block to the calling thread's cache. Does not free packet->data
+    static void Release(Packet *packet);
+
+    /// \return Room for CRABNET_PACKET_INLINE_DATA_SIZE bytes right after \a packet, which must come from Allocate().
+    /// 0 when CRABNET_PACKET_INLINE_DATA_SIZE is 0
+    static unsigned char *GetInlineData(Packet *packet);
+
+    /// \return How many times a thread exchanged a magazine with the depot. Each exchange moves up to CRABNET_PACKET_MAGAZINE_SIZE blocks
+    static uint64_t GetDepotExchangeCount(void);
+};
+
+} // namespace RakNet
+
+#endif
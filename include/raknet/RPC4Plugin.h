@@ -177,6 +177,16 @@ class NetworkIDManager;
         /// If called while processing a slot, no further slots for the currently executing signal will be executed
         void InterruptSignal(void);
 
+        /// \brief The BitStreams RPC4 builds for calls, signals and return values take their memory from \a _bitStreamArena
+        /// once they outgrow BITSTREAM_STACK_ALLOCATION_SIZE, rather than from the heap.
+        /// \details The arena is used from the threads calling Call(), Signal() and RakPeerInterface::Receive(), which must be
+        /// the same one. Reset it between calls, not during them.
+        /// \param[in] _bitStreamArena The arena to use, or 0 for the heap, the default
+        void SetBitStreamArena(BitStreamArena *_bitStreamArena);
+
+        /// Returns what was passed to SetBitStreamArena()
+        BitStreamArena *GetBitStreamArena(void) const;
+
         /// \internal
         struct LocalCallback
         {
@@ -231,6 +241,8 @@ class NetworkIDManager;
 
         bool interruptSignal;
 
+        BitStreamArena *bitStreamArena;
+
         void InvokeSignal(DataStructures::HashIndex functionIndex, RakNet::BitStream *serializedParameters, Packet *packet);
     };
 
@@ -60,6 +60,11 @@
 #define BITSTREAM_STACK_ALLOCATION_SIZE 256
 #endif
 
+// Bytes a BitStreamArena takes from the heap at once, for the BitStreams that outgrow BITSTREAM_STACK_ALLOCATION_SIZE
+#ifndef CRABNET_BITSTREAM_ARENA_BLOCK_SIZE
+#define CRABNET_BITSTREAM_ARENA_BLOCK_SIZE 65536
+#endif
+
 // Redefine if you want to disable or change the target for debug CRABNET_DEBUG_PRINTF
 #ifndef CRABNET_DEBUG_PRINTF
 #define CRABNET_DEBUG_PRINTF printf
@@ -83,19 +88,45 @@
 #endif
 #endif
 
-/// This controls the amount of memory used per connection.
-/// This many datagrams are tracked by datagramNumber. If more than this many datagrams are sent, then an ack for an older datagram would be ignored
-/// This results in an unnecessary resend in that case
+/// How many sent datagrams are tracked by datagramNumber before the history first grows. Must be a power of 2
+/// Datagrams stay tracked while a message they carried is unacknowledged, so acks for older datagrams are no longer ignored
 #ifndef DATAGRAM_MESSAGE_ID_ARRAY_LENGTH
 #define DATAGRAM_MESSAGE_ID_ARRAY_LENGTH 512
 #endif
 
-/// This is the maximum number of reliable user messages that can be on the wire at a time
-/// If this is too low, then high ping connections with a large throughput will be underutilized
-/// This will be evident because RakNetStatistics::messagesInSend buffer will increase over time, yet at the same time the outgoing bandwidth per second is less than your connection supports
+/// The most sent datagrams tracked at once, per connection. Must be a power of 2, at least DATAGRAM_MESSAGE_ID_ARRAY_LENGTH
+/// Past this the oldest datagram is dropped even while a message it carried is unacknowledged. That message is still resent
+/// on timeout, and acked through the datagram it was resent in
+#ifndef CRABNET_MAXIMUM_DATAGRAM_HISTORY
+#define CRABNET_MAXIMUM_DATAGRAM_HISTORY 65536
+#endif
+
+/// How many unacknowledged reliable user messages the resend queue has room for before it first grows. Must be a power of 2
+/// The queue doubles as needed, so this no longer limits how many messages can be on the wire at a time
 #ifndef RESEND_BUFFER_ARRAY_LENGTH
 #define RESEND_BUFFER_ARRAY_LENGTH 512
-#define RESEND_BUFFER_ARRAY_MASK 511
+#endif
+
+/// How far past the next expected ordering index an ordering channel holds messages that arrived early
+/// Further ahead, it holds them only while they would fill at least a quarter of the window, so memory follows the number of
+/// messages held rather than how far ahead a peer claims a message is. Unreliable messages past that are dropped. A reliable one
+/// was already acked and would never be resent, so the connection is dropped instead
+#ifndef CRABNET_MAX_ORDERING_WINDOW
+#define CRABNET_MAX_ORDERING_WINDOW 4096
+#endif
+
+/// Largest split message accepted from a remote system, in bytes
+/// The reassembly buffer is sized from the fragment size and count in the first fragments to arrive, so this bounds what a
+/// remote system can make us allocate for one message. Larger messages are dropped
+#ifndef CRABNET_MAX_SPLIT_MESSAGE_SIZE
+#define CRABNET_MAX_SPLIT_MESSAGE_SIZE (64 * 1024 * 1024)
+#endif
+
+/// Most bytes one connection may hold for all the split messages it is reassembling at once.
+/// Bounds how much a remote system can make us allocate by starting many split messages without finishing them.
+/// A reliable split message that does not fit drops the connection, since its fragments were already acknowledged
+#ifndef CRABNET_MAX_SPLIT_BYTES_PER_CONNECTION
+#define CRABNET_MAX_SPLIT_BYTES_PER_CONNECTION (128 * 1024 * 1024)
 #endif
 
 /// Uncomment if you want to link in the DLMalloc library to use with RakMemoryOverride
@@ -109,17 +140,11 @@
 #define GET_TIME_SPIKE_LIMIT 0
 #endif
 
-// Use sliding window congestion control instead of ping based congestion control
+// Use sliding window congestion control instead of ping based congestion control, for connections that do not select one with RakPeer::SetCongestionControl()
 #ifndef USE_SLIDING_WINDOW_CONGESTION_CONTROL
 #define USE_SLIDING_WINDOW_CONGESTION_CONTROL 1
 #endif
 
-// When a large message is arriving, preallocate the memory for the entire block
-// This results in large messages not taking up time to reassembly with memcpy, but is vulnerable to attackers causing the host to run out of memory
-#ifndef PREALLOCATE_LARGE_MESSAGES
-#define PREALLOCATE_LARGE_MESSAGES 0
-#endif
-
 #ifndef CRABNET_SUPPORT_IPV6
 #define CRABNET_SUPPORT_IPV6 0
 #endif
@@ -163,6 +188,133 @@
 #define USE_ALLOCA 1
 #endif
 
+// If defined to 1, SocketDescriptor::recvBatchSize may be used to read several datagrams per recvmmsg() call
+// Only Linux provides recvmmsg()
+#ifndef CRABNET_SUPPORT_RECVMMSG
+#if defined(__linux__) && !defined(ANDROID) && !defined(__native_client__)
+#define CRABNET_SUPPORT_RECVMMSG 1
+#else
+#define CRABNET_SUPPORT_RECVMMSG 0
+#endif
+#endif
+
+// Upper bound for SocketDescriptor::recvBatchSize. Each receive thread keeps this many RNS2RecvStruct checked out of the free pool
+#ifndef RNS2_MAXIMUM_RECV_BATCH_SIZE
+#define RNS2_MAXIMUM_RECV_BATCH_SIZE 64
+#endif
+
+// If defined to 1, SocketDescriptor::sendBatchSize may be used to send the datagrams of an update cycle with sendmmsg()
+// Only Linux provides sendmmsg() and UDP_SEGMENT
+#ifndef CRABNET_SUPPORT_SENDMMSG
+#if defined(__linux__) && !defined(ANDROID) && !defined(__native_client__)
+#define CRABNET_SUPPORT_SENDMMSG 1
+#else
+#define CRABNET_SUPPORT_SENDMMSG 0
+#endif
+#endif
+
+// Upper bound for SocketDescriptor::sendBatchSize. Each socket allocates about MAXIMUM_MTU_SIZE bytes per entry
+#ifndef RNS2_MAXIMUM_SEND_BATCH_SIZE
+#define RNS2_MAXIMUM_SEND_BATCH_SIZE 64
+#endif
+
+// If defined to 1, SocketDescriptor::reusePortSocketCount may be used to bind several SO_REUSEPORT sockets to one port
+// Only Linux spreads incoming datagrams across such sockets
+#ifndef CRABNET_SUPPORT_REUSEPORT
+#if defined(__linux__) && !defined(ANDROID) && !defined(__native_client__)
+#define CRABNET_SUPPORT_REUSEPORT 1
+#else
+#define CRABNET_SUPPORT_REUSEPORT 0
+#endif
+#endif
+
+// Upper bound for SocketDescriptor::reusePortSocketCount. Each socket has its own receive thread
+#ifndef RNS2_MAXIMUM_REUSEPORT_SOCKETS
+#define RNS2_MAXIMUM_REUSEPORT_SOCKETS 16
+#endif
+
+// How many received datagrams may wait for the update thread, and how many spare RNS2RecvStruct are kept for reuse.
+// Datagrams arriving while the queue is full are dropped, as the kernel would drop them if the socket buffer was full,
+// and counted in RakNetStatistics::receiveQueueDropped. The default for RakPeerInterface::SetReceiveQueueSize()
+#ifndef CRABNET_BUFFERED_PACKETS_QUEUE_SIZE
+#define CRABNET_BUFFERED_PACKETS_QUEUE_SIZE 8192
+#endif
+
+// If defined to 1, SignaledEvent is backed by an eventfd so a wakeup between two waits is never lost
+#ifndef CRABNET_SUPPORT_EVENTFD
+#if defined(__linux__) && !defined(ANDROID) && !defined(__native_client__)
+#define CRABNET_SUPPORT_EVENTFD 1
+#else
+#define CRABNET_SUPPORT_EVENTFD 0
+#endif
+#endif
+
+// Longest time in milliseconds the update thread sleeps while connections are open or being opened.
+// Incoming datagrams, user commands and ReliabilityLayer deadlines wake it sooner. 10 restores the old fixed polling interval
+#ifndef CRABNET_UPDATE_THREAD_MAX_WAIT_MS
+#define CRABNET_UPDATE_THREAD_MAX_WAIT_MS 100
+#endif
+
+// Longest time in milliseconds the update thread sleeps when there are no connections and no connection attempts
+#ifndef CRABNET_UPDATE_THREAD_IDLE_WAIT_MS
+#define CRABNET_UPDATE_THREAD_IDLE_WAIT_MS 1000
+#endif
+
+// Longest time in milliseconds RunUpdateCycle leaves a connection alone when nothing is due on it.
+// Keepalive, ping and resend deadlines are tracked exactly, this only bounds housekeeping such as unreliable message culling
+#ifndef CRABNET_REMOTE_SYSTEM_MAX_UPDATE_INTERVAL_MS
+#define CRABNET_REMOTE_SYSTEM_MAX_UPDATE_INTERVAL_MS 1000
+#endif
+
+// Most threads RakPeer::SetUpdateWorkerCount() may split connection updates across
+#ifndef CRABNET_MAXIMUM_UPDATE_WORKERS
+#define CRABNET_MAXIMUM_UPDATE_WORKERS 16
+#endif
+
+// With several update workers, cycles with fewer due connections than this are run on the update thread alone,
+// since waking the workers costs more than the work saved
+#ifndef CRABNET_UPDATE_WORKER_MIN_SYSTEMS
+#define CRABNET_UPDATE_WORKER_MIN_SYSTEMS 8
+#endif
+
+// Packets with at most this many bytes of data are allocated as one block, with the data right after the Packet header.
+// Larger packets allocate their data separately. Set to 0 to always malloc packet->data separately, as older versions did,
+// if your application frees or replaces packet->data itself
+#ifndef CRABNET_PACKET_INLINE_DATA_SIZE
+#define CRABNET_PACKET_INLINE_DATA_SIZE 240
+#endif
+
+// How many free Packet blocks each thread caches in one magazine. A thread holds up to two magazines
+#ifndef CRABNET_PACKET_MAGAZINE_SIZE
+#define CRABNET_PACKET_MAGAZINE_SIZE 64
+#endif
+
+// How many magazines of free Packet blocks threads may exchange through the shared depot before blocks go back to the heap
+#ifndef CRABNET_PACKET_DEPOT_SIZE
+#define CRABNET_PACKET_DEPOT_SIZE 256
+#endif
+
+// Longest burst, in microseconds at the pacing rate, that a connection sends at once when RakPeer::SetPacing() is on.
+// The update thread sleeps in whole milliseconds, so lower values only spread datagrams further with a finer timer
+#ifndef CRABNET_PACING_MAX_BURST_US
+#define CRABNET_PACING_MAX_BURST_US 1000
+#endif
+
+// How much faster than one congestion window per round trip the sliding window congestion control paces, in slow start and in
+// congestion avoidance. Pacing at exactly the window would keep slow start from growing it, and leaves no room for timer jitter
+#ifndef CRABNET_PACING_SLOW_START_GAIN
+#define CRABNET_PACING_SLOW_START_GAIN 2.0
+#endif
+#ifndef CRABNET_PACING_CONGESTION_AVOIDANCE_GAIN
+#define CRABNET_PACING_CONGESTION_AVOIDANCE_GAIN 1.25
+#endif
+
+// ReliabilityFeature flags (ReliabilityLayer.h) offered to remote systems when connecting. Only flags both systems offer are used.
+// 0 keeps the wire format of versions without negotiation
+#ifndef CRABNET_RELIABILITY_FEATURES
+#define CRABNET_RELIABILITY_FEATURES 3
+#endif
+
 //#define USE_THREADED_SEND
 
 #endif // __CRABNET_DEFINES_H
@@ -39,6 +39,7 @@ namespace RakNet
 {
 
 class RakNetSocket2;
+class RNS2EventHandler;
 struct RNS2_BerkleyBindParameters;
 struct RNS2_SendParameters;
 typedef int RNS2Socket;
@@ -83,6 +84,11 @@ struct RNS2RecvStruct
     SystemAddress systemAddress;
     RakNet::TimeUS timeRead;
     RakNetSocket2 *socket;
+
+    // Only used by RakPeer. Counts the zero-copy InternalPacket and Packet objects pointing into data, plus one while
+    // the datagram is processed. Each reference is dropped with eventHandler->DeallocRNS2RecvStruct()
+    std::atomic<unsigned int> refCount;
+    RNS2EventHandler *eventHandler;
 };
 
 class RakNetSocket2Allocator
@@ -101,6 +107,9 @@ public:
     //        bufferedPackets.Push(recvFromStruct);
     //        quitAndDataEvents.SetEvent();
     virtual void OnRNS2Recv(RNS2RecvStruct *recvStruct)=0;
+    // Called instead of OnRNS2Recv when a socket reads several datagrams in one system call
+    // The default implementation calls OnRNS2Recv once per datagram
+    virtual void OnRNS2RecvBatch(RNS2RecvStruct **recvStructs, unsigned int count);
     virtual void DeallocRNS2RecvStruct(RNS2RecvStruct *s)=0;
     virtual RNS2RecvStruct *AllocRNS2RecvStruct()=0;
 
@@ -117,6 +126,10 @@ public:
     // In order for the handler to trigger, some platforms must call PollRecvFrom, some platforms this create an internal thread.
     void SetRecvEventHandler(RNS2EventHandler *_eventHandler);
     virtual RNS2SendResult Send( RNS2_SendParameters *sendParameters )=0;
+    // Same as Send, but sockets that support it hold the datagram until FlushSendBatch() or until the batch is full
+    // Only call both from the same thread (RakPeer's update thread)
+    virtual RNS2SendResult SendBatched( RNS2_SendParameters *sendParameters );
+    virtual void FlushSendBatch(void);
     RNS2Type GetSocketType(void) const;
     void SetSocketType(RNS2Type t);
     bool IsBerkleySocket(void) const;
@@ -219,6 +232,10 @@ struct RNS2_BerkleyBindParameters
     int pollingThreadPriority;
     RNS2EventHandler *eventHandler;
     unsigned short remotePortRakNetWasStartedOn_PS3_PS4_PSP2;
+    unsigned short recvBatchSize; // 1 for recvfrom, more for recvmmsg where supported
+    unsigned short sendBatchSize; // 1 for sendto, more for sendmmsg where supported
+    bool sendBatchUseGSO;
+    bool reusePort; // SO_REUSEPORT, so other sockets may bind the same port
 };
 
 // Every platform except Windows Store 8 can use the Berkley sockets interface
@@ -246,6 +263,14 @@ public:
     RNS2Socket GetSocket(void) const;
     void SetDoNotFragment( int opt );
 
+    // How many receive calls returned data, how many datagrams they returned in total, and the most returned by one call
+    void GetRecvBatchStatistics(uint64_t *recvCalls, uint64_t *datagramsReceived, unsigned int *largestBatch) const;
+    // How many system calls were used to send datagrams, and how many datagrams they sent
+    void GetSendBatchStatistics(uint64_t *sendCalls, uint64_t *datagramsSent) const;
+
+    virtual RNS2SendResult SendBatched( RNS2_SendParameters *sendParameters );
+    virtual void FlushSendBatch(void);
+
 protected:
     // Used by other classes
     RNS2BindResult BindShared( RNS2_BerkleyBindParameters *bindParameters );
@@ -260,16 +285,45 @@ protected:
     void SetSocketOptions(void);
     void SetBroadcastSocket(int broadcast);
     void SetIPHdrIncl(int ipHdrIncl);
+    void SetReusePort(bool reusePort);
     void RecvFromBlocking(RNS2RecvStruct *recvFromStruct);
     void RecvFromBlockingIPV4(RNS2RecvStruct *recvFromStruct);
     void RecvFromBlockingIPV4And6(RNS2RecvStruct *recvFromStruct);
+#if CRABNET_SUPPORT_RECVMMSG==1
+    // Returns the number of datagrams read into recvFromStructs, or <= 0 on failure
+    int RecvFromBlockingBatch(RNS2RecvStruct **recvFromStructs, unsigned int count);
+#endif
+    void UpdateRecvBatchStatistics(unsigned int datagramCount);
+    void AllocateSendBatch(void);
+#if CRABNET_SUPPORT_SENDMMSG==1
+    // Returns the number of batch entries sent, starting at firstEntry, or minus errno on failure
+    int SendBatchEntries(unsigned int firstEntry);
+    void FlushSendBatchUnlocked(void);
+#endif
 
     RNS2Socket rns2Socket;
     RNS2_BerkleyBindParameters binding;
 
     unsigned RecvFromLoopInt(void);
+    unsigned RecvFromLoopBatchInt(void);
     std::atomic<uint32_t> isRecvFromLoopThreadActive;
     std::atomic<bool> endThreads;
+    std::atomic<uint64_t> recvBatchCalls;
+    std::atomic<uint64_t> recvBatchDatagrams;
+    std::atomic<uint32_t> recvBatchLargest;
+
+    struct SendBatchEntry
+    {
+        char data[MAXIMUM_MTU_SIZE];
+        int length;
+        SystemAddress systemAddress;
+    };
+    // Update shards may add to the same batch from several threads
+    SimpleMutex sendBatchMutex;
+    SendBatchEntry *sendBatch;
+    unsigned int sendBatchCount;
+    std::atomic<uint64_t> sendBatchCalls;
+    std::atomic<uint64_t> sendBatchDatagrams;
     // Constructor not called!
 
 #if defined(__APPLE__)
@@ -81,6 +81,32 @@ struct RAK_DLL_EXPORT RakNetStatistics
     /// If \a isLimitedByOutgoingBandwidthLimit is true, what is the limit, in bytes per second?
     uint64_t BPSLimitByOutgoingBandwidthLimit;
 
+    /// Is the pacer holding data back to spread datagrams out over time? See RakPeerInterface::SetPacing()
+    bool isLimitedByPacing;
+
+    /// What rate, in bytes per second, does the pacer spread datagrams at? 0 if pacing is off or congestion control has no rate estimate yet
+    uint64_t BPSLimitByPacing;
+
+    /// How many times was data the pacer held back sent, over the lifetime of the connection?
+    uint64_t pacingDelays;
+
+    /// How long, in microseconds, did that data wait in total? pacingDelayTotal / pacingDelays is the average wait
+    RakNet::TimeUS pacingDelayTotal;
+
+    /// The longest single wait for the pacer, in microseconds
+    RakNet::TimeUS pacingDelayLongest;
+
+    /// How many parity messages were sent for ordering channels using forward error correction. See RakPeerInterface::SetForwardErrorCorrection()
+    uint64_t fecParitySent;
+
+    /// How many UNRELIABLE_SEQUENCED messages on those channels were lost, rebuilt from parity and returned.
+    /// A rebuilt message is dropped, and not counted, if a newer one on its channel was already returned
+    uint64_t fecMessagesRecovered;
+
+    /// How many UNRELIABLE_SEQUENCED messages on those channels were lost and could not be rebuilt, because another of their group was lost too.
+    /// Losses in groups whose parity was lost are not seen, so are not counted
+    uint64_t fecMessagesLost;
+
     /// For each priority level, how many messages are waiting to be sent out?
     unsigned int messageInSendBuffer[NUMBER_OF_PRIORITIES];
 
@@ -100,6 +126,30 @@ struct RAK_DLL_EXPORT RakNetStatistics
     /// What is the average total packetloss over the lifetime of the connection?
     float packetlossTotal;
 
+    /// How many receive calls returned data on the socket this connection uses. Shared by all connections on that socket.
+    /// With SocketDescriptor::recvBatchSize greater than 1, each call may return several datagrams
+    uint64_t receiveBatchCalls;
+
+    /// How many datagrams were returned by those calls. receiveBatchDatagrams / receiveBatchCalls is the average batch size
+    uint64_t receiveBatchDatagrams;
+
+    /// The most datagrams returned by a single receive call
+    unsigned int receiveBatchLargest;
+
+    /// How many send calls the update thread made on the socket this connection uses. Shared by all connections on that socket.
+    /// With SocketDescriptor::sendBatchSize greater than 1, each call may carry several datagrams
+    uint64_t sendBatchCalls;
+
+    /// How many datagrams were passed to those calls
+    uint64_t sendBatchDatagrams;
+
+    /// How many times threads handing received datagrams to the update thread, or to the update workers, lost a race and retried. Shared by all connections
+    uint64_t receiveQueueContention;
+
+    /// How many received datagrams were dropped because the update thread, or an update worker, fell RakPeerInterface::SetReceiveQueueSize() datagrams behind.
+    /// Reliable messages in them are resent, others are lost. Shared by all connections
+    uint64_t receiveQueueDropped;
+
     RakNetStatistics& operator +=(const RakNetStatistics& other)
     {
         unsigned i;
@@ -115,6 +165,15 @@ struct RAK_DLL_EXPORT RakNetStatistics
             runningTotal[i]+=other.runningTotal[i];
         }
 
+        pacingDelays+=other.pacingDelays;
+        pacingDelayTotal+=other.pacingDelayTotal;
+        if (other.pacingDelayLongest > pacingDelayLongest)
+            pacingDelayLongest=other.pacingDelayLongest;
+
+        fecParitySent+=other.fecParitySent;
+        fecMessagesRecovered+=other.fecMessagesRecovered;
+        fecMessagesLost+=other.fecMessagesLost;
+
         return *this;
     }
 };
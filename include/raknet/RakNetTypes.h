@@ -29,6 +29,7 @@ namespace RakNet {
 class RakPeerInterface;
 class BitStream;
 struct Packet;
+struct RNS2RecvStruct;
 
 enum StartupResult
 {
@@ -92,6 +93,9 @@ typedef unsigned char MessageID;
 
 typedef uint32_t BitSize_t;
 
+/// Passed to RakPeerInterface::SendNoCopy(). Called once RakNet no longer references \a data, from any thread
+typedef void (*SendReleaseCallback)(const char *data, void *userData);
+
 #if defined(_MSC_VER) && _MSC_VER > 0
 #define PRINTF_64_BIT_MODIFIER "I64"
 #else
@@ -166,6 +170,26 @@ struct RAK_DLL_EXPORT SocketDescriptor
 
     /// XBOX only: set IPPROTO_VDP if you want to use VDP. If enabled, this socket does not support broadcast to 255.255.255.255
     unsigned int extraSocketOptions;
+
+    /// Linux only: read up to this many datagrams per recvmmsg() call, and hand them to RakPeer under a single lock.
+    /// 1 (default) reads one datagram per recvfrom() call. Clamped to RNS2_MAXIMUM_RECV_BATCH_SIZE.
+    /// \pre CRABNET_SUPPORT_RECVMMSG must be set to 1 in RakNetDefines.h, otherwise this is ignored
+    unsigned short recvBatchSize;
+
+    /// Linux only: hold up to this many datagrams generated by RakPeer's update cycle and send them with one sendmmsg() call.
+    /// 1 (default) sends each datagram with its own sendto() call. Clamped to RNS2_MAXIMUM_SEND_BATCH_SIZE.
+    /// \pre CRABNET_SUPPORT_SENDMMSG must be set to 1 in RakNetDefines.h, otherwise this is ignored
+    unsigned short sendBatchSize;
+
+    /// Linux only: when sendBatchSize is greater than 1, coalesce consecutive equal sized datagrams to the same system into one UDP_SEGMENT (GSO) send.
+    /// Falls back to plain sendmmsg() if the kernel rejects it.
+    bool sendBatchUseGSO;
+
+    /// Linux only: bind this many sockets to the same port with SO_REUSEPORT, each with its own receive thread.
+    /// The kernel spreads incoming datagrams across them by sender address, and each connection replies through the socket its datagrams arrive on.
+    /// Pair with RakPeer::SetUpdateWorkerCount() so the update work scales too. 1 (default) binds one socket. Clamped to RNS2_MAXIMUM_REUSEPORT_SOCKETS.
+    /// \pre CRABNET_SUPPORT_REUSEPORT must be set to 1 in RakNetDefines.h, otherwise this is ignored
+    unsigned short reusePortSocketCount;
 };
 
 extern bool NonNumericHostString( const char *host );
@@ -425,6 +449,10 @@ struct Packet
     /// @internal
     /// If true, this message is meant for the user, not for the plugins, so do not process it through plugins
     bool wasGeneratedLocally;
+
+    /// @internal
+    /// If not 0, data points into this received datagram rather than being allocated. See RakPeerInterface::SetZeroCopyReceive()
+    RNS2RecvStruct *receiveBuffer;
 };
 
 ///  Index of an unassigned player
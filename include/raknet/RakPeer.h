@@ -36,6 +36,9 @@
 #include "NativeFeatureIncludes.h"
 #include "SecureHandshake.h"
 #include "DS_Queue.h"
+#include "DS_TimerWheel.h"
+#include "DS_LockFreeRing.h"
+#include "Rand.h"
 
 namespace RakNet {
 /// Forward declarations
@@ -121,6 +124,26 @@ public:
     /// \return Maximum number of incoming connections, which is always <= maxConnections
     unsigned int GetMaximumIncomingConnections( void ) const;
 
+    /// \brief Splits the reliability layer work of connections across \a workerCount threads.
+    /// \details Each connection is pinned to one worker by its system index. Defaults to 1, which does all the work on the update thread.
+    /// Only takes effect when called before Startup(), and is ignored when RAKPEER_USER_THREADED is 1.
+    /// \note Plugin callbacks made from the reliability layer, such as OnInternalPacket() and OnReliabilityLayerNotification(),
+    /// may run on a worker thread when \a workerCount is more than 1.
+    /// \param[in] workerCount Number of threads, including the update thread. Clamped to 1..CRABNET_MAXIMUM_UPDATE_WORKERS
+    void SetUpdateWorkerCount( unsigned int workerCount );
+
+    /// \brief Sets how many received datagrams may wait for the update thread, or for each update worker.
+    /// \details Datagrams arriving while that many are waiting are dropped and counted in RakNetStatistics::receiveQueueDropped.
+    /// Only takes effect when called before Startup(). Defaults to CRABNET_BUFFERED_PACKETS_QUEUE_SIZE.
+    /// \param[in] size Rounded up to a power of two
+    void SetReceiveQueueSize( unsigned int size );
+
+    /// \brief Keeps messages that fit in one datagram in the buffer they were received into, all the way to the Packet returned by Receive().
+    /// \details Only user messages are passed on this way; messages RakPeer handles itself are still copied.
+    /// The receive buffer is reused once DeallocatePacket() is called, so holding many packets keeps many buffers of MAXIMUM_MTU_SIZE bytes.
+    /// Applies to datagrams received after the call. Defaults to false.
+    void SetZeroCopyReceive( bool enabled );
+
     /// \brief Returns how many open connections exist at this time.
     /// \return Number of open connections.
     unsigned short NumberOfConnections(void) const;
@@ -265,6 +288,23 @@ public:
     /// \return 0 on bad input. Otherwise a number that identifies this message. If \a reliability is a type that returns a receipt, on a later call to Receive() you will get ID_SND_RECEIPT_ACKED or ID_SND_RECEIPT_LOSS with bytes 1-4 inclusive containing this number
     uint32_t SendList( const char **data, const int *lengths, const int numParameters, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, uint32_t forceReceiptNumber=0 );
 
+    /// \brief Sends a block of data to the specified system that you are connected to, without copying it.
+    ///
+    /// Same as Send(), but \a data is referenced until RakNet is done with it, including by every part of a large message that is split. Then \a releaseCallback is called.
+    /// \note Do not change or free \a data until \a releaseCallback is called. It is called exactly once, also if the send fails, and may be called from a RakNet thread before this returns.
+    /// \param[in] data Block of data to send.
+    /// \param[in] length Size in bytes of the data to send.
+    /// \param[in] releaseCallback Called with \a data and \a userData once RakNet no longer references \a data.
+    /// \param[in] userData Passed to \a releaseCallback.
+    /// \param[in] priority Priority level to send on.  See PacketPriority.h
+    /// \param[in] reliability How reliably to send this data.  See PacketPriority.h
+    /// \param[in] orderingChannel Channel to order the messages on, when using ordered or sequenced messages. Messages are only ordered relative to other messages on the same stream.
+    /// \param[in] systemIdentifier System Address or RakNetGUID to send this packet to, or in the case of broadcasting, the address not to send it to.  Use UNASSIGNED_SYSTEM_ADDRESS to specify none.
+    /// \param[in] broadcast True to send this packet to all connected systems. If true, then systemAddress specifies who not to send the packet to.
+    /// \param[in] forceReceipt If 0, will automatically determine the receipt number to return. If non-zero, will return what you give it.
+    /// \return 0 on bad input. Otherwise a number that identifies this message. If \a reliability is a type that returns a receipt, on a later call to Receive() you will get ID_SND_RECEIPT_ACKED or ID_SND_RECEIPT_LOSS with bytes 1-4 inclusive containing this number
+    uint32_t SendNoCopy( const char *data, const int length, SendReleaseCallback releaseCallback, void *userData, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, uint32_t forceReceiptNumber=0 );
+
     /// \brief Gets a message from the incoming message queue.
     /// \details Use DeallocatePacket() to deallocate the message after you are done with it.
     /// User-thread functions, such as RPC calls and the plugin function PluginInterface::Update occur here.
@@ -277,6 +317,19 @@ public:
     /// \param[in] packet Message to deallocate.
     void DeallocatePacket( Packet *packet );
 
+    /// \brief Gets up to \a maxPackets messages from the incoming message queue at once.
+    /// \details Plugins see each message as they would with Receive(), but PluginInterface::Update runs once per call
+    /// and the queue is locked once per call instead of once per message.
+    /// \param[out] packets Array of at least \a maxPackets pointers, filled from the front.
+    /// \param[in] maxPackets Size of \a packets.
+    /// \return Number of messages written to \a packets. 0 if none are waiting.
+    unsigned int ReceiveBatch( Packet **packets, unsigned int maxPackets );
+
+    /// \brief Call this to deallocate messages returned by ReceiveBatch() when you are done handling them.
+    /// \param[in] packets Messages to deallocate. Null entries are skipped.
+    /// \param[in] packetCount Number of entries in \a packets.
+    void DeallocatePacketBatch( Packet **packets, unsigned int packetCount );
+
     /// \brief Return the total number of connections we are allowed.
     /// \return Total number of connections allowed.
     unsigned int GetMaximumNumberOfPeers( void ) const;
@@ -463,6 +516,42 @@ public:
     /// \return Timeout time for a given system.
     RakNet::TimeMS GetTimeoutTime( const SystemAddress target );
 
+    /// \brief Choose how a connection decides how fast to send.
+    /// \details Each end of a connection chooses for its own sends, so both ends may differ.
+    /// A connected system switches on its next update and keeps its datagram numbering, so this may be called at any time.
+    /// \param[in] algorithm See CongestionControlAlgorithm.
+    /// \param[in] target SystemAddress structure of the target system. Pass UNASSIGNED_SYSTEM_ADDRESS for all systems, including those that connect later.
+    void SetCongestionControl( CongestionControlAlgorithm algorithm, const SystemAddress target );
+
+    /// \brief Returns the congestion control algorithm for the given system.
+    /// \param[in] target Target system. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value.
+    /// \return Congestion control algorithm for a given system.
+    CongestionControlAlgorithm GetCongestionControl( const SystemAddress target );
+
+    /// \brief Spread each connection's datagrams out at the rate its congestion control estimates.
+    /// \details Without pacing, each update sends everything congestion control allows at once.
+    /// \param[in] enabled True to pace sends.
+    /// \param[in] target SystemAddress structure of the target system. Pass UNASSIGNED_SYSTEM_ADDRESS for all systems, including those that connect later.
+    void SetPacing( bool enabled, const SystemAddress target );
+
+    /// \brief Returns if sends to the given system are paced.
+    /// \param[in] target Target system. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value.
+    /// \return True if paced.
+    bool GetPacing( const SystemAddress target );
+
+    /// \brief Follow every \a groupSize UNRELIABLE_SEQUENCED messages sent on \a orderingChannel with a parity message.
+    /// \details The remote system can rebuild one lost message per group from the parity.
+    /// \param[in] orderingChannel The ordering channel, 0 to 31.
+    /// \param[in] groupSize Messages per parity, 2 to 32. 0 to turn it off.
+    /// \param[in] target SystemAddress structure of the target system. Pass UNASSIGNED_SYSTEM_ADDRESS for all systems, including those that connect later.
+    void SetForwardErrorCorrection( unsigned char orderingChannel, unsigned int groupSize, const SystemAddress target );
+
+    /// \brief Returns messages per parity on the given channel, or 0 if off.
+    /// \param[in] orderingChannel The ordering channel, 0 to 31.
+    /// \param[in] target Target system. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value.
+    /// \return Messages per parity.
+    unsigned int GetForwardErrorCorrection( unsigned char orderingChannel, const SystemAddress target );
+
     /// \brief Returns the current MTU size
     /// \param[in] target Which system to get MTU for.  UNASSIGNED_SYSTEM_ADDRESS to get the default
     /// \return The current MTU size of the target system.
@@ -639,6 +728,10 @@ public:
     // );
     bool RunUpdateCycle( BitStream &updateBitStream );
 
+    /// \internal
+    // How long UpdateNetworkLoop may sleep after RunUpdateCycle, in milliseconds
+    int GetUpdateThreadWaitTime(void);
+
     /// \internal
     // Call manually if RAKPEER_USER_THREADED==1 at least every 30 milliseconds.
     // Call in a loop until returns false if the socket is non-blocking
@@ -680,6 +773,7 @@ public:
         // Reference counted socket to send back on
         RakNetSocket2* rakNetSocket;
         SystemIndex remoteSystemIndex;
+        bool isDueInShard; /// Set while this system is on its update worker's dueRemoteSystems list
 
 #ifdef LIBCAT_SECURITY
         // Cached answer used internally by RakPeer to prevent DoS attacks based on the connexion handshake
@@ -699,12 +793,13 @@ public:
 protected:
 
     friend RAK_THREAD_DECLARATION(UpdateNetworkLoop);
+    friend RAK_THREAD_DECLARATION(UpdateWorkerLoop);
     //friend RAK_THREAD_DECLARATION(RecvFromLoop);
     friend RAK_THREAD_DECLARATION(UDTConnect);
 
     friend bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char *data, unsigned int length, RakPeer *rakPeer, RakNetSocket2* rakNetSocket, bool *isOfflineMessage, RakNet::TimeUS timeRead );
     friend void ProcessNetworkPacket( const SystemAddress systemAddress, const char *data, unsigned int length, RakPeer *rakPeer, RakNet::TimeUS timeRead, BitStream &updateBitStream );
-    friend void ProcessNetworkPacket( const SystemAddress systemAddress, const char *data, unsigned int length, RakPeer *rakPeer, RakNetSocket2* rakNetSocket, RakNet::TimeUS timeRead, BitStream &updateBitStream );
+    friend void ProcessNetworkPacket( const SystemAddress systemAddress, const char *data, unsigned int length, RakPeer *rakPeer, RakNetSocket2* rakNetSocket, RakNet::TimeUS timeRead, BitStream &updateBitStream, RNS2RecvStruct *receiveBuffer );
 
     int GetIndexFromSystemAddress( const SystemAddress systemAddress, bool calledFromNetworkThread ) const;
     int GetIndexFromGuid( const RakNetGUID guid );
@@ -780,6 +875,63 @@ protected:
     /// Threadsafe because RemoteSystemStruct is preallocated, and the list is only added to, not removed from
     RemoteSystemStruct** activeSystemList;
     unsigned int activeSystemListSize;
+    /// When each active system next needs RunUpdateCycle, by remoteSystemIndex, in milliseconds. Only used by the network thread
+    DataStructures::TimerWheel remoteSystemTimers;
+    /// Systems taken from remoteSystemTimers by the current RunUpdateCycle
+    DataStructures::List<unsigned int> dueRemoteSystems;
+
+    struct BufferedCommandStruct;
+    /// \internal
+    /// \brief The connections pinned to one update worker, RemoteSystemLookupHashIndex(systemAddress) % updateWorkerCount
+    struct UpdateShard
+    {
+        RakPeer *rakPeer;
+        unsigned int shardIndex;
+        /// Datagrams from senders that hash to this shard. Pushed by the receive threads, popped by the worker
+        DataStructures::LockFreeRing<RNS2RecvStruct*> receivedDatagrams;
+        /// Sends for this shard's connections, and a copy of each broadcast. Pushed by the user threads, popped by the worker
+        DataStructures::Queue<BufferedCommandStruct*> bufferedCommands;
+        SimpleMutex bufferedCommandsMutex;
+        /// This shard's part of dueRemoteSystems, followed by the systems the worker received from or sent to
+        DataStructures::List<unsigned int> dueRemoteSystems;
+        /// How many of dueRemoteSystems came from remoteSystemTimers
+        unsigned int numTimedRemoteSystems;
+        BitStream updateBitStream;
+        RakNetRandom rnr;
+        SignaledEvent startEvent;
+        std::atomic<bool> hasWork;
+        std::atomic<bool> isThreadActive;
+    };
+    /// Set by SetUpdateWorkerCount(). Shard 0 runs on the update thread, the others on their own threads
+    unsigned int updateWorkerCount;
+    UpdateShard *updateShards;
+    /// Time passed to the shards for the cycle in progress
+    RakNet::TimeUS updateShardsTimeUS;
+    std::atomic<unsigned int> updateShardsPending;
+    std::atomic<bool> endUpdateWorkers;
+    /// Set once the shards exist, so the receive and user threads can push to them
+    std::atomic<bool> updateShardsRunning;
+    SignaledEvent updateShardsDoneEvent;
+    bool StartUpdateWorkers(int threadPriority);
+    void StopUpdateWorkers(void);
+    unsigned int GetUpdateShardIndex(const SystemAddress &sa) const;
+    bool UpdateShardHasWork(UpdateShard *shard);
+    void AddShardRemoteSystem(UpdateShard *shard, RemoteSystemStruct *remoteSystem);
+    void ProcessShardDatagram(UpdateShard *shard, RNS2RecvStruct *recvStruct);
+    void RunUpdateShard(UpdateShard *shard);
+    void UpdateDueRemoteSystems(RakNet::TimeUS timeUS, BitStream &updateBitStream);
+
+    /// Set by SetZeroCopyReceive(). Read by whichever thread hands datagrams to the reliability layer
+    std::atomic<bool> zeroCopyReceive;
+    /// Set by SetCongestionControl(UNASSIGNED_SYSTEM_ADDRESS). Read by the update thread when a system connects
+    std::atomic<CongestionControlAlgorithm> defaultCongestionControl;
+    /// Set by SetPacing(UNASSIGNED_SYSTEM_ADDRESS). Read by the update thread when a system connects
+    std::atomic<bool> defaultPacing;
+    /// Set by SetForwardErrorCorrection(UNASSIGNED_SYSTEM_ADDRESS). Read by the update thread when a system connects
+    std::atomic<unsigned char> defaultFecGroupSizes[NUMBER_OF_ORDERED_STREAMS];
+    /// Takes the next message from remoteSystem's reliability layer. Only user messages keep pointing into their
+    /// receive buffer; everything RakPeer handles itself is copied, so it can be released with free()
+    BitSize_t ReceiveFromReliabilityLayer(RemoteSystemStruct *remoteSystem, unsigned char **data, RNS2RecvStruct **receiveBuffer);
 
     // Use a hash, with binaryAddress plus port mod length as the index
     RemoteSystemIndex **remoteSystemLookup;
@@ -886,6 +1038,9 @@ protected:
         RakNetSocket2* socket;
         unsigned short port;
         uint32_t receipt;
+        // Only for BCS_SEND. If set, data belongs to the application and is handed back through this rather than freed
+        SendReleaseCallback releaseCallback;
+        void *releaseUserData;
         enum {BCS_SEND, BCS_CLOSE_CONNECTION, BCS_GET_SOCKET, BCS_CHANGE_SYSTEM_ADDRESS,/* BCS_USE_USER_SOCKET, BCS_REBIND_SOCKET_ADDRESS, BCS_RPC, BCS_RPC_SHIFT,*/ BCS_DO_NOTHING} command;
     };
 
@@ -897,15 +1052,21 @@ protected:
 
     // DataStructures::ThreadsafeAllocatingQueue<RNS2RecvStruct> bufferedPackets;
 
-    DataStructures::Queue<RNS2RecvStruct*> bufferedPacketsFreePool;
-    RakNet::SimpleMutex bufferedPacketsFreePoolMutex;
-    DataStructures::Queue<RNS2RecvStruct*> bufferedPacketsQueue;
-    RakNet::SimpleMutex bufferedPacketsQueueMutex;
+    // Receive threads push datagrams and the update thread pops them. Neither ring takes a lock
+    DataStructures::LockFreeRing<RNS2RecvStruct*> bufferedPacketsFreePool;
+    DataStructures::LockFreeRing<RNS2RecvStruct*> bufferedPacketsQueue;
+    /// Datagrams thrown away because bufferedPacketsQueue or a shard's receivedDatagrams was full
+    std::atomic<uint64_t> bufferedPacketsDropped;
+    /// Set by SetReceiveQueueSize(). Capacity of bufferedPacketsQueue, bufferedPacketsFreePool and each shard's receivedDatagrams
+    unsigned int receiveQueueSize;
+    /// Contention on the receivedDatagrams rings of shards that were already stopped
+    std::atomic<uint64_t> updateShardsReceiveContention;
 
     virtual void DeallocRNS2RecvStruct(RNS2RecvStruct *s);
     virtual RNS2RecvStruct *AllocRNS2RecvStruct();
     void SetupBufferedPackets(void);
     void PushBufferedPacket(RNS2RecvStruct * p);
+    void PushReceivedDatagram(RNS2RecvStruct * p);
     RNS2RecvStruct *PopBufferedPacket(void);
 
     struct SocketQueryOutput
@@ -924,8 +1085,12 @@ protected:
     // This stores the user send calls to be handled by the update thread.  This way we don't have thread contention over systemAddresss
     void CloseConnectionInternal( const AddressOrGUID& systemIdentifier, bool sendDisconnectionNotification, bool performImmediate, unsigned char orderingChannel, PacketPriority disconnectionNotificationPriority );
     void SendBuffered( const char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, RemoteSystemStruct::ConnectMode connectionMode, uint32_t receipt );
+    void SendBufferedNoCopy( const char *data, BitSize_t numberOfBitsToSend, SendReleaseCallback releaseCallback, void *releaseUserData, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, uint32_t receipt );
     void SendBufferedList( const char **data, const int *lengths, const int numParameters, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, RemoteSystemStruct::ConnectMode connectionMode, uint32_t receipt );
-    bool SendImmediate( char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, bool useCallerDataAllocation, RakNet::TimeUS currentTime, uint32_t receipt );
+    bool SendImmediate( char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, bool useCallerDataAllocation, RakNet::TimeUS currentTime, uint32_t receipt, SendReleaseCallback releaseCallback=0, void *releaseUserData=0, UpdateShard *shard=0 );
+    void PushBufferedCommand(BufferedCommandStruct *bcs);
+    void RunBufferedSend(BufferedCommandStruct *bcs, RakNet::TimeUS currentTime, UpdateShard *shard);
+    bool HasBufferedCommands(void);
     //bool HandleBufferedRPC(BufferedCommandStruct *bcs, RakNet::TimeMS time);
     void ClearBufferedCommands(void);
     void ClearBufferedPackets(void);
@@ -942,6 +1107,9 @@ protected:
 
     // Smart pointer so I can return the object to the user
     DataStructures::List<RakNetSocket2* > socketList;
+    /// Sockets sharing a port with a socketList entry through SO_REUSEPORT, from SocketDescriptor::reusePortSocketCount.
+    /// Not returned by GetSockets(). Connections whose datagrams arrive on one of these reply through it
+    DataStructures::List<RakNetSocket2* > reusePortSocketList;
     void DerefAllSockets(void);
     unsigned int GetRakNetSocketFromUserConnectionSocketIndex(unsigned int userIndex) const;
 
@@ -983,11 +1151,10 @@ protected:
 
 
     SignaledEvent quitAndDataEvents;
+    /// True while the update thread sleeps longer than the old 10 millisecond poll, so buffered commands must wake it
+    std::atomic<bool> updateThreadIsWaitingLong;
     bool limitConnectionFrequencyFromTheSameIP;
 
-    SimpleMutex packetAllocationPoolMutex;
-    DataStructures::MemoryPool<Packet> packetAllocationPool;
-
     SimpleMutex packetReturnMutex;
     DataStructures::Queue<Packet*> packetReturnQueue;
     Packet *AllocPacket(unsigned dataSize);
@@ -1001,6 +1168,8 @@ protected:
     void ResetSendReceipt(void);
     void OnConnectedPong(RakNet::Time sendPingTime, RakNet::Time sendPongTime, RemoteSystemStruct *remoteSystem);
     void CallPluginCallbacks(DataStructures::List<PluginInterface2*> &pluginList, Packet *packet);
+    /// Shifts the timestamp and gives plugins the packet. Returns false if a plugin kept or deallocated it
+    bool FilterReceivedPacket(Packet *packet);
 
 #ifdef LIBCAT_SECURITY
     // Encryption and security
@@ -1011,6 +1180,12 @@ protected:
     bool InitializeClientSecurity(RequestedConnectionStruct *rcs, const char *public_key);
 #endif
     virtual void OnRNS2Recv(RNS2RecvStruct *recvStruct);
+    virtual void OnRNS2RecvBatch(RNS2RecvStruct **recvStructs, unsigned int count);
+    void FillSocketStatistics(RakNetSocket2 *s, RakNetStatistics *rns) const;
+    void FillReceiveQueueStatistics(RakNetStatistics *rns) const;
+    void SignalBufferedCommand(bool immediate);
+    void ScheduleRemoteSystemUpdate(RemoteSystemStruct *remoteSystem);
+    RakNet::TimeUS GetRemoteSystemTimeToNextUpdate(RemoteSystemStruct *remoteSystem, RakNet::TimeUS timeUS, RakNet::TimeMS timeMS);
     void FillIPList(void);
 } 
 // #if defined(SN_TARGET_PSP2)
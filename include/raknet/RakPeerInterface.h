@@ -24,6 +24,7 @@
 #include "DS_List.h"
 #include "RakNetSmartPtr.h"
 #include "RakNetSocket2.h"
+#include "CCRakNetCongestionControl.h"
 
 namespace RakNet
 {
@@ -103,6 +104,24 @@ public:
     /// \return the maximum number of incoming connections, which is always <= maxConnections
     virtual unsigned int GetMaximumIncomingConnections( void ) const=0;
 
+    /// Splits the reliability layer work of connections across \a workerCount threads. Each connection stays on one worker
+    /// for its lifetime. Defaults to 1, which does all the work on the update thread.
+    /// Only takes effect when called before Startup(). Plugin callbacks made from the reliability layer, such as
+    /// OnInternalPacket() and OnReliabilityLayerNotification(), may run on a worker thread when \a workerCount is more than 1
+    /// \param[in] workerCount Number of threads, including the update thread. Clamped to 1..CRABNET_MAXIMUM_UPDATE_WORKERS
+    virtual void SetUpdateWorkerCount( unsigned int workerCount )=0;
+
+    /// How many received datagrams may wait for the update thread, or for each update worker. Datagrams arriving while that many
+    /// are waiting are dropped and counted in RakNetStatistics::receiveQueueDropped; reliable messages in them are resent by the sender.
+    /// Only takes effect when called before Startup(). Defaults to CRABNET_BUFFERED_PACKETS_QUEUE_SIZE
+    /// \param[in] size Rounded up to a power of two
+    virtual void SetReceiveQueueSize( unsigned int size )=0;
+
+    /// When enabled, a message that fits in one datagram is not copied out of the buffer it was received into.
+    /// The Packet returned by Receive() points into that buffer, which is reused once DeallocatePacket() is called.
+    /// Holding many such packets keeps their receive buffers, of MAXIMUM_MTU_SIZE bytes each, from being reused. Defaults to false
+    virtual void SetZeroCopyReceive( bool enabled )=0;
+
     /// Returns how many open connections there are at this time
     /// \return the number of open connections
     virtual unsigned short NumberOfConnections(void) const=0;
@@ -238,6 +257,22 @@ public:
     /// \return 0 on bad input. Otherwise a number that identifies this message. If \a reliability is a type that returns a receipt, on a later call to Receive() you will get ID_SND_RECEIPT_ACKED or ID_SND_RECEIPT_LOSS with bytes 1-4 inclusive containing this number
     virtual uint32_t SendList( const char **data, const int *lengths, const int numParameters, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, uint32_t forceReceiptNumber=0 )=0;
 
+    /// Sends a block of data to the specified system that you are connected to, without copying it. Same as Send(), but \a data is referenced until RakNet is done with it,
+    /// including by every part of a large message that is split. Then \a releaseCallback is called.
+    /// Do not change or free \a data until \a releaseCallback is called. It is called exactly once, also if the send fails, and may be called from a RakNet thread before this returns.
+    /// \param[in] data The block of data to send
+    /// \param[in] length The size in bytes of the data to send
+    /// \param[in] releaseCallback Called with \a data and \a userData once RakNet no longer references \a data
+    /// \param[in] userData Passed to \a releaseCallback
+    /// \param[in] priority What priority level to send on.  See PacketPriority.h
+    /// \param[in] reliability How reliability to send this data.  See PacketPriority.h
+    /// \param[in] orderingChannel When using ordered or sequenced messages, what channel to order these on. Messages are only ordered relative to other messages on the same stream
+    /// \param[in] systemIdentifier Who to send this packet to, or in the case of broadcasting who not to send it to. Pass either a SystemAddress structure or a RakNetGUID structure. Use UNASSIGNED_SYSTEM_ADDRESS or to specify none
+    /// \param[in] broadcast True to send this packet to all connected systems. If true, then systemAddress specifies who not to send the packet to.
+    /// \param[in] forceReceipt If 0, will automatically determine the receipt number to return. If non-zero, will return what you give it.
+    /// \return 0 on bad input. Otherwise a number that identifies this message. If \a reliability is a type that returns a receipt, on a later call to Receive() you will get ID_SND_RECEIPT_ACKED or ID_SND_RECEIPT_LOSS with bytes 1-4 inclusive containing this number
+    virtual uint32_t SendNoCopy( const char *data, const int length, SendReleaseCallback releaseCallback, void *userData, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, uint32_t forceReceiptNumber=0 )=0;
+
     /// Gets a message from the incoming message queue.
     /// Use DeallocatePacket() to deallocate the message after you are done with it.
     /// User-thread functions, such as RPC calls and the plugin function PluginInterface::Update occur here.
@@ -247,9 +282,23 @@ public:
     virtual Packet* Receive( void )=0;
 
     /// Call this to deallocate a message returned by Receive() when you are done handling it.
+    /// \note Small messages keep their data in the same block as the Packet, so do not free() or replace packet->data yourself.
+    /// Build with CRABNET_PACKET_INLINE_DATA_SIZE set to 0 if your application relies on that. See RakNetDefines.h
     /// \param[in] packet The message to deallocate.
     virtual void DeallocatePacket( Packet *packet )=0;
 
+    /// Gets up to \a maxPackets messages from the incoming message queue at once. Plugins see each message as they would with Receive(),
+    /// but PluginInterface::Update runs once per call and the queue is locked once per call instead of once per message.
+    /// \param[out] packets Array of at least \a maxPackets pointers, filled from the front
+    /// \param[in] maxPackets Size of \a packets
+    /// \return Number of messages written to \a packets. 0 if none are waiting. Free them with DeallocatePacketBatch() or DeallocatePacket()
+    virtual unsigned int ReceiveBatch( Packet **packets, unsigned int maxPackets )=0;
+
+    /// Call this to deallocate messages returned by ReceiveBatch() when you are done handling them.
+    /// \param[in] packets The messages to deallocate. Null entries are skipped
+    /// \param[in] packetCount Number of entries in \a packets
+    virtual void DeallocatePacketBatch( Packet **packets, unsigned int packetCount )=0;
+
     /// Return the total number of connections we are allowed
     virtual unsigned int GetMaximumNumberOfPeers( void ) const=0;
 
@@ -432,6 +481,41 @@ public:
     /// \return timeoutTime for a given system.
     virtual RakNet::TimeMS GetTimeoutTime( const SystemAddress target )=0;
 
+    /// Choose how a connection decides how fast to send. Each end of a connection chooses for its own sends, so both ends may differ.
+    /// A connected system switches on its next update and keeps its datagram numbering, so this may be called at any time.
+    /// The default is CC_SLIDING_WINDOW, or CC_UDT if USE_SLIDING_WINDOW_CONGESTION_CONTROL is 0.
+    /// \param[in] algorithm See CongestionControlAlgorithm. CC_BBR keeps its rate on random loss, which suits lossy wireless links
+    /// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS for all systems, including those that connect later.
+    virtual void SetCongestionControl( CongestionControlAlgorithm algorithm, const SystemAddress target )=0;
+
+    /// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value
+    /// \return The congestion control algorithm for a given system.
+    virtual CongestionControlAlgorithm GetCongestionControl( const SystemAddress target )=0;
+
+    /// Spread each connection's datagrams out at the rate its congestion control estimates, rather than sending all it allows at once.
+    /// Bursts that overflow small router buffers cause losses, which loss based congestion control then answers by sending slower.
+    /// Off by default. See RakNetStatistics::pacingDelays for how long the pacer holds data back.
+    /// \param[in] enabled True to pace sends
+    /// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS for all systems, including those that connect later.
+    virtual void SetPacing( bool enabled, const SystemAddress target )=0;
+
+    /// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value
+    /// \return If sends to the given system are paced.
+    virtual bool GetPacing( const SystemAddress target )=0;
+
+    /// Follow every \a groupSize UNRELIABLE_SEQUENCED messages sent on \a orderingChannel with a parity message, from which the remote system can rebuild any one of them that is lost.
+    /// Costs about one message in \a groupSize of extra bandwidth. Messages that are split are not covered, and a rebuilt message is dropped like any other late sequenced message if a newer one was already returned.
+    /// Off by default, and only used with systems that support it. See RakNetStatistics::fecMessagesRecovered.
+    /// \param[in] orderingChannel The ordering channel, 0 to 31
+    /// \param[in] groupSize Messages per parity, 2 to 32. 0 to turn it off
+    /// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS for all systems, including those that connect later.
+    virtual void SetForwardErrorCorrection( unsigned char orderingChannel, unsigned int groupSize, const SystemAddress target )=0;
+
+    /// \param[in] orderingChannel The ordering channel, 0 to 31
+    /// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value
+    /// \return Messages per parity on the given channel, or 0 if off.
+    virtual unsigned int GetForwardErrorCorrection( unsigned char orderingChannel, const SystemAddress target )=0;
+
     /// Returns the current MTU size
     /// \param[in] target Which system to get this for.  UNASSIGNED_SYSTEM_ADDRESS to get the default
     /// \return The current MTU size
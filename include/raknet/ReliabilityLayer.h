@@ -32,7 +32,6 @@
 #include "DS_BPlusTree.h"
 #include "DS_MemoryPool.h"
 #include "RakNetDefines.h"
-#include "DS_Heap.h"
 #include "BitStream.h"
 #include "NativeFeatureIncludes.h"
 #include "SecureHandshake.h"
@@ -40,14 +39,17 @@
 #include "Rand.h"
 #include "RakNetSocket2.h"
 #include "SplitPacketList.h"
+#include "ResendQueue.h"
+#include "DatagramHistory.h"
+#include "OutgoingQueue.h"
+#include "OrderingWindow.h"
+#include "FecChannel.h"
 
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL!=1
-#include "CCRakNetUDT.h"
-#define INCLUDE_TIMESTAMP_WITH_DATAGRAMS 1
-#else
-#include "CCRakNetSlidingWindow.h"
+#include "CCRakNetCongestionControl.h"
+#include <atomic>
+
+// The datagram header must not depend on the congestion controller, since each end of a connection may use a different one
 #define INCLUDE_TIMESTAMP_WITH_DATAGRAMS 0
-#endif
 
 /// Number of ordered streams available. You can use up to 32 ordered streams
 #define NUMBER_OF_ORDERED_STREAMS 32 // 2^5
@@ -59,7 +61,15 @@ namespace RakNet {
     /// Forward declarations
 class PluginInterface2;
 class RakNetRandom;
-typedef uint64_t reliabilityHeapWeightType;
+
+/// Optional parts of the wire format. Exchanged in ID_OPEN_CONNECTION_REQUEST_2 and ID_OPEN_CONNECTION_REPLY_2, and only used when both systems offer them
+enum ReliabilityFeature
+{
+    /// Send ACKs and NAKs with DataStructures::RangeList::SerializeBitmap()
+    RF_BITMAP_ACKS = 1 << 0,
+    /// Send FecChannel parity messages for ordering channels set with ReliabilityLayer::SetForwardErrorCorrection()
+    RF_FEC_PARITY = 1 << 1
+};
 
 // int SplitPacketIndexComp( SplitPacketIndexType const &key, InternalPacket* const &data );
 struct SplitPacketChannel//<SplitPacketChannel>
@@ -67,17 +77,6 @@ struct SplitPacketChannel//<SplitPacketChannel>
     CCTimeType lastUpdateTime;
 
     SplitPacketList splitPacketList;
-
-#if PREALLOCATE_LARGE_MESSAGES==1
-    InternalPacket *returnedPacket;
-    bool gotFirstPacket;
-    unsigned int stride;
-    unsigned int splitPacketsArrived;
-#else
-    // This is here for progress notifications, since progress notifications return the first packet data, if available
-    InternalPacket *firstPacket;
-#endif
-
 };
 int RAK_DLL_EXPORT SplitPacketChannelComp( SplitPacketIdType const &key, SplitPacketChannel* const &data );
 
@@ -138,6 +137,29 @@ public:
     /// \param[out] the value passed to SetTimeoutTime
     RakNet::TimeMS GetTimeoutTime(void);
 
+    /// Which congestion controller this connection uses. Takes effect on the next Update(), keeping the datagram numbering of the previous one
+    void SetCongestionControl( CongestionControlAlgorithm algorithm );
+
+    /// Returns the value passed to SetCongestionControl(), or the default for connections that never called it
+    CongestionControlAlgorithm GetCongestionControl(void) const;
+
+    /// Spread datagrams out at the rate congestion control estimates, instead of sending everything it allows at once each Update()
+    void SetPacing( bool enabled );
+
+    /// Returns the value passed to SetPacing()
+    bool GetPacing(void) const;
+
+    /// Follow every \a groupSize UNRELIABLE_SEQUENCED messages sent on \a orderingChannel with a parity message, from which the remote system can rebuild one of them if lost.
+    /// Only used if both systems agreed on RF_FEC_PARITY. 0 turns it off, which is the default
+    void SetForwardErrorCorrection( unsigned char orderingChannel, unsigned int groupSize );
+
+    /// Returns the value passed to SetForwardErrorCorrection()
+    unsigned int GetForwardErrorCorrection( unsigned char orderingChannel ) const;
+
+    /// ReliabilityFeature flags both systems agreed on when connecting. Reset() clears them
+    void SetReliabilityFeatures( unsigned char features );
+    unsigned char GetReliabilityFeatures(void) const;
+
     /// Packets are read directly from the socket layer and skip the reliability layer because unconnected players do not use the reliability layer
     /// This function takes packet data after a player has been confirmed as connected.
     /// \param[in] buffer The socket data
@@ -145,16 +167,19 @@ public:
     /// \param[in] systemAddress The player that this data is from
     /// \param[in] messageHandlerList A list of registered plugins
     /// \param[in] MTUSize maximum datagram size
+    /// \param[in] receiveBuffer If not 0, \a buffer is receiveBuffer->data. Messages that are not split then point into it instead of being copied
     /// \retval true Success
     /// \retval false Modified packet
     bool HandleSocketReceiveFromConnectedPlayer(
         const char *buffer, unsigned int length, SystemAddress &systemAddress, DataStructures::List<PluginInterface2*> &messageHandlerList, int MTUSize,
-        RakNetSocket2 *s, RakNetRandom *rnr, CCTimeType timeRead, BitStream &updateBitStream);
+        RakNetSocket2 *s, RakNetRandom *rnr, CCTimeType timeRead, BitStream &updateBitStream, RNS2RecvStruct *receiveBuffer);
 
     /// This allocates bytes and writes a user-level message to those bytes.
     /// \param[out] data The message
+    /// \param[out] receiveBuffer If not 0, \a data points into this datagram and the caller owns one reference to it instead of owning \a data.
+    /// Pass 0 to always get data that can be freed with free()
     /// \return Returns number of BITS put into the buffer
-    BitSize_t Receive( unsigned char**data );
+    BitSize_t Receive( unsigned char**data, RNS2RecvStruct **receiveBuffer );
 
     /// Puts data on the send queue
     /// \param[in] data The data to send
@@ -166,8 +191,10 @@ public:
     /// \param[in] MTUSize maximum datagram size
     /// \param[in] currentTime Current time, as per RakNet::GetTimeMS()
     /// \param[in] receipt This number will be returned back with ID_SND_RECEIPT_ACKED or ID_SND_RECEIPT_LOSS and is only returned with the reliability types that contain RECEIPT in the name
-    /// \return True or false for success or failure.
-    bool Send( char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, unsigned char orderingChannel, bool makeDataCopy, int MTUSize, CCTimeType currentTime, uint32_t receipt );
+    /// \param[in] releaseCallback If not 0, \a data is referenced rather than copied or freed, also by the parts of a split message, and handed to this once none of them needs it. \a makeDataCopy is ignored
+    /// \param[in] releaseUserData Passed to \a releaseCallback
+    /// \return True or false for success or failure. On failure \a releaseCallback was not called
+    bool Send( char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, unsigned char orderingChannel, bool makeDataCopy, int MTUSize, CCTimeType currentTime, uint32_t receipt, SendReleaseCallback releaseCallback=0, void *releaseUserData=0 );
 
     /// Call once per game cycle.  Handles internal lists and actually does the send.
     /// \param[in] s the communication  end point
@@ -208,11 +235,18 @@ public:
     /// Has a lot of time passed since the last ack
     bool AckTimeout(RakNet::Time curTime);
     CCTimeType GetNextSendTime(void) const;
+    /// How long until Update() has something to do for this connection, no more than \a maxWait
+    /// Used to put the update thread to sleep instead of polling
+    CCTimeType GetTimeToNextUpdate(CCTimeType time, CCTimeType maxWait) const;
     CCTimeType GetTimeBetweenPackets(void) const;
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
     CCTimeType GetAckPing(void) const;
 #endif
     RakNet::TimeMS GetTimeLastDatagramArrived(void) const {return timeLastDatagramArrived;}
+    /// AckTimeout() returns true once this time passes, unless another datagram arrives first
+    RakNet::TimeMS GetAckTimeoutTime(void) const {return timeLastDatagramArrived + timeoutTime;}
+    /// Reliable messages sent and not acknowledged yet. While there are any, Update() kills the connection on AckTimeout()
+    unsigned int GetMessagesInResendBuffer(void) const {return statistics.messagesInResendBuffer;}
 
     // If true, will update time between packets quickly based on ping calculations
     //void SetDoFastThroughputReactions(bool fast);
@@ -233,7 +267,7 @@ private:
 
 
     /// Parse a bitstream and create an internal packet to represent this data
-    InternalPacket* CreateInternalPacketFromBitStream( RakNet::BitStream *bitStream, CCTimeType time );
+    InternalPacket* CreateInternalPacketFromBitStream( RakNet::BitStream *bitStream, CCTimeType time, RNS2RecvStruct *receiveBuffer );
 
     /// Does what the function name says
     unsigned RemovePacketFromResendListAndDeleteOlderReliableSequenced( const MessageNumberType messageNumber, CCTimeType time, DataStructures::List<PluginInterface2*> &messageHandlerList, const SystemAddress &systemAddress );
@@ -333,26 +367,8 @@ private:
     int splitMessageProgressInterval;
     CCTimeType unreliableTimeout;
 
-    struct MessageNumberNode
-    {
-        DatagramSequenceNumberType messageNumber;
-        MessageNumberNode *next;
-    };
-    struct DatagramHistoryNode
-    {
-        DatagramHistoryNode(): head(nullptr), timeSent(0) {}
-        DatagramHistoryNode(MessageNumberNode *_head, CCTimeType ts
-            ) :
-        head(_head), timeSent(ts)
-        {}
-        MessageNumberNode *head;
-        CCTimeType timeSent;
-    };
-    // Queue length is programmatically restricted to DATAGRAM_MESSAGE_ID_ARRAY_LENGTH
-    // This is essentially an O(1) lookup to get a DatagramHistoryNode given an index
-    // datagramHistory holds a linked list of MessageNumberNode. Each MessageNumberNode refers to one element in resendList which can be cleared on an ack.
-    DataStructures::Queue<DatagramHistoryNode> datagramHistory;
-    DataStructures::MemoryPool<MessageNumberNode> datagramHistoryMessagePool;
+    // O(1) lookup of the reliable messages sent in a datagram, given its datagram number. Each message number refers to one element in resendQueue which can be cleared on an ack.
+    DatagramHistory datagramHistory;
 
     struct UnreliableWithAckReceiptNode
     {
@@ -366,17 +382,11 @@ private:
     };
     DataStructures::List<UnreliableWithAckReceiptNode> unreliableWithAckReceiptHistory;
 
-    void RemoveFromDatagramHistory(DatagramSequenceNumberType index);
-    MessageNumberNode* GetMessageNumberNodeByDatagramIndex(DatagramSequenceNumberType index, CCTimeType *timeSent);
-    void AddFirstToDatagramHistory(DatagramSequenceNumberType datagramNumber, CCTimeType timeSent);
-    MessageNumberNode* AddFirstToDatagramHistory(DatagramSequenceNumberType datagramNumber, DatagramSequenceNumberType messageNumber, CCTimeType timeSent);
-    MessageNumberNode* AddSubsequentToDatagramHistory(MessageNumberNode *messageNumberNode, DatagramSequenceNumberType messageNumber);
-    DatagramSequenceNumberType datagramHistoryPopCount;
+    MessageNumberType *AddToDatagramHistory(DatagramSequenceNumberType datagramNumber, CCTimeType timeSent, unsigned int messageCount);
 
     DataStructures::MemoryPool<InternalPacket> internalPacketPool;
     // DataStructures::BPlusTree<DatagramSequenceNumberType, InternalPacket*, RESEND_TREE_ORDER> resendTree;
-    InternalPacket *resendBuffer[RESEND_BUFFER_ARRAY_LENGTH];
-    InternalPacket *resendLinkedListHead;
+    ResendQueue resendQueue;
     InternalPacket *unreliableLinkedListHead;
     void RemoveFromUnreliableLinkedList(InternalPacket *internalPacket);
     void AddToUnreliableLinkedList(InternalPacket *internalPacket);
@@ -400,15 +410,14 @@ private:
 //    CCTimeType lastPacketlossTime;
 
     //DataStructures::Queue<InternalPacket*> sendPacketSet[ NUMBER_OF_PRIORITIES ];
-    DataStructures::Heap<reliabilityHeapWeightType, InternalPacket*, false> outgoingPacketBuffer;
-    reliabilityHeapWeightType outgoingPacketBufferNextWeights[NUMBER_OF_PRIORITIES];
-    void InitHeapWeights(void);
-    reliabilityHeapWeightType GetNextWeight(int priorityLevel);
+    OutgoingQueue outgoingPacketBuffer;
 //    unsigned int messageInSendBuffer[NUMBER_OF_PRIORITIES];
 //    double bytesInSendBuffer[NUMBER_OF_PRIORITIES];
 
 
     DataStructures::OrderedList<SplitPacketIdType, SplitPacketChannel*, SplitPacketChannelComp> splitPacketChannelList;
+    // Bytes held by splitPacketChannelList, limited by CRABNET_MAX_SPLIT_BYTES_PER_CONNECTION
+    uint64_t splitPacketBytesReserved;
 
     MessageNumberType sendReliableMessageNumberIndex;
     MessageNumberType internalOrderIndex;
@@ -434,11 +443,10 @@ private:
     //    If a message has a greater ordering index, and is sequenced or ordered, buffer it
     //    If a message has the current ordering index, and is ordered, buffer, then push off messages from buffer
     // 5. Pushing off messages from buffer:
-    //    Messages in buffer are put in a minheap. The value of each node is calculated such that messages are returned:
+    //    Messages in buffer are put in an OrderingWindow slot for their ordering index. Messages are returned:
     //    A. (lowest ordering index, lowest sequence index)
     //    B. (lowest ordering index, no sequence index)
-    //    Messages are pushed off until the heap is empty, or the next message to be returned does not preserve the ordered index
-    //    For an empty heap, the heap weight should start at the lowest value based on the next expected ordering index, to avoid variable overflow
+    //    Messages are pushed off until the slot for the next expected ordering index is empty
 
     // Sender increments this by 1 for every ordered message sent
     OrderingIndexType orderedWriteIndex[NUMBER_OF_ORDERED_STREAMS];
@@ -448,8 +456,14 @@ private:
     OrderingIndexType orderedReadIndex[NUMBER_OF_ORDERED_STREAMS];
     // Highest value received for sequencedWriteIndex for the current value of orderedReadIndex on the same channel.
     OrderingIndexType highestSequencedReadIndex[NUMBER_OF_ORDERED_STREAMS];
-    DataStructures::Heap<reliabilityHeapWeightType, InternalPacket*, false> orderingHeaps[NUMBER_OF_ORDERED_STREAMS];
-    OrderingIndexType heapIndexOffsets[NUMBER_OF_ORDERED_STREAMS];
+    OrderingWindow orderingWindows[NUMBER_OF_ORDERED_STREAMS];
+
+    // Set from the user thread by SetForwardErrorCorrection()
+    std::atomic<unsigned char> fecGroupSizes[NUMBER_OF_ORDERED_STREAMS];
+    FecChannel fecChannels[NUMBER_OF_ORDERED_STREAMS];
+    // Parity completed since the last Update(). Queued after that Update() sent its datagrams, so it does not share one with the message that completed the group
+    DataStructures::List<InternalPacket*> fecPendingParity;
+    void QueueFecParity( unsigned char orderingChannel, PacketPriority priority, CCTimeType time );
 
 
 
@@ -520,11 +534,24 @@ private:
     CCTimeType nextAckTimeToSend;
 
 
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL==1
-    RakNet::CCRakNetSlidingWindow congestionManager;
-#else
-    RakNet::CCRakNetUDT congestionManager;
-#endif
+    RakNet::CCRakNetCongestionControl *congestionManager;
+    // Set from the user thread by SetCongestionControl(), applied on the next Update()
+    std::atomic<CongestionControlAlgorithm> requestedCongestionControl;
+    void ApplyRequestedCongestionControl(CCTimeType time);
+
+    // Set from the user thread by SetPacing()
+    std::atomic<bool> pacingEnabled;
+    unsigned char reliabilityFeatures;
+    // Bytes that may still be sent before the pacer holds data back. Goes negative when a datagram overshoots
+    double pacingBudget;
+    // Refill rate of pacingBudget, per CCTimeType unit. 0 while pacing is not limiting sends
+    double pacingBytesPerTick;
+    CCTimeType lastPacingRefill;
+    // When the pacer started holding back the data that is still waiting. 0 if none is
+    CCTimeType pacingHoldStart;
+    void ApplyPacing(CCTimeType time, int *transmissionBandwidth, int *retransmissionBandwidth);
+    void RecordPacingDelay(CCTimeType time, bool sentDatagrams);
+    CCTimeType GetNextPacedSendTime(void) const;
 
 
     uint32_t unacknowledgedBytes;
@@ -536,10 +563,6 @@ private:
     void PushDatagram(void);
     bool TagMostRecentPushAsSecondOfPacketPair(void);
     void ClearPacketsAndDatagrams(void);
-    void MoveToListHead(InternalPacket *internalPacket);
-    void RemoveFromList(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes);
-    void AddToListTail(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes);
-    void PopListHead(bool modifyUnacknowledgedBytes);
     bool IsResendQueueEmpty(void) const;
     void SortSplitPacketList(DataStructures::List<InternalPacket*> &data, unsigned int leftEdge, unsigned int rightEdge) const;
     void SendACKs(RakNetSocket2 *s, SystemAddress &systemAddress, CCTimeType time, RakNetRandom *rnr, BitStream &updateBitStream);
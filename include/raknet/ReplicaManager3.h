@@ -236,6 +236,15 @@ public:
     /// \param[in] intervalMS How frequently to autoserialize all objects. This controls the maximum number of game object updates per second.
     void SetAutoSerializeInterval(RakNet::Time intervalMS);
 
+    /// \details The temporary BitStreams built to serialize, construct and destroy replicas take their memory from \a _bitStreamArena
+    /// once they outgrow BITSTREAM_STACK_ALLOCATION_SIZE, rather than from the heap.<BR>
+    /// The arena is used from the thread calling RakPeerInterface::Receive(). Reset it after Receive() returns.<BR>
+    /// \param[in] _bitStreamArena The arena to use, or 0 for the heap, the default
+    void SetBitStreamArena(BitStreamArena *_bitStreamArena);
+
+    /// Returns what was passed to SetBitStreamArena()
+    BitStreamArena *GetBitStreamArena(void) const;
+
     /// \brief Return the connections that we think have an instance of the specified Replica3 instance
     /// \details This can be wrong, for example if that system locally deleted the outside the scope of ReplicaManager3, if QueryRemoteConstruction() returned false, or if DeserializeConstruction() returned false.
     /// \param[in] replica The replica to check against.
@@ -335,6 +344,7 @@ protected:
     PRO defaultSendParameters;
     RakNet::Time autoSerializeInterval;
     RakNet::Time lastAutoSerializeOccurance;
+    BitStreamArena *bitStreamArena;
     bool autoCreateConnections, autoDestroyConnections;
     Replica3 *currentlyDeallocatingReplica;
     // Set on the first call to ReferenceInternal(), and should never be changed after that
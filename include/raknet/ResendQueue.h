@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  Copyright (c) 2016-2018, TES3MP Team
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file ResendQueue.h
+/// \internal
+/// \brief Reliable messages that were sent and not acknowledged yet, found by message number or by when they are due for a resend
+///
+
+
+#ifndef __RESEND_QUEUE_H
+#define __RESEND_QUEUE_H
+
+#include "InternalPacket.h"
+
+namespace RakNet
+{
+
+/// \brief Holds the reliable messages of one connection until they are acknowledged.
+/// \details Two flat arrays, both grown by doubling:
+/// An index from message number to message, so acks and NAKs find a message directly.
+/// A binary heap ordered by InternalPacket::nextActionTime, so the next resend is always at the top,
+/// including messages a NAK made due early. Each message stores its heap position in InternalPacket::resendQueueIndex.
+/// The queue does not own the messages, and never frees them.
+class ResendQueue
+{
+public:
+    ResendQueue();
+    ~ResendQueue();
+
+    /// Forget every message and release the arrays
+    void Clear(void);
+
+    bool IsEmpty(void) const {return heapSize == 0;}
+    unsigned int Size(void) const {return heapSize;}
+
+    /// Can a message with this number be added? Only false once as many messages are unacknowledged as message numbers can tell apart
+    bool HasRoomFor(MessageNumberType messageNumber) const;
+
+    /// Add a message whose reliableMessageNumber was assigned, due at its nextActionTime
+    /// \pre HasRoomFor(internalPacket->reliableMessageNumber)
+    void Push(InternalPacket *internalPacket);
+
+    /// \return The message due soonest. 0 if empty
+    InternalPacket *Peek(void) const {return heapSize ? heap[0].internalPacket : 0;}
+
+    /// \return The message with this number, or 0 if it was acknowledged or never sent
+    InternalPacket *Get(MessageNumberType messageNumber) const;
+
+    /// Remove the message with this number
+    /// \return The message, or 0 if it was not in the queue
+    InternalPacket *Remove(MessageNumberType messageNumber);
+
+    /// Set when a message is due, and move it to its new place
+    void SetNextActionTime(InternalPacket *internalPacket, RakNet::TimeUS nextActionTime);
+
+    /// Messages in no particular order, for 0 <= index < Size()
+    InternalPacket *operator[](unsigned int index) const {return heap[index].internalPacket;}
+
+protected:
+    struct HeapNode
+    {
+        // Copied from the message so sifting does not touch the messages themselves
+        RakNet::TimeUS nextActionTime;
+        InternalPacket *internalPacket;
+    };
+
+    void GrowIndex(void);
+    void GrowHeap(void);
+    void SiftUp(unsigned int heapIndex);
+    void SiftDown(unsigned int heapIndex);
+    void Place(unsigned int heapIndex, const HeapNode &node);
+
+    // Message numbers map to index[messageNumber & indexMask]
+    InternalPacket **index;
+    unsigned int indexMask;
+
+    HeapNode *heap;
+    unsigned int heapSize;
+    unsigned int heapCapacity;
+};
+
+} // namespace RakNet
+
+#endif
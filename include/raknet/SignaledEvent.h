@@ -23,6 +23,7 @@
 #endif
 
 #include "Export.h"
+#include "RakNetDefines.h"
 
 namespace RakNet
 {
@@ -41,6 +42,8 @@ public:
 protected:
 #ifdef _WIN32
     HANDLE eventList;
+#elif CRABNET_SUPPORT_EVENTFD==1
+    int eventFd;
 #else
     SimpleMutex isSignaledMutex;
     bool isSignaled;
@@ -6,28 +6,59 @@
 
 #include <InternalPacket.h>
 #include <vector>
+#include <stdint.h>
 
 namespace RakNet
 {
 
     class ReliabilityLayer;
+
+    /// Reassembles one split message. Each fragment is copied to its final offset in one buffer as it arrives,
+    /// and released right away. Which fragments arrived is kept in a bitmap.
+    /// Every fragment but the last has the same size, so the buffer is allocated once the first of those arrives.
     class SplitPacketList
     {
         friend class ReliabilityLayer;
     public:
         SplitPacketList();
-        ~SplitPacketList() = default;
-        void prealloc(unsigned count, SplitPacketIdType splitPacketId);
-        bool insert(InternalPacket *internalPacket);
+        ~SplitPacketList();
+        // Returns false if a message of count fragments would be larger than CRABNET_MAX_SPLIT_MESSAGE_SIZE,
+        // or tracking them would take more than maxBytes
+        bool prealloc(unsigned count, SplitPacketIdType splitPacketId, uint64_t maxBytes);
+        // Takes ownership of internalPacket. Returns false if it was a duplicate, does not fit the others,
+        // or the message buffer it needs would take more than maxBytes. The last sets overLimit()
+        bool insert(InternalPacket *internalPacket, uint64_t maxBytes);
         unsigned size() const;
         unsigned count() const;
+        // Bytes allocated for the bitmap and the message buffer
+        uint64_t reservedBytes() const;
+        bool overLimit() const;
 
-        InternalPacket *operator[](unsigned n);
         SplitPacketIdType id() const;
+        // Data of fragment 0, or nullptr if it did not arrive yet
+        const unsigned char *firstData(unsigned *byteLength) const;
+        // Release everything still held
+        void clear();
     private:
-        std::vector<InternalPacket*> packets;
+        bool hasArrived(SplitPacketIndexType index) const;
+        void setArrived(SplitPacketIndexType index, bool arrived);
+        bool setStride(unsigned byteLength, uint64_t maxBytes);
+        void place(InternalPacket *internalPacket);
+        void release(InternalPacket *internalPacket);
+
+        std::vector<uint64_t> arrived;
+        unsigned char *buffer;
+        // Bytes in every fragment but the last. 0 until one of those arrived
+        unsigned stride;
+        BitSize_t bitLength;
+        // First fragment to arrive, without its data. Keeps the header fields for the rebuilt message
+        InternalPacket *header;
+        // Last fragment, if it arrived before stride was known
+        InternalPacket *pendingLast;
         SplitPacketIdType splitPacketId;
+        SplitPacketIndexType total;
         SplitPacketIndexType inUse;
+        bool isOverLimit;
         ReliabilityLayer *reliabilityLayer;
     };
 }